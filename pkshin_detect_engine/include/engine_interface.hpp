@@ -11,6 +11,145 @@
 #include <maccel/maccel.h>
 #include <hailo/hailort.hpp>
 
+namespace pkshin{
+    enum ThreadRole {
+        THREAD_ROLE_FEEDER = 0,    // engine threads feeding the devices
+        THREAD_ROLE_PRE = 1,       // app preprocessing
+        THREAD_ROLE_POST = 2,      // app postprocessing
+        THREAD_ROLE_WRITER = 3,    // app thread collecting and writing the results
+        NUM_THREAD_ROLES = 4
+    };
+
+    struct RealtimeStats {
+        bool enabled;
+        long minor_faults;
+        long major_faults;
+        long involuntary_switches;    // involuntary context switches (ru_nivcsw) of the real-time hot path threads
+    };
+
+    struct HedgeStats {
+        bool enabled;
+        long hedged;    // slots dispatched to a second device
+        long won;       // hedged slots whose second result came first
+    };
+
+    struct FaultStats {
+        bool enabled;
+        long errors;
+        long timeouts;
+        long quarantines;    // times a device was taken out of the dispatch
+        long requeued;       // slots moved to another device
+        long dropped;        // slots no device could run. The app gets no output for them
+    };
+
+    struct StreamStats {
+        bool enabled;
+        float weight;
+        long frames;              // completed frames, dropped ones included
+        long dropped;             // frames the engine gave up on. They have no output
+        long pending;             // frames waiting for a slot
+        double mean_latency_ms;   // from the enqueue to the completion of the frame
+        double p95_latency_ms;    // over the last 256 frames
+        double fps;               // completed frames per second since the first enqueue
+    };
+
+    struct VariantStats {
+        bool enabled;
+        int active;        // variant of the tflite devices, -1 for the model of the command line
+        long switches;
+        long slots[8];     // slots run by every variant
+    };
+
+    struct AccuracyStats {
+        bool enabled;
+        long slots;               // slots run
+        double mean_accuracy;     // of the devices that ran them
+        long unmet;               // slots run below their minimum, no usable device met it
+    };
+
+    struct GateStats {
+        bool enabled;
+        long parks;         // devices parked for a low load
+        long wakes;         // parked devices woken again
+        long hot;           // times a device went over the hard temperature
+        float max_temp;     // hottest reading, in degrees C
+    };
+
+    struct BundleInfo {
+        bool loaded;
+        const char * family;        // postprocessing family of the app, empty when the bundle gives none
+        const char * preprocess;    // preprocessing recipe of the app, empty when the bundle gives none
+    };
+
+    struct ShapeStats {
+        bool enabled;
+        long full_batches;     // batches run at the shape of the model
+        long batches[8];       // batches run at every shape
+        double pixels;         // input pixels of the batches against the ones at the shape of the model
+    };
+
+    // Slots of the accelerators whose head ran on the cpu
+    struct SplitStats {
+        bool enabled;
+        long slots;
+        double head_ms;        // average head run, the hand over of the linked tensors included
+        double wait_ms;        // average wait of a finished backbone for the head of the slot before it
+    };
+
+    // Use of the models of the registry
+    struct RegistryStats {
+        bool enabled;
+        long hits;             // acquires of a loaded model
+        long misses;           // acquires that had to load the model
+        long preloads;         // loads in the background
+        long evictions;
+        int resident;          // models loaded
+        double resident_mb;
+        double load_ms;        // average load, preloads included
+    };
+
+    // A box of a decoded RGB image, in the pixels of the image
+    struct Crop {
+        const uint8_t * rgb;
+        int width;
+        int height;
+        float x;
+        float y;
+        float w;
+        float h;
+    };
+
+    // Crops run through the second stage classifier
+    struct CropStats {
+        bool enabled;
+        long crops;
+        long batches;          // classifier invokes, every one a batch of crops
+        double mean_batch;     // crops per batch
+        double batch_ms;       // average batch, crop and resize included
+    };
+
+    // Hot swaps of the tflite part
+    struct SwapStats {
+        bool enabled;          // a swap ran or is running
+        int version;           // 0 for the model of the command line, one more per swap
+        bool loading;
+        long slots[2];         // tflite slots of the version before and of the current one
+        double slot_ms[2];     // their average run
+    };
+
+    // Slots run by the engine of another board
+    struct RemoteStats {
+        bool enabled;
+        bool connected;
+        long slots;            // slots the remote engine ran
+        long lost;             // slots lost with the connection or failed by the remote engine
+        double latency_ms;     // EWMA of the wait for the first result of a queue over the time of a slot
+        double slot_ms;        // EWMA of the time per slot once the results stream in
+        double sent_mb;
+        double received_mb;
+    };
+}
+
 namespace tflite{
     namespace pkshin{
         class FlatBufferModel : public ::tflite::FlatBufferModel {
@@ -90,9 +229,132 @@ namespace tflite{
 
             TfLiteStatus SetSchedulerParams(std::vector<float> perfs);
 
+            TfLiteStatus SetMemoryParams(bool huge_pages);
+
+            TfLiteStatus SetPlacementParams(const char * config);
+
+            TfLiteStatus ApplyThreadPlacement(int role);
+
+            std::vector<int> GetPlacementCpus(int role);
+
+            TfLiteStatus SetRealtimeParams(const char * policy, bool lock_memory);
+
+            ::pkshin::RealtimeStats GetRealtimeStats();
+
+            TfLiteStatus SetHedgeParams(float factor);
+
+            ::pkshin::HedgeStats GetHedgeStats();
+
+            TfLiteStatus SetFaultParams(double device_timeout_ms, const char * inject);
+
+            ::pkshin::FaultStats GetFaultStats();
+
+            int AddStream(float weight);
+
+            int GetNumStreams();
+
+            long EnqueueFrame(int stream);
+
+            int ScheduleBatch(int max_slots);
+
+            int GetSlotStream(int slot);
+
+            long GetSlotSequence(int slot);
+
+            TfLiteStatus CompleteSlot(int slot);
+
+            long PopInOrder(int stream);
+
+            ::pkshin::StreamStats GetStreamStats(int stream);
+
+            TfLiteStatus SetTraceParams(const char * record_path, const char * replay_path, double replay_speed);
+
+            int NextReplayBatch();
+
+            TfLiteStatus SetProfileParams(const char * db_path);
+
+            TfLiteStatus CalibrateProfile(int runs);
+
+            TfLiteStatus SetVariantParams(const char * variants, double target_p95_ms);
+
+            int GetSlotVariant(int slot);
+
+            ::pkshin::VariantStats GetVariantStats();
+
+            TfLiteStatus SetCascadeParams(const char * model, float band_lo, float band_hi, int band_count);
+
+            bool IsCascadeEnabled();
+
+            bool NeedsEscalation(const std::vector<float> & scores);
+
+            TfLiteStatus InvokeCascade(const std::vector<int> & slots);
+
+            TfLiteStatus SetAccuracyParams(std::vector<float> accuracies, float min_accuracy, float target_accuracy);
+
+            TfLiteStatus SetStreamAccuracy(int stream, float min_accuracy);
+
+            ::pkshin::AccuracyStats GetAccuracyStats();
+
+            TfLiteStatus SetGateParams(const char * config);
+
+            ::pkshin::GateStats GetGateStats();
+
+            ::pkshin::BundleInfo GetBundleInfo();
+
+            TfLiteStatus SetShapeParams(const char * shapes);
+
+            int PickInputShape(int image_width, int image_height);
+
+            TfLiteStatus SetInputShape(int shape);
+
+            ::pkshin::ShapeStats GetShapeStats();
+
+            TfLiteStatus SetSplitParams(const char * manifest);
+
+            ::pkshin::SplitStats GetSplitStats();
+
+            TfLiteStatus SetRegistryParams(const char * models, double budget_mb, int threads);
+
+            TfLiteStatus PreloadModel(const char * id);
+
+            ::tflite::Interpreter * AcquireModel(const char * id);
+
+            void ReleaseModel(const char * id);
+
+            ::pkshin::RegistryStats GetRegistryStats();
+
+            TfLiteStatus SetCropParams(const char * id, int max_batch);
+
+            TfLiteStatus ClassifyCrops(const std::vector<::pkshin::Crop> & crops, std::vector<int> & classes, std::vector<float> & scores);
+
+            ::pkshin::CropStats GetCropStats();
+
+            TfLiteStatus SwapModel(const char * filename);
+
+            ::pkshin::SwapStats GetSwapStats();
+
+            TfLiteStatus SetRemoteParams(const char * address, int window, double cost_ms);
+
+            TfLiteStatus ServeRemote(const char * address);
+
+            ::pkshin::RemoteStats GetRemoteStats();
+
+            TfLiteStatus SetBatchTuningParams(double target_p95_ms);
+
+            int GetBatchSize();
+
+            TfLiteStatus SetExecutorParams(int num_threads, int tflite_threads);
+
+            TfLiteStatus ParallelFor(int role, int n, void (*fn)(void *, int), void * arg);
+
+            template <class F>
+            TfLiteStatus ParallelFor(int role, int n, F & fn){
+                return ParallelFor(role, n, [](void * arg, int i){ (*(F *)arg)(i); }, &fn);
+            }
+
             TfLiteStatus SetPostProcessParams(std::vector<float> ori_score_thrs, std::vector<float> new_score_thrs);
 
-            std::vector<float> GetPostProcessParams();
+            const std::vector<float> & GetPostProcessParams();
 
             double GetSumTurnAroundTime();
 
@@ -8,7 +8,9 @@ echo $MODELFILE
 
 rm -f ./detection_result.json
 
-taskset -c 4,5,6,7 ./pkshin_detect image model/$MODELFILE $DATADIR/labels.txt $DATADIR/images detection_result.json npu
+./pkshin_detect image model/$MODELFILE $DATADIR/labels.txt $DATADIR/images detection_result.json npu --placement=feeder=4-7,pre=0-3,post=0-3,writer=4-7
+# For the small objects, run the images as overlapping tiles on every device instead:
+# ./pkshin_detect image model/$MODELFILE $DATADIR/labels.txt $DATADIR/images detection_result.json npu --placement=feeder=4-7,pre=0-3,post=0-3,writer=4-7 --tile=1024 --tile_overlap=200
 
 if [ $? -eq 1 ];
 then
@@ -17,16 +17,22 @@ PARAMS=()
 #do
 
 
+# Instead of the batch sweep, --latency_budget=MS lets the engine tune the batch (up to the batch argument) for a p95 turnaround
+#./pkshin_detect image $MODELFILE $DATADIR/labels.txt $DATADIR/images detection_result.json 0 69 0,1,1,1,1 -1,-1 --latency_budget=300 --placement=feeder=4-7,pre=0-3,post=0-3,writer=4-7
+
+# Instead of the PARAMS array, perfs auto takes them from the device profiles of the model. --calibrate=20 measures them on the first run
+#./pkshin_detect image $MODELFILE $DATADIR/labels.txt $DATADIR/images detection_result.json 0 25 auto -1,-1 --profile_db=profiles.db --calibrate=20 --placement=feeder=4-7,pre=0-3,post=0-3,writer=4-7
+
 #for batch in 1 2 3 6 12 19 23 46 69
 #do
 
 #rm -f ./detection_result.json
 
 #echo $MODELFILE
-#taskset -c 4,5,6,7 ./pkshin_detect image $MODELFILE $DATADIR/labels.txt $DATADIR/images detection_result.json 0 25 0,1,1,1,1 -1,-1
+#./pkshin_detect image $MODELFILE $DATADIR/labels.txt $DATADIR/images detection_result.json 0 25 0,1,1,1,1 -1,-1 --placement=feeder=4-7,pre=0-3,post=0-3,writer=4-7
 
 #echo ${MODELFILES[$index]}
-#taskset -c 4,5,6,7 ./pkshin_detect image ${MODELFILES[$index]} $DATADIR/labels.txt $DATADIR/images detection_result.json 0 25 ${PARAMS[index]}
+#./pkshin_detect image ${MODELFILES[$index]} $DATADIR/labels.txt $DATADIR/images detection_result.json 0 25 ${PARAMS[index]} --placement=feeder=4-7,pre=0-3,post=0-3,writer=4-7
 
 
 #if [ $? -eq 1 ];
@@ -43,7 +49,7 @@ do
 
 echo "GPU"
 echo $MODELFILE
-taskset -c 4,5,6,7 ./pkshin_detect image $MODELFILE $DATADIR/labels.txt $DATADIR/images detection_result.json 0 40 0,1,1,1,1 -1,-1
+./pkshin_detect image $MODELFILE $DATADIR/labels.txt $DATADIR/images detection_result.json 0 40 0,1,1,1,1 -1,-1 --placement=feeder=4-7,pre=0-3,post=0-3,writer=4-7
 
 done
 
@@ -52,7 +58,7 @@ do
 
 echo "DSP"
 echo $MODELFILE
-taskset -c 4,5,6,7 ./pkshin_detect image $MODELFILE $DATADIR/labels.txt $DATADIR/images detection_result.json 0 40 1,0,1,1,1 -1,-1
+./pkshin_detect image $MODELFILE $DATADIR/labels.txt $DATADIR/images detection_result.json 0 40 1,0,1,1,1 -1,-1 --placement=feeder=4-7,pre=0-3,post=0-3,writer=4-7
 
 done
 
@@ -65,7 +71,7 @@ echo $MODELFILE
 result=""
 for i in {1..10}
 do
-result=$'$result\n$(taskset -c 4,5,6,7 ./pkshin_detect image $MODELFILE $DATADIR/labels.txt $DATADIR/images detection_result.json 0 40 1,1,0,1,1 0.001,0.001)'
+result=$'$result\n$(./pkshin_detect image $MODELFILE $DATADIR/labels.txt $DATADIR/images detection_result.json 0 40 1,1,0,1,1 0.001,0.001 --placement=feeder=4-7,pre=0-3,post=0-3,writer=4-7)'
 done
 awk 'BEGIN {tt=0 pt=0 tp=0 mt=0 ap=0} $1==pkshinresult {print $0 tt+=$2 pt+=$3 tp+=$4 mt+=$5 ap+=$6} END {print("Average Turnaround time:\t" tt/10 "\nAverage preprocess time:\t" pt/10 "\nAverage turnaround + postprocess time:\t" tp/10 "\nMaximum Turnaround time:\t" mt/10 "\nApplication latency:\t" ap/10 )}' $result
 
@@ -0,0 +1,140 @@
+#include "alloc_check.hpp"
+
+#include <iostream>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+
+#ifdef ALLOC_CHECK
+
+static const char * alloc_stage_names_[NUM_ALLOC_STAGES] = {"engine", "pre", "post", "decode", "writer"};
+
+// Stages that have to stay allocation free in the steady state
+static const bool alloc_stage_checked_[NUM_ALLOC_STAGES] = {true, true, true, false, false};
+
+static std::atomic<bool> alloc_armed_(false);
+static std::atomic<long> alloc_counts_[NUM_ALLOC_STAGES];
+static thread_local int alloc_stage_ = ALLOC_STAGE_ENGINE;
+
+extern "C" {
+    void * __libc_malloc(size_t size);
+    void * __libc_calloc(size_t num, size_t size);
+    void * __libc_realloc(void * ptr, size_t size);
+    void * __libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void * ptr);
+}
+
+static inline void count_alloc(){
+    if(alloc_armed_.load(std::memory_order_relaxed))
+        alloc_counts_[alloc_stage_].fetch_add(1, std::memory_order_relaxed);
+}
+
+// The executable's definitions take precedence over libc for every shared library, the engine included
+extern "C" {
+    void * malloc(size_t size){
+        count_alloc();
+        return __libc_malloc(size);
+    }
+
+    void * calloc(size_t num, size_t size){
+        count_alloc();
+        return __libc_calloc(num, size);
+    }
+
+    void * realloc(void * ptr, size_t size){
+        count_alloc();
+        return __libc_realloc(ptr, size);
+    }
+
+    void * memalign(size_t alignment, size_t size){
+        count_alloc();
+        return __libc_memalign(alignment, size);
+    }
+
+    void * aligned_alloc(size_t alignment, size_t size){
+        count_alloc();
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void ** ptr, size_t alignment, size_t size){
+        if(alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+            return EINVAL;
+
+        count_alloc();
+        *ptr = __libc_memalign(alignment, size);
+
+        return *ptr == NULL ? ENOMEM : 0;
+    }
+
+    void free(void * ptr){
+        __libc_free(ptr);
+    }
+}
+
+AllocStageScope::AllocStageScope(int stage) : prev_stage_(alloc_stage_){
+    alloc_stage_ = stage;
+}
+
+AllocStageScope::~AllocStageScope(){
+    alloc_stage_ = prev_stage_;
+}
+
+bool alloc_check_enabled(){
+    return true;
+}
+
+void alloc_check_arm(){
+    for(int i = 0; i < NUM_ALLOC_STAGES; i++)
+        alloc_counts_[i] = 0;
+
+    alloc_armed_ = true;
+}
+
+bool alloc_check_report(){
+    alloc_armed_ = false;
+
+    bool success = true;
+
+    std::cout << "Steady state allocations:";
+    for(int i = 0; i < NUM_ALLOC_STAGES; i++){
+        std::cout << " " << alloc_stage_names_[i] << " " << alloc_counts_[i];
+        if(alloc_stage_checked_[i] && alloc_counts_[i] > 0)
+            success = false;
+    }
+    std::cout << "\n";
+
+    if(!success){
+        std::cerr << "ERROR: Heap allocations in the steady state of";
+        for(int i = 0; i < NUM_ALLOC_STAGES; i++){
+            if(alloc_stage_checked_[i] && alloc_counts_[i] > 0)
+                std::cerr << " " << alloc_stage_names_[i];
+        }
+        std::cerr << std::endl;
+    }
+
+    return success;
+}
+
+#else
+
+AllocStageScope::AllocStageScope(int stage) : prev_stage_(stage){
+
+}
+
+AllocStageScope::~AllocStageScope(){
+
+}
+
+bool alloc_check_enabled(){
+    return false;
+}
+
+void alloc_check_arm(){
+
+}
+
+bool alloc_check_report(){
+    return true;
+}
+
+#endif //ALLOC_CHECK
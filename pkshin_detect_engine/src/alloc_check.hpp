@@ -0,0 +1,35 @@
+#ifndef _ALLOC_CHECK_HPP_
+#define _ALLOC_CHECK_HPP_
+
+// Heap allocation counting for the steady state check. Build with ALLOC_CHECK=1 to interpose malloc and friends;
+// otherwise every call here is a no-op.
+// Allocations are charged to the stage of the calling thread. Threads that never enter a stage (the engine device
+// feeders, the tflite and executor threads) count as ALLOC_STAGE_ENGINE.
+enum AllocStage {
+    ALLOC_STAGE_ENGINE = 0,    // engine, device feeders and the cpu executor
+    ALLOC_STAGE_PRE = 1,       // normalization and padding into the input tensor
+    ALLOC_STAGE_POST = 2,      // output decoding and nms
+    ALLOC_STAGE_DECODE = 3,    // jpeg file reading. libjpeg allocates its per-image pools itself
+    ALLOC_STAGE_WRITER = 4,    // json results and the directory listing
+    NUM_ALLOC_STAGES = 5
+};
+
+class AllocStageScope {
+    public:
+    AllocStageScope(int stage);
+
+    ~AllocStageScope();
+
+    private:
+    int prev_stage_;
+};
+
+bool alloc_check_enabled();
+
+// Start counting. Called after the warm-up batches, once the scratch buffers have grown
+void alloc_check_arm();
+
+// Prints the allocations per stage. Returns false when a stage that must not allocate did
+bool alloc_check_report();
+
+#endif //_ALLOC_CHECK_HPP_
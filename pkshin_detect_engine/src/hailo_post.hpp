@@ -5,9 +5,7 @@
 
 #include <engine_interface.hpp>
 
-#include "hailo_post/double_buffer.hpp"
-#include "hailo_post/hailo_objects.hpp"
-#include "hailo_post/yolo_hailortpp.hpp"
+#include "hailo_post/structures.hpp"
 
 using namespace hailort;
 
@@ -24,70 +22,22 @@ typedef struct{
 } DetResult;
 #endif //_DETRESULT_
 
-template <typename T>
-class FeatureData {
-public:
-    FeatureData(uint32_t buffers_size, float32_t qp_zp, float32_t qp_scale, uint32_t width, hailo_vstream_info_t vstream_info) :
-    m_buffers(buffers_size), m_qp_zp(qp_zp), m_qp_scale(qp_scale), m_width(width), m_vstream_info(vstream_info)
-    {}
-    static bool sort_tensors_by_size (std::shared_ptr<FeatureData> i, std::shared_ptr<FeatureData> j) { return i->m_width < j->m_width; };
-
-    DoubleBuffer<T> m_buffers;
-    float32_t m_qp_zp;
-    float32_t m_qp_scale;
-    uint32_t m_width;
-    hailo_vstream_info_t m_vstream_info;
-};
-
-template <typename T>
-static hailo_status create_feature(hailo_vstream_info_t vstream_info, size_t output_frame_size, std::shared_ptr<FeatureData<T>> &feature) {
-    feature = std::make_shared<FeatureData<T>>(static_cast<uint32_t>(output_frame_size), vstream_info.quant_info.qp_zp,
-        vstream_info.quant_info.qp_scale, vstream_info.shape.width, vstream_info);
-
-    return HAILO_SUCCESS;
-}
-
+// Decodes the hailo nms output straight from the output tensor. The boxes are read in place, so no HailoROI,
+// HailoTensor or detection objects are created per frame. results is cleared and keeps its capacity.
 template <typename T>
 static hailo_status hailo_postprocess(tflite::Interpreter * interpreter, int model_mode, std::vector<DetResult> & results, int cur_batch = -1){
-    auto status = HAILO_SUCCESS;
     const auto & output_vstreams = interpreter->get_hailo_vstreams()->second;
     auto output_vstreams_size = output_vstreams.size();
 
-    std::vector<std::shared_ptr<FeatureData<T>>> features;
-    features.reserve(output_vstreams_size);
-    for(size_t i = 0; i < output_vstreams_size; i++) {
-        std::shared_ptr<FeatureData<T>> feature(nullptr);
-        auto status = create_feature(output_vstreams[i].get_info(), output_vstreams[i].get_frame_size(), feature);
-        if (HAILO_SUCCESS != status) {
-            std::cerr << "ERROR: Failed creating feature with status = " << status << std::endl;
-            return status;
-        }
-
-        features.emplace_back(feature);
-
-        if(cur_batch == -1){
-            TfLiteTensor* output_tensor_i = interpreter->output_tensor(i);
-            TfLiteIntArray* output_dims = output_tensor_i->dims;
+    results.clear();
 
-            int size = 1;
-            for(int j = 1; j < output_dims->size; j++)
-                size *= output_dims->data[j];
+    for(size_t i = 0; i < output_vstreams_size; i++) {
+        const hailo_vstream_info_t & vstream_info = output_vstreams[i].get_info();
+        if(vstream_info.format.order != HAILO_FORMAT_ORDER_HAILO_NMS)
+            continue;
 
-            if(output_tensor_i->type == kTfLiteUInt8){
-                uint8_t * output_ptr = interpreter->typed_output_tensor<uint8_t>(i);
-                std::vector<T>& buffer = features[i]->m_buffers.get_write_buffer();
-                memcpy(buffer.data(), output_ptr, size * sizeof(uint8_t));
-                features[i]->m_buffers.release_write_buffer();
-            }
-            else if(output_tensor_i->type == kTfLiteFloat32){
-                float * output_ptr = interpreter->typed_output_tensor<float>(i);
-                std::vector<T>& buffer = features[i]->m_buffers.get_write_buffer();
-                memcpy(buffer.data(), output_ptr, size * sizeof(float));
-                features[i]->m_buffers.release_write_buffer();
-            }
-        }
-        else{
-            int tensor_index;
+        int tensor_index = i;
+        if(cur_batch != -1){
             switch(model_mode){
                 case 1:
                 case 2:
@@ -100,66 +50,66 @@ static hailo_status hailo_postprocess(tflite::Interpreter * interpreter, int mod
                     tensor_index = i + 1;
                     break;
             }
+        }
 
-            TfLiteTensor* output_tensor_i = interpreter->output_tensor(tensor_index);
-            TfLiteIntArray* output_dims = output_tensor_i->dims;
+        TfLiteTensor* output_tensor_i = interpreter->output_tensor(tensor_index);
+        TfLiteIntArray* output_dims = output_tensor_i->dims;
 
-            int size = 1;
-            for(int j = 1; j < output_dims->size; j++)
-                size *= output_dims->data[j];
+        int size = 1;
+        for(int j = 1; j < output_dims->size; j++)
+            size *= output_dims->data[j];
 
-            if(interpreter->output_tensor(tensor_index)->type == kTfLiteUInt8){
-                uint8_t * output_ptr = interpreter->typed_output_tensor<uint8_t>(tensor_index) + cur_batch * size;
-                std::vector<T>& buffer = features[i]->m_buffers.get_write_buffer();
-                memcpy(buffer.data(), output_ptr, size * sizeof(uint8_t));
-                features[i]->m_buffers.release_write_buffer();
-            }
-            else if(interpreter->output_tensor(tensor_index)->type == kTfLiteFloat32){
-                float * output_ptr = interpreter->typed_output_tensor<float>(tensor_index) + cur_batch * size;
-                std::vector<T>& buffer = features[i]->m_buffers.get_write_buffer();
-                memcpy(buffer.data(), output_ptr, size * sizeof(float));
-                features[i]->m_buffers.release_write_buffer();
-            }
+        int batch = cur_batch == -1 ? 0 : cur_batch;
+
+        uint8_t * src_ptr;
+        if(output_tensor_i->type == kTfLiteUInt8){
+            src_ptr = interpreter->typed_output_tensor<uint8_t>(tensor_index) + batch * size;
+        }
+        else if(output_tensor_i->type == kTfLiteFloat32){
+            src_ptr = (uint8_t *)(interpreter->typed_output_tensor<float>(tensor_index) + batch * size);
+        }
+        else{
+            continue;
         }
-    }
 
-    std::sort(features.begin(), features.end(), &FeatureData<T>::sort_tensors_by_size);
+        // Per class: the number of boxes followed by the boxes (see HailoNMSDecode)
+        uint32_t num_of_classes = vstream_info.nms_shape.number_of_classes;
+        uint32_t max_bboxes_per_class = vstream_info.nms_shape.max_bboxes_per_class;
+        uint32_t offset = 0;
 
-    HailoROIPtr roi = std::make_shared<HailoROI>(HailoROI(HailoBBox(0.0f, 0.0f, 1.0f, 1.0f)));
-        
-    for(uint j = 0; j < features.size(); j++) {
-        roi->add_tensor(std::make_shared<HailoTensor>(reinterpret_cast<T*>(features[j]->m_buffers.get_read_buffer().data()), features[j]->m_vstream_info));
-    }
+        for(uint32_t class_index = 1; class_index <= num_of_classes; class_index++){
+            float32_t bbox_count;
+            memcpy(&bbox_count, src_ptr + offset, sizeof(bbox_count));
+            offset += sizeof(bbox_count);
 
-    filter(roi);
+            if((int)bbox_count > max_bboxes_per_class){
+                std::cerr << "ERROR: Got more than the maximum bboxes per class in the nms buffer\n";
+                return HAILO_INTERNAL_FAILURE;
+            }
 
-    for(auto &feature : features) {
-        feature->m_buffers.release_read_buffer();
-    }
+            for(int box_index = 0; box_index < (int)bbox_count; box_index++){
+                common::hailo_bbox_float32_t bbox;
+                memcpy(&bbox, src_ptr + offset, sizeof(bbox));
+                offset += sizeof(bbox);
 
-    std::vector<HailoDetectionPtr> detections = hailo_common::get_hailo_detections(roi);
+                float score = bbox.score > 1.0f ? 1.0f : (bbox.score < 0.0f ? 0.0f : bbox.score);
+                if(score == 0)
+                    continue;
 
-    results.reserve(detections.size());
+                DetResult result;
+                result.score = score;
+                result.xmin = bbox.x_min;
+                result.ymin = bbox.y_min;
+                result.xmax = bbox.x_max;
+                result.ymax = bbox.y_max;
+                result.id = class_index;
 
-    for(auto &detection : detections) {
-        if (detection->get_confidence() == 0) {
-            continue;
+                results.push_back(result);
+            }
         }
-        DetResult result;
-        result.score = detection->get_confidence();
-
-        HailoBBox bbox = detection->get_bbox();
-
-        result.xmin = bbox.xmin();
-        result.ymin = bbox.ymin();
-        result.xmax = bbox.xmax();
-        result.ymax = bbox.ymax();
-        result.id = detection->get_class_id();
-
-        results.push_back(result);
     }
 
-    return status;
+    return HAILO_SUCCESS;
 }
 
 #endif //_HAILOPOST_HPP_
\ No newline at end of file
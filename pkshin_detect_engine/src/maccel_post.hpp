@@ -8,6 +8,8 @@
 
 #include <opencv2/opencv.hpp>
 
+#include "nms.hpp"
+
 
 #ifndef _DETRESULT_
 #define _DETRESULT_
@@ -21,7 +23,7 @@ typedef struct{
 } DetResult;
 #endif //_DETRESULT_
 
-static std::vector<std::vector<int>> generate_grids(int input_h, int input_w, std::vector<int> strides){
+static std::vector<std::vector<int>> generate_grids(int input_h, int input_w, const std::vector<int> & strides){
 
 	std::vector<std::vector<int>> all_grids;
 	for(int i = 0; i < strides.size(); i++){
@@ -67,12 +69,26 @@ static bool maccel_post(tflite::Interpreter * interpreter, int model_mode, std::
     TfLiteIntArray* input_dims = input_tensor_0->dims;
     int input_height = input_dims->data[1];
     int input_width = input_dims->data[2];
-    std::vector<int> strides = {8, 16, 32};
-    std::vector<std::vector<int>> grids = generate_grids(input_height, input_width, strides);
+    static const std::vector<int> strides = {8, 16, 32};
+
+    // The grids only change with the input size. The rest are scratch buffers of the post thread, reused across frames
+    thread_local std::vector<std::vector<int>> grids;
+    thread_local int grids_height = -1, grids_width = -1;
+    if(grids_height != input_height || grids_width != input_width){
+        grids = generate_grids(input_height, input_width, strides);
+        grids_height = input_height;
+        grids_width = input_width;
+    }
 
-    std::vector<int> class_ids;
-    std::vector<float> scores;
-    std::vector<cv::Rect2d> boxes;
+    thread_local std::vector<int> class_ids;
+    thread_local std::vector<float> scores;
+    thread_local std::vector<cv::Rect2d> boxes;
+    thread_local std::vector<cv::Rect2d> _boxes;
+    thread_local std::vector<int> nms_result;
+    thread_local std::vector<int> nms_order;
+    class_ids.clear();
+    scores.clear();
+    boxes.clear();
 
     for(int i = 0; i < 3; i++){
         float * output_ptr;
@@ -164,20 +180,19 @@ static bool maccel_post(tflite::Interpreter * interpreter, int model_mode, std::
         }
     }
 
-    std::vector<int> nms_result;
     if(multi_label){
         // Batched nms trick since batched nms function is only available opencv > 4.7.0
-        std::vector<cv::Rect2d> _boxes = boxes;
+        _boxes = boxes;
 
         for(int i = 0; i < _boxes.size(); i++){
             cv::Point2d offset(class_ids[i] * input_width, class_ids[i] * input_height);
             _boxes[i] = _boxes[i] + offset;
         }
 
-        cv::dnn::NMSBoxes(_boxes, scores, conf_threshold, iou_threshold, nms_result, 1.0, max_detections);
+        nms_boxes(_boxes, scores, conf_threshold, iou_threshold, nms_result, max_detections, nms_order);
     }
     else{
-        cv::dnn::NMSBoxes(boxes, scores, conf_threshold, iou_threshold, nms_result, 1.0, max_detections);
+        nms_boxes(boxes, scores, conf_threshold, iou_threshold, nms_result, max_detections, nms_order);
     }
 
     results.reserve(nms_result.size());
@@ -1,14 +1,20 @@
 #include <iostream>
 #include <cstring>
 #include <cstddef>
+#include <cstdio>
 #include <string>
 #include <vector>
 #include <fstream>
+#include <sstream>
+#include <map>
 
 #include <engine_interface.hpp>
 
-//bool run_qcarcam(tflite::Interpreter * interpreter, int model_mode, std::vector<std::string> * labels, char * display_path);
+//bool run_qcarcam(tflite::Interpreter * interpreter, int model_mode, std::vector<std::string> * labels, char * display_path, bool live);
 bool run_image(tflite::Interpreter * interpreter, int model_mode, std::vector<std::string> * labels, char * directory_path, char * result_path, int batch_size, std::vector<float> perfs, std::vector<float> ori_score_thrs, std::vector<float> new_score_thrs);
+void set_image_tiling(int size, int overlap);
+void set_model_swap(const char * file, int after);
+void set_remote_serving(const char * address);
 
 int main(int argc, char * argv[]){
     int model_mode; // 1 for ssd_mobilenet
@@ -19,21 +25,61 @@ int main(int argc, char * argv[]){
                     // 6 for yolo obb
     std::vector<std::string> labels;
 
+    // Split the --key=value options from the positional arguments
+    std::map<std::string, std::string> options;
+    int num_args = 1;
+    for(int i = 1; i < argc; i++){
+        char * separator = strchr(argv[i], '=');
+        if(strncmp(argv[i], "--", 2) == 0 && separator != NULL){
+            options[std::string(argv[i] + 2, separator - argv[i] - 2)] = std::string(separator + 1);
+        }
+        else{
+            argv[num_args] = argv[i];
+            num_args++;
+        }
+    }
+    argv[num_args] = NULL;
+    argc = num_args;
+
     //usage guide
     if(!argv[1] || strcmp(argv[1], "-help") == 0 || strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "--h") == 0){
         std::cout << "Usage: pkshin_detect camera [MODEL] [LABEL] [DISPLAY] [ACCELERATOR]\n";
         std::cout << "camera mode runs the object detection using qcarcam API.\n";
-        std::cout << "[MODEL] is path of the model file.\n";
+        std::cout << "[MODEL] is path of the model file, or of a .pkbundle manifest naming the artifacts of the devices and the model family.\n";
         std::cout << "[LABEL] is path of the label file.\n";
         std::cout << "[DISPLAY] is path of the file defining the display setting.\n";
         std::cout << "[ACCELERATOR] specifies the accelerator to run the inference. CPU, GPU, NPU is supported. Default value is CPU.\n\n";
         std::cout << "Usage: pkshin_detect image [MODEL] [LABEL] [IMG_DIR] [RESULT] [ACCELERATOR]\n";
         std::cout << "image mode runs the object detection with jpeg images.\n";
-        std::cout << "[MODEL] is path of the model file.\n";
+        std::cout << "[MODEL] is path of the model file, or of a .pkbundle manifest naming the artifacts of the devices and the model family.\n";
         std::cout << "[LABEL] is path of the label file.\n";
         std::cout << "[IMG_DIR] is path of the directory containing images.\n";
         std::cout << "[RESULT] is path of the result json file.\n";
         std::cout << "[ACCELERATOR] specifies the accelerator to run the inference. CPU, GPU, NPU is supported. Default value is CPU.\n\n";
+        std::cout << "[OPTIONS] are --key=value pairs and can be placed anywhere.\n";
+        std::cout << "--huge_pages=1 maps the engine tensor buffers with huge pages.\n";
+        std::cout << "--placement=feeder=big,pre=little,post=little,writer=0+1,isolate=1 pins the feeder, pre, post and writer threads. Default is pre=0-3,post=0-3.\n";
+        std::cout << "--cpu_threads=4 sets the size of the cpu executor running the pre and post stages. Default is 4.\n";
+        std::cout << "--tflite_threads=1 sets the number of tflite cpu backend threads. Default is 1.\n";
+        std::cout << "--rt=fifo runs the threads under SCHED_FIFO (or rr) with feeder_prio, pre_prio, post_prio and writer_prio from --placement, and prefaults the tensor buffers.\n";
+        std::cout << "--mlock=0 keeps the process memory unlocked in the real-time mode.\n";
+        std::cout << "--hedge=1.5 runs a slot again on an idle device once it takes 1.5 times longer than expected. Needs a mixed accelerator.\n";
+        std::cout << "--latency_budget=MS tunes the batch size for the best throughput with a p95 turnaround within MS. The batch argument is the upper bound.\n";
+        std::cout << "--device_timeout=MS moves the slots of a device failing or running over MS to the other devices. --inject_faults=hailo1=error:0.05,maccel=stall:0.01:3000 fails or stalls device calls for testing.\n";
+        std::cout << "--streams=2,1,1 deals the images to streams sharing the devices by weight.\n";
+        std::cout << "--profile_db=FILE seeds the scheduler with the device profiles of the model when the perfs argument is auto. --calibrate=20 profiles every device over 20 runs into the database first.\n";
+        std::cout << "--variants=yolov8n.tflite,yolov8s.tflite,yolov8m.tflite runs the smaller tflite variants on the gpu and hexagon when the p95 turnaround is over --variant_target=MS, and the larger ones when it is well under.\n";
+        std::cout << "--cascade=yolov8m.tflite runs the images again on the larger tflite model on the gpu and hexagon when --cascade_count=1 or more detections score in --cascade_band=0.25,0.5, and merges both results. Image mode only.\n";
+        std::cout << "--accuracy=0.37,0.37,0.33,0.33,0.33 gives the measured accuracy of every device in the order of the perfs. The slots then only go to devices of --min_accuracy=0.35 or more, those of stream i to --stream_accuracy=A0,A1,.. or more, and --accuracy_target=0.36 moves slots to the more accurate devices until the mean of a batch reaches it.\n";
+        std::cout << "--gate=gpu=/sys/class/thermal/thermal_zone10/temp,soc=/sys/class/thermal/thermal_zone0/temp,soft=70,hard=85,park=0.5,hailo_wake=40 shrinks the share of a device heating up over soft, holds it back over hard, and parks the slowest devices while the others run the load.\n";
+        std::cout << "--shapes=640x384,384x640 runs the images at the tightest of these input shapes on the gpu and hexagon, grouped into batches per shape, to leave out the letterbox padding. Image mode only, without streams or the cascade.\n";
+        std::cout << "--tile=1024 cuts the images into tiles of 1024 pixels overlapping by --tile_overlap=200, runs every tile in a slot of its own on all the devices, and merges the detections of the tiles with nms. Image mode only, without streams, the cascade or shapes.\n";
+        std::cout << "--split=MANIFEST runs the hef or mxq as the backbone of a split model and the tflite head of the manifest on the cpu, the head of a slot overlapping the backbone of the next one. Mixed modes only, without --hedge, --device_timeout or --shapes.\n";
+        std::cout << "--models=cls=mobilenet.tflite,obb=yolov8s_obb.tflite registers more models by id, run on the cpu beside the model of the engine. They load on first use, --preload=cls loads them in the background, and --model_budget=256 drops the least recently used ones over 256 MB.\n";
+        std::cout << "--classify=cls runs the registry model cls on the crops of the detections, in batches of up to --classify_batch=32 crops, while the detector runs the next batch. The detections get its class_id and class_score. Image mode only, without the cascade or tiles.\n";
+        std::cout << "--swap=FILE loads FILE as the tflite part of a mixed accelerator after --swap_after=100 batches, beside the running model, and switches to it between two batches without stopping. Modes 3 and 4 only, without variants, the cascade or shapes.\n";
+        std::cout << "--remote=HOST:PORT or unix:PATH adds the engine another board serves with --serve=HOST:PORT to the devices of the dispatch, with up to --remote_window=4 slots in flight and --remote_cost=MS per slot until it is measured. Both run the same mode and model. Modes 3 and 4 only, without --split or --shapes.\n";
+        std::cout << "--trace=FILE records the arrival, device, run times and input hash of every slot. --replay=FILE runs the batches of a trace at its arrivals, --replay_speed=2 twice as fast, with the images as inputs.\n\n";
         return true;
     }
 
@@ -42,17 +88,41 @@ int main(int argc, char * argv[]){
         std::cerr << "ERROR: The first argument must be camera or image. camera mode requires at least 3 more arguments and image mode requires at least 4 more arguments\n\n";
         std::cerr << "Usage: pkshin_detect camera [MODEL] [LABEL] [DISPLAY] [ACCELERATOR]\n";
         std::cerr << "camera mode runs the object detection using qcarcam API.\n";
-        std::cerr << "[MODEL] is path of the model file.\n";
+        std::cerr << "[MODEL] is path of the model file, or of a .pkbundle manifest naming the artifacts of the devices and the model family.\n";
         std::cerr << "[LABEL] is path of the label file.\n";
         std::cerr << "[DISPLAY] is path of the file defining the display setting.\n";
         std::cerr << "[ACCELERATOR] specifies the accelerator to run the inference. CPU, GPU, NPU is supported. Default value is CPU.\n\n";
         std::cerr << "Usage: pkshin_detect image [MODEL] [LABEL] [IMG_DIR] [RESULT] [ACCELERATOR]\n";
         std::cerr << "image mode runs the object detection with jpeg images.\n";
-        std::cerr << "[MODEL] is path of the model file.\n";
+        std::cerr << "[MODEL] is path of the model file, or of a .pkbundle manifest naming the artifacts of the devices and the model family.\n";
         std::cerr << "[LABEL] is path of the label file.\n";
         std::cerr << "[IMG_DIR] is path of the directory containing images.\n";
         std::cerr << "[RESULT] is path of the result json file.\n";
         std::cerr << "[ACCELERATOR] specifies the accelerator to run the inference. CPU, GPU, NPU is supported. Default value is CPU.\n\n";
+        std::cerr << "[OPTIONS] are --key=value pairs and can be placed anywhere.\n";
+        std::cerr << "--huge_pages=1 maps the engine tensor buffers with huge pages.\n";
+        std::cerr << "--placement=feeder=big,pre=little,post=little,writer=0+1,isolate=1 pins the feeder, pre, post and writer threads. Default is pre=0-3,post=0-3.\n";
+        std::cerr << "--cpu_threads=4 sets the size of the cpu executor running the pre and post stages. Default is 4.\n";
+        std::cerr << "--tflite_threads=1 sets the number of tflite cpu backend threads. Default is 1.\n";
+        std::cerr << "--rt=fifo runs the threads under SCHED_FIFO (or rr) with feeder_prio, pre_prio, post_prio and writer_prio from --placement, and prefaults the tensor buffers.\n";
+        std::cerr << "--mlock=0 keeps the process memory unlocked in the real-time mode.\n";
+        std::cerr << "--hedge=1.5 runs a slot again on an idle device once it takes 1.5 times longer than expected. Needs a mixed accelerator.\n";
+        std::cerr << "--latency_budget=MS tunes the batch size for the best throughput with a p95 turnaround within MS. The batch argument is the upper bound.\n";
+        std::cerr << "--device_timeout=MS moves the slots of a device failing or running over MS to the other devices. --inject_faults=hailo1=error:0.05,maccel=stall:0.01:3000 fails or stalls device calls for testing.\n";
+        std::cerr << "--streams=2,1,1 deals the images to streams sharing the devices by weight.\n";
+        std::cerr << "--profile_db=FILE seeds the scheduler with the device profiles of the model when the perfs argument is auto. --calibrate=20 profiles every device over 20 runs into the database first.\n";
+        std::cerr << "--variants=yolov8n.tflite,yolov8s.tflite,yolov8m.tflite runs the smaller tflite variants on the gpu and hexagon when the p95 turnaround is over --variant_target=MS, and the larger ones when it is well under.\n";
+        std::cerr << "--cascade=yolov8m.tflite runs the images again on the larger tflite model on the gpu and hexagon when --cascade_count=1 or more detections score in --cascade_band=0.25,0.5, and merges both results. Image mode only.\n";
+        std::cerr << "--accuracy=0.37,0.37,0.33,0.33,0.33 gives the measured accuracy of every device in the order of the perfs. The slots then only go to devices of --min_accuracy=0.35 or more, those of stream i to --stream_accuracy=A0,A1,.. or more, and --accuracy_target=0.36 moves slots to the more accurate devices until the mean of a batch reaches it.\n";
+        std::cerr << "--gate=gpu=/sys/class/thermal/thermal_zone10/temp,soc=/sys/class/thermal/thermal_zone0/temp,soft=70,hard=85,park=0.5,hailo_wake=40 shrinks the share of a device heating up over soft, holds it back over hard, and parks the slowest devices while the others run the load.\n";
+        std::cerr << "--shapes=640x384,384x640 runs the images at the tightest of these input shapes on the gpu and hexagon, grouped into batches per shape, to leave out the letterbox padding. Image mode only, without streams or the cascade.\n";
+        std::cerr << "--tile=1024 cuts the images into tiles of 1024 pixels overlapping by --tile_overlap=200, runs every tile in a slot of its own on all the devices, and merges the detections of the tiles with nms. Image mode only, without streams, the cascade or shapes.\n";
+        std::cerr << "--split=MANIFEST runs the hef or mxq as the backbone of a split model and the tflite head of the manifest on the cpu, the head of a slot overlapping the backbone of the next one. Mixed modes only, without --hedge, --device_timeout or --shapes.\n";
+        std::cerr << "--models=cls=mobilenet.tflite,obb=yolov8s_obb.tflite registers more models by id, run on the cpu beside the model of the engine. They load on first use, --preload=cls loads them in the background, and --model_budget=256 drops the least recently used ones over 256 MB.\n";
+        std::cerr << "--classify=cls runs the registry model cls on the crops of the detections, in batches of up to --classify_batch=32 crops, while the detector runs the next batch. The detections get its class_id and class_score. Image mode only, without the cascade or tiles.\n";
+        std::cerr << "--swap=FILE loads FILE as the tflite part of a mixed accelerator after --swap_after=100 batches, beside the running model, and switches to it between two batches without stopping. Modes 3 and 4 only, without variants, the cascade or shapes.\n";
+        std::cerr << "--remote=HOST:PORT or unix:PATH adds the engine another board serves with --serve=HOST:PORT to the devices of the dispatch, with up to --remote_window=4 slots in flight and --remote_cost=MS per slot until it is measured. Both run the same mode and model. Modes 3 and 4 only, without --split or --shapes.\n";
+        std::cerr << "--trace=FILE records the arrival, device, run times and input hash of every slot. --replay=FILE runs the batches of a trace at its arrivals, --replay_speed=2 twice as fast, with the images as inputs.\n\n";
         return false;
     }
 
@@ -132,8 +202,306 @@ int main(int argc, char * argv[]){
         return false;
     }
 
-    // Parse the model info
-    if(strstr(argv[2], "mobilenet")){
+    if(options.count("huge_pages") && options["huge_pages"] != "0"){
+        if(interpreter->SetMemoryParams(true) != kTfLiteOk){
+            std::cerr << "ERROR: Huge page allocation for interpreter failed.\n";
+            return false;
+        }
+    }
+
+    std::string placement = options.count("placement") ? options["placement"] : "pre=0-3,post=0-3";
+    if(interpreter->SetPlacementParams(placement.c_str()) != kTfLiteOk){
+        std::cerr << "ERROR: Invalid thread placement: " << placement << std::endl;
+        return false;
+    }
+
+    if(options.count("rt")){
+        bool lock_memory = !options.count("mlock") || options["mlock"] != "0";
+        if(interpreter->SetRealtimeParams(options["rt"].c_str(), lock_memory) != kTfLiteOk){
+            std::cerr << "ERROR: Invalid real-time mode: " << options["rt"] << std::endl;
+            return false;
+        }
+    }
+
+    int cpu_threads = options.count("cpu_threads") ? atoi(options["cpu_threads"].c_str()) : 4;
+    int tflite_threads = options.count("tflite_threads") ? atoi(options["tflite_threads"].c_str()) : 1;
+    if(interpreter->SetExecutorParams(cpu_threads, tflite_threads) != kTfLiteOk){
+        std::cerr << "ERROR: Cannot start the cpu executor.\n";
+        return false;
+    }
+
+    // --profile_db=FILE keeps the measured device profiles per model. --calibrate=RUNS profiles the devices and saves them
+    if(options.count("profile_db")){
+        if(interpreter->SetProfileParams(options["profile_db"].c_str()) != kTfLiteOk){
+            std::cerr << "ERROR: Cannot load the profile database: " << options["profile_db"] << std::endl;
+            return false;
+        }
+
+        if(options.count("calibrate") && interpreter->CalibrateProfile(atoi(options["calibrate"].c_str())) != kTfLiteOk){
+            std::cerr << "ERROR: Calibration failed\n";
+            return false;
+        }
+    }
+
+    // --latency_budget=MS tunes the batch size for the best throughput with a p95 turnaround within MS. The batch argument is the upper bound
+    if(options.count("latency_budget")){
+        if(interpreter->SetBatchTuningParams(atof(options["latency_budget"].c_str())) != kTfLiteOk){
+            std::cerr << "ERROR: Invalid latency budget: " << options["latency_budget"] << std::endl;
+            return false;
+        }
+    }
+
+    // --hedge=F re-dispatches a slot to an idle device once it runs F times longer than expected
+    if(options.count("hedge")){
+        if(interpreter->SetHedgeParams(atof(options["hedge"].c_str())) != kTfLiteOk){
+            std::cerr << "ERROR: Invalid hedge factor: " << options["hedge"] << std::endl;
+            return false;
+        }
+    }
+
+    // --streams=W1,W2,.. splits the images into streams that share the devices by weight, like cameras of different priority
+    if(options.count("streams")){
+        char streams_str[100];
+        strncpy(streams_str, options["streams"].c_str(), sizeof(streams_str) - 1);
+        streams_str[sizeof(streams_str) - 1] = '\0';
+
+        char * ret_token = strtok(streams_str, ",");
+        while(ret_token != NULL){
+            if(interpreter->AddStream(atof(ret_token)) < 0){
+                std::cerr << "ERROR: Invalid stream weights: " << options["streams"] << std::endl;
+                return false;
+            }
+            ret_token = strtok(NULL, ",");
+        }
+    }
+
+    // --device_timeout=MS moves the slots of a device that fails or runs over MS to the other devices and quarantines it.
+    // --inject_faults=SPEC fails or stalls device calls on purpose, e.g. hailo1=error:0.05,maccel=stall:0.01:3000
+    if(options.count("device_timeout") || options.count("inject_faults")){
+        double device_timeout = options.count("device_timeout") ? atof(options["device_timeout"].c_str()) : 0;
+        const char * inject = options.count("inject_faults") ? options["inject_faults"].c_str() : NULL;
+        if(interpreter->SetFaultParams(device_timeout, inject) != kTfLiteOk){
+            std::cerr << "ERROR: Invalid fault params\n";
+            return false;
+        }
+    }
+
+    // --variants=FILES lists the tflite variants of the model from the smallest to the largest. The gpu and hexagon step
+    // between them to hold the p95 turnaround of --variant_target=MS
+    if(options.count("variants")){
+        double variant_target = options.count("variant_target") ? atof(options["variant_target"].c_str()) : 0;
+        if(interpreter->SetVariantParams(options["variants"].c_str(), variant_target) != kTfLiteOk){
+            std::cerr << "ERROR: Invalid variants: " << options["variants"] << std::endl;
+            return false;
+        }
+    }
+
+    // --cascade=FILE escalates the frames with --cascade_count=N detections scored in --cascade_band=LO,HI to a larger
+    // tflite model of the same tensors
+    if(options.count("cascade")){
+        float band_lo = 0.25, band_hi = 0.5;
+        if(options.count("cascade_band") && sscanf(options["cascade_band"].c_str(), "%f,%f", &band_lo, &band_hi) != 2){
+            std::cerr << "ERROR: Invalid cascade band: " << options["cascade_band"] << std::endl;
+            return false;
+        }
+
+        int band_count = options.count("cascade_count") ? atoi(options["cascade_count"].c_str()) : 1;
+        if(interpreter->SetCascadeParams(options["cascade"].c_str(), band_lo, band_hi, band_count) != kTfLiteOk){
+            std::cerr << "ERROR: Invalid cascade params\n";
+            return false;
+        }
+    }
+
+    // --accuracy=A0,A1,.. is the measured accuracy of the devices in the order of the perfs, e.g. the mAP of the model on
+    // every device. --min_accuracy and --stream_accuracy keep the slots off the devices below them, --accuracy_target
+    // is the mean accuracy a batch is brought up to
+    if(options.count("accuracy")){
+        std::vector<float> accuracies;
+        char accuracy_str[100];
+        strncpy(accuracy_str, options["accuracy"].c_str(), sizeof(accuracy_str) - 1);
+        accuracy_str[sizeof(accuracy_str) - 1] = '\0';
+
+        char * ret_token = strtok(accuracy_str, ",");
+        while(ret_token != NULL){
+            accuracies.push_back(atof(ret_token));
+            ret_token = strtok(NULL, ",");
+        }
+
+        float min_accuracy = options.count("min_accuracy") ? atof(options["min_accuracy"].c_str()) : 0;
+        float accuracy_target = options.count("accuracy_target") ? atof(options["accuracy_target"].c_str()) : 0;
+        if(interpreter->SetAccuracyParams(accuracies, min_accuracy, accuracy_target) != kTfLiteOk){
+            std::cerr << "ERROR: Invalid accuracies: " << options["accuracy"] << std::endl;
+            return false;
+        }
+
+        if(options.count("stream_accuracy")){
+            strncpy(accuracy_str, options["stream_accuracy"].c_str(), sizeof(accuracy_str) - 1);
+            accuracy_str[sizeof(accuracy_str) - 1] = '\0';
+
+            int stream = 0;
+            ret_token = strtok(accuracy_str, ",");
+            while(ret_token != NULL){
+                if(interpreter->SetStreamAccuracy(stream++, atof(ret_token)) != kTfLiteOk){
+                    std::cerr << "ERROR: Invalid stream accuracies: " << options["stream_accuracy"] << std::endl;
+                    return false;
+                }
+                ret_token = strtok(NULL, ",");
+            }
+        }
+    }
+
+    // --gate=SPEC reads the device and SoC temperatures from sysfs style files to keep the devices under their throttling
+    // point, and parks the devices the load does not need
+    if(options.count("gate")){
+        if(interpreter->SetGateParams(options["gate"].c_str()) != kTfLiteOk){
+            std::cerr << "ERROR: Invalid device gate: " << options["gate"] << std::endl;
+            return false;
+        }
+    }
+
+    // --shapes=LIST builds the tflite part at every WxH of the list, so the images of a wide or tall aspect run without
+    // most of their padding
+    if(options.count("shapes")){
+        if(options.count("streams") || options.count("cascade")){
+            std::cerr << "ERROR: --shapes cannot be used with --streams or --cascade\n";
+            return false;
+        }
+
+        if(interpreter->SetShapeParams(options["shapes"].c_str()) != kTfLiteOk){
+            std::cerr << "ERROR: Invalid input shapes: " << options["shapes"] << std::endl;
+            return false;
+        }
+    }
+
+    // --tile=SIZE runs the images as overlapping tiles, for the small objects of images much larger than the input
+    if(options.count("tile")){
+        int tile_size = atoi(options["tile"].c_str());
+        int tile_overlap = options.count("tile_overlap") ? atoi(options["tile_overlap"].c_str()) : tile_size / 5;
+
+        if(tile_size <= 0 || tile_overlap < 0 || tile_overlap >= tile_size){
+            std::cerr << "ERROR: The tiles need a positive size over their overlap\n";
+            return false;
+        }
+
+        if(options.count("streams") || options.count("cascade") || options.count("shapes")){
+            std::cerr << "ERROR: --tile cannot be used with --streams, --cascade or --shapes\n";
+            return false;
+        }
+
+        set_image_tiling(tile_size, tile_overlap);
+        std::cout << "INFO: Run the images as tiles of " << tile_size << " pixels overlapping by " << tile_overlap << "\n";
+    }
+
+    // --split=MANIFEST cuts the model between the accelerator and a tflite head on the cpu, by the tensor names of the manifest
+    if(options.count("split")){
+        if(options.count("hedge") || options.count("device_timeout") || options.count("shapes")){
+            std::cerr << "ERROR: --split cannot be used with --hedge, --device_timeout or --shapes\n";
+            return false;
+        }
+
+        if(interpreter->SetSplitParams(options["split"].c_str()) != kTfLiteOk){
+            std::cerr << "ERROR: Invalid split manifest: " << options["split"] << std::endl;
+            return false;
+        }
+    }
+
+    // --models=ID=FILE,.. registers the models the app runs by id, cached under --model_budget=MB
+    if(options.count("models")){
+        double model_budget = options.count("model_budget") ? atof(options["model_budget"].c_str()) : 0;
+        if(interpreter->SetRegistryParams(options["models"].c_str(), model_budget, tflite_threads) != kTfLiteOk){
+            std::cerr << "ERROR: Invalid registry models: " << options["models"] << std::endl;
+            return false;
+        }
+
+        if(options.count("preload")){
+            std::stringstream ss(options["preload"]);
+            std::string id;
+            while(std::getline(ss, id, ',')){
+                if(!id.empty() && interpreter->PreloadModel(id.c_str()) != kTfLiteOk)
+                    return false;
+            }
+        }
+    }
+
+    // --classify=ID runs a registry model on the crops of the detections as a second stage
+    if(options.count("classify")){
+        if(!options.count("models") || options.count("cascade") || options.count("tile")){
+            std::cerr << "ERROR: --classify needs --models, and cannot be used with --cascade or --tile\n";
+            return false;
+        }
+
+        int classify_batch = options.count("classify_batch") ? atoi(options["classify_batch"].c_str()) : 32;
+        if(interpreter->SetCropParams(options["classify"].c_str(), classify_batch) != kTfLiteOk){
+            std::cerr << "ERROR: Invalid crop classifier: " << options["classify"] << std::endl;
+            return false;
+        }
+    }
+
+    // --swap=FILE replaces the tflite part of the model while the batches run
+    if(options.count("swap")){
+        int swap_after = options.count("swap_after") ? atoi(options["swap_after"].c_str()) : 100;
+        if(swap_after < 0 || options.count("variants") || options.count("cascade") || options.count("shapes")){
+            std::cerr << "ERROR: --swap needs --swap_after of 0 or more, and cannot be used with --variants, --cascade or --shapes\n";
+            return false;
+        }
+
+        set_model_swap(options["swap"].c_str(), swap_after);
+    }
+
+    // --remote=ADDRESS runs slots on the engine of another board. --serve=ADDRESS makes this engine the one of the other board
+    if(options.count("remote")){
+        int remote_window = options.count("remote_window") ? atoi(options["remote_window"].c_str()) : 4;
+        double remote_cost = options.count("remote_cost") ? atof(options["remote_cost"].c_str()) : 0;
+        if(options.count("serve") || interpreter->SetRemoteParams(options["remote"].c_str(), remote_window, remote_cost) != kTfLiteOk){
+            std::cerr << "ERROR: Cannot add the remote engine: " << options["remote"] << ". It cannot be used with --serve\n";
+            return false;
+        }
+    }
+
+    if(options.count("serve"))
+        set_remote_serving(options["serve"].c_str());
+
+    // --trace=FILE records every slot of the dispatches. --replay=FILE feeds the batches of a trace back at the recorded
+    // arrivals, --replay_speed times faster
+    if(options.count("trace") || options.count("replay")){
+        if(options.count("replay") && options.count("streams")){
+            std::cerr << "ERROR: --replay cannot be used with --streams\n";
+            return false;
+        }
+
+        const char * trace = options.count("trace") ? options["trace"].c_str() : NULL;
+        const char * replay = options.count("replay") ? options["replay"].c_str() : NULL;
+        double replay_speed = options.count("replay_speed") ? atof(options["replay_speed"].c_str()) : 1;
+        if(interpreter->SetTraceParams(trace, replay, replay_speed) != kTfLiteOk){
+            std::cerr << "ERROR: Invalid trace params\n";
+            return false;
+        }
+    }
+
+    // Parse the model info. A bundle names the family, otherwise it comes from the model file name
+    pkshin::BundleInfo bundle_info = interpreter->GetBundleInfo();
+    if(bundle_info.loaded && bundle_info.family[0] != '\0'){
+        const char * families[] = {"ssd_mobilenet", "efficientdet", "efficientdet_lite", "yolo", "yolov10", "yolo_obb"};
+
+        model_mode = 0;
+        for(int i = 0; i < 6; i++){
+            if(strcmp(bundle_info.family, families[i]) == 0)
+                model_mode = i + 1;
+        }
+
+        if(model_mode == 0){
+            std::cerr << "ERROR: Unknown family in the bundle: " << bundle_info.family << ". ssd_mobilenet, efficientdet, efficientdet_lite, yolo, yolov10, yolo_obb are supported\n";
+            return false;
+        }
+
+        std::cout << "INFO: Model family from the bundle: " << bundle_info.family << "\n";
+
+        // The preprocessing follows the family in this app
+        const char * recipe = model_mode == 1 ? "stretch" : "letterbox";
+        if(bundle_info.preprocess[0] != '\0' && strcmp(bundle_info.preprocess, recipe) != 0)
+            std::cout << "WARNING: The " << bundle_info.family << " family is preprocessed with " << recipe << ", not " << bundle_info.preprocess << "\n";
+    }
+    else if(strstr(argv[2], "mobilenet")){
         if(strstr(argv[2], "ssd")){
             std::cout << "INFO: Model file: ssd_mobilenet\n";
             model_mode = 1;
@@ -237,7 +605,7 @@ int main(int argc, char * argv[]){
     // Call the appropriate functons for mode
     if(strcmp(argv[1], "camera") == 0){
         std::cout << "INFO: Running the object detection using qcarcam API.\n";
-        //return run_qcarcam(interpreter.get(), model_mode, &labels, argv[4]);
+        //return run_qcarcam(interpreter.get(), model_mode, &labels, argv[4], options.count("live") > 0);
     }
     else if(strcmp(argv[1], "image") == 0){
         std::cout << "INFO: Running the object detection with jpeg images.\n";
@@ -247,7 +615,8 @@ int main(int argc, char * argv[]){
         char *ret_token = NULL;
         std::vector<float> perfs;
 
-        ret_token = strtok(perfs_str, ",");
+        // auto leaves the perfs to the profile database
+        ret_token = strcmp(perfs_str, "auto") == 0 ? NULL : strtok(perfs_str, ",");
         while(ret_token != NULL) {
             perfs.push_back(atof(ret_token));
             ret_token = strtok(NULL, ",");
@@ -0,0 +1,148 @@
+#ifndef _NMS_HPP_
+#define _NMS_HPP_
+
+#include <vector>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+
+// Sorts the indices of the scores above score_threshold in descending order and keeps the top_k of them
+static void nms_order_scores(const std::vector<float> & scores, float score_threshold, int top_k, std::vector<int> & order){
+    order.clear();
+    for(int i = 0; i < scores.size(); i++){
+        if(scores[i] > score_threshold)
+            order.push_back(i);
+    }
+
+    // Ties keep the input order like the stable sort of opencv
+    std::sort(order.begin(), order.end(), [&scores](int a, int b){
+        return scores[a] > scores[b] || (scores[a] == scores[b] && a < b);
+    });
+
+    if(top_k > 0 && order.size() > top_k)
+        order.resize(top_k);
+}
+
+// Greedy nms with the results of cv::dnn::NMSBoxes(eta = 1): the top_k boxes scoring above score_threshold, in descending
+// score order, are kept when their IoU with every kept box is at most nms_threshold.
+// Unlike cv::dnn::NMSBoxes it works on the caller's buffers, so it does not allocate once they have grown.
+static void nms_boxes(const std::vector<cv::Rect2d> & boxes, const std::vector<float> & scores, float score_threshold, float nms_threshold, std::vector<int> & indices, int top_k, std::vector<int> & order){
+    nms_order_scores(scores, score_threshold, top_k, order);
+
+    indices.clear();
+    for(int i = 0; i < order.size(); i++){
+        const cv::Rect2d & box = boxes[order[i]];
+        bool keep = true;
+
+        for(int j = 0; j < indices.size() && keep; j++){
+            const cv::Rect2d & kept = boxes[indices[j]];
+
+            double area_sum = box.area() + kept.area();
+            float overlap = 1.f;
+            if(area_sum > std::numeric_limits<double>::epsilon()){
+                double intersection = (box & kept).area();
+                overlap = 1.f - static_cast<float>(1.0 - intersection / (area_sum - intersection));
+            }
+
+            keep = overlap <= nms_threshold;
+        }
+
+        if(keep)
+            indices.push_back(order[i]);
+    }
+}
+
+static inline float polygon_area(const cv::Point2f * points, int n){
+    float area = 0;
+    for(int i = 0; i < n; i++){
+        const cv::Point2f & p = points[i];
+        const cv::Point2f & q = points[(i + 1) % n];
+        area += p.x * q.y - q.x * p.y;
+    }
+
+    return std::abs(area) * 0.5f;
+}
+
+static inline bool point_in_convex(const cv::Point2f * polygon, int n, const cv::Point2f & point, float orientation){
+    for(int i = 0; i < n; i++){
+        const cv::Point2f & p = polygon[i];
+        const cv::Point2f & q = polygon[(i + 1) % n];
+        if(orientation * ((q.x - p.x) * (point.y - p.y) - (q.y - p.y) * (point.x - p.x)) < -1e-4f)
+            return false;
+    }
+
+    return true;
+}
+
+// IoU of two rotated rectangles like the one of cv::dnn::NMSBoxes: a rectangle inside the other counts as 1.
+// The intersection is clipped on fixed arrays (Sutherland-Hodgman), so no temporary vector is made.
+static float rotated_rect_iou(const cv::RotatedRect & a, const cv::RotatedRect & b){
+    cv::Point2f pa[4], pb[4];
+    a.points(pa);
+    b.points(pb);
+
+    float orientation_a = (pa[1].x - pa[0].x) * (pa[2].y - pa[0].y) - (pa[1].y - pa[0].y) * (pa[2].x - pa[0].x) < 0 ? -1.f : 1.f;
+    float orientation_b = (pb[1].x - pb[0].x) * (pb[2].y - pb[0].y) - (pb[1].y - pb[0].y) * (pb[2].x - pb[0].x) < 0 ? -1.f : 1.f;
+
+    bool a_in_b = true, b_in_a = true;
+    for(int i = 0; i < 4; i++){
+        a_in_b = a_in_b && point_in_convex(pb, 4, pa[i], orientation_b);
+        b_in_a = b_in_a && point_in_convex(pa, 4, pb[i], orientation_a);
+    }
+    if(a_in_b || b_in_a)
+        return 1.f;
+
+    // Clip a by every edge of b. Two convex quadrilaterals intersect in at most 8 vertices
+    cv::Point2f buf[2][16];
+    int n = 4;
+    for(int i = 0; i < 4; i++)
+        buf[0][i] = pa[i];
+
+    int cur = 0;
+    for(int e = 0; e < 4 && n > 0; e++){
+        const cv::Point2f & p = pb[e];
+        const cv::Point2f & q = pb[(e + 1) % 4];
+        const cv::Point2f * in = buf[cur];
+        cv::Point2f * out = buf[1 - cur];
+        int m = 0;
+
+        for(int i = 0; i < n; i++){
+            const cv::Point2f & s = in[i];
+            const cv::Point2f & t = in[(i + 1) % n];
+            float ds = orientation_b * ((q.x - p.x) * (s.y - p.y) - (q.y - p.y) * (s.x - p.x));
+            float dt = orientation_b * ((q.x - p.x) * (t.y - p.y) - (q.y - p.y) * (t.x - p.x));
+
+            if(ds >= 0)
+                out[m++] = s;
+            if((ds >= 0) != (dt >= 0) && m < 16)
+                out[m++] = s + (t - s) * (ds / (ds - dt));
+        }
+
+        n = m;
+        cur = 1 - cur;
+    }
+
+    if(n < 3)
+        return 0.f;
+
+    float intersection = polygon_area(buf[cur], n);
+    return intersection / (a.size.area() + b.size.area() - intersection);
+}
+
+// nms_boxes for rotated boxes, with the results of cv::dnn::NMSBoxes on RotatedRect
+static void nms_rotated_boxes(const std::vector<cv::RotatedRect> & boxes, const std::vector<float> & scores, float score_threshold, float nms_threshold, std::vector<int> & indices, int top_k, std::vector<int> & order){
+    nms_order_scores(scores, score_threshold, top_k, order);
+
+    indices.clear();
+    for(int i = 0; i < order.size(); i++){
+        bool keep = true;
+
+        for(int j = 0; j < indices.size() && keep; j++)
+            keep = rotated_rect_iou(boxes[order[i]], boxes[indices[j]]) <= nms_threshold;
+
+        if(keep)
+            indices.push_back(order[i]);
+    }
+}
+
+#endif //_NMS_HPP_
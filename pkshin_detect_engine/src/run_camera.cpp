@@ -5,6 +5,9 @@
 #include <chrono>
 #include <string>
 #include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include <engine_interface.hpp>
 #include "hailo_post.hpp"
@@ -29,9 +32,35 @@ static int input_height;
 static int input_width;
 static int input_channel;
 
-
-// Callback function called when the camera frame is refreshed
-void qcarcam_event_handler(int input_id, unsigned char* buf_ptr, size_t buf_len){
+// Live input: the camera callbacks only leave their frame in a mailbox and draw the latest detections, and one
+// inference thread takes the newest frame of each camera in turn. A frame replaced before it was taken is dropped,
+// so the latency stays bounded when inference is slower than the cameras.
+#define MAX_CAMERAS 16
+
+struct LiveCamera {
+    std::vector<uint8_t> latest;     // newest frame, owned by the mailbox
+    std::vector<uint8_t> spare;      // buffer the callback copies into, owned by the callback
+    std::chrono::steady_clock::time_point latest_time;
+    bool fresh;
+
+    std::vector<uint8_t> overlay;         // uyvy detections of the last inferred frame
+    std::vector<uint8_t> overlay_mask;    // per uyvy macro pixel, set where the overlay has a drawing
+    bool has_overlay;
+
+    unsigned long captured;
+    unsigned long inferred;
+    unsigned long dropped;
+    double sum_latency_ms;    // capture to published detections
+};
+
+static bool live_mode = false;
+static LiveCamera live_cameras[MAX_CAMERAS];
+static std::mutex live_mutex;
+static std::condition_variable live_cv;
+
+// Runs the detection on a uyvy frame. Without out_mask the detections are drawn on the frame and it is written back to
+// out_ptr. With out_mask they are drawn on an empty image, which goes to out_ptr with the mask of the drawn pixels.
+static void detect_frame(int input_id, unsigned char * buf_ptr, unsigned char * out_ptr, uint8_t * out_mask){
     std::vector<std::string> & labels = *labels_ptr;
 
     // Get the camera info
@@ -332,7 +361,11 @@ void qcarcam_event_handler(int input_id, unsigned char* buf_ptr, size_t buf_len)
         rgb_buf_ptr[i + 2] = tmp;
     }
 
-    cv::Mat cvimg(camera_height, camera_width, CV_8UC3, rgb_buf_ptr);
+    cv::Mat cvimg;
+    if(out_mask == NULL)
+        cvimg = cv::Mat(camera_height, camera_width, CV_8UC3, rgb_buf_ptr);
+    else
+        cvimg = cv::Mat::zeros(camera_height, camera_width, CV_8UC3);
 
     // Output of inference
     if(interpreter->is_hailo_output()){
@@ -853,9 +886,19 @@ void qcarcam_event_handler(int input_id, unsigned char* buf_ptr, size_t buf_len)
 
     memcpy(rgb_buf_ptr, cvimg.data, camera_width * camera_height * 3 * sizeof(uint8_t));
 
+    if(out_mask != NULL){
+        for(int i = 0; i < camera_width * camera_height / 2; i++){
+            bool drawn = false;
+            for(int j = 0; j < 6; j++)
+                drawn = drawn || rgb_buf_ptr[6 * i + j] != 0;
+
+            out_mask[i] = drawn;
+        }
+    }
+
     // Change color format from bgr to uyuv
     fcvColorRGB888ToYCbCr422PseudoPlanaru8(rgb_buf_ptr, camera_width, camera_height, camera_width * 3, y, uv, camera_width, camera_width);
-    fcvInterleaveu8(uv, y, camera_width, camera_height, camera_width, camera_width, buf_ptr, camera_width * 2);
+    fcvInterleaveu8(uv, y, camera_width, camera_height, camera_width, camera_width, out_ptr, camera_width * 2);
 
     // Free memory
     delete rgb_buf_ptr;
@@ -864,10 +907,111 @@ void qcarcam_event_handler(int input_id, unsigned char* buf_ptr, size_t buf_len)
     fcvMemFree(y);
 }
 
-bool run_qcarcam(tflite::Interpreter * interpreter_arg, int model_mode_arg, std::vector<std::string> * labels_arg, char * display_path){
+// Inference thread of the live input
+static void live_infer_thread(){
+    std::vector<uint8_t> frame;
+    std::vector<uint8_t> overlay;
+    std::vector<uint8_t> overlay_mask;
+    int next_camera = 0;
+
+    while(true){
+        int input_id = -1;
+        std::chrono::steady_clock::time_point captured_at;
+
+        {
+            std::unique_lock<std::mutex> lk(live_mutex);
+            while(input_id < 0){
+                // Cameras in turn, so a fast one cannot starve the others
+                for(int i = 0; i < MAX_CAMERAS && input_id < 0; i++){
+                    int camera = (next_camera + i) % MAX_CAMERAS;
+                    if(live_cameras[camera].fresh)
+                        input_id = camera;
+                }
+
+                if(input_id < 0)
+                    live_cv.wait(lk);
+            }
+
+            LiveCamera & camera = live_cameras[input_id];
+            frame.swap(camera.latest);
+            captured_at = camera.latest_time;
+            camera.fresh = false;
+            next_camera = (input_id + 1) % MAX_CAMERAS;
+        }
+
+        overlay.resize(frame.size());
+        overlay_mask.resize(frame.size() / 4);
+        detect_frame(input_id, frame.data(), overlay.data(), overlay_mask.data());
+
+        double latency_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - captured_at).count();
+
+        std::lock_guard<std::mutex> lk(live_mutex);
+        LiveCamera & camera = live_cameras[input_id];
+        camera.overlay.swap(overlay);
+        camera.overlay_mask.swap(overlay_mask);
+        camera.has_overlay = true;
+        camera.inferred++;
+        camera.sum_latency_ms += latency_ms;
+    }
+}
+
+// Callback function called when the camera frame is refreshed
+void qcarcam_event_handler(int input_id, unsigned char* buf_ptr, size_t buf_len){
+    if(!live_mode){
+        detect_frame(input_id, buf_ptr, buf_ptr, NULL);
+        return;
+    }
+
+    if(input_id < 0 || input_id >= MAX_CAMERAS){
+        std::cerr << "ERROR: The camera id must be smaller than " << MAX_CAMERAS << "\n";
+        exit(-1);
+    }
+
+    LiveCamera & camera = live_cameras[input_id];
+
+    // Only the swap is under the lock, so the callback never waits for the inference
+    if(camera.spare.size() != buf_len)
+        camera.spare.resize(buf_len);
+    memcpy(camera.spare.data(), buf_ptr, buf_len);
+
+    std::lock_guard<std::mutex> lk(live_mutex);
+
+    camera.latest.swap(camera.spare);
+    camera.latest_time = std::chrono::steady_clock::now();
+    if(camera.fresh)
+        camera.dropped++;
+    camera.fresh = true;
+    camera.captured++;
+    live_cv.notify_one();
+
+    // Draw the latest detections of the camera on the live frame
+    if(camera.has_overlay && camera.overlay.size() == buf_len){
+        for(size_t i = 0; i < buf_len / 4; i++){
+            if(camera.overlay_mask[i])
+                memcpy(buf_ptr + 4 * i, camera.overlay.data() + 4 * i, 4);
+        }
+    }
+}
+
+bool run_qcarcam(tflite::Interpreter * interpreter_arg, int model_mode_arg, std::vector<std::string> * labels_arg, char * display_path, bool live){
     interpreter = interpreter_arg;
     model_mode = model_mode_arg;
     labels_ptr = labels_arg;
+    live_mode = live;
+
+    if(live_mode){
+        for(int i = 0; i < MAX_CAMERAS; i++){
+            live_cameras[i].fresh = false;
+            live_cameras[i].has_overlay = false;
+            live_cameras[i].captured = 0;
+            live_cameras[i].inferred = 0;
+            live_cameras[i].dropped = 0;
+            live_cameras[i].sum_latency_ms = 0;
+        }
+
+        std::thread(live_infer_thread).detach();
+        std::cout << "INFO: Live input. Inference takes the newest frame of every camera\n";
+    }
 
     // Get the input tensor size info
     TfLiteTensor* input_tensor_0 = interpreter->input_tensor(0);
@@ -891,7 +1035,23 @@ bool run_qcarcam(tflite::Interpreter * interpreter_arg, int model_mode_arg, std:
         std::cout << std::fixed;
         std::cout.precision(3);
         std::cout << "Average inference speed(0~" << secs << "s): " << 1000000.0 / average_inference_time << "fps\n";
-        std::cout << "Average inference speed(0~" << secs << "s): " << average_inference_time << "us\n\n";
+        std::cout << "Average inference speed(0~" << secs << "s): " << average_inference_time << "us\n";
+
+        if(live_mode){
+            std::lock_guard<std::mutex> lk(live_mutex);
+            for(int i = 0; i < MAX_CAMERAS; i++){
+                LiveCamera & camera = live_cameras[i];
+                if(camera.captured == 0)
+                    continue;
+
+                std::cout << "Camera " << i << ": captured " << camera.captured << ", inferred " << camera.inferred << ", dropped " << camera.dropped;
+                if(camera.inferred > 0)
+                    std::cout << ", latency " << camera.sum_latency_ms / camera.inferred << " ms";
+                std::cout << "\n";
+            }
+        }
+
+        std::cout << "\n";
     }
 
     // Stop qcarcam
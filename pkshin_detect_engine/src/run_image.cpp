@@ -6,6 +6,7 @@
 #include <chrono>
 #include <string>
 #include <vector>
+#include <deque>
 #include <thread>
 #include <mutex>
 
@@ -16,6 +17,8 @@
 #include "hailo_post.hpp"
 #include "maccel_post.hpp"
 #include "tflite_post.hpp"
+#include "alloc_check.hpp"
+#include "nms.hpp"
 
 #include <opencv2/opencv.hpp>
 #include <fastcv/fastcv.h>
@@ -35,26 +38,46 @@ static unsigned int num_turnaround = 0;
 static double sum_turnaround = 0;
 static double max_turnaround = 0;
 
+static long num_escalated = 0;
+static long num_cascade_frames = 0;
+
+// With tiling, the images are cut into overlapping tiles of tile_size pixels, and every tile runs in a slot of its own
+static int tile_size = 0;
+static int tile_overlap = 0;
+static long num_tiles = 0;
+static long num_tiled_images = 0;
+
+// Detections given a class by the crop classifier
+static long num_classified = 0;
+
+// The tflite part swaps to swap_file after swap_after batches, while the batches keep running
+static std::string swap_file;
+static int swap_after = 0;
+
+// A served engine runs the slots of the engines of other boards instead of the images
+static std::string serve_address;
+
 static std::mutex in_postprocess_mutex;
 static std::mutex in_preprocess_mutex;
 
+// Batches run before the allocation check is armed
+#define ALLOC_CHECK_WARMUP_BATCHES 2
 
-void preprocess_thread(tflite::Interpreter * interpreter, int model_mode, std::string filename, json_object * json_images, int cur_batch, std::vector<int> &img_heights, std::vector<int> &img_widths, int image_id){
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(0, &cpuset);
-    CPU_SET(1, &cpuset);
-    CPU_SET(2, &cpuset);
-    CPU_SET(3, &cpuset);
-    pthread_t current_thread = pthread_self();
-    pthread_setaffinity_np(current_thread, sizeof(cpu_set_t), &cpuset);
-    
-    // Decode the image
-    struct jpeg_decompress_struct cinfo;
-    struct jpeg_error_mgr jerr;
 
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_decompress(&cinfo);
+// Decodes a jpeg into rgb_buf, which only grows, so the steady state reuses it
+void decode_image(const std::string & filename, std::vector<uint8_t> & rgb_buf, int & img_height, int & img_width){
+    AllocStageScope decode_stage(ALLOC_STAGE_DECODE);
+
+    thread_local struct jpeg_decompress_struct cinfo;
+    thread_local struct jpeg_error_mgr jerr;
+    thread_local bool cinfo_created = false;
+
+    // The decompressor is reused across images
+    if(!cinfo_created){
+        cinfo.err = jpeg_std_error(&jerr);
+        jpeg_create_decompress(&cinfo);
+        cinfo_created = true;
+    }
 
     FILE * fp = fopen(filename.c_str(), "rb");
     if(fp == NULL) {
@@ -71,25 +94,26 @@ void preprocess_thread(tflite::Interpreter * interpreter, int model_mode, std::s
     jpeg_start_decompress(&cinfo);
 
     // Get the image data
-    int img_height = cinfo.output_height;
-    int img_width = cinfo.output_width;
+    img_height = cinfo.output_height;
+    img_width = cinfo.output_width;
     int row_stride = cinfo.output_width * 3;
 
-    img_heights[cur_batch] = img_height;
-    img_widths[cur_batch] = img_width;
+    if(rgb_buf.size() < (size_t) img_height * img_width * 3)
+        rgb_buf.resize((size_t) img_height * img_width * 3);
 
-    uint8_t * rgb_buf_ptr = (uint8_t *)malloc(sizeof(uint8_t) * img_height * img_width * 3);
     while(cinfo.output_scanline < cinfo.output_height){
-        uint8_t * rowptr = rgb_buf_ptr + row_stride * cinfo.output_scanline; 
+        uint8_t * rowptr = rgb_buf.data() + row_stride * cinfo.output_scanline; 
         jpeg_read_scanlines(&cinfo, &rowptr, 1);
     }
 
     jpeg_finish_decompress(&cinfo);
-    jpeg_destroy_decompress(&cinfo);
 
     fclose(fp);
+}
+
+void write_json_image(json_object * json_images, int image_id, const std::string & filename, int img_height, int img_width){
+    AllocStageScope writer_stage(ALLOC_STAGE_WRITER);
 
-    // Write json images
     json_object * json_image = json_object_new_object();
 
     json_object_object_add(json_image, "id", json_object_new_int(image_id));
@@ -100,6 +124,17 @@ void preprocess_thread(tflite::Interpreter * interpreter, int model_mode, std::s
     in_preprocess_mutex.lock();
     json_object_array_add(json_images, json_image);
     in_preprocess_mutex.unlock();
+}
+
+// Letterboxes or stretches the image into the input slot cur_batch. The image may be a region of a larger one
+void fill_input(tflite::Interpreter * interpreter, int model_mode, const cv::Mat & cvImg, int cur_batch){
+    AllocStageScope pre_stage(ALLOC_STAGE_PRE);
+
+    // Scratch buffer of this worker. It only grows, so the steady state reuses it
+    thread_local std::vector<uint8_t> resize_buf;
+
+    int img_height = cvImg.rows;
+    int img_width = cvImg.cols;
 
     // Get the input tensor size info
     TfLiteTensor* input_tensor_0 = interpreter->input_tensor(0);
@@ -128,14 +163,14 @@ void preprocess_thread(tflite::Interpreter * interpreter, int model_mode, std::s
     int resize_height = img_height * scale_height;
     int resize_width = img_width * scale_width;
 
-    cv::Mat cvImg(cv::Size(img_width, img_height), CV_8UC3, rgb_buf_ptr);
+    // cv::resize keeps a destination of the right size and type, so it writes into the scratch buffer
+    if(resize_buf.size() < (size_t) resize_height * resize_width * 3)
+        resize_buf.resize((size_t) resize_height * resize_width * 3);
 
-    cv::Mat resizecvImg;
+    cv::Mat resizecvImg(cv::Size(resize_width, resize_height), CV_8UC3, resize_buf.data());
     cv::resize(cvImg, resizecvImg, cv::Size(resize_width, resize_height));
     uint8_t * resize_img_ptr = resizecvImg.data;
 
-    free(rgb_buf_ptr);
-
     for(int i = 0; i < interpreter->inputs().size(); i++){
         // Normalize and pad input
         void * input_img_ptr_arg;
@@ -312,16 +347,35 @@ void preprocess_thread(tflite::Interpreter * interpreter, int model_mode, std::s
     in_preprocess_mutex.unlock();
 }
 
+void preprocess_thread(tflite::Interpreter * interpreter, int model_mode, const std::string & filename, json_object * json_images, int cur_batch, std::vector<int> &img_heights, std::vector<int> &img_widths, int image_id, std::vector<uint8_t> * image_rgb = NULL){
+    AllocStageScope pre_stage(ALLOC_STAGE_PRE);
+
+    // Scratch buffer of this worker. It only grows, so the steady state reuses it
+    thread_local std::vector<uint8_t> rgb_buf;
+
+    // The image is kept in image_rgb when a later stage crops it
+    std::vector<uint8_t> & rgb = image_rgb != NULL ? *image_rgb : rgb_buf;
+
+    // Decode the image
+    int img_height;
+    int img_width;
+    decode_image(filename, rgb, img_height, img_width);
+
+    img_heights[cur_batch] = img_height;
+    img_widths[cur_batch] = img_width;
+
+    // Write json images
+    write_json_image(json_images, image_id, filename, img_height, img_width);
+
+    fill_input(interpreter, model_mode, cv::Mat(cv::Size(img_width, img_height), CV_8UC3, rgb.data()), cur_batch);
+}
+
 void postprocess_thread(tflite::Interpreter * interpreter, int model_mode, std::vector<int> &img_heights, std::vector<int> &img_widths, std::vector<int> &image_ids, json_object * json_annotations, int cur_batch){
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    CPU_SET(0, &cpuset);
-    CPU_SET(1, &cpuset);
-    CPU_SET(2, &cpuset);
-    CPU_SET(3, &cpuset);
-    pthread_t current_thread = pthread_self();
-    pthread_setaffinity_np(current_thread, sizeof(cpu_set_t), &cpuset);
-    
+    // The decoded results go to json, only the decoding and nms are checked
+    AllocStageScope writer_stage(ALLOC_STAGE_WRITER);
+
+    thread_local std::vector<DetResult> results;
+
     // Get the input tensor size info
     TfLiteTensor* input_tensor_0 = interpreter->input_tensor(0);
     TfLiteIntArray* input_dims = input_tensor_0->dims;
@@ -346,8 +400,11 @@ void postprocess_thread(tflite::Interpreter * interpreter, int model_mode, std::
 
     // Postprocess
     if(interpreter->is_tflite_output(cur_batch)){
-        std::vector<DetResult> results;
-        tflite_post(interpreter, model_mode, results, true, cur_batch);
+        {
+            AllocStageScope post_stage(ALLOC_STAGE_POST);
+            results.clear();
+            tflite_post(interpreter, model_mode, results, true, cur_batch);
+        }
 
         // Output of inference   
         switch(model_mode){
@@ -503,6 +560,8 @@ void postprocess_thread(tflite::Interpreter * interpreter, int model_mode, std::
             }
             case 6: //yolo obb
             {
+                AllocStageScope post_stage(ALLOC_STAGE_POST);
+
                 // Get the output tensor size info
                 TfLiteTensor *output_tensor_0 = interpreter->output_tensor(0);
                 TfLiteIntArray *output_dims = output_tensor_0->dims;
@@ -520,9 +579,16 @@ void postprocess_thread(tflite::Interpreter * interpreter, int model_mode, std::
 
                 float pi = 3.14159265358979323846;
 
-                std::vector<int> class_ids;
-                std::vector<float> scores;
-                std::vector<cv::RotatedRect> boxes;
+                thread_local std::vector<int> class_ids;
+                thread_local std::vector<float> scores;
+                thread_local std::vector<cv::RotatedRect> boxes;
+                thread_local std::vector<cv::RotatedRect> _boxes;
+                thread_local std::vector<int> nms_result;
+                thread_local std::vector<int> nms_order;
+
+                class_ids.clear();
+                scores.clear();
+                boxes.clear();
 
                 for(int i = 0; i < output_width; i++){
                     float cx = output_arr[0][i] * input_width;		            // center x
@@ -567,22 +633,23 @@ void postprocess_thread(tflite::Interpreter * interpreter, int model_mode, std::
                     }
                 }
 
-                std::vector<int> nms_result;
                 if (multi_label) {
                     // Batched nms trick since batched nms function is only available opencv > 4.7.0
-                    std::vector<cv::RotatedRect> _boxes = boxes;
+                    _boxes.assign(boxes.begin(), boxes.end());
 
                     for (int i = 0; i < _boxes.size(); i++) {
                         cv::Point2f offset(class_ids[i] * input_width, class_ids[i] * input_height);
                         _boxes[i].center = _boxes[i].center + offset;
                     }
 
-                    cv::dnn::NMSBoxes(_boxes, scores, conf_threshold, iou_threshold, nms_result, 1.0, max_detections);
+                    nms_rotated_boxes(_boxes, scores, conf_threshold, iou_threshold, nms_result, max_detections, nms_order);
                 }
                 else {
-                    cv::dnn::NMSBoxes(boxes, scores, conf_threshold, iou_threshold, nms_result, 1.0, max_detections);
+                    nms_rotated_boxes(boxes, scores, conf_threshold, iou_threshold, nms_result, max_detections, nms_order);
                 }
 
+                AllocStageScope json_stage(ALLOC_STAGE_WRITER);
+
                 for (int i = 0; i < nms_result.size(); i++) {
                     int idx = nms_result[i];
 
@@ -640,8 +707,11 @@ void postprocess_thread(tflite::Interpreter * interpreter, int model_mode, std::
         }
     }
     else if(interpreter->is_hailo_output(cur_batch)){
-        std::vector<DetResult> results;
-        auto status = hailo_postprocess<uint8_t>(interpreter, model_mode, results, cur_batch);
+        hailo_status status;
+        {
+            AllocStageScope post_stage(ALLOC_STAGE_POST);
+            status = hailo_postprocess<uint8_t>(interpreter, model_mode, results, cur_batch);
+        }
         if (HAILO_SUCCESS != status) {
             std::cerr << "ERROR: hailo postprocess failed\n";
             exit(-1);
@@ -712,8 +782,11 @@ void postprocess_thread(tflite::Interpreter * interpreter, int model_mode, std::
         }
     }
     else if(interpreter->is_maccel_output(cur_batch)){
-        std::vector<DetResult> results;
-        maccel_post(interpreter, model_mode, results, true, cur_batch);
+        {
+            AllocStageScope post_stage(ALLOC_STAGE_POST);
+            results.clear();
+            maccel_post(interpreter, model_mode, results, true, cur_batch);
+        }
 
         // Output of inference
         switch(model_mode){
@@ -786,7 +859,277 @@ void postprocess_thread(tflite::Interpreter * interpreter, int model_mode, std::
     in_postprocess_mutex.unlock();
 }
 
+// Size of a jpeg from its header, without decoding it
+bool jpeg_size(const char * filename, int & width, int & height){
+    static struct jpeg_decompress_struct cinfo;
+    static struct jpeg_error_mgr jerr;
+    static bool cinfo_created = false;
+
+    if(!cinfo_created){
+        cinfo.err = jpeg_std_error(&jerr);
+        jpeg_create_decompress(&cinfo);
+        cinfo_created = true;
+    }
+
+    FILE * fp = fopen(filename, "rb");
+    if(fp == NULL)
+        return false;
+
+    jpeg_stdio_src(&cinfo, fp);
+    jpeg_read_header(&cinfo, TRUE);
+    width = cinfo.image_width;
+    height = cinfo.image_height;
+    jpeg_abort_decompress(&cinfo);
+
+    fclose(fp);
+
+    return true;
+}
+
+// Scores of the detections of a slot
+void annotation_scores(json_object * annotations, std::vector<float> & scores){
+    scores.clear();
+    for(int i = 0; i < json_object_array_length(annotations); i++){
+        json_object * score;
+        if(json_object_object_get_ex(json_object_array_get_idx(annotations, i), "score", &score))
+            scores.push_back(json_object_get_double(score));
+    }
+}
+
+// Box of a detection as a rotated rect, from its bbox [x,y,w,h] or rbox [cx,cy,w,h,angle]
+bool annotation_box(json_object * annotation, cv::RotatedRect & box){
+    json_object * array;
+    if(json_object_object_get_ex(annotation, "rbox", &array) && json_object_array_length(array) == 5){
+        float v[5];
+        for(int i = 0; i < 5; i++)
+            v[i] = json_object_get_double(json_object_array_get_idx(array, i));
+        box = cv::RotatedRect(cv::Point2f(v[0], v[1]), cv::Size2f(v[2], v[3]), v[4]);
+        return true;
+    }
+
+    if(json_object_object_get_ex(annotation, "bbox", &array) && json_object_array_length(array) == 4){
+        float v[4];
+        for(int i = 0; i < 4; i++)
+            v[i] = json_object_get_double(json_object_array_get_idx(array, i));
+        box = cv::RotatedRect(cv::Point2f(v[0] + v[2] / 2, v[1] + v[3] / 2), cv::Size2f(v[2], v[3]), 0);
+        return true;
+    }
+
+    return false;
+}
+
+// Moves the detections of the larger model to merged, with the ones of the smaller model it did not find
+void merge_cascade(json_object * small, json_object * large, json_object * merged){
+    const float iou_threshold = 0.5;
+
+    std::vector<cv::RotatedRect> large_boxes;
+    std::vector<int> large_ids;
+    for(int i = 0; i < json_object_array_length(large); i++){
+        json_object * annotation = json_object_array_get_idx(large, i);
+        json_object * id;
+        cv::RotatedRect box;
+        if(annotation_box(annotation, box) && json_object_object_get_ex(annotation, "category_id", &id)){
+            large_boxes.push_back(box);
+            large_ids.push_back(json_object_get_int(id));
+        }
+
+        json_object_array_add(merged, json_object_get(annotation));
+    }
+
+    for(int i = 0; i < json_object_array_length(small); i++){
+        json_object * annotation = json_object_array_get_idx(small, i);
+        json_object * id;
+        cv::RotatedRect box;
+        bool found = false;
+        if(annotation_box(annotation, box) && json_object_object_get_ex(annotation, "category_id", &id)){
+            for(int j = 0; !found && j < large_boxes.size(); j++)
+                found = large_ids[j] == json_object_get_int(id) && rotated_rect_iou(box, large_boxes[j]) >= iou_threshold;
+        }
+
+        if(!found)
+            json_object_array_add(merged, json_object_get(annotation));
+    }
+}
+
+void set_image_tiling(int size, int overlap){
+    tile_size = size;
+    tile_overlap = overlap;
+}
+
+void set_model_swap(const char * file, int after){
+    swap_file = file;
+    swap_after = after;
+}
+
+void set_remote_serving(const char * address){
+    serve_address = address;
+}
+
+// An image cut into tiles, until the detections of all its tiles are merged
+struct TiledImage {
+    int id;
+    std::string filename;
+    int width;
+    int height;
+    bool decoded;
+    std::vector<uint8_t> rgb;
+    std::vector<cv::Rect> tiles;
+    int next_tile;      // next tile to give a slot
+    int done_tiles;
+    json_object * detections;    // of the tiles done, in image coordinates
+};
+
+// Overlapping tiles of size x size over the image, the last ones flush with its far edges. A smaller image is one tile
+void image_tiles(int width, int height, int size, int overlap, std::vector<cv::Rect> & tiles){
+    tiles.clear();
+
+    int stride = size - overlap;
+    for(int y = 0; ; y += stride){
+        int tile_y = std::max(0, std::min(y, height - size));
+        for(int x = 0; ; x += stride){
+            int tile_x = std::max(0, std::min(x, width - size));
+            tiles.push_back(cv::Rect(tile_x, tile_y, std::min(size, width), std::min(size, height)));
+
+            if(tile_x + size >= width)
+                break;
+        }
+
+        if(tile_y + size >= height)
+            break;
+    }
+}
+
+// Moves a detection of a tile to the coordinates of the image
+void shift_annotation(json_object * annotation, float dx, float dy){
+    const char * keys[] = {"bbox", "rbox", "poly"};
+
+    for(int k = 0; k < 3; k++){
+        json_object * array;
+        if(!json_object_object_get_ex(annotation, keys[k], &array))
+            continue;
+
+        // The position is the first pair of bbox and rbox, every pair of poly
+        int n = k < 2 ? 2 : json_object_array_length(array);
+        for(int i = 0; i < n && i < json_object_array_length(array); i++){
+            double value = json_object_get_double(json_object_array_get_idx(array, i));
+            json_object_array_put_idx(array, i, json_object_new_double(value + (i % 2 == 0 ? dx : dy)));
+        }
+    }
+}
+
+// Cross-tile nms of the detections of an image into merged. An object in the overlap of two tiles is found by both, the
+// best scoring box of it is kept. Rotated nms for the rbox of obb models
+void merge_tiles(json_object * detections, json_object * merged, int width, int height){
+    const float iou_threshold = 0.5;
+
+    thread_local std::vector<json_object *> annotations;
+    thread_local std::vector<cv::Rect2d> boxes;
+    thread_local std::vector<cv::RotatedRect> rotated_boxes;
+    thread_local std::vector<float> scores;
+    thread_local std::vector<int> nms_result;
+    thread_local std::vector<int> nms_order;
+
+    annotations.clear();
+    boxes.clear();
+    rotated_boxes.clear();
+    scores.clear();
+
+    bool rotated = false;
+    for(int i = 0; i < json_object_array_length(detections); i++){
+        json_object * annotation = json_object_array_get_idx(detections, i);
+        json_object * id;
+        json_object * score;
+        cv::RotatedRect box;
+        if(!annotation_box(annotation, box) || !json_object_object_get_ex(annotation, "category_id", &id) || !json_object_object_get_ex(annotation, "score", &score)){
+            json_object_array_add(merged, json_object_get(annotation));
+            continue;
+        }
+
+        rotated = rotated || json_object_object_get_ex(annotation, "rbox", NULL);
+
+        // Batched nms trick: the boxes of every category are moved away from the others
+        float offset = json_object_get_int(id) * (width + height);
+        box.center.x += offset;
+        box.center.y += offset;
+
+        annotations.push_back(annotation);
+        rotated_boxes.push_back(box);
+        boxes.push_back(cv::Rect2d(box.center.x - box.size.width / 2, box.center.y - box.size.height / 2, box.size.width, box.size.height));
+        scores.push_back(json_object_get_double(score));
+    }
+
+    if(rotated)
+        nms_rotated_boxes(rotated_boxes, scores, -1, iou_threshold, nms_result, 0, nms_order);
+    else
+        nms_boxes(boxes, scores, -1, iou_threshold, nms_result, 0, nms_order);
+
+    for(int i = 0; i < nms_result.size(); i++)
+        json_object_array_add(merged, json_object_get(annotations[nms_result[i]]));
+}
+
+// Detections of a batch waiting for the crop classifier, with the decoded images of their slots
+struct CropBatch {
+    std::vector<json_object *> annotations;
+    std::vector<std::vector<uint8_t>> rgbs;
+    std::vector<int> widths;
+    std::vector<int> heights;
+    int count;
+};
+
+// Second stage on the detections of a batch. The crops of all its slots go to the classifier together, and every
+// detection gets the class and score of its crop
+void classify_crops(tflite::Interpreter * interpreter, CropBatch * batch, json_object * json_annotations){
+    interpreter->ApplyThreadPlacement(pkshin::THREAD_ROLE_POST);
+
+    std::vector<pkshin::Crop> crops;
+    std::vector<json_object *> detections;
+    std::vector<int> classes;
+    std::vector<float> scores;
+
+    for(int i = 0; i < batch->count; i++){
+        for(int j = 0; j < json_object_array_length(batch->annotations[i]); j++){
+            json_object * annotation = json_object_array_get_idx(batch->annotations[i], j);
+            cv::RotatedRect box;
+            if(!annotation_box(annotation, box))
+                continue;
+
+            // An oriented box is cropped by its upright bounds
+            cv::Rect2f bounds = box.boundingRect2f();
+            crops.push_back({batch->rgbs[i].data(), batch->widths[i], batch->heights[i], bounds.x, bounds.y, bounds.width, bounds.height});
+            detections.push_back(annotation);
+        }
+    }
+
+    if(interpreter->ClassifyCrops(crops, classes, scores) != kTfLiteOk){
+        std::cerr << "ERROR: Crop classification failed\n";
+        exit(-1);
+    }
+
+    long classified = 0;
+    for(int k = 0; k < detections.size(); k++){
+        if(classes[k] < 0)
+            continue;
+
+        json_object_object_add(detections[k], "class_id", json_object_new_int(classes[k]));
+        json_object_object_add(detections[k], "class_score", json_object_new_double(scores[k]));
+        classified++;
+    }
+
+    in_postprocess_mutex.lock();
+    for(int i = 0; i < batch->count; i++){
+        for(int j = 0; j < json_object_array_length(batch->annotations[i]); j++)
+            json_object_array_add(json_annotations, json_object_get(json_object_array_get_idx(batch->annotations[i], j)));
+
+        json_object_put(batch->annotations[i]);
+        batch->annotations[i] = NULL;
+    }
+    num_classified += classified;
+    in_postprocess_mutex.unlock();
+}
+
 void infer(tflite::Interpreter * interpreter, int model_mode, char * directory_path, json_object * json_images, json_object * json_annotations, int batch_size){
+    interpreter->ApplyThreadPlacement(pkshin::THREAD_ROLE_WRITER);
+
     for(int i = 0; i < interpreter->inputs().size(); i++){
         // Get the input tensor size info
         TfLiteTensor* input_tensor_i = interpreter->input_tensor(i);
@@ -817,48 +1160,285 @@ void infer(tflite::Interpreter * interpreter, int model_mode, char * directory_p
 
     struct dirent * ent;
 
-    int thread_num = 4;
+    // The directory listing and the json results are not on the checked path
+    AllocStageScope writer_stage(ALLOC_STAGE_WRITER);
+
+    std::vector<int> img_heights(batch_size);
+    std::vector<int> img_widths(batch_size);
+    std::vector<int> image_ids(batch_size);
+    std::vector<std::string> filenames(batch_size);
+
+    // With streams, the images are dealt to them in turn like the frames of cameras, and wait in their backlog for a slot
+    int num_streams = interpreter->GetNumStreams();
+    std::vector<std::deque<std::pair<int, std::string>>> backlogs(num_streams);
+    int next_stream = 0;
+    bool listed = false;
+
+    // With the cascade, the detections stay per slot until the uncertain frames ran the larger model
+    bool cascade = interpreter->IsCascadeEnabled();
+    std::vector<json_object *> slot_annotations(batch_size, NULL);
+    std::vector<json_object *> cascade_annotations(batch_size, NULL);
+    std::vector<int> escalated;
+    std::vector<float> scores;
+
+    // With input shapes, the images are grouped per tightest shape and a batch runs the images of one shape. The
+    // bucket of an image is its shape + 1
+    bool shaped = interpreter->GetShapeStats().enabled && model_mode != 1;
+    std::vector<std::deque<std::pair<int, std::string>>> buckets(shaped ? 9 : 0);
+
+    // With tiling, the tiles of the images fill the slots. The detections of an image are merged once all its tiles ran
+    bool tiled = tile_size > 0;
+    std::deque<TiledImage> tiled_images;
+    std::vector<TiledImage *> slot_images(batch_size, NULL);
+    std::vector<cv::Rect> slot_tiles(batch_size);
+    std::vector<TiledImage *> decode_images;
+    std::vector<std::vector<uint8_t>> rgb_pool;
+
+    // With the crop classifier, the detections of a batch are classified on their own thread while the detector runs
+    // the next batch. The batches alternate between two sets of slot images
+    bool classify = interpreter->GetCropStats().enabled;
+    CropBatch crop_batches[2];
+    int crop_turn = 0;
+    std::thread classify_thread;
+    for(int i = 0; classify && i < 2; i++){
+        crop_batches[i].annotations.assign(batch_size, NULL);
+        crop_batches[i].rgbs.resize(batch_size);
+        crop_batches[i].widths.assign(batch_size, 0);
+        crop_batches[i].heights.assign(batch_size, 0);
+        crop_batches[i].count = 0;
+    }
 
     int image_id = 0;
+    int num_batches = 0;
     while(true){
         int cur_batch = 0;
-        std::vector<int> img_heights;
-        std::vector<int> img_widths;
-        std::vector<int> image_ids;
-        img_heights.resize(batch_size);
-        img_widths.resize(batch_size);
-        image_ids.resize(batch_size);
+
+        // The engine may tune the batch below the tensor batch size
+        int round_batch = interpreter->GetBatchSize();
+
+        // A replay paces the batches at the recorded arrivals and ends with the trace. The images are used again when they run out
+        int replay_batch = interpreter->NextReplayBatch();
+        if(replay_batch < 0)
+            break;
+        if(replay_batch > 0)
+            round_batch = std::min(replay_batch, round_batch);
+
+        // Count the allocations once the scratch buffers have grown over the warm-up batches
+        if(num_batches++ == ALLOC_CHECK_WARMUP_BATCHES)
+            alloc_check_arm();
+
+        if(!swap_file.empty() && num_batches == swap_after + 1)
+            interpreter->SwapModel(swap_file.c_str());
 
         preprocess_start = std::chrono::high_resolution_clock::now();
 
-        while(cur_batch < batch_size){
-            std::vector<std::thread> threads;
-            int cur_thread_num = 0;
-            while(cur_thread_num < thread_num && cur_batch + cur_thread_num < batch_size){
+        while(!shaped && !tiled && num_streams == 0 && cur_batch < round_batch){
+            ent = readdir(dir);
+
+            if(ent == NULL && replay_batch > 0 && image_id > 0){
+                rewinddir(dir);
+                continue;
+            }
+
+            if(ent == NULL)
+                break;
+
+            const char * filename = ent->d_name;               
+            if(strstr(filename, ".jpg")){
+                std::cout << "Detecting " << filename << "..\r";
+                std::cout.flush();
+                image_id++;
+                image_ids[cur_batch] = image_id;
+                filenames[cur_batch] = filename;
+                cur_batch++;
+            }
+        }
+
+        while(tiled && cur_batch < round_batch){
+            // The tiles left of the images in flight go first
+            TiledImage * image = NULL;
+            for(int i = 0; i < tiled_images.size() && image == NULL; i++){
+                if(tiled_images[i].next_tile < tiled_images[i].tiles.size())
+                    image = &tiled_images[i];
+            }
+
+            if(image == NULL){
                 ent = readdir(dir);
 
+                if(ent == NULL && replay_batch > 0 && image_id > 0){
+                    rewinddir(dir);
+                    continue;
+                }
+
                 if(ent == NULL)
                     break;
 
-                const char * filename = ent->d_name;               
-                if(strstr(filename, ".jpg")){
-                    std::cout << "Detecting " << filename << "..\r";
-                    std::cout.flush();
-                    image_id++;
-                    image_ids[cur_batch + cur_thread_num] = image_id;
-                    threads.push_back(std::thread(preprocess_thread, interpreter, model_mode, std::string(filename), json_images, cur_batch + cur_thread_num, std::ref(img_heights), std::ref(img_widths), image_id));
-                    cur_thread_num++;
+                if(!strstr(ent->d_name, ".jpg"))
+                    continue;
+
+                int width, height;
+                if(!jpeg_size(ent->d_name, width, height)){
+                    std::cerr << "ERROR: Cannot open the image: " << ent->d_name << std::endl;
+                    exit(-1);
                 }
+
+                std::cout << "Detecting " << ent->d_name << "..\r";
+                std::cout.flush();
+
+                image_id++;
+                tiled_images.emplace_back();
+                image = &tiled_images.back();
+                image->id = image_id;
+                image->filename = ent->d_name;
+                image->width = width;
+                image->height = height;
+                image->decoded = false;
+                if(!rgb_pool.empty()){
+                    image->rgb.swap(rgb_pool.back());
+                    rgb_pool.pop_back();
+                }
+                image_tiles(width, height, tile_size, tile_overlap, image->tiles);
+                image->next_tile = 0;
+                image->done_tiles = 0;
+                image->detections = json_object_new_array();
+                num_tiled_images++;
+                continue;
             }
 
-            for(int i = 0; i < cur_thread_num; i++){
-                threads[i].join();
+            slot_images[cur_batch] = image;
+            slot_tiles[cur_batch] = image->tiles[image->next_tile++];
+            image_ids[cur_batch] = image->id;
+            img_widths[cur_batch] = slot_tiles[cur_batch].width;
+            img_heights[cur_batch] = slot_tiles[cur_batch].height;
+            cur_batch++;
+        }
+
+        int batch_shape = -1;
+        while(shaped && cur_batch == 0){
+            // A full bucket goes first. Once the directory is done, the fullest one
+            int bucket = -1;
+            for(int i = 0; i < buckets.size() && bucket < 0; i++){
+                if(buckets[i].size() >= round_batch)
+                    bucket = i;
+            }
+            for(int i = 0; listed && i < buckets.size(); i++){
+                if(!buckets[i].empty() && (bucket < 0 || buckets[i].size() > buckets[bucket].size()))
+                    bucket = i;
             }
 
-            cur_batch += cur_thread_num;
+            if(bucket >= 0){
+                batch_shape = bucket - 1;
+                while(cur_batch < round_batch && !buckets[bucket].empty()){
+                    image_ids[cur_batch] = buckets[bucket].front().first;
+                    filenames[cur_batch] = buckets[bucket].front().second;
+                    buckets[bucket].pop_front();
 
-            if(ent == NULL)
+                    std::cout << "Detecting " << filenames[cur_batch] << "..\r";
+                    cur_batch++;
+                }
+                std::cout.flush();
+                break;
+            }
+
+            if(listed)
                 break;
+
+            ent = readdir(dir);
+
+            if(ent == NULL && replay_batch > 0 && image_id > 0){
+                rewinddir(dir);
+                continue;
+            }
+
+            if(ent == NULL){
+                listed = true;
+                continue;
+            }
+
+            if(strstr(ent->d_name, ".jpg")){
+                int width = 0, height = 0;
+                jpeg_size(ent->d_name, width, height);
+
+                image_id++;
+                buckets[interpreter->PickInputShape(width, height) + 1].push_back(std::make_pair(image_id, std::string(ent->d_name)));
+            }
+        }
+
+        // The batch is filled at the dims of its shape
+        if(shaped && interpreter->SetInputShape(batch_shape) != kTfLiteOk){
+            std::cerr << "ERROR: Cannot switch to the input shape " << batch_shape << std::endl;
+            exit(-1);
+        }
+
+        if(num_streams > 0){
+            // Every stream is kept a batch ahead, so the engine picks the share of each
+            while(!listed){
+                bool fed = true;
+                for(int i = 0; i < num_streams; i++)
+                    fed = fed && backlogs[i].size() >= round_batch;
+                if(fed)
+                    break;
+
+                ent = readdir(dir);
+                if(ent == NULL){
+                    listed = true;
+                    break;
+                }
+
+                if(strstr(ent->d_name, ".jpg")){
+                    image_id++;
+                    interpreter->EnqueueFrame(next_stream);
+                    backlogs[next_stream].push_back(std::make_pair(image_id, std::string(ent->d_name)));
+                    next_stream = (next_stream + 1) % num_streams;
+                }
+            }
+
+            cur_batch = interpreter->ScheduleBatch(round_batch);
+            for(int i = 0; i < cur_batch; i++){
+                std::deque<std::pair<int, std::string>> & backlog = backlogs[interpreter->GetSlotStream(i)];
+                image_ids[i] = backlog.front().first;
+                filenames[i] = backlog.front().second;
+                backlog.pop_front();
+
+                std::cout << "Detecting " << filenames[i] << "..\r";
+            }
+            std::cout.flush();
+        }
+
+        // Decode the batch on the shared cpu executor
+        auto preprocess = [&](int i){
+            preprocess_thread(interpreter, model_mode, filenames[i], json_images, i, img_heights, img_widths, image_ids[i], classify ? &crop_batches[crop_turn].rgbs[i] : NULL);
+        };
+
+        // A tiled image is decoded once, then every slot takes its tile of it
+        decode_images.clear();
+        for(int i = 0; tiled && i < tiled_images.size(); i++){
+            if(!tiled_images[i].decoded)
+                decode_images.push_back(&tiled_images[i]);
+        }
+
+        auto decode = [&](int i){
+            TiledImage * image = decode_images[i];
+            decode_image(image->filename, image->rgb, image->height, image->width);
+            write_json_image(json_images, image->id, image->filename, image->height, image->width);
+            image->decoded = true;
+        };
+
+        auto fill_tile = [&](int i){
+            TiledImage * image = slot_images[i];
+            cv::Mat cvImg(cv::Size(image->width, image->height), CV_8UC3, image->rgb.data());
+            fill_input(interpreter, model_mode, cvImg(slot_tiles[i]), i);
+        };
+
+        {
+            AllocStageScope engine_stage(ALLOC_STAGE_ENGINE);
+            if(tiled){
+                interpreter->ParallelFor(pkshin::THREAD_ROLE_PRE, decode_images.size(), decode);
+                interpreter->ParallelFor(pkshin::THREAD_ROLE_PRE, cur_batch, fill_tile);
+            }
+            else{
+                interpreter->ParallelFor(pkshin::THREAD_ROLE_PRE, cur_batch, preprocess);
+            }
         }
 
         if(cur_batch == 0)
@@ -866,32 +1446,133 @@ void infer(tflite::Interpreter * interpreter, int model_mode, char * directory_p
             
         invoke_start = std::chrono::high_resolution_clock::now();
 
-        // Invoke
-        if(interpreter->Invoke() != kTfLiteOk){
-            std::cerr << "ERROR: Model execute failed\n";
-            exit(-1);
-        }
+        for(int i = 0; (cascade || tiled || classify) && i < cur_batch; i++)
+            slot_annotations[i] = json_object_new_array();
 
-        int cur_thread_num = 0;
-        for(int i = 0; i < cur_batch; i += cur_thread_num){
-            std::vector<std::thread> threads;
-    
-            cur_thread_num = 0;
-            for(int j = 0; j < thread_num && i + j < cur_batch; j++){
-                threads.push_back(std::thread(postprocess_thread, interpreter, model_mode, std::ref(img_heights), std::ref(img_widths), std::ref(image_ids), json_annotations, i + j));
-                cur_thread_num++;
-            }
+        auto postprocess = [&](int i){
+            postprocess_thread(interpreter, model_mode, img_heights, img_widths, image_ids, (cascade || tiled || classify) ? slot_annotations[i] : json_annotations, i);
+            if(num_streams > 0 && !cascade)
+                interpreter->CompleteSlot(i);
+        };
+
+        {
+            AllocStageScope engine_stage(ALLOC_STAGE_ENGINE);
 
-            for(int j = 0; j < cur_thread_num; j++){
-                threads[j].join();
+            // Invoke
+            if(interpreter->Invoke() != kTfLiteOk){
+                std::cerr << "ERROR: Model execute failed\n";
+                exit(-1);
             }
+
+            interpreter->ParallelFor(pkshin::THREAD_ROLE_POST, cur_batch, postprocess);
         }
 
+        // The turnaround of the first stage, before the cascade dispatch replaces it
         max_turnaround += interpreter->GetMaxTurnAroundTime();
         sum_turnaround += interpreter->GetSumTurnAroundTime();
         num_turnaround++;
+
+        if(cascade){
+            escalated.clear();
+            for(int i = 0; i < cur_batch; i++){
+                annotation_scores(slot_annotations[i], scores);
+                if(interpreter->NeedsEscalation(scores))
+                    escalated.push_back(i);
+            }
+
+            auto cascade_postprocess = [&](int k){
+                int i = escalated[k];
+                cascade_annotations[i] = json_object_new_array();
+                postprocess_thread(interpreter, model_mode, img_heights, img_widths, image_ids, cascade_annotations[i], i);
+            };
+
+            if(!escalated.empty()){
+                AllocStageScope engine_stage(ALLOC_STAGE_ENGINE);
+
+                if(interpreter->InvokeCascade(escalated) != kTfLiteOk){
+                    std::cerr << "ERROR: Cascade execute failed\n";
+                    exit(-1);
+                }
+
+                interpreter->ParallelFor(pkshin::THREAD_ROLE_POST, escalated.size(), cascade_postprocess);
+            }
+
+            num_escalated += escalated.size();
+            num_cascade_frames += cur_batch;
+
+            for(int i = 0; i < cur_batch; i++){
+                if(cascade_annotations[i] != NULL){
+                    merge_cascade(slot_annotations[i], cascade_annotations[i], json_annotations);
+                    json_object_put(cascade_annotations[i]);
+                    cascade_annotations[i] = NULL;
+                }
+                else{
+                    for(int j = 0; j < json_object_array_length(slot_annotations[i]); j++)
+                        json_object_array_add(json_annotations, json_object_get(json_object_array_get_idx(slot_annotations[i], j)));
+                }
+
+                json_object_put(slot_annotations[i]);
+                slot_annotations[i] = NULL;
+
+                if(num_streams > 0)
+                    interpreter->CompleteSlot(i);
+            }
+        }
+
+        if(tiled){
+            for(int i = 0; i < cur_batch; i++){
+                TiledImage * image = slot_images[i];
+                for(int j = 0; j < json_object_array_length(slot_annotations[i]); j++){
+                    json_object * annotation = json_object_array_get_idx(slot_annotations[i], j);
+                    shift_annotation(annotation, slot_tiles[i].x, slot_tiles[i].y);
+                    json_object_array_add(image->detections, json_object_get(annotation));
+                }
+
+                json_object_put(slot_annotations[i]);
+                slot_annotations[i] = NULL;
+
+                image->done_tiles++;
+                num_tiles++;
+            }
+
+            // The images get their tiles in order, so they are done in order
+            while(!tiled_images.empty() && tiled_images.front().done_tiles == tiled_images.front().tiles.size()){
+                TiledImage & image = tiled_images.front();
+                merge_tiles(image.detections, json_annotations, image.width, image.height);
+                json_object_put(image.detections);
+
+                rgb_pool.push_back(std::vector<uint8_t>());
+                rgb_pool.back().swap(image.rgb);
+                tiled_images.pop_front();
+            }
+        }
+
+        if(classify){
+            CropBatch & crop_batch = crop_batches[crop_turn];
+            for(int i = 0; i < cur_batch; i++){
+                crop_batch.annotations[i] = slot_annotations[i];
+                crop_batch.widths[i] = img_widths[i];
+                crop_batch.heights[i] = img_heights[i];
+                slot_annotations[i] = NULL;
+            }
+            crop_batch.count = cur_batch;
+
+            // The batch before is done with the other set of images, the next batch decodes into it
+            if(classify_thread.joinable())
+                classify_thread.join();
+            classify_thread = std::thread(classify_crops, interpreter, &crop_batch, json_annotations);
+            crop_turn = 1 - crop_turn;
+        }
+
+        // The slots complete in any order. Each stream gets its results back in frame order
+        for(int i = 0; i < num_streams; i++){
+            while(interpreter->PopInOrder(i) >= 0);
+        }
     }
 
+    if(classify_thread.joinable())
+        classify_thread.join();
+
     closedir(dir);
 }
 
@@ -937,6 +1618,13 @@ bool run_image(tflite::Interpreter * interpreter, int model_mode, std::vector<st
     interpreter->SetSchedulerParams(perfs);
     interpreter->SetPostProcessParams(ori_score_thrs, new_score_thrs);
 
+    // Serves until the server socket fails
+    if(!serve_address.empty()){
+        interpreter->ServeRemote(serve_address.c_str());
+        chdir(current_dir);
+        return false;
+    }
+
     infer(interpreter, model_mode, directory_path, json_images, json_annotations, batch_size);
 
     auto application_elapsed = std::chrono::high_resolution_clock::now() - application_start;
@@ -949,6 +1637,80 @@ bool run_image(tflite::Interpreter * interpreter, int model_mode, std::vector<st
     std::cout << "Average turnaround + postprocess time:\t" << sum_postprocess_time / num_postprocess << " ms, Num postprocess: " << num_postprocess << "\n";
     std::cout << "Maximum Turnaround time:\t" << max_turnaround / num_turnaround << " ms, Num turnaroud: " << num_turnaround << "\n";
     std::cout << "Application latency:\t" << application_latency / 1000.0 << " s\n";
+
+    pkshin::RealtimeStats rt_stats = interpreter->GetRealtimeStats();
+    if(rt_stats.enabled)
+        std::cout << "Hot path page faults:\t" << rt_stats.minor_faults << " minor, " << rt_stats.major_faults << " major, involuntary context switches: " << rt_stats.involuntary_switches << "\n";
+
+    std::cout << "Final batch size:\t" << interpreter->GetBatchSize() << "\n";
+
+    pkshin::HedgeStats hedge_stats = interpreter->GetHedgeStats();
+    if(hedge_stats.enabled)
+        std::cout << "Hedged slots:\t" << hedge_stats.hedged << ", won by the hedge: " << hedge_stats.won << "\n";
+
+    pkshin::VariantStats variant_stats = interpreter->GetVariantStats();
+    if(variant_stats.enabled){
+        std::cout << "Variant switches:\t" << variant_stats.switches << ", slots per variant:";
+        for(int i = 0; i < 8; i++)
+            std::cout << " " << variant_stats.slots[i];
+        std::cout << "\n";
+    }
+
+    pkshin::AccuracyStats accuracy_stats = interpreter->GetAccuracyStats();
+    if(accuracy_stats.enabled)
+        std::cout << "Slot accuracy:\t" << accuracy_stats.mean_accuracy << " mean over " << accuracy_stats.slots << " slots, " << accuracy_stats.unmet << " below their minimum\n";
+
+    pkshin::GateStats gate_stats = interpreter->GetGateStats();
+    if(gate_stats.enabled)
+        std::cout << "Device gate:\t" << gate_stats.parks << " parks, " << gate_stats.wakes << " wakes, " << gate_stats.hot << " times over the hard temperature, hottest " << gate_stats.max_temp << " C\n";
+
+    pkshin::ShapeStats shape_stats = interpreter->GetShapeStats();
+    if(shape_stats.enabled){
+        std::cout << "Input shapes:\t" << shape_stats.full_batches << " batches at the model shape, batches per shape:";
+        for(int i = 0; i < 8; i++)
+            std::cout << " " << shape_stats.batches[i];
+        std::cout << ", " << shape_stats.pixels * 100 << "% of the input pixels\n";
+    }
+
+    if(tile_size > 0)
+        std::cout << "Tiled images:\t" << num_tiled_images << " in " << num_tiles << " tiles of " << tile_size << " pixels\n";
+
+    pkshin::SplitStats split_stats = interpreter->GetSplitStats();
+    if(split_stats.enabled)
+        std::cout << "Split heads:\t" << split_stats.slots << " slots, head mean " << split_stats.head_ms << " ms, backbone wait mean " << split_stats.wait_ms << " ms\n";
+
+    pkshin::RegistryStats registry_stats = interpreter->GetRegistryStats();
+    if(registry_stats.enabled)
+        std::cout << "Registry models:\t" << registry_stats.hits << " hits, " << registry_stats.misses << " misses, " << registry_stats.preloads << " preloads, " << registry_stats.evictions << " evictions, " << registry_stats.resident << " resident in " << registry_stats.resident_mb << " MB, load mean " << registry_stats.load_ms << " ms\n";
+
+    pkshin::CropStats crop_stats = interpreter->GetCropStats();
+    if(crop_stats.enabled)
+        std::cout << "Crop classifier:\t" << num_classified << " detections classified in " << crop_stats.batches << " batches, " << crop_stats.mean_batch << " crops per batch, batch mean " << crop_stats.batch_ms << " ms\n";
+
+    pkshin::SwapStats swap_stats = interpreter->GetSwapStats();
+    if(swap_stats.enabled)
+        std::cout << "Model versions:\t" << swap_stats.version << (swap_stats.loading ? " swaps, one loading, " : " swaps, ") << swap_stats.slots[0] << " tflite slots before the last at mean " << swap_stats.slot_ms[0] << " ms, " << swap_stats.slots[1] << " after at mean " << swap_stats.slot_ms[1] << " ms\n";
+
+    pkshin::RemoteStats remote_stats = interpreter->GetRemoteStats();
+    if(remote_stats.enabled)
+        std::cout << "Remote engine:\t" << remote_stats.slots << " slots, " << remote_stats.lost << " lost, " << (remote_stats.connected ? "connected" : "disconnected") << ", slot mean " << remote_stats.slot_ms << " ms, latency " << remote_stats.latency_ms << " ms, " << remote_stats.sent_mb << " MB sent, " << remote_stats.received_mb << " MB received\n";
+
+    if(interpreter->IsCascadeEnabled())
+        std::cout << "Escalated frames:\t" << num_escalated << " of " << num_cascade_frames << "\n";
+
+    for(int i = 0; i < interpreter->GetNumStreams(); i++){
+        pkshin::StreamStats stream_stats = interpreter->GetStreamStats(i);
+        std::cout << "Stream " << i << " (weight " << stream_stats.weight << "):\t" << stream_stats.frames << " frames, " << stream_stats.fps << " fps, latency mean " << stream_stats.mean_latency_ms << " ms, p95 " << stream_stats.p95_latency_ms << " ms\n";
+    }
+
+    pkshin::FaultStats fault_stats = interpreter->GetFaultStats();
+    if(fault_stats.enabled){
+        std::cout << "Device faults:\t" << fault_stats.errors << " errors, " << fault_stats.timeouts << " timeouts, " << fault_stats.quarantines << " quarantines\n";
+        std::cout << "Faulted slots:\t" << fault_stats.requeued << " requeued, " << fault_stats.dropped << " dropped\n";
+    }
+
+    bool alloc_success = alloc_check_report();
+
     std::cout << "pkshinresult " << sum_turnaround / num_preproces << " " << sum_preprocess_time / num_preproces << " " << sum_postprocess_time / num_postprocess << " " << max_turnaround / num_turnaround << " " << application_latency / 1000.0 << std::endl << std::endl;
 
     // Write json file
@@ -962,5 +1724,5 @@ bool run_image(tflite::Interpreter * interpreter, int model_mode, std::vector<st
 
     json_object_put(json_result);
 
-    return true;
+    return alloc_success;
 }
\ No newline at end of file
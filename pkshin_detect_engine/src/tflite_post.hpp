@@ -7,6 +7,8 @@
 
 #include <opencv2/opencv.hpp>
 
+#include "nms.hpp"
+
 
 #ifndef _DETRESULT_
 #define _DETRESULT_
@@ -195,9 +197,16 @@ static bool tflite_post(tflite::Interpreter * interpreter, int model_mode, std::
             float iou_threshold = 0.7;
             bool multi_label = true; // If true, nms is done per class. slow but accurate.
 
-            std::vector<int> class_ids;
-            std::vector<float> scores;
-            std::vector<cv::Rect2d> boxes;
+            // Scratch buffers of the post thread, reused across frames
+            thread_local std::vector<int> class_ids;
+            thread_local std::vector<float> scores;
+            thread_local std::vector<cv::Rect2d> boxes;
+            thread_local std::vector<cv::Rect2d> _boxes;
+            thread_local std::vector<int> nms_result;
+            thread_local std::vector<int> nms_order;
+            class_ids.clear();
+            scores.clear();
+            boxes.clear();
 
             for(int i = 0; i < output_width; i++){
                 float x = output_arr[0][i];
@@ -244,20 +253,19 @@ static bool tflite_post(tflite::Interpreter * interpreter, int model_mode, std::
                 }
             }
             
-            std::vector<int> nms_result;
             if(multi_label){
                 // Batched nms trick since batched nms function is only available opencv > 4.7.0
-                std::vector<cv::Rect2d> _boxes = boxes;
+                _boxes = boxes;
 
                 for(int i = 0; i < _boxes.size(); i++){
                     cv::Point2d offset(class_ids[i] * input_width, class_ids[i] * input_height);
                     _boxes[i] = _boxes[i] + offset;
                 }
 
-                cv::dnn::NMSBoxes(_boxes, scores, conf_threshold, iou_threshold, nms_result, 1.0, max_detections);
+                nms_boxes(_boxes, scores, conf_threshold, iou_threshold, nms_result, max_detections, nms_order);
             }
             else{
-                cv::dnn::NMSBoxes(boxes, scores, conf_threshold, iou_threshold, nms_result, 1.0, max_detections);
+                nms_boxes(boxes, scores, conf_threshold, iou_threshold, nms_result, max_detections, nms_order);
             }
 
             results.reserve(nms_result.size());
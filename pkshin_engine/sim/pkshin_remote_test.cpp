@@ -0,0 +1,267 @@
+#include <iostream>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+#include <unistd.h>
+
+#include "remote.hpp"
+#include "fault.hpp"
+
+// Self-test of the link to the engine of another board and of the fault injection. It runs on any host, without the
+// device libraries. A server thread stands in for the remote engine: every result is made from the inputs and the tag
+// of its request, so the client checks the framing of every slot. Three tags are special, the server fails the slot
+// of one, drops the connection on another and runs the last one into an injected stall.
+// Checked are the handshake, a mismatched layout, a pipelined window of requests, a failed slot, a lost connection
+// and the reconnect, a stall past the timeout of the client, the injected faults of the remote device and the
+// quarantine they lead to.
+
+static const uint32_t FAIL_TAG = 100;
+static const uint32_t DROP_TAG = 200;
+static const uint32_t STALL_TAG = 300;
+static const int WINDOW = 4;
+
+static int failures = 0;
+
+static void check(bool ok, const std::string & what){
+    std::cout << (ok ? "PASS: " : "FAIL: ") << what << "\n";
+    if(!ok)
+        failures++;
+}
+
+// Byte k of output j of a slot. The tflite part answers the even tags and the accelerator part the odd ones
+static uint8_t result_byte(uint32_t tag, int j, int k, const uint8_t * input){
+    return (uint8_t)(tag * 7 + j * 31 + k + input[k % 12]);
+}
+
+static int result_part(uint32_t tag){
+    return tag == FAIL_TAG ? pkshin::REMOTE_FAILED : tag % 2 == 0 ? pkshin::REMOTE_TFLITE : pkshin::REMOTE_ACCELERATOR;
+}
+
+static void fill_input(uint32_t tag, std::vector<std::vector<uint8_t>> & inputs){
+    for(int j = 0; j < inputs.size(); j++){
+        for(int k = 0; k < inputs[j].size(); k++)
+            inputs[j][k] = (uint8_t)(tag + j * 13 + k * 3);
+    }
+}
+
+static std::vector<std::vector<uint8_t>> slot_buffers(const std::vector<uint32_t> & bytes){
+    std::vector<std::vector<uint8_t>> buffers;
+    for(int j = 0; j < bytes.size(); j++)
+        buffers.push_back(std::vector<uint8_t>(bytes[j] > 0 ? bytes[j] : 1));
+
+    return buffers;
+}
+
+static std::vector<void *> slot_pointers(std::vector<std::vector<uint8_t>> & buffers){
+    std::vector<void *> pointers;
+    for(int j = 0; j < buffers.size(); j++)
+        pointers.push_back(buffers[j].data());
+
+    return pointers;
+}
+
+// Serves sessions clients, one after the other
+static void serve(pkshin::RemoteServer * server, const pkshin::RemoteLayout * layout, int sessions){
+    std::vector<std::vector<uint8_t>> inputs = slot_buffers(layout->input_bytes);
+    std::vector<std::vector<uint8_t>> outputs = slot_buffers(layout->output_bytes);
+    std::vector<void *> input_pointers = slot_pointers(inputs);
+    std::vector<void *> output_pointers = slot_pointers(outputs);
+
+    pkshin::FaultInjector stalls;
+    stalls.parse("remote=stall:1:300");
+
+    for(int session = 0; session < sessions; session++){
+        int fd = server->accept();
+        if(fd < 0)
+            return;
+
+        uint32_t tag;
+        while(pkshin::remote_read_request(fd, *layout, tag, input_pointers.data())){
+            if(tag == DROP_TAG)
+                break;
+            if(tag == STALL_TAG)
+                stalls.inject(pkshin::REMOTE_DEVICE);
+
+            for(int j = 0; j < outputs.size(); j++){
+                for(int k = 0; k < layout->output_bytes[j]; k++)
+                    outputs[j][k] = result_byte(tag, j, k, inputs[0].data());
+            }
+
+            if(!pkshin::remote_write_result(fd, *layout, tag, result_part(tag), output_pointers.data()))
+                break;
+        }
+
+        close(fd);
+    }
+}
+
+// Whether the result of tag came back in the outputs of its part, and only there
+static bool check_result(uint32_t tag, int part, const pkshin::RemoteLayout & layout, std::vector<std::vector<uint8_t>> & outputs){
+    if(part != result_part(tag))
+        return false;
+
+    std::vector<std::vector<uint8_t>> inputs = slot_buffers(layout.input_bytes);
+    fill_input(tag, inputs);
+
+    for(int j = 0; j < outputs.size(); j++){
+        bool in_part = part == pkshin::REMOTE_TFLITE ? j < layout.tflite_outputs : part == pkshin::REMOTE_ACCELERATOR && j >= layout.tflite_outputs;
+        for(int k = 0; k < layout.output_bytes[j]; k++){
+            uint8_t expected = in_part ? result_byte(tag, j, k, inputs[0].data()) : 0xaa;
+            if(outputs[j][k] != expected)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static void clear_outputs(std::vector<std::vector<uint8_t>> & outputs){
+    for(int j = 0; j < outputs.size(); j++)
+        memset(outputs[j].data(), 0xaa, outputs[j].size());
+}
+
+// The client end, like the feeder of the remote device. The link closes when it returns, which ends the session
+static void run_client(const std::string & address, const pkshin::RemoteLayout & layout){
+    {
+        pkshin::RemoteLayout other = layout;
+        other.output_bytes[1]++;
+
+        pkshin::RemoteLink link;
+        check(!link.connect(address.c_str(), other, WINDOW, 2000), "a client of another layout is turned away");
+    }
+
+    pkshin::RemoteLink link;
+    check(link.connect(address.c_str(), layout, WINDOW, 2000) && link.connected(), "a client of the same layout connects");
+
+    std::vector<std::vector<uint8_t>> inputs = slot_buffers(layout.input_bytes);
+    std::vector<std::vector<uint8_t>> outputs = slot_buffers(layout.output_bytes);
+    std::vector<void *> input_pointers = slot_pointers(inputs);
+    std::vector<void *> output_pointers = slot_pointers(outputs);
+
+    // Up to WINDOW requests ahead of the results, like run_remote_queue
+    const uint32_t num_tags = 3 * WINDOW;
+    uint32_t sent = 0, received = 0;
+    bool ok = true;
+    while(ok && received < num_tags){
+        while(ok && sent < num_tags && sent - received < WINDOW){
+            fill_input(sent + 1, inputs);
+            ok = link.send(sent + 1, input_pointers.data()) == pkshin::DEVICE_OK;
+            sent++;
+        }
+
+        int part;
+        clear_outputs(outputs);
+        ok = ok && link.receive(received + 1, part, output_pointers.data()) == pkshin::DEVICE_OK;
+        ok = ok && check_result(received + 1, part, layout, outputs);
+        received++;
+    }
+    check(ok, "pipelined requests come back in order, every slot with the outputs of its part");
+
+    int part = -1;
+    fill_input(FAIL_TAG, inputs);
+    ok = link.send(FAIL_TAG, input_pointers.data()) == pkshin::DEVICE_OK;
+    ok = ok && link.receive(FAIL_TAG, part, output_pointers.data()) == pkshin::DEVICE_OK && part == pkshin::REMOTE_FAILED;
+    check(ok && link.connected(), "a slot the remote engine failed keeps the connection");
+
+    fill_input(DROP_TAG, inputs);
+    link.send(DROP_TAG, input_pointers.data());
+    check(link.receive(DROP_TAG, part, output_pointers.data()) != pkshin::DEVICE_OK && !link.connected(), "a lost connection fails the receive and closes the link");
+
+    check(link.reconnect() && link.connected(), "the link reconnects");
+
+    fill_input(1, inputs);
+    clear_outputs(outputs);
+    ok = link.send(1, input_pointers.data()) == pkshin::DEVICE_OK;
+    ok = ok && link.receive(1, part, output_pointers.data()) == pkshin::DEVICE_OK && check_result(1, part, layout, outputs);
+    check(ok, "slots run again after the reconnect");
+}
+
+// A client with a timeout shorter than the stall the server runs into
+static void run_stalled_client(const std::string & address, const pkshin::RemoteLayout & layout){
+    pkshin::RemoteLink link;
+    check(link.connect(address.c_str(), layout, WINDOW, 100), "a client with a short timeout connects");
+
+    std::vector<std::vector<uint8_t>> inputs = slot_buffers(layout.input_bytes);
+    std::vector<std::vector<uint8_t>> outputs = slot_buffers(layout.output_bytes);
+    std::vector<void *> input_pointers = slot_pointers(inputs);
+    std::vector<void *> output_pointers = slot_pointers(outputs);
+
+    int part;
+    fill_input(STALL_TAG, inputs);
+    bool sent = link.send(STALL_TAG, input_pointers.data()) == pkshin::DEVICE_OK;
+    check(sent && link.receive(STALL_TAG, part, output_pointers.data()) == pkshin::DEVICE_TIMEOUT && !link.connected(), "a stalled remote engine times the receive out");
+}
+
+static void test_link(const std::string & address){
+    // An input of no bytes is one the remote engine does not need, it is left out of the requests
+    pkshin::RemoteLayout layout = {3, 1, {12, 0, 5}, {8, 6}};
+
+    pkshin::RemoteServer server;
+    if(!server.listen(address.c_str(), layout)){
+        check(false, "the server listens on " + address);
+        return;
+    }
+
+    // The turned away client does not count as a session
+    std::thread server_thread(serve, &server, &layout, 3);
+    run_client(address, layout);
+    run_stalled_client(address, layout);
+    server_thread.join();
+}
+
+static void test_faults(){
+    pkshin::FaultInjector invalid;
+    check(!invalid.parse("remote=error:2") && !invalid.parse("remote:error=1") && !invalid.parse("npu=error:1"), "invalid fault injection entries are rejected");
+
+    pkshin::FaultInjector errors;
+    check(errors.parse("remote=error:1"), "a fault injection entry parses");
+
+    bool ok = true;
+    for(int i = 0; i < 10; i++)
+        ok = ok && errors.inject(pkshin::REMOTE_DEVICE) == pkshin::DEVICE_ERROR && errors.inject(0) == pkshin::DEVICE_OK;
+    check(ok, "errors are injected on the remote device only");
+
+    pkshin::FaultInjector stalls;
+    stalls.parse("remote=stall:1:50");
+    auto start = std::chrono::steady_clock::now();
+    int fault = stalls.inject(pkshin::REMOTE_DEVICE);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    check(fault == pkshin::DEVICE_OK && ms >= 50, "a stall blocks the call for its ms");
+
+    // What the engine does with an injected fault: the device is quarantined until its backoff is over
+    pkshin::DeviceHealth health;
+    health.set_params(50, 100);
+    health.report_fault(pkshin::REMOTE_DEVICE, errors.inject(pkshin::REMOTE_DEVICE));
+    check(!health.usable(pkshin::REMOTE_DEVICE) && health.usable(0), "a faulted device is quarantined");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    check(health.usable(pkshin::REMOTE_DEVICE), "the device is probed again after its backoff");
+
+    health.report_ok(pkshin::REMOTE_DEVICE);
+    pkshin::FaultStats stats = health.stats();
+    check(health.usable(pkshin::REMOTE_DEVICE) && stats.errors == 1 && stats.quarantines == 1, "a successful probe brings the device back");
+}
+
+int main(int argc, char * argv[]){
+    if(argc > 2){
+        std::cerr << "Usage: pkshin_remote_test [unix:PATH or HOST:PORT]\n";
+        return -1;
+    }
+
+    std::string address = argc == 2 ? argv[1] : "unix:/tmp/pkshin_remote_test." + std::to_string(getpid());
+
+    test_link(address);
+    test_faults();
+
+    if(failures > 0){
+        std::cout << failures << " checks failed\n";
+        return -1;
+    }
+
+    std::cout << "All checks passed\n";
+
+    return 0;
+}
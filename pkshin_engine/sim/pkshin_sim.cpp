@@ -0,0 +1,411 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <deque>
+
+#include "partition.hpp"
+#include "trace.hpp"
+#include "fault.hpp"
+
+// Offline discrete-event simulator of the batch dispatch. Every device draws its per-slot service time from a
+// distribution, and the slots of a dispatch are placed by the policy under test. The greedy policy is the partition
+// of Interpreter::Invoke itself. Dispatches run back to back like the image app: the next one starts when every slot
+// of the previous one is done.
+
+// Per-slot service time of a device
+class ServiceTime {
+    public:
+    bool parse(const std::string & spec){
+        std::vector<std::string> fields;
+        size_t start = 0, end;
+        while((end = spec.find(':', start)) != std::string::npos){
+            fields.push_back(spec.substr(start, end - start));
+            start = end + 1;
+        }
+        fields.push_back(spec.substr(start));
+
+        if(fields.size() < 3)
+            return false;
+
+        name_ = fields[0];
+        kind_ = fields[1];
+
+        if(kind_ == "const" && fields.size() == 3){
+            a_ = atof(fields[2].c_str());
+            return a_ > 0;
+        }
+        else if((kind_ == "normal" || kind_ == "lognormal") && fields.size() == 4){
+            a_ = atof(fields[2].c_str());
+            b_ = atof(fields[3].c_str());
+            return a_ > 0 && b_ >= 0;
+        }
+        else if(kind_ == "samples" && fields.size() == 3){
+            // One service time in ms per line, e.g. recorded on the board. Lines starting with # are skipped
+            std::ifstream file(fields[2]);
+            std::string line;
+            while(std::getline(file, line)){
+                if(line.empty() || line[0] == '#')
+                    continue;
+                double ms = atof(line.c_str());
+                if(ms > 0)
+                    samples_.push_back(ms);
+            }
+
+            if(samples_.empty())
+                std::cerr << "ERROR: No samples in " << fields[2] << std::endl;
+
+            return !samples_.empty();
+        }
+        else if(kind_ == "trace" && fields.size() == 3){
+            // The runs of the device named like this one in a trace recorded by the engine
+            std::vector<pkshin::TraceRecord> records;
+            if(!pkshin::read_trace(fields[2].c_str(), records))
+                return false;
+
+            for(int i = 0; i < records.size(); i++){
+                if(records[i].device >= 0 && name_ == pkshin::device_name(records[i].device) && records[i].end_us > records[i].start_us)
+                    samples_.push_back((records[i].end_us - records[i].start_us) / 1000.0);
+            }
+
+            if(samples_.empty())
+                std::cerr << "ERROR: No runs of " << name_ << " in " << fields[2] << std::endl;
+
+            return !samples_.empty();
+        }
+
+        return false;
+    }
+
+    const std::string & name(){
+        return name_;
+    }
+
+    double mean(){
+        if(kind_ == "const" || kind_ == "normal")
+            return a_;
+        if(kind_ == "lognormal")
+            return a_ * exp(0.5 * b_ * b_);
+
+        double sum = 0;
+        for(int i = 0; i < samples_.size(); i++)
+            sum += samples_[i];
+        return sum / samples_.size();
+    }
+
+    double draw(std::mt19937 & rng){
+        if(kind_ == "const")
+            return a_;
+
+        if(kind_ == "normal")
+            return std::max(0.0, std::normal_distribution<double>(a_, b_)(rng));
+
+        if(kind_ == "lognormal")
+            return a_ * exp(std::normal_distribution<double>(0, b_)(rng));
+
+        return samples_[std::uniform_int_distribution<int>(0, samples_.size() - 1)(rng)];
+    }
+
+    private:
+    std::string name_;
+    std::string kind_;
+    double a_ = 0;
+    double b_ = 0;
+    std::vector<double> samples_;
+};
+
+struct SimResult {
+    double makespan_ms;
+    std::vector<double> turnarounds_ms;
+    std::vector<double> busy_ms;
+    long misses;
+};
+
+enum Policy {
+    POLICY_GREEDY = 0,    // static partition by the perfs, like Interpreter::Invoke
+    POLICY_STEAL = 1,     // greedy, and an idle device steals the last queued slot of another when it would end it sooner
+    POLICY_EDF = 2        // an idle device takes the slot with the earliest deadline
+};
+
+static const char * policy_names[] = {"greedy", "steal", "edf"};
+
+static void simulate(int policy, std::vector<ServiceTime> & devices, const std::vector<float> & perfs, int batch, int num_batches, const std::vector<double> & deadlines, std::mt19937 & rng, SimResult & result){
+    int num_devices = devices.size();
+
+    result.makespan_ms = 0;
+    result.turnarounds_ms.clear();
+    result.busy_ms.assign(num_devices, 0);
+    result.misses = 0;
+
+    std::vector<int> slot_devices(batch);
+    std::vector<int> counts(num_devices);
+    std::vector<double> device_free(num_devices);
+    std::vector<double> slot_deadlines(batch);
+    std::vector<bool> taken(batch);
+    std::vector<std::deque<int>> queues(num_devices);
+    std::vector<bool> retired(num_devices);
+
+    for(int b = 0; b < num_batches; b++){
+        double dispatch_start = result.makespan_ms;
+        double dispatch_end = dispatch_start;
+
+        for(int j = 0; j < num_devices; j++)
+            device_free[j] = dispatch_start;
+
+        // Slots of the streams in turn, each with the deadline of its stream
+        for(int i = 0; i < batch; i++)
+            slot_deadlines[i] = deadlines.empty() ? 0 : dispatch_start + deadlines[i % deadlines.size()];
+
+        auto run_slot = [&](int slot, int device){
+            double service_ms = devices[device].draw(rng);
+            device_free[device] += service_ms;
+            result.busy_ms[device] += service_ms;
+            result.turnarounds_ms.push_back(device_free[device] - dispatch_start);
+            if(!deadlines.empty() && device_free[device] > slot_deadlines[slot])
+                result.misses++;
+            dispatch_end = std::max(dispatch_end, device_free[device]);
+        };
+
+        if(policy == POLICY_GREEDY){
+            pkshin::partition_greedy(perfs.data(), num_devices, batch, slot_devices.data(), counts.data());
+            for(int i = 0; i < batch; i++)
+                run_slot(i, slot_devices[i]);
+        }
+        else if(policy == POLICY_STEAL){
+            pkshin::partition_greedy(perfs.data(), num_devices, batch, slot_devices.data(), counts.data());
+            for(int j = 0; j < num_devices; j++){
+                queues[j].clear();
+                retired[j] = false;
+            }
+            for(int i = 0; i < batch; i++)
+                queues[slot_devices[i]].push_back(i);
+
+            while(true){
+                // Next device to go idle
+                int device = -1;
+                for(int j = 0; j < num_devices; j++){
+                    if(!retired[j] && (device < 0 || device_free[j] < device_free[device]))
+                        device = j;
+                }
+                if(device < 0)
+                    break;
+
+                if(!queues[device].empty()){
+                    int slot = queues[device].front();
+                    queues[device].pop_front();
+                    run_slot(slot, device);
+                    continue;
+                }
+
+                // The victim expected to end last, judged by the perfs like the partition
+                int victim = -1;
+                double victim_end = 0;
+                for(int j = 0; j < num_devices; j++){
+                    double end = device_free[j] + perfs[j] * queues[j].size();
+                    if(!queues[j].empty() && end > victim_end){
+                        victim = j;
+                        victim_end = end;
+                    }
+                }
+
+                if(victim >= 0 && device_free[device] + perfs[device] < victim_end){
+                    int slot = queues[victim].back();
+                    queues[victim].pop_back();
+                    run_slot(slot, device);
+                }
+                else{
+                    retired[device] = true;
+                }
+            }
+        }
+        else{
+            taken.assign(batch, false);
+
+            for(int n = 0; n < batch; n++){
+                // Next device to go idle. Ties go to the faster device by the perfs
+                int device = 0;
+                for(int j = 1; j < num_devices; j++){
+                    if(device_free[j] < device_free[device] || (device_free[j] == device_free[device] && perfs[j] < perfs[device]))
+                        device = j;
+                }
+
+                int slot = -1;
+                for(int i = 0; i < batch; i++){
+                    if(!taken[i] && (slot < 0 || slot_deadlines[i] < slot_deadlines[slot]))
+                        slot = i;
+                }
+
+                taken[slot] = true;
+                run_slot(slot, device);
+            }
+        }
+
+        result.makespan_ms = dispatch_end;
+    }
+}
+
+static double percentile(std::vector<double> & values, double p){
+    if(values.empty())
+        return 0;
+
+    int index = std::min<int>(values.size() - 1, values.size() * p);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static bool parse_list(const std::string & str, std::vector<double> & values){
+    values.clear();
+
+    size_t start = 0;
+    while(start <= str.size()){
+        size_t end = str.find(',', start);
+        if(end == std::string::npos)
+            end = str.size();
+
+        char * parse_end;
+        std::string token = str.substr(start, end - start);
+        double value = strtod(token.c_str(), &parse_end);
+        if(token.empty() || *parse_end != '\0')
+            return false;
+
+        values.push_back(value);
+        start = end + 1;
+    }
+
+    return true;
+}
+
+static void usage(std::ostream & out){
+    out << "Usage: pkshin_sim --devices=NAME:DIST,.. [OPTIONS]\n";
+    out << "DIST is the per-slot service time in ms of the device: const:MS, normal:MEAN:STD, lognormal:MEDIAN:SIGMA or samples:FILE with one time per line, or trace:FILE with the runs of the device in a trace recorded by the engine.\n";
+    out << "--perfs=20,35,8 are the costs the greedy policy partitions with, the perfs of the app. Default is the mean of every device.\n";
+    out << "--policy=greedy,steal,edf picks the policies to compare. Default is all of them.\n";
+    out << "--batch=1,2,4,8 picks the batch sizes to compare. Default is 1,2,4,8.\n";
+    out << "--batches=1000 sets the number of dispatches per run. Default is 1000.\n";
+    out << "--deadlines=33,100 gives the slots the deadlines of the streams in turn, in ms from the dispatch, for edf and the miss rate.\n";
+    out << "--seed=1 seeds the service times. Every run starts from the same seed.\n\n";
+    out << "Example: pkshin_sim --devices=gpu:lognormal:22:0.2,hexagon:lognormal:30:0.1,maccel:const:9 --perfs=22,30,9\n";
+}
+
+int main(int argc, char * argv[]){
+    std::map<std::string, std::string> options;
+    for(int i = 1; i < argc; i++){
+        char * separator = strchr(argv[i], '=');
+        if(strncmp(argv[i], "--", 2) != 0 || separator == NULL){
+            usage(strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0 ? std::cout : std::cerr);
+            return strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0 ? 0 : -1;
+        }
+        options[std::string(argv[i] + 2, separator - argv[i] - 2)] = std::string(separator + 1);
+    }
+
+    if(!options.count("devices")){
+        usage(std::cerr);
+        return -1;
+    }
+
+    std::vector<ServiceTime> devices;
+    {
+        std::string specs = options["devices"];
+        size_t start = 0;
+        while(start <= specs.size()){
+            size_t end = specs.find(',', start);
+            if(end == std::string::npos)
+                end = specs.size();
+
+            ServiceTime device;
+            if(!device.parse(specs.substr(start, end - start))){
+                std::cerr << "ERROR: Invalid device: " << specs.substr(start, end - start) << std::endl;
+                return -1;
+            }
+            devices.push_back(device);
+            start = end + 1;
+        }
+    }
+
+    std::vector<double> values;
+    std::vector<float> perfs;
+    if(options.count("perfs")){
+        if(!parse_list(options["perfs"], values) || values.size() != devices.size()){
+            std::cerr << "ERROR: --perfs needs one cost per device\n";
+            return -1;
+        }
+        for(int i = 0; i < values.size(); i++)
+            perfs.push_back(values[i]);
+    }
+    else{
+        for(int i = 0; i < devices.size(); i++)
+            perfs.push_back(devices[i].mean());
+    }
+
+    std::vector<int> policies;
+    {
+        std::string names = options.count("policy") ? options["policy"] : "greedy,steal,edf";
+        for(int p = 0; p < 3; p++){
+            if(("," + names + ",").find(std::string(",") + policy_names[p] + ",") != std::string::npos)
+                policies.push_back(p);
+        }
+        if(policies.empty()){
+            std::cerr << "ERROR: Invalid policy: " << names << std::endl;
+            return -1;
+        }
+    }
+
+    std::vector<double> batches;
+    if(!parse_list(options.count("batch") ? options["batch"] : "1,2,4,8", batches)){
+        std::cerr << "ERROR: Invalid batch sizes: " << options["batch"] << std::endl;
+        return -1;
+    }
+
+    std::vector<double> deadlines;
+    if(options.count("deadlines") && !parse_list(options["deadlines"], deadlines)){
+        std::cerr << "ERROR: Invalid deadlines: " << options["deadlines"] << std::endl;
+        return -1;
+    }
+
+    int num_batches = options.count("batches") ? atoi(options["batches"].c_str()) : 1000;
+    unsigned seed = options.count("seed") ? atoi(options["seed"].c_str()) : 1;
+
+    std::cout << "Devices:";
+    for(int i = 0; i < devices.size(); i++)
+        std::cout << " " << devices[i].name() << " (mean " << devices[i].mean() << " ms, perf " << perfs[i] << ")";
+    std::cout << "\n\n";
+
+    std::cout << std::fixed;
+    std::cout.precision(2);
+
+    SimResult result;
+    for(int b = 0; b < batches.size(); b++){
+        int batch = batches[b];
+        if(batch <= 0){
+            std::cerr << "ERROR: The batch size must be positive\n";
+            return -1;
+        }
+
+        for(int p = 0; p < policies.size(); p++){
+            std::mt19937 rng(seed);
+            simulate(policies[p], devices, perfs, batch, num_batches, deadlines, rng, result);
+
+            long frames = result.turnarounds_ms.size();
+            double sum = 0;
+            for(int i = 0; i < frames; i++)
+                sum += result.turnarounds_ms[i];
+
+            std::cout << "batch " << batch << ", " << policy_names[policies[p]] << ":\tmakespan " << result.makespan_ms / 1000 << " s, " << frames * 1000 / result.makespan_ms << " fps";
+            std::cout << ", turnaround mean " << sum / frames << " p50 " << percentile(result.turnarounds_ms, 0.5) << " p95 " << percentile(result.turnarounds_ms, 0.95) << " p99 " << percentile(result.turnarounds_ms, 0.99) << " max " << percentile(result.turnarounds_ms, 1) << " ms";
+            if(!deadlines.empty())
+                std::cout << ", deadline misses " << 100.0 * result.misses / frames << "%";
+            std::cout << "\n\tutilization:";
+            for(int j = 0; j < devices.size(); j++)
+                std::cout << " " << devices[j].name() << " " << 100 * result.busy_ms[j] / result.makespan_ms << "%";
+            std::cout << "\n";
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include "arena.hpp"
+
+#include <iostream>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace pkshin{
+    static const size_t huge_page_size_ = 2 * 1024 * 1024;
+
+    TensorArena::TensorArena(size_t alignment) : offset_(0), alignment_(alignment), huge_pages_(false){
+
+    }
+
+    TensorArena::~TensorArena(){
+        release();
+    }
+
+    void TensorArena::set_huge_pages(bool huge_pages){
+        huge_pages_ = huge_pages;
+    }
+
+    bool TensorArena::is_huge_pages(){
+        return huge_pages_;
+    }
+
+    size_t TensorArena::aligned_size(size_t size){
+        return (size + alignment_ - 1) / alignment_ * alignment_;
+    }
+
+    bool TensorArena::map_block(size_t size){
+        size_t page_size = huge_pages_ ? huge_page_size_ : sysconf(_SC_PAGESIZE);
+        size = (size + page_size - 1) / page_size * page_size;
+
+        void * base = MAP_FAILED;
+
+        if(huge_pages_){
+            base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if(base == MAP_FAILED){
+                // No reserved huge pages. Fall back to transparent huge pages
+                base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if(base != MAP_FAILED)
+                    madvise(base, size, MADV_HUGEPAGE);
+            }
+        }
+        else{
+            base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        }
+
+        if(base == MAP_FAILED){
+            std::cerr << "ERROR: Failed to map tensor arena of " << size << " bytes\n";
+            return false;
+        }
+
+        blocks_.push_back({(char *) base, size});
+        offset_ = 0;
+
+        return true;
+    }
+
+    bool TensorArena::reserve(size_t size){
+        if(blocks_.size() == 1 && blocks_[0].size >= size){
+            offset_ = 0;
+            return true;
+        }
+
+        release();
+
+        return map_block(size);
+    }
+
+    void * TensorArena::allocate(size_t size){
+        size = aligned_size(size);
+
+        if(blocks_.empty() || offset_ + size > blocks_.back().size){
+            size_t block_size = blocks_.empty() ? size : blocks_.back().size * 2;
+            if(block_size < size)
+                block_size = size;
+
+            if(!map_block(block_size))
+                return NULL;
+        }
+
+        void * ptr = blocks_.back().base + offset_;
+        offset_ += size;
+
+        return ptr;
+    }
+
+    void TensorArena::release(){
+        for(int i = 0; i < blocks_.size(); i++)
+            munmap(blocks_[i].base, blocks_[i].size);
+
+        blocks_.clear();
+        offset_ = 0;
+    }
+
+    void TensorArena::prefault(){
+        // Write every page once so the hot path does not take the first-touch faults. The contents are kept
+        size_t page_size = sysconf(_SC_PAGESIZE);
+
+        for(int i = 0; i < blocks_.size(); i++){
+            volatile char * base = blocks_[i].base;
+            for(size_t offset = 0; offset < blocks_[i].size; offset += page_size)
+                base[offset] = base[offset];
+        }
+    }
+
+    size_t TensorArena::capacity(){
+        size_t size = 0;
+        for(int i = 0; i < blocks_.size(); i++)
+            size += blocks_[i].size;
+
+        return size;
+    }
+
+    size_t TensorArena::used(){
+        size_t size = offset_;
+        for(int i = 0; i + 1 < blocks_.size(); i++)
+            size += blocks_[i].size;
+
+        return size;
+    }
+}
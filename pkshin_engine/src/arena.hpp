@@ -0,0 +1,49 @@
+#ifndef _ARENA_HPP_
+#define _ARENA_HPP_
+
+#include <cstddef>
+#include <vector>
+
+namespace pkshin{
+    // Bump allocator over mmap blocks. Every allocation is aligned to the arena alignment (64 bytes by default).
+    // reserve() keeps one block and rewinds it, so the buffers can be laid out again without going back to the kernel.
+    class TensorArena {
+        public:
+        TensorArena(size_t alignment = 64);
+
+        ~TensorArena();
+
+        void set_huge_pages(bool huge_pages);
+
+        bool is_huge_pages();
+
+        bool reserve(size_t size);
+
+        void * allocate(size_t size);
+
+        void release();
+
+        void prefault();
+
+        size_t aligned_size(size_t size);
+
+        size_t capacity();
+
+        size_t used();
+
+        private:
+        struct Block {
+            char * base;
+            size_t size;
+        };
+
+        bool map_block(size_t size);
+
+        std::vector<Block> blocks_;
+        size_t offset_;
+        size_t alignment_;
+        bool huge_pages_;
+    };
+}
+
+#endif //_ARENA_HPP_
@@ -0,0 +1,269 @@
+#include "bundle.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace pkshin{
+    static const char * artifact_keys_[BUNDLE_KINDS] = {"tflite", "mxq", "hef"};
+    static const char * mode_names_[] = {"tflite", "maccel", "hailo", "tflite+maccel", "tflite+hailo"};
+
+    // Artifacts every mode needs
+    static const unsigned mode_artifacts_[] = {
+        1u << BUNDLE_TFLITE,
+        1u << BUNDLE_MXQ,
+        1u << BUNDLE_HEF,
+        (1u << BUNDLE_TFLITE) | (1u << BUNDLE_MXQ),
+        (1u << BUNDLE_TFLITE) | (1u << BUNDLE_HEF)
+    };
+
+    // 1x640x640x3
+    static bool parse_dims(const std::string & text, std::vector<int> & dims){
+        std::istringstream fields(text);
+        std::string dim;
+
+        dims.clear();
+        while(std::getline(fields, dim, 'x')){
+            char * end;
+            long value = strtol(dim.c_str(), &end, 10);
+            if(dim.empty() || *end != '\0' || value <= 0)
+                return false;
+            dims.push_back(value);
+        }
+
+        return !dims.empty();
+    }
+
+    ModelBundle::ModelBundle() : loaded_(false), mode_(-1), map_(NULL), map_size_(0){
+        for(int i = 0; i < BUNDLE_KINDS; i++)
+            artifacts_[i] = {false, "", false, 0, 0};
+    }
+
+    ModelBundle::~ModelBundle(){
+        unmap();
+    }
+
+    void ModelBundle::unmap(){
+        if(map_ != NULL){
+            munmap(map_, map_size_);
+            map_ = NULL;
+            map_size_ = 0;
+        }
+    }
+
+    bool ModelBundle::load(const char * path){
+        unmap();
+        loaded_ = false;
+
+        std::ifstream file(path);
+        if(!file.is_open()){
+            std::cerr << "ERROR: Cannot open the bundle: " << path << std::endl;
+            return false;
+        }
+
+        bundle_path_ = path;
+        std::string dir;
+        size_t slash = bundle_path_.rfind('/');
+        if(slash != std::string::npos)
+            dir = bundle_path_.substr(0, slash + 1);
+
+        mode_ = -1;
+        for(int i = 0; i < BUNDLE_KINDS; i++)
+            artifacts_[i] = {false, "", false, 0, 0};
+        family_.clear();
+        preprocess_.clear();
+        profile_.clear();
+        inputs_.clear();
+        outputs_.clear();
+
+        std::string line;
+        int line_number = 0;
+        bool header = false, ended = false;
+        while(!ended && std::getline(file, line)){
+            line_number++;
+            if(line.empty() || line[0] == '#')
+                continue;
+
+            std::istringstream fields(line);
+            std::string key, value;
+            fields >> key;
+
+            bool valid = true;
+            if(!header){
+                int version = 0;
+                valid = key == "pkbundle" && (fields >> version) && version == 1;
+                header = true;
+            }
+            else if(key == "end"){
+                ended = true;
+            }
+            else if(key == "mode"){
+                valid = (bool)(fields >> value);
+                for(int i = 0; valid && i < 5; i++){
+                    if(value == mode_names_[i])
+                        mode_ = i;
+                }
+                valid = valid && mode_ >= 0;
+            }
+            else if(key == "family" || key == "preprocess" || key == "profile"){
+                valid = (bool)(fields >> value);
+                if(key == "family")
+                    family_ = value;
+                else if(key == "preprocess")
+                    preprocess_ = value;
+                else
+                    profile_ = value[0] == '/' ? value : dir + value;
+            }
+            else if(key == "input" || key == "output"){
+                BundleTensor tensor;
+                std::string dims;
+                valid = (fields >> tensor.index >> tensor.type >> dims) && parse_dims(dims, tensor.dims);
+
+                tensor.quantized = (bool)(fields >> tensor.scale >> tensor.zero_point);
+                if(!tensor.quantized){
+                    tensor.scale = 0;
+                    tensor.zero_point = 0;
+                }
+
+                if(valid)
+                    (key == "input" ? inputs_ : outputs_).push_back(tensor);
+            }
+            else{
+                int kind = -1;
+                for(int i = 0; i < BUNDLE_KINDS; i++){
+                    if(key == artifact_keys_[i])
+                        kind = i;
+                }
+
+                valid = kind >= 0 && (fields >> value);
+                if(valid){
+                    Artifact & artifact = artifacts_[kind];
+                    artifact.present = true;
+
+                    // @offset:size of the bundle itself. Not for the mxq, the maccel runtime only loads it from its own file
+                    if(value[0] == '@' && kind == BUNDLE_MXQ){
+                        std::cerr << "ERROR: The mxq artifact of the bundle " << path << " cannot be embedded, give its path\n";
+                        return false;
+                    }
+
+                    if(value[0] == '@'){
+                        char * end;
+                        artifact.embedded = true;
+                        artifact.path = bundle_path_;
+                        artifact.offset = strtoull(value.c_str() + 1, &end, 10);
+                        valid = *end == ':';
+                        artifact.size = valid ? strtoull(end + 1, &end, 10) : 0;
+                        valid = valid && *end == '\0' && artifact.size > 0;
+                    }
+                    else{
+                        artifact.path = value[0] == '/' ? value : dir + value;
+                    }
+                }
+            }
+
+            if(!valid){
+                std::cerr << "ERROR: Invalid bundle " << path << " line " << line_number << ": " << line << std::endl;
+                return false;
+            }
+        }
+
+        if(!header || mode_ < 0){
+            std::cerr << "ERROR: The bundle " << path << " has no pkbundle header or no mode\n";
+            return false;
+        }
+
+        for(int i = 0; i < BUNDLE_KINDS; i++){
+            if((mode_artifacts_[mode_] & (1u << i)) && !artifacts_[i].present){
+                std::cerr << "ERROR: The " << mode_names_[mode_] << " bundle " << path << " has no " << artifact_keys_[i] << " artifact\n";
+                return false;
+            }
+        }
+
+        // One mapping for every embedded artifact. The pages are only read in when a device loads its artifact
+        bool embedded = false;
+        for(int i = 0; i < BUNDLE_KINDS; i++)
+            embedded = embedded || artifacts_[i].embedded;
+
+        if(embedded){
+            int fd = open(path, O_RDONLY);
+            struct stat st;
+            if(fd < 0 || fstat(fd, &st) != 0){
+                std::cerr << "ERROR: Cannot map the bundle: " << path << std::endl;
+                if(fd >= 0)
+                    close(fd);
+                return false;
+            }
+
+            map_size_ = st.st_size;
+            map_ = mmap(NULL, map_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if(map_ == MAP_FAILED){
+                map_ = NULL;
+                map_size_ = 0;
+                std::cerr << "ERROR: Cannot map the bundle: " << path << std::endl;
+                return false;
+            }
+
+            for(int i = 0; i < BUNDLE_KINDS; i++){
+                if(artifacts_[i].embedded && (artifacts_[i].offset > map_size_ || artifacts_[i].size > map_size_ - artifacts_[i].offset)){
+                    std::cerr << "ERROR: The " << artifact_keys_[i] << " artifact is past the end of the bundle " << path << std::endl;
+                    unmap();
+                    return false;
+                }
+            }
+        }
+
+        loaded_ = true;
+
+        return true;
+    }
+
+    bool ModelBundle::is_loaded(){
+        return loaded_;
+    }
+
+    int ModelBundle::mode(){
+        return mode_;
+    }
+
+    bool ModelBundle::has(int kind){
+        return artifacts_[kind].present;
+    }
+
+    const std::string & ModelBundle::path(int kind){
+        return artifacts_[kind].path;
+    }
+
+    const char * ModelBundle::data(int kind, size_t & size){
+        if(!artifacts_[kind].embedded || map_ == NULL)
+            return NULL;
+
+        size = artifacts_[kind].size;
+        return (const char *)map_ + artifacts_[kind].offset;
+    }
+
+    const std::string & ModelBundle::family(){
+        return family_;
+    }
+
+    const std::string & ModelBundle::preprocess(){
+        return preprocess_;
+    }
+
+    const std::string & ModelBundle::profile(){
+        return profile_;
+    }
+
+    const std::vector<BundleTensor> & ModelBundle::inputs(){
+        return inputs_;
+    }
+
+    const std::vector<BundleTensor> & ModelBundle::outputs(){
+        return outputs_;
+    }
+}
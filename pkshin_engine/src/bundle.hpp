@@ -0,0 +1,109 @@
+#ifndef _BUNDLE_HPP_
+#define _BUNDLE_HPP_
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace pkshin{
+    // Artifacts of a bundle, one per device family
+    enum BundleArtifactKind {
+        BUNDLE_TFLITE = 0,
+        BUNDLE_MXQ = 1,
+        BUNDLE_HEF = 2,
+        BUNDLE_KINDS = 3
+    };
+
+    // What the app takes from the bundle. The strings live as long as the engine
+    struct BundleInfo {
+        bool loaded;
+        const char * family;        // postprocessing family of the app, empty when the bundle gives none
+        const char * preprocess;    // preprocessing recipe of the app, empty when the bundle gives none
+    };
+
+    // A tensor the bundle declares, to check the one the engine gets from the artifact against
+    struct BundleTensor {
+        int index;
+        std::string type;           // name of the TfLiteType, e.g. uint8 or float32
+        std::vector<int> dims;
+        bool quantized;
+        float scale;
+        int zero_point;
+    };
+
+    // A model bundle: a text manifest with the artifacts of the devices and the metadata of the model, e.g.
+    //     pkbundle 1
+    //     mode tflite+hailo
+    //     tflite @4096:3276800
+    //     hef yolov8s.hef
+    //     family yolo
+    //     preprocess letterbox
+    //     input 0 uint8 1x640x640x3 0.00392157 0
+    //     output 0 float32 1x80x100x5
+    //     profile yolov8s.prof
+    //     end
+    // An artifact is a path relative to the bundle, or @offset:size of the bundle file itself. The embedded artifacts
+    // follow the manifest, and the file is mapped once for all of them. The mxq is always a path, maccel loads it from
+    // its own file. mode is the engine mode, family and preprocess are for the app, profile is the profile database of
+    // the model.
+    class ModelBundle {
+        public:
+        ModelBundle();
+
+        ~ModelBundle();
+
+        bool load(const char * path);
+
+        bool is_loaded();
+
+        // Engine mode, 0 for tflite to 4 for tflite+hailo
+        int mode();
+
+        bool has(int kind);
+
+        // A file artifact, or the bundle itself for an embedded one. Either way the file to hash for the model
+        const std::string & path(int kind);
+
+        // An embedded artifact in the mapped bundle, NULL for a file one
+        const char * data(int kind, size_t & size);
+
+        const std::string & family();
+
+        const std::string & preprocess();
+
+        // Path of the profile database, empty for none
+        const std::string & profile();
+
+        const std::vector<BundleTensor> & inputs();
+
+        const std::vector<BundleTensor> & outputs();
+
+        private:
+        struct Artifact {
+            bool present;
+            std::string path;
+            bool embedded;
+            size_t offset;
+            size_t size;
+        };
+
+        void unmap();
+
+        bool loaded_;
+        int mode_;
+        std::string bundle_path_;
+        Artifact artifacts_[BUNDLE_KINDS];
+        std::string family_;
+        std::string preprocess_;
+        std::string profile_;
+        std::vector<BundleTensor> inputs_;
+        std::vector<BundleTensor> outputs_;
+        void * map_;
+        size_t map_size_;
+    };
+
+    // Suffix of the bundle files
+    static const char BUNDLE_SUFFIX[] = ".pkbundle";
+}
+
+#endif //_BUNDLE_HPP_
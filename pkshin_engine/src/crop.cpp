@@ -0,0 +1,173 @@
+#include "crop.hpp"
+
+#include <iostream>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+
+namespace pkshin{
+    CropClassifier::CropClassifier() : registry_(NULL), max_batch_(1), batch_sum_ms_(0){
+        stats_ = {false, 0, 0, 0, 0};
+    }
+
+    bool CropClassifier::configure(ModelRegistry * registry, const char * id, int max_batch){
+        if(!registry->has(id)){
+            std::cerr << "ERROR: No registry model " << id << " for the crops\n";
+            return false;
+        }
+
+        if(max_batch <= 0){
+            std::cerr << "ERROR: The crops need a batch of 1 or more\n";
+            return false;
+        }
+
+        // Loaded now, so the first detections do not wait for it
+        ::tflite::Interpreter * interpreter = registry->acquire(id);
+        if(interpreter == NULL)
+            return false;
+
+        TfLiteTensor * input = interpreter->input_tensor(0);
+        TfLiteTensor * output = interpreter->output_tensor(0);
+        bool valid = interpreter->inputs().size() == 1 && input->dims->size == 4 && input->dims->data[3] == 3 && (input->type == kTfLiteUInt8 || input->type == kTfLiteFloat32);
+        valid = valid && output->dims->size == 2 && (output->type == kTfLiteUInt8 || output->type == kTfLiteFloat32);
+        registry->release(id);
+
+        if(!valid){
+            std::cerr << "ERROR: The crop classifier " << id << " needs one NHWC RGB input of uint8 or float and NxCLASSES scores\n";
+            return false;
+        }
+
+        registry_ = registry;
+        id_ = id;
+        max_batch_ = max_batch;
+
+        std::lock_guard<std::mutex> lk(mutex_);
+        stats_ = {true, 0, 0, 0, 0};
+        batch_sum_ms_ = 0;
+
+        return true;
+    }
+
+    bool CropClassifier::enabled(){
+        return registry_ != NULL;
+    }
+
+    bool CropClassifier::classify(const std::vector<Crop> & crops, std::vector<int> & classes, std::vector<float> & scores){
+        classes.assign(crops.size(), -1);
+        scores.assign(crops.size(), 0);
+        if(crops.empty())
+            return true;
+
+        // The model may have been dropped from the registry since, it is loaded again then
+        ::tflite::Interpreter * interpreter = registry_->acquire(id_.c_str());
+        if(interpreter == NULL)
+            return false;
+
+        bool ok = true;
+        for(int first = 0; ok && first < crops.size(); first += max_batch_){
+            int count = std::min(max_batch_, (int)crops.size() - first);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            ok = run_batch(interpreter, crops.data() + first, count, classes.data() + first, scores.data() + first);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lk(mutex_);
+            stats_.crops += count;
+            stats_.batches++;
+            batch_sum_ms_ += ms;
+            stats_.mean_batch = (double)stats_.crops / stats_.batches;
+            stats_.batch_ms = batch_sum_ms_ / stats_.batches;
+        }
+
+        registry_->release(id_.c_str());
+
+        return ok;
+    }
+
+    bool CropClassifier::run_batch(::tflite::Interpreter * interpreter, const Crop * crops, int count, int * classes, float * scores){
+        // A fixed batch, so the tensors are only allocated again when the registry loaded the model again
+        int batch = max_batch_;
+
+        TfLiteTensor * input = interpreter->input_tensor(0);
+        if(input->dims->data[0] != batch){
+            if(interpreter->ResizeInputTensor(interpreter->inputs()[0], {batch, input->dims->data[1], input->dims->data[2], 3}) != kTfLiteOk || interpreter->AllocateTensors() != kTfLiteOk){
+                std::cerr << "ERROR: Cannot resize the crop classifier to a batch of " << batch << std::endl;
+                return false;
+            }
+            input = interpreter->input_tensor(0);
+        }
+
+        int height = input->dims->data[1];
+        int width = input->dims->data[2];
+        size_t slot = (size_t)height * width * 3;
+
+        thread_local cv::Mat resized;
+        thread_local std::vector<bool> empty;
+        empty.assign(batch, true);
+        for(int k = 0; k < batch; k++){
+            cv::Rect box;
+            if(k < count){
+                const Crop & crop = crops[k];
+                box = cv::Rect(cv::Point(floorf(crop.x), floorf(crop.y)), cv::Point(ceilf(crop.x + crop.w), ceilf(crop.y + crop.h))) & cv::Rect(0, 0, crop.width, crop.height);
+            }
+
+            // The padding slots of the batch and the empty crops are zero
+            if(box.area() == 0){
+                if(input->type == kTfLiteUInt8)
+                    memset(input->data.uint8 + k * slot, 0, slot);
+                else
+                    memset(input->data.f + k * slot, 0, slot * sizeof(float));
+                continue;
+            }
+
+            empty[k] = false;
+            cv::Mat image(cv::Size(crops[k].width, crops[k].height), CV_8UC3, (void *)crops[k].rgb);
+            if(input->type == kTfLiteUInt8){
+                cv::Mat dst(cv::Size(width, height), CV_8UC3, input->data.uint8 + k * slot);
+                cv::resize(image(box), dst, dst.size());
+            }
+            else{
+                cv::resize(image(box), resized, cv::Size(width, height));
+                cv::Mat dst(cv::Size(width, height), CV_32FC3, input->data.f + k * slot);
+                resized.convertTo(dst, CV_32FC3, 1.0 / 255);
+            }
+        }
+
+        if(interpreter->Invoke() != kTfLiteOk){
+            std::cerr << "ERROR: Crop classifier execute failed\n";
+            return false;
+        }
+
+        TfLiteTensor * output = interpreter->output_tensor(0);
+        int num_classes = output->dims->data[1];
+        for(int k = 0; k < count; k++){
+            if(empty[k])
+                continue;
+
+            int best = 0;
+            float best_score;
+            if(output->type == kTfLiteUInt8){
+                const uint8_t * row = output->data.uint8 + k * num_classes;
+                best = std::max_element(row, row + num_classes) - row;
+                best_score = (row[best] - output->params.zero_point) * output->params.scale;
+            }
+            else{
+                const float * row = output->data.f + k * num_classes;
+                best = std::max_element(row, row + num_classes) - row;
+                best_score = row[best];
+            }
+
+            classes[k] = best;
+            scores[k] = best_score;
+        }
+
+        return true;
+    }
+
+    CropStats CropClassifier::stats(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return stats_;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef _CROP_HPP_
+#define _CROP_HPP_
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include "registry.hpp"
+
+namespace pkshin{
+    // A box of a decoded RGB image, in the pixels of the image
+    struct Crop {
+        const uint8_t * rgb;
+        int width;
+        int height;
+        float x;
+        float y;
+        float w;
+        float h;
+    };
+
+    // Crops run through the second stage classifier
+    struct CropStats {
+        bool enabled;
+        long crops;
+        long batches;          // classifier invokes, every one a batch of crops
+        double mean_batch;     // crops per batch
+        double batch_ms;       // average batch, crop and resize included
+    };
+
+    // Second stage of a detector: a classifier of the registry run on the crops of the detections. The crops are
+    // resized straight into the input tensor of the classifier, in batches of max_batch, the last one padded with
+    // zero slots. The input keeps that batch, so a steady stream of detections does not allocate the tensors again.
+    // The classifier runs on the cpu interpreter of the registry, not on the devices of the engine.
+    class CropClassifier {
+        public:
+        CropClassifier();
+
+        bool configure(ModelRegistry * registry, const char * id, int max_batch);
+
+        bool enabled();
+
+        // The class and score of every crop, -1 and 0 for an empty one
+        bool classify(const std::vector<Crop> & crops, std::vector<int> & classes, std::vector<float> & scores);
+
+        CropStats stats();
+
+        private:
+        bool run_batch(::tflite::Interpreter * interpreter, const Crop * crops, int count, int * classes, float * scores);
+
+        ModelRegistry * registry_;
+        std::string id_;
+        int max_batch_;
+
+        std::mutex mutex_;
+        CropStats stats_;
+        double batch_sum_ms_;
+    };
+}
+
+#endif //_CROP_HPP_
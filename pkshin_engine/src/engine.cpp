@@ -24,6 +24,65 @@ namespace pkshin{
 
         return std::move(network_groups->at(0));
     }
+
+    // The tflite part, from the mapped bundle when it is embedded there
+    std::unique_ptr<::tflite::FlatBufferModel> build_tflite_model(){
+        if(!swapped_file_.empty())
+            return ::tflite::FlatBufferModel::BuildFromFile(swapped_file_.c_str());
+
+        size_t size;
+        const char * data = model_bundle_.is_loaded() ? model_bundle_.data(BUNDLE_TFLITE, size) : NULL;
+        if(data != NULL)
+            return ::tflite::FlatBufferModel::BuildFromBuffer(data, size);
+
+        return ::tflite::FlatBufferModel::BuildFromFile(tflite_filename_);
+    }
+
+    hailort::Expected<hailort::Hef> create_hef(){
+        size_t size;
+        const char * data = model_bundle_.is_loaded() ? model_bundle_.data(BUNDLE_HEF, size) : NULL;
+        if(data != NULL)
+            return hailort::Hef::create(hailort::MemoryView((void *)data, size));
+
+        return hailort::Hef::create(filename_);
+    }
+
+    size_t tensor_type_size(TfLiteType type){
+        switch(type){
+            case kTfLiteUInt8:
+                return sizeof(uint8_t);
+            case kTfLiteUInt16:
+                return sizeof(uint16_t);
+            case kTfLiteFloat32:
+                return sizeof(float);
+            default:
+                return 0;
+        }
+    }
+
+    // Carve every input and output buffer out of one aligned arena. Called again on resize.
+    bool layout_tensor_arena(){
+        size_t size = 0;
+        for(int i = 0; i < input_bytes_.size(); i++)
+            size += tensor_arena_.aligned_size(input_bytes_[i]);
+        for(int i = 0; i < output_bytes_.size(); i++)
+            size += tensor_arena_.aligned_size(output_bytes_[i]);
+
+        if(!tensor_arena_.reserve(size))
+            return false;
+
+        for(int i = 0; i < input_bytes_.size(); i++)
+            input_datas_[i] = input_bytes_[i] > 0 ? tensor_arena_.allocate(input_bytes_[i]) : NULL;
+        for(int i = 0; i < output_bytes_.size(); i++)
+            output_datas_[i] = output_bytes_[i] > 0 ? tensor_arena_.allocate(output_bytes_[i]) : NULL;
+
+        if(prefault_arenas_){
+            tensor_arena_.prefault();
+            meta_arena_.prefault();
+        }
+
+        return true;
+    }
 }
 
 using namespace pkshin;
@@ -100,6 +159,32 @@ namespace tflite{
 
                 return std::make_unique<FlatBufferModel>();
             }
+            else if(strlen(BUNDLE_SUFFIX) <= len && strcmp(filename + len - strlen(BUNDLE_SUFFIX), BUNDLE_SUFFIX) == 0){
+                if(!model_bundle_.load(filename))
+                    return NULL;
+
+                // The paths of the artifacts, or of the bundle itself for the embedded ones, so the model hash covers them
+                mode_ = model_bundle_.mode();
+                if(model_bundle_.has(BUNDLE_TFLITE)){
+                    strncpy(tflite_filename_, model_bundle_.path(BUNDLE_TFLITE).c_str(), sizeof(tflite_filename_) - 1);
+                    if(mode_ == 0)
+                        strncpy(filename_, tflite_filename_, sizeof(filename_) - 1);
+                }
+                if(mode_ == 1 || mode_ == 3)
+                    strncpy(filename_, model_bundle_.path(BUNDLE_MXQ).c_str(), sizeof(filename_) - 1);
+                if(mode_ == 2 || mode_ == 4)
+                    strncpy(filename_, model_bundle_.path(BUNDLE_HEF).c_str(), sizeof(filename_) - 1);
+
+                std::cout << "INFO: Model bundle detected, mode " << mode_ << (model_bundle_.family().empty() ? "" : ", family ") << model_bundle_.family() << "\n";
+
+                if(mode_ == 0){
+                    std::unique_ptr<::tflite::FlatBufferModel> oldTypeFlatBufferModel = build_tflite_model();
+
+                    return static_unique_pointer_cast<FlatBufferModel, ::tflite::FlatBufferModel>(std::move(oldTypeFlatBufferModel));
+                }
+
+                return std::make_unique<FlatBufferModel>();
+            }
             else{
                 std::cerr << "ERROR: model file is invalid\n";
                 return NULL;
@@ -123,13 +208,97 @@ namespace tflite{
     }
 
     namespace pkshin{
+        void Init_gpu_interpreter();
+        void Release_gpu_interpreter();
         void Invoke_gpu_queue();
         void Invoke_hexagon_queue();
         void Invoke_maccel_queue();
         void Invoke_hailo_queue();
         void Invoke_hailo_queue2();
         void Invoke_hailo_queue3();
+        void Invoke_remote_queue();
         void Invoke_thread();
+        void run_device_queue(int device, std::vector<int> & queue);
+        bool slot_tracking();
+        bool accuracy_scheduling();
+        bool device_available(int device);
+        int partition_device(int j);
+        bool build_tflite_variant(const char * filename, int device, TfliteVariant & variant, int width = 0, int height = 0);
+        void release_tflite_variant(TfliteVariant & variant);
+        int slot_size(TfLiteIntArray * dims);
+        void apply_input_shape(int shape);
+        void tflite_io_sizes(int & input_size, int & output_size);
+        void save_cascade_slots(const std::vector<int> & slots, int tflite_input_size, int tflite_output_size);
+        void restore_cascade_slots(const std::vector<int> & slots, bool escalated, int tflite_input_size, int tflite_output_size);
+        bool build_split_head(SplitManifest & split, int device);
+        void release_split();
+        void run_split_head(int device, int slot, std::chrono::high_resolution_clock::time_point start);
+        void load_swap();
+        RemoteLayout remote_layout();
+        void serve_remote_client(Interpreter * interpreter, int fd, RemoteLayout layout);
+        void run_remote_queue(std::vector<int> & queue);
+        float remote_cost();
+
+        FeederThread * device_feeder(int device){
+            switch(device){
+                case 0:
+                    return &gpu_feeder_;
+                case 1:
+                    return &hexagon_feeder_;
+                case 2:
+                    return &maccel_feeder_;
+                case 3:
+                    return &hailo_feeder_;
+                case 4:
+                    return &hailo_feeder2_;
+                case 5:
+                    return &hailo_feeder3_;
+                default:
+                    return &remote_feeder_;
+            }
+        }
+
+        std::vector<int> & device_queue(int device){
+            switch(device){
+                case 0:
+                    return gpu_queue_;
+                case 1:
+                    return hexagon_queue_;
+                case 2:
+                    return maccel_queue_;
+                case 3:
+                    return hailo_queue_;
+                case 4:
+                    return hailo_queue2_;
+                case 5:
+                    return hailo_queue3_;
+                default:
+                    return remote_queue_;
+            }
+        }
+
+        // Warns about the tensors of the artifacts that differ from the ones the bundle declares
+        void check_bundle_tensors(const char * kind, const std::vector<BundleTensor> & declared, const std::vector<TfLiteTensor *> & tensors){
+            for(int i = 0; i < declared.size(); i++){
+                const BundleTensor & bundle_tensor = declared[i];
+                if(bundle_tensor.index < 0 || bundle_tensor.index >= tensors.size()){
+                    std::cout << "WARNING: The bundle declares " << kind << " " << bundle_tensor.index << ", the model has " << tensors.size() << "\n";
+                    continue;
+                }
+
+                TfLiteTensor * tensor = tensors[bundle_tensor.index];
+                bool match = strcasecmp(bundle_tensor.type.c_str(), TfLiteTypeGetName(tensor->type)) == 0 && bundle_tensor.dims.size() == tensor->dims->size;
+                for(int j = 0; match && j < bundle_tensor.dims.size(); j++){
+                    // The batch follows the engine
+                    match = j == 0 || bundle_tensor.dims[j] == tensor->dims->data[j];
+                }
+                if(match && bundle_tensor.quantized)
+                    match = bundle_tensor.zero_point == tensor->params.zero_point && fabs(bundle_tensor.scale - tensor->params.scale) <= 1e-6 * fabs(bundle_tensor.scale);
+
+                if(!match)
+                    std::cout << "WARNING: The " << kind << " " << bundle_tensor.index << " of the model differs from the bundle. The model is used\n";
+            }
+        }
 
         Interpreter::Interpreter(::tflite::ErrorReporter* error_reporter) : ::tflite::Interpreter(error_reporter){
             //std::cout << "Interpreter Constructor\n";
@@ -191,7 +360,7 @@ namespace tflite{
                         exit(-1);
                     }
                     
-                    static auto hef = hailort::Hef::create(filename_);
+                    static auto hef = create_hef();
                     if (!hef) {
                         std::cerr << "ERROR: Failed to create hef: " << filename_ << ", status = " << hef.status() << std::endl;
                         exit(-1);
@@ -228,7 +397,7 @@ namespace tflite{
                         exit(-1);
                     }
                     
-                    static auto hef = hailort::Hef::create(filename_);
+                    static auto hef = create_hef();
                     if (!hef) {
                         std::cerr << "ERROR: Failed to create hef: " << filename_ << ", status = " << hef.status() << std::endl;
                         exit(-1);
@@ -296,13 +465,19 @@ namespace tflite{
                 case 3:
                 case 4:
                 {
-                    gpu_thread_ = std::thread(Invoke_gpu_queue);
-
-                    std::unique_lock<std::mutex> lk(gpu_thread_mutex_);
-                    gpu_thread_set_cv_.wait(lk);
-                    gpu_thread_mutex_.unlock();
-
-                    static std::unique_ptr<::tflite::FlatBufferModel> model = ::tflite::FlatBufferModel::BuildFromFile(tflite_filename_);
+                    // The gpu interpreter is built on its feeder thread, and start() returns once it is ready
+                    gpu_feeder_.start(Invoke_gpu_queue, Init_gpu_interpreter, Release_gpu_interpreter);
+
+                    // The other feeders and the dispatcher also live as long as the interpreter, so Invoke does not create threads
+                    invoke_feeder_.start(Invoke_thread);
+                    hexagon_feeder_.start(Invoke_hexagon_queue);
+                    maccel_feeder_.start(Invoke_maccel_queue);
+                    hailo_feeder_.start(Invoke_hailo_queue);
+                    hailo_feeder2_.start(Invoke_hailo_queue2);
+                    hailo_feeder3_.start(Invoke_hailo_queue3);
+                    remote_feeder_.start(Invoke_remote_queue);
+
+                    static std::unique_ptr<::tflite::FlatBufferModel> model = build_tflite_model();
                     if(model == NULL){
                         std::cerr << "ERROR: Model load failed. Check the model name.\n";
                         exit(-1);
@@ -339,7 +514,11 @@ namespace tflite{
                                 exit(-1);
                             }
                             
-                            hexagonInterpreter_ = interpreter.release();
+                            // Owned like a swapped in model, so the first swap frees it
+                            hexagon_live_.model = std::move(model);
+                            hexagon_live_.delegate = std::move(npu_delegate);
+                            hexagon_live_.interpreter = std::move(interpreter);
+                            hexagonInterpreter_ = hexagon_live_.interpreter.get();
                         }
                     }
 
@@ -369,16 +548,18 @@ namespace tflite{
                     input_dims_.resize(input_size);
                     input_tensors_.resize(input_size);
                     input_datas_.resize(input_size);
+                    input_bytes_.resize(input_size);
                     input_names_.resize(input_size);
                     output_dims_.resize(output_size);
                     output_tensors_.resize(output_size);
                     output_datas_.resize(output_size);
+                    output_bytes_.resize(output_size);
                     output_names_.resize(output_size);
 
                     for(int i = 0; i < input_size; i++){
                         auto input_shape_info = mobilintModel_->getModelInputShape()[i];
 
-                        input_dims_[i] = (TfLiteIntArray *) malloc(sizeof(int) * 5);
+                        input_dims_[i] = (TfLiteIntArray *) meta_arena_.allocate(sizeof(int) * 5);
 
                         if(input_shape_info[0] == 0){
                             input_dims_[i]->size = 0;
@@ -388,7 +569,7 @@ namespace tflite{
                             input_dims_[i]->data[0] = 1;
                             input_dims_[i]->data[1] = input_shape_info[0];
 
-                            input_datas_[i] = malloc(sizeof(float) * input_shape_info[0]);
+                            input_bytes_[i] = sizeof(float) * input_shape_info[0];
                         }
                         else if(input_shape_info[2] == 0){
                             input_dims_[i]->size = 3;
@@ -396,7 +577,7 @@ namespace tflite{
                             input_dims_[i]->data[1] = input_shape_info[0];
                             input_dims_[i]->data[2] = input_shape_info[1];
 
-                            input_datas_[i] = malloc(sizeof(float) * input_shape_info[0] * input_shape_info[1]);
+                            input_bytes_[i] = sizeof(float) * input_shape_info[0] * input_shape_info[1];
                         }
                         else{
                             input_dims_[i]->size = 4;
@@ -405,21 +586,21 @@ namespace tflite{
                             input_dims_[i]->data[2] = input_shape_info[1];
                             input_dims_[i]->data[3] = input_shape_info[2];
 
-                            input_datas_[i] = malloc(sizeof(float) * input_shape_info[0] * input_shape_info[1] * input_shape_info[2]);
+                            input_bytes_[i] = sizeof(float) * input_shape_info[0] * input_shape_info[1] * input_shape_info[2];
                         }
 
-                        input_tensors_[i] = (TfLiteTensor *) malloc(sizeof(TfLiteTensor));
+                        input_tensors_[i] = (TfLiteTensor *) meta_arena_.allocate(sizeof(TfLiteTensor));
 
                         input_tensors_[i]->dims = input_dims_[i];
                         input_tensors_[i]->type = kTfLiteFloat32;
-                        input_names_[i] = (char *) malloc(sizeof(char) * 2);
+                        input_names_[i] = (char *) meta_arena_.allocate(sizeof(char) * 2);
                         strcpy(input_names_[i], " ");
                     }
 
                     for(int i = 0; i < output_size; i++){
                         auto output_shape_info = mobilintModel_->getModelOutputShape()[i];
 
-                        output_dims_[i] = (TfLiteIntArray *) malloc(sizeof(int) * 5);
+                        output_dims_[i] = (TfLiteIntArray *) meta_arena_.allocate(sizeof(int) * 5);
 
                         if(output_shape_info[0] == 0){
                             output_dims_[i]->size = 0;
@@ -429,7 +610,7 @@ namespace tflite{
                             output_dims_[i]->data[0] = 1;
                             output_dims_[i]->data[1] = output_shape_info[0];
 
-                            output_datas_[i] = malloc(sizeof(float) * output_shape_info[0]);
+                            output_bytes_[i] = sizeof(float) * output_shape_info[0];
                         }
                         else if(output_shape_info[2] == 0){
                             output_dims_[i]->size = 3;
@@ -437,7 +618,7 @@ namespace tflite{
                             output_dims_[i]->data[1] = output_shape_info[0];
                             output_dims_[i]->data[2] = output_shape_info[1];
 
-                            output_datas_[i] = malloc(sizeof(float) * output_shape_info[0] * output_shape_info[1]);
+                            output_bytes_[i] = sizeof(float) * output_shape_info[0] * output_shape_info[1];
                         }
                         else{
                             output_dims_[i]->size = 4;
@@ -446,14 +627,14 @@ namespace tflite{
                             output_dims_[i]->data[2] = output_shape_info[1];
                             output_dims_[i]->data[3] = output_shape_info[2];
 
-                            output_datas_[i] = malloc(sizeof(float) * output_shape_info[0] * output_shape_info[1] * output_shape_info[2]);
+                            output_bytes_[i] = sizeof(float) * output_shape_info[0] * output_shape_info[1] * output_shape_info[2];
                         }
 
-                        output_tensors_[i] = (TfLiteTensor *) malloc(sizeof(TfLiteTensor));
+                        output_tensors_[i] = (TfLiteTensor *) meta_arena_.allocate(sizeof(TfLiteTensor));
 
                         output_tensors_[i]->dims = output_dims_[i];
                         output_tensors_[i]->type = kTfLiteFloat32;
-                        output_names_[i] = (char *) malloc(sizeof(char) * 2);
+                        output_names_[i] = (char *) meta_arena_.allocate(sizeof(char) * 2);
                         strcpy(output_names_[i], " ");
                     }
 
@@ -470,10 +651,12 @@ namespace tflite{
                     input_dims_.resize(input_size);
                     input_tensors_.resize(input_size);
                     input_datas_.resize(input_size);
+                    input_bytes_.resize(input_size);
                     input_names_.resize(input_size);
                     output_dims_.resize(output_size);
                     output_tensors_.resize(output_size);
                     output_datas_.resize(output_size);
+                    output_bytes_.resize(output_size);
                     output_names_.resize(output_size);
 
                     for(int i = 0; i < input_size; i++){
@@ -484,7 +667,7 @@ namespace tflite{
                         auto quant_info = input_info.quant_info;
                         auto name = input_info.name;
 
-                        input_dims_[i] = (TfLiteIntArray *) malloc(sizeof(int) * 5);
+                        input_dims_[i] = (TfLiteIntArray *) meta_arena_.allocate(sizeof(int) * 5);
 
                         if(shape.height == 0){
                             input_dims_[i]->size = 0;
@@ -508,7 +691,7 @@ namespace tflite{
                             input_dims_[i]->data[3] = frame_size / shape.height / shape.width;
                         }
 
-                        input_tensors_[i] = (TfLiteTensor *) malloc(sizeof(TfLiteTensor));
+                        input_tensors_[i] = (TfLiteTensor *) meta_arena_.allocate(sizeof(TfLiteTensor));
 
                         input_tensors_[i]->dims = input_dims_[i];
 
@@ -528,7 +711,7 @@ namespace tflite{
                                 for(int j = 0; j < input_dims_[i]->size; j++)
                                     size *= input_dims_[i]->data[j];
 
-                                input_datas_[i] = malloc(sizeof(uint8_t) * size);
+                                input_bytes_[i] = sizeof(uint8_t) * size;
                                 break;
                             }
                             case HAILO_FORMAT_TYPE_UINT16:
@@ -541,7 +724,7 @@ namespace tflite{
                                 for(int j = 0; j < input_dims_[i]->size; j++)
                                     size *= input_dims_[i]->data[j];
 
-                                input_datas_[i] = malloc(sizeof(uint16_t) * size);
+                                input_bytes_[i] = sizeof(uint16_t) * size;
                                 break;
                             }
                             case HAILO_FORMAT_TYPE_FLOAT32:
@@ -554,7 +737,7 @@ namespace tflite{
                                 for(int j = 0; j < input_dims_[i]->size; j++)
                                     size *= input_dims_[i]->data[j];
 
-                                input_datas_[i] = malloc(sizeof(float32_t) * size);
+                                input_bytes_[i] = sizeof(float32_t) * size;
                                 break;
                             }
                         }
@@ -564,8 +747,8 @@ namespace tflite{
                         params.scale = quant_info.qp_scale;
                         input_tensors_[i]->params = params;
 
-                        input_names_[i] = (char *) malloc(sizeof(char) * strlen(name));
-                        strncpy(input_names_[i], name, strlen(name));
+                        input_names_[i] = (char *) meta_arena_.allocate(strlen(name) + 1);
+                        strcpy(input_names_[i], name);
                         input_tensors_[i]->name = input_names_[i];
                     }
 
@@ -577,7 +760,7 @@ namespace tflite{
                         auto quant_info = output_info.quant_info;
                         auto name = output_info.name;
 
-                        output_dims_[i] = (TfLiteIntArray *) malloc(sizeof(int) * 5);
+                        output_dims_[i] = (TfLiteIntArray *) meta_arena_.allocate(sizeof(int) * 5);
 
                         if(shape.height == 0){
                             output_dims_[i]->size = 0;
@@ -601,7 +784,7 @@ namespace tflite{
                             output_dims_[i]->data[3] = frame_size / shape.height / shape.width;
                         }
 
-                        output_tensors_[i] = (TfLiteTensor *) malloc(sizeof(TfLiteTensor));
+                        output_tensors_[i] = (TfLiteTensor *) meta_arena_.allocate(sizeof(TfLiteTensor));
 
                         output_tensors_[i]->dims = output_dims_[i];
 
@@ -621,7 +804,7 @@ namespace tflite{
                                 for(int j = 0; j < output_dims_[i]->size; j++)
                                     size *= output_dims_[i]->data[j];
 
-                                output_datas_[i] = malloc(sizeof(uint8_t) * size);
+                                output_bytes_[i] = sizeof(uint8_t) * size;
                                 break;
                             }
                             case HAILO_FORMAT_TYPE_UINT16:
@@ -634,7 +817,7 @@ namespace tflite{
                                 for(int j = 0; j < output_dims_[i]->size; j++)
                                     size *= output_dims_[i]->data[j];
 
-                                output_datas_[i] = malloc(sizeof(uint16_t) * size);
+                                output_bytes_[i] = sizeof(uint16_t) * size;
                                 break;
                             }
                             case HAILO_FORMAT_TYPE_FLOAT32:
@@ -647,7 +830,7 @@ namespace tflite{
                                 for(int j = 0; j < output_dims_[i]->size; j++)
                                     size *= output_dims_[i]->data[j];
 
-                                output_datas_[i] = malloc(sizeof(float32_t) * size);
+                                output_bytes_[i] = sizeof(float32_t) * size;
                                 break;
                             }
                         }
@@ -657,8 +840,8 @@ namespace tflite{
                         params.scale = quant_info.qp_scale;
                         output_tensors_[i]->params = params;
 
-                        output_names_[i] = (char *) malloc(sizeof(char) * strlen(name));
-                        strncpy(output_names_[i], name, strlen(name));
+                        output_names_[i] = (char *) meta_arena_.allocate(strlen(name) + 1);
+                        strcpy(output_names_[i], name);
                         output_tensors_[i]->name = output_names_[i];
                     }
                     
@@ -695,35 +878,37 @@ namespace tflite{
                     input_dims_.resize(input_size);
                     input_tensors_.resize(input_size);
                     input_datas_.resize(input_size);
+                    input_bytes_.resize(input_size);
                     input_names_.resize(input_size);
                     output_dims_.resize(output_size);
                     output_tensors_.resize(output_size);
                     output_datas_.resize(output_size);
+                    output_bytes_.resize(output_size);
                     output_names_.resize(output_size);
 
                     for(int i = 0; i < tflite_input_size; i++){
                         TfLiteTensor* input_tensor_i = interpreter->input_tensor(i);
                         TfLiteIntArray* input_dims = input_tensor_i->dims;
 
-                        input_dims_[i] = (TfLiteIntArray *) malloc(sizeof(int) * 5);
+                        input_dims_[i] = (TfLiteIntArray *) meta_arena_.allocate(sizeof(int) * 5);
 
-                        int malloc_size = 1;
+                        int alloc_size = 1;
 
                         input_dims_[i]->size = input_dims->size;
                         for(int j = 0; j < input_dims->size; j++){
                             input_dims_[i]->data[j] = input_dims->data[j];
-                            malloc_size *= input_dims->data[j];
+                            alloc_size *= input_dims->data[j];
                         }
 
-                        input_tensors_[i] = (TfLiteTensor *) malloc(sizeof(TfLiteTensor));
+                        input_tensors_[i] = (TfLiteTensor *) meta_arena_.allocate(sizeof(TfLiteTensor));
 
                         if(input_tensor_i->type == kTfLiteUInt8){
                             input_tensors_[i]->type = kTfLiteUInt8;
-                            input_datas_[i] = malloc(sizeof(uint8_t) * malloc_size);
+                            input_bytes_[i] = sizeof(uint8_t) * alloc_size;
                         }
                         else if(input_tensor_i->type == kTfLiteFloat32){
                             input_tensors_[i]->type = kTfLiteFloat32;
-                            input_datas_[i] = malloc(sizeof(float) * malloc_size);
+                            input_bytes_[i] = sizeof(float) * alloc_size;
                         }
 
                         input_tensors_[i]->dims = input_dims_[i];
@@ -734,15 +919,15 @@ namespace tflite{
                         input_tensors_[i]->params = params;
 
                         const char * name = interpreter->GetInputName(i);
-                        input_names_[i] = (char *) malloc(sizeof(char) * strlen(name));
-                        strncpy(input_names_[i], name, strlen(name));
+                        input_names_[i] = (char *) meta_arena_.allocate(strlen(name) + 1);
+                        strcpy(input_names_[i], name);
                         input_tensors_[i]->name = input_names_[i];
                     }
 
                     for(int i = tflite_input_size; i < input_size; i++){
                         auto input_shape_info = mobilintModel_->getModelInputShape()[i - tflite_input_size];
 
-                        input_dims_[i] = (TfLiteIntArray *) malloc(sizeof(int) * 5);
+                        input_dims_[i] = (TfLiteIntArray *) meta_arena_.allocate(sizeof(int) * 5);
 
                         if(input_shape_info[0] == 0){
                             input_dims_[i]->size = 0;
@@ -752,7 +937,7 @@ namespace tflite{
                             input_dims_[i]->data[0] = 1;
                             input_dims_[i]->data[1] = input_shape_info[0];
 
-                            input_datas_[i] = malloc(sizeof(float) * input_shape_info[0]);
+                            input_bytes_[i] = sizeof(float) * input_shape_info[0];
                         }
                         else if(input_shape_info[2] == 0){
                             input_dims_[i]->size = 3;
@@ -760,7 +945,7 @@ namespace tflite{
                             input_dims_[i]->data[1] = input_shape_info[0];
                             input_dims_[i]->data[2] = input_shape_info[1];
 
-                            input_datas_[i] = malloc(sizeof(float) * input_shape_info[0] * input_shape_info[1]);
+                            input_bytes_[i] = sizeof(float) * input_shape_info[0] * input_shape_info[1];
                         }
                         else{
                             input_dims_[i]->size = 4;
@@ -769,14 +954,14 @@ namespace tflite{
                             input_dims_[i]->data[2] = input_shape_info[1];
                             input_dims_[i]->data[3] = input_shape_info[2];
 
-                            input_datas_[i] = malloc(sizeof(float) * input_shape_info[0] * input_shape_info[1] * input_shape_info[2]);
+                            input_bytes_[i] = sizeof(float) * input_shape_info[0] * input_shape_info[1] * input_shape_info[2];
                         }
 
-                        input_tensors_[i] = (TfLiteTensor *) malloc(sizeof(TfLiteTensor));
+                        input_tensors_[i] = (TfLiteTensor *) meta_arena_.allocate(sizeof(TfLiteTensor));
 
                         input_tensors_[i]->dims = input_dims_[i];
                         input_tensors_[i]->type = kTfLiteFloat32;
-                        input_names_[i] = (char *) malloc(sizeof(char) * 2);
+                        input_names_[i] = (char *) meta_arena_.allocate(sizeof(char) * 2);
                         strcpy(input_names_[i], " ");
                     }
 
@@ -784,25 +969,25 @@ namespace tflite{
                         TfLiteTensor* output_tensor_i = interpreter->output_tensor(i);
                         TfLiteIntArray* output_dims = output_tensor_i->dims;
 
-                        output_dims_[i] = (TfLiteIntArray *) malloc(sizeof(int) * 5);
+                        output_dims_[i] = (TfLiteIntArray *) meta_arena_.allocate(sizeof(int) * 5);
 
-                        int malloc_size = 1;
+                        int alloc_size = 1;
 
                         output_dims_[i]->size = output_dims->size;
                         for(int j = 0; j < output_dims->size; j++){
                             output_dims_[i]->data[j] = output_dims->data[j];
-                            malloc_size *= output_dims->data[j];
+                            alloc_size *= output_dims->data[j];
                         }
 
-                        output_tensors_[i] = (TfLiteTensor *) malloc(sizeof(TfLiteTensor));
+                        output_tensors_[i] = (TfLiteTensor *) meta_arena_.allocate(sizeof(TfLiteTensor));
 
                         if(output_tensor_i->type == kTfLiteUInt8){
                             output_tensors_[i]->type = kTfLiteUInt8;
-                            output_datas_[i] = malloc(sizeof(uint8_t) * malloc_size);
+                            output_bytes_[i] = sizeof(uint8_t) * alloc_size;
                         }
                         else if(output_tensor_i->type == kTfLiteFloat32){
                             output_tensors_[i]->type = kTfLiteFloat32;
-                            output_datas_[i] = malloc(sizeof(float) * malloc_size);
+                            output_bytes_[i] = sizeof(float) * alloc_size;
                         }
                         
                         output_tensors_[i]->dims = output_dims_[i];
@@ -813,15 +998,15 @@ namespace tflite{
                         output_tensors_[i]->params = params;
 
                         const char * name = interpreter->GetOutputName(i);
-                        output_names_[i] = (char *) malloc(sizeof(char) * strlen(name));
-                        strncpy(output_names_[i], name, strlen(name));
+                        output_names_[i] = (char *) meta_arena_.allocate(strlen(name) + 1);
+                        strcpy(output_names_[i], name);
                         output_tensors_[i]->name = output_names_[i];
                     }
 
                     for(int i = tflite_output_size; i < output_size; i++){
                         auto output_shape_info = mobilintModel_->getModelOutputShape()[i - tflite_output_size];
 
-                        output_dims_[i] = (TfLiteIntArray *) malloc(sizeof(int) * 5);
+                        output_dims_[i] = (TfLiteIntArray *) meta_arena_.allocate(sizeof(int) * 5);
 
                         if(output_shape_info[0] == 0){
                             output_dims_[i]->size = 0;
@@ -831,7 +1016,7 @@ namespace tflite{
                             output_dims_[i]->data[0] = 1;
                             output_dims_[i]->data[1] = output_shape_info[0];
 
-                            output_datas_[i] = malloc(sizeof(float) * output_shape_info[0]);
+                            output_bytes_[i] = sizeof(float) * output_shape_info[0];
                         }
                         else if(output_shape_info[2] == 0){
                             output_dims_[i]->size = 3;
@@ -839,7 +1024,7 @@ namespace tflite{
                             output_dims_[i]->data[1] = output_shape_info[0];
                             output_dims_[i]->data[2] = output_shape_info[1];
 
-                            output_datas_[i] = malloc(sizeof(float) * output_shape_info[0] * output_shape_info[1]);
+                            output_bytes_[i] = sizeof(float) * output_shape_info[0] * output_shape_info[1];
                         }
                         else{
                             output_dims_[i]->size = 4;
@@ -848,14 +1033,14 @@ namespace tflite{
                             output_dims_[i]->data[2] = output_shape_info[1];
                             output_dims_[i]->data[3] = output_shape_info[2];
 
-                            output_datas_[i] = malloc(sizeof(float) * output_shape_info[0] * output_shape_info[1] * output_shape_info[2]);
+                            output_bytes_[i] = sizeof(float) * output_shape_info[0] * output_shape_info[1] * output_shape_info[2];
                         }
 
-                        output_tensors_[i] = (TfLiteTensor *) malloc(sizeof(TfLiteTensor));
+                        output_tensors_[i] = (TfLiteTensor *) meta_arena_.allocate(sizeof(TfLiteTensor));
 
                         output_tensors_[i]->dims = output_dims_[i];
                         output_tensors_[i]->type = kTfLiteFloat32;
-                        output_names_[i] = (char *) malloc(sizeof(char) * 2);
+                        output_names_[i] = (char *) meta_arena_.allocate(sizeof(char) * 2);
                         strcpy(output_names_[i], " ");
                     }
 
@@ -892,36 +1077,38 @@ namespace tflite{
                     input_dims_.resize(input_size);
                     input_tensors_.resize(input_size);
                     input_datas_.resize(input_size);
+                    input_bytes_.resize(input_size);
                     input_names_.resize(input_size);
                     output_dims_.resize(output_size);
                     output_tensors_.resize(output_size);
                     output_datas_.resize(output_size);
+                    output_bytes_.resize(output_size);
                     output_names_.resize(output_size);
 
                     for(int i = 0; i < tflite_input_size; i++){
                         TfLiteTensor* input_tensor_i = interpreter->input_tensor(i);
                         TfLiteIntArray* input_dims = input_tensor_i->dims;
 
-                        input_dims_[i] = (TfLiteIntArray *) malloc(sizeof(int) * 5);
+                        input_dims_[i] = (TfLiteIntArray *) meta_arena_.allocate(sizeof(int) * 5);
 
-                        int malloc_size = 1;
+                        int alloc_size = 1;
 
                         input_dims_[i]->size = input_dims->size;
 
                         for(int j = 0; j < input_dims->size; j++){
                             input_dims_[i]->data[j] = input_dims->data[j];
-                            malloc_size *= input_dims->data[j];
+                            alloc_size *= input_dims->data[j];
                         }
 
-                        input_tensors_[i] = (TfLiteTensor *) malloc(sizeof(TfLiteTensor));
+                        input_tensors_[i] = (TfLiteTensor *) meta_arena_.allocate(sizeof(TfLiteTensor));
 
                         if(input_tensor_i->type == kTfLiteUInt8){
                             input_tensors_[i]->type = kTfLiteUInt8;
-                            input_datas_[i] = malloc(sizeof(uint8_t) * malloc_size);
+                            input_bytes_[i] = sizeof(uint8_t) * alloc_size;
                         }
                         else if(input_tensor_i->type == kTfLiteFloat32){
                             input_tensors_[i]->type = kTfLiteFloat32;
-                            input_datas_[i] = malloc(sizeof(float) * malloc_size);
+                            input_bytes_[i] = sizeof(float) * alloc_size;
                         }
                       
                         input_tensors_[i]->dims = input_dims_[i];
@@ -932,8 +1119,8 @@ namespace tflite{
                         input_tensors_[i]->params = params;
 
                         const char * name = interpreter->GetInputName(i);
-                        input_names_[i] = (char *) malloc(sizeof(char) * strlen(name));
-                        strncpy(input_names_[i], name, strlen(name));
+                        input_names_[i] = (char *) meta_arena_.allocate(strlen(name) + 1);
+                        strcpy(input_names_[i], name);
                         input_tensors_[i]->name = input_names_[i];
                     }
 
@@ -945,7 +1132,7 @@ namespace tflite{
                         auto quant_info = input_info.quant_info;
                         auto name = input_info.name;
 
-                        input_dims_[i] = (TfLiteIntArray *) malloc(sizeof(int) * 5);
+                        input_dims_[i] = (TfLiteIntArray *) meta_arena_.allocate(sizeof(int) * 5);
 
                         if(shape.height == 0){
                             input_dims_[i]->size = 0;
@@ -969,7 +1156,7 @@ namespace tflite{
                             input_dims_[i]->data[3] = frame_size / shape.height / shape.width;
                         }
 
-                        input_tensors_[i] = (TfLiteTensor *) malloc(sizeof(TfLiteTensor));
+                        input_tensors_[i] = (TfLiteTensor *) meta_arena_.allocate(sizeof(TfLiteTensor));
 
                         input_tensors_[i]->dims = input_dims_[i];
 
@@ -989,7 +1176,7 @@ namespace tflite{
                                 for(int j = 0; j < input_dims_[i]->size; j++)
                                     size *= input_dims_[i]->data[j];
 
-                                input_datas_[i] = malloc(sizeof(uint8_t) * size);
+                                input_bytes_[i] = sizeof(uint8_t) * size;
                                 break;
                             }
                             case HAILO_FORMAT_TYPE_UINT16:
@@ -1002,7 +1189,7 @@ namespace tflite{
                                 for(int j = 0; j < input_dims_[i]->size; j++)
                                     size *= input_dims_[i]->data[j];
 
-                                input_datas_[i] = malloc(sizeof(uint16_t) * size);
+                                input_bytes_[i] = sizeof(uint16_t) * size;
                                 break;
                             }
                             case HAILO_FORMAT_TYPE_FLOAT32:
@@ -1015,7 +1202,7 @@ namespace tflite{
                                 for(int j = 0; j < input_dims_[i]->size; j++)
                                     size *= input_dims_[i]->data[j];
 
-                                input_datas_[i] = malloc(sizeof(float32_t) * size);
+                                input_bytes_[i] = sizeof(float32_t) * size;
                                 break;
                             }
                         }
@@ -1025,8 +1212,8 @@ namespace tflite{
                         params.scale = quant_info.qp_scale;
                         input_tensors_[i]->params = params;
 
-                        input_names_[i] = (char *) malloc(sizeof(char) * strlen(name));
-                        strncpy(input_names_[i], name, strlen(name));
+                        input_names_[i] = (char *) meta_arena_.allocate(strlen(name) + 1);
+                        strcpy(input_names_[i], name);
                         input_tensors_[i]->name = input_names_[i];
                     }
 
@@ -1034,26 +1221,26 @@ namespace tflite{
                         TfLiteTensor* output_tensor_i = interpreter->output_tensor(i);
                         TfLiteIntArray* output_dims = output_tensor_i->dims;
 
-                        output_dims_[i] = (TfLiteIntArray *) malloc(sizeof(int) * 5);
+                        output_dims_[i] = (TfLiteIntArray *) meta_arena_.allocate(sizeof(int) * 5);
 
-                        int malloc_size = 1;
+                        int alloc_size = 1;
 
                         output_dims_[i]->size = output_dims->size;
 
                         for(int j = 0; j < output_dims->size; j++){
                             output_dims_[i]->data[j] = output_dims->data[j];
-                            malloc_size *= output_dims->data[j];
+                            alloc_size *= output_dims->data[j];
                         }
 
-                        output_tensors_[i] = (TfLiteTensor *) malloc(sizeof(TfLiteTensor));
+                        output_tensors_[i] = (TfLiteTensor *) meta_arena_.allocate(sizeof(TfLiteTensor));
 
                         if(output_tensor_i->type == kTfLiteUInt8){
                             output_tensors_[i]->type = kTfLiteUInt8;
-                            output_datas_[i] = malloc(sizeof(uint8_t) * malloc_size);
+                            output_bytes_[i] = sizeof(uint8_t) * alloc_size;
                         }
                         else if(output_tensor_i->type == kTfLiteFloat32){
                             output_tensors_[i]->type = kTfLiteFloat32;
-                            output_datas_[i] = malloc(sizeof(float) * malloc_size);
+                            output_bytes_[i] = sizeof(float) * alloc_size;
                         }
 
                         output_tensors_[i]->dims = output_dims_[i];
@@ -1064,8 +1251,8 @@ namespace tflite{
                         output_tensors_[i]->params = params;
 
                         const char * name = interpreter->GetOutputName(i);
-                        output_names_[i] = (char *) malloc(sizeof(char) * strlen(name));
-                        strncpy(output_names_[i], name, strlen(name));
+                        output_names_[i] = (char *) meta_arena_.allocate(strlen(name) + 1);
+                        strcpy(output_names_[i], name);
                         output_tensors_[i]->name = output_names_[i];
                     }
 
@@ -1077,7 +1264,7 @@ namespace tflite{
                         auto quant_info = output_info.quant_info;
                         auto name = output_info.name;
 
-                        output_dims_[i] = (TfLiteIntArray *) malloc(sizeof(int) * 5);
+                        output_dims_[i] = (TfLiteIntArray *) meta_arena_.allocate(sizeof(int) * 5);
 
                         if(shape.height == 0){
                             output_dims_[i]->size = 0;
@@ -1101,7 +1288,7 @@ namespace tflite{
                             output_dims_[i]->data[3] = frame_size / shape.height / shape.width;
                         }
 
-                        output_tensors_[i] = (TfLiteTensor *) malloc(sizeof(TfLiteTensor));
+                        output_tensors_[i] = (TfLiteTensor *) meta_arena_.allocate(sizeof(TfLiteTensor));
 
                         output_tensors_[i]->dims = output_dims_[i];
 
@@ -1121,7 +1308,7 @@ namespace tflite{
                                 for(int j = 0; j < output_dims_[i]->size; j++)
                                     size *= output_dims_[i]->data[j];
 
-                                output_datas_[i] = malloc(sizeof(uint8_t) * size);
+                                output_bytes_[i] = sizeof(uint8_t) * size;
                                 break;
                             }
                             case HAILO_FORMAT_TYPE_UINT16:
@@ -1134,7 +1321,7 @@ namespace tflite{
                                 for(int j = 0; j < output_dims_[i]->size; j++)
                                     size *= output_dims_[i]->data[j];
 
-                                output_datas_[i] = malloc(sizeof(uint16_t) * size);
+                                output_bytes_[i] = sizeof(uint16_t) * size;
                                 break;
                             }
                             case HAILO_FORMAT_TYPE_FLOAT32:
@@ -1147,7 +1334,7 @@ namespace tflite{
                                 for(int j = 0; j < output_dims_[i]->size; j++)
                                     size *= output_dims_[i]->data[j];
 
-                                output_datas_[i] = malloc(sizeof(float32_t) * size);
+                                output_bytes_[i] = sizeof(float32_t) * size;
                                 break;
                             }
                         }
@@ -1157,19 +1344,57 @@ namespace tflite{
                         params.scale = quant_info.qp_scale;
                         output_tensors_[i]->params = params;
 
-                        output_names_[i] = (char *) malloc(sizeof(char) * strlen(name));
-                        strncpy(output_names_[i], name, strlen(name));
+                        output_names_[i] = (char *) meta_arena_.allocate(strlen(name) + 1);
+                        strcpy(output_names_[i], name);
                         output_tensors_[i]->name = output_names_[i];
                     }
                     
                     break;
                 }
             }
+
+            switch(mode_){
+                case 0:
+                {
+                    break;
+                }
+                case 1:
+                case 2:
+                case 3:
+                case 4:
+                {
+                    if(!layout_tensor_arena()){
+                        std::cerr << "ERROR: Memory allocation for tensor arena failed.\n";
+                        exit(-1);
+                    }
+
+                    check_bundle_tensors("input", model_bundle_.inputs(), input_tensors_);
+                    check_bundle_tensors("output", model_bundle_.outputs(), output_tensors_);
+
+                    // The calibration profiles stored with the model
+                    if((mode_ == 3 || mode_ == 4) && !model_bundle_.profile().empty())
+                        SetProfileParams(model_bundle_.profile().c_str());
+
+                    break;
+                }
+            }
         }
 
         Interpreter::~Interpreter(){
             //std::cout << "Interpreter Destructor\n";
 
+            cpu_executor_.stop();
+            model_registry_.clear();
+
+            // A swap waiting for its switch gives up. Its model is freed with the others
+            {
+                std::lock_guard<std::mutex> lk(swap_mutex_);
+                swap_stop_ = true;
+            }
+            swap_cv_.notify_all();
+            if(swap_thread_.joinable())
+                swap_thread_.join();
+
             switch(mode_){
                 case 0:
                 {
@@ -1178,42 +1403,42 @@ namespace tflite{
                 case 1:
                 case 2:
                 {
-                    for(int i = 0; i < inputs_.size(); i++){
-                        free(input_datas_[i]);
-                        free(input_dims_[i]);
-                        free(input_names_[i]);
-                        free(input_tensors_[i]);
-                    }
+                    tensor_arena_.release();
+                    meta_arena_.release();
 
-                    for(int i = 0; i < outputs_.size(); i++){
-                        free(output_datas_[i]);
-                        free(output_dims_[i]);
-                        free(output_names_[i]);
-                        free(output_tensors_[i]);
-                    }  
+                    break;
                 }
                 case 3:
                 case 4:
                 {
                     turnaround_mutex_.lock();
                     turnaround_mutex_.unlock();
-                    
-                    gpu_thread_start_cv_.notify_one();
-                    gpu_thread_.join();
 
-                    for(int i = 0; i < inputs_.size(); i++){
-                        free(input_datas_[i]);
-                        free(input_dims_[i]);
-                        free(input_names_[i]);
-                        free(input_tensors_[i]);
+                    invoke_feeder_.stop();
+
+                    // A feeder still stuck in a device call cannot be joined. Leave it and the buffers it may touch
+                    bool hung = false;
+                    for(int i = 0; i < DeviceHealth::MAX_DEVICES; i++){
+                        if(device_busy_[i] && !device_feeder(i)->is_idle()){
+                            std::cout << "WARNING: " << device_name(i) << " is still stuck. Leave its thread\n";
+                            device_feeder(i)->stop(false);
+                            hung = true;
+                        }
+                        else{
+                            device_feeder(i)->stop();
+                        }
                     }
 
-                    for(int i = 0; i < outputs_.size(); i++){
-                        free(output_datas_[i]);
-                        free(output_dims_[i]);
-                        free(output_names_[i]);
-                        free(output_tensors_[i]);
-                    }  
+                    if(!hung){
+                        hexagon_variants_.clear();
+                        release_tflite_variant(hexagon_cascade_);
+                        hexagon_shapes_.clear();
+                        release_split();
+                        release_tflite_variant(hexagon_swap_);
+                        release_tflite_variant(hexagon_live_);
+                        tensor_arena_.release();
+                        meta_arena_.release();
+                    }
 
                     break;
                 }
@@ -1235,9 +1460,9 @@ namespace tflite{
         bool Interpreter::is_hailo_output(int batch_id){
             if(mode_ == 2)
                 return true;
-            else if (mode_ == 4){
+            else if (mode_ == 4 && !split_enabled_){
                 batch_mutex_[batch_id].lock();
-                if(batch_run_[batch_id] == 3 || batch_run_[batch_id] == 4 || batch_run_[batch_id] == 5){
+                if(batch_run_[batch_id] == 3 || batch_run_[batch_id] == 4 || batch_run_[batch_id] == 5 || (batch_run_[batch_id] == REMOTE_DEVICE && remote_parts_[batch_id] == REMOTE_ACCELERATOR)){
                     batch_mutex_[batch_id].unlock();
                     return true;
                 }
@@ -1253,9 +1478,9 @@ namespace tflite{
         bool Interpreter::is_maccel_output(int batch_id){
             if(mode_ == 1)
                 return true;
-            else if(mode_ == 3){
+            else if(mode_ == 3 && !split_enabled_){
                 batch_mutex_[batch_id].lock();
-                if(batch_run_[batch_id] == 2){
+                if(batch_run_[batch_id] == 2 || (batch_run_[batch_id] == REMOTE_DEVICE && remote_parts_[batch_id] == REMOTE_ACCELERATOR)){
                     batch_mutex_[batch_id].unlock();
                     return true;
                 }
@@ -1274,8 +1499,10 @@ namespace tflite{
             else if(gpuInterpreter_ == nullptr && hexagonInterpreter_ == nullptr)
                 return false;
             else if(mode_ == 3 || mode_ == 4){
+                // The head of a split model gives the accelerator slots the outputs of the tflite part. A remote slot has
+                // the outputs of the device that ran it on the other board
                 batch_mutex_[batch_id].lock();
-                if(batch_run_[batch_id] == 0 || batch_run_[batch_id] == 1){
+                if(batch_run_[batch_id] == 0 || batch_run_[batch_id] == 1 || (split_enabled_ && batch_run_[batch_id] >= 2) || (batch_run_[batch_id] == REMOTE_DEVICE && remote_parts_[batch_id] == REMOTE_TFLITE)){
                     batch_mutex_[batch_id].unlock();
                     return true;
                 }
@@ -1355,44 +1582,52 @@ namespace tflite{
                         return kTfLiteOk;
 
                     batch_sizes_ = dims[0];
+                    active_batch_ = batch_sizes_;
+                    batch_tuner_.set_params(latency_budget_ms_, batch_sizes_);
                     batch_run_.resize(batch_sizes_);
+                    slot_devices_.resize(batch_sizes_);
+                    slot_run_ms_.resize(batch_sizes_);
+                    slot_copy_ms_.resize(batch_sizes_);
+                    slot_variants_.resize(batch_sizes_);
+                    slot_min_accuracy_.resize(batch_sizes_);
                     batch_mutex_ = std::vector<std::mutex>(batch_sizes_);
                     turnaround_.resize(batch_sizes_);
 
-                    for(int i = 0; i < inputs_.size(); i++){
-                        free(input_datas_[i]);
+                    // The queues keep their capacity across Invoke calls
+                    gpu_queue_.reserve(batch_sizes_);
+                    hexagon_queue_.reserve(batch_sizes_);
+                    maccel_queue_.reserve(batch_sizes_);
+                    hailo_queue_.reserve(batch_sizes_);
+                    hailo_queue2_.reserve(batch_sizes_);
+                    hailo_queue3_.reserve(batch_sizes_);
+                    remote_queue_.reserve(batch_sizes_);
+                    remote_parts_.resize(batch_sizes_);
+                    remote_sent_at_.resize(batch_sizes_);
 
+                    for(int i = 0; i < inputs_.size(); i++){
                         input_dims_[i]->data[0] = batch_sizes_;
 
                         int size = 1;
                         for(int j = 0; j < input_dims_[i]->size; j++)
                             size *= input_dims_[i]->data[j];
 
-                        if(input_tensors_[i]->type == kTfLiteUInt8){
-                            input_datas_[i] = malloc(sizeof(uint8_t) * size);
-                        }
-                        else if(input_tensors_[i]->type == kTfLiteFloat32){
-                            input_datas_[i] = malloc(sizeof(float) * size);
-                        }
+                        input_bytes_[i] = tensor_type_size(input_tensors_[i]->type) * size;
                     }
 
                     for(int i = 0; i < outputs_.size(); i++){
-                        free(output_datas_[i]);
-
                         output_dims_[i]->data[0] = batch_sizes_;
 
                         int size = 1;
                         for(int j = 0; j < output_dims_[i]->size; j++)
                             size *= output_dims_[i]->data[j];
 
-                        if(output_tensors_[i]->type == kTfLiteUInt8){
-                            output_datas_[i] = malloc(sizeof(uint8_t) * size);
-                        }
-                        else if(output_tensors_[i]->type == kTfLiteFloat32){
-                            output_datas_[i] = malloc(sizeof(float) * size);                
-                        }
+                        output_bytes_[i] = tensor_type_size(output_tensors_[i]->type) * size;
                     }
 
+                    // The arena is reused when the new batch fits in its capacity
+                    if(!layout_tensor_arena())
+                        return kTfLiteError;
+
                     return kTfLiteOk;
 
                     break;
@@ -1537,555 +1772,2941 @@ namespace tflite{
         }
 
         TfLiteStatus Interpreter::SetSchedulerParams(std::vector<float> perfs){
-            perfs_ = perfs;
+            // No perfs keeps the ones of the profile database
+            if(!perfs.empty())
+                perfs_ = perfs;
 
             return kTfLiteOk;
         }
 
-        TfLiteStatus Interpreter::SetPostProcessParams(std::vector<float> ori_score_thrs, std::vector<float> new_score_thrs){
-            ori_score_thrs_ = ori_score_thrs;
-            new_score_thrs_ = new_score_thrs;
-            cur_score_thrs_ = ori_score_thrs;
+        TfLiteStatus Interpreter::SetMemoryParams(bool huge_pages){
+            switch(mode_){
+                case 0:
+                {
+                    return kTfLiteOk;
 
-            return kTfLiteOk;
-        }
+                    break;
+                }
+                case 1:
+                case 2:
+                case 3:
+                case 4:
+                {
+                    if(tensor_arena_.is_huge_pages() == huge_pages)
+                        return kTfLiteOk;
 
-        std::vector<float> Interpreter::GetPostProcessParams(){
-            return cur_score_thrs_;
-        }
+                    turnaround_mutex_.lock();
 
-        double Interpreter::GetSumTurnAroundTime(){
-            turnaround_mutex_.lock();
-            double return_value = sum_turnaround_;
-            turnaround_mutex_.unlock();
-            return return_value;
-        }
+                    tensor_arena_.release();
+                    tensor_arena_.set_huge_pages(huge_pages);
+                    bool success = layout_tensor_arena();
 
-        double Interpreter::GetMaxTurnAroundTime(){
-            turnaround_mutex_.lock();
-            double return_value = max_turnaround_;
-            turnaround_mutex_.unlock();
-            return return_value;
-        }
+                    turnaround_mutex_.unlock();
 
-        void Invoke_gpu_queue(){
-            std::unique_ptr<::tflite::FlatBufferModel> model = ::tflite::FlatBufferModel::BuildFromFile(tflite_filename_);
-            if(model == NULL){
-                std::cerr << "ERROR: Model load failed. Check the model name.\n";
-                exit(-1);
-            }
-            
-            ::tflite::ops::builtin::BuiltinOpResolver resolver;
-            ::tflite::InterpreterBuilder builder(*model, resolver);
-            std::unique_ptr<::tflite::Interpreter> interpreter;
-            builder(&interpreter);
-            if(interpreter == NULL){
-                std::cerr << "ERROR: Interpreter build failed.\n";
-                exit(-1);
-            }
-            
-            TfLiteGpuDelegateOptionsV2 gpu_delegate_options = TfLiteGpuDelegateOptionsV2Default();
-            gpu_delegate_options.inference_priority1 = TFLITE_GPU_INFERENCE_PRIORITY_MIN_LATENCY;
-            gpu_delegate_options.inference_priority2 = TFLITE_GPU_INFERENCE_PRIORITY_MIN_MEMORY_USAGE;
-            gpu_delegate_options.inference_priority3 = TFLITE_GPU_INFERENCE_PRIORITY_MAX_PRECISION;
-            gpu_delegate_options.inference_preference = TFLITE_GPU_INFERENCE_PREFERENCE_SUSTAINED_SPEED;
-            gpu_delegate_options.experimental_flags |= TFLITE_GPU_EXPERIMENTAL_FLAGS_GL_ONLY;
+                    if(!success){
+                        std::cerr << "ERROR: Memory allocation for tensor arena failed.\n";
+                        return kTfLiteError;
+                    }
 
-            auto * gpu_delegate_ptr = TfLiteGpuDelegateV2Create(&gpu_delegate_options);
-            if(gpu_delegate_ptr == NULL){
-                std::cout << "WARNING: Cannot create gpu delegate. Run without gpu delegate.\n";
-                TfLiteGpuDelegateV2Delete(gpu_delegate_ptr);
-                gpuInterpreter_ = nullptr;
-            }
-            else{
-                ::tflite::Interpreter::TfLiteDelegatePtr gpu_delegate(gpu_delegate_ptr, &TfLiteGpuDelegateV2Delete);
+                    if(huge_pages)
+                        std::cout << "INFO: Tensor arena uses huge pages (" << tensor_arena_.capacity() << " bytes)\n";
 
-                if (interpreter->ModifyGraphWithDelegate(gpu_delegate.get()) != kTfLiteOk){
-                    std::cout << "WARNING: Cannot convert model with gpu delegate. Run without gpu delegate.\n";
-                    gpuInterpreter_ = nullptr;
-                }
-                else{
-                    if(interpreter->AllocateTensors() != kTfLiteOk) {
-                        std::cerr << "ERROR: Memory allocation for interpreter failed.\n";
-                        exit(-1);
-                    }
-                    
-                    gpuInterpreter_ = interpreter.get();
+                    return kTfLiteOk;
+
+                    break;
                 }
             }
+        }
 
-            gpu_thread_set_cv_.notify_one();
+        TfLiteStatus Interpreter::SetPlacementParams(const char * config){
+            if(!thread_placement_.parse(config))
+                return kTfLiteError;
 
-            std::unique_lock<std::mutex> lk(gpu_thread_mutex_);
-            while(true){
-                gpu_thread_start_cv_.wait(lk);
-                gpu_thread_mutex_.unlock();
+            std::cout << "INFO: Thread placement: " << thread_placement_.describe() << std::endl;
 
-                if(gpu_queue_.size() == 0){
-                    std::cout << "INFO: Terminate gpu thread\n";
-                    break;
-                }
+            if(mode_ <= 2){
+                // The single device models run on the calling thread
+                return thread_placement_.apply(THREAD_ROLE_FEEDER) ? kTfLiteOk : kTfLiteError;
+            }
 
-                for(int i = 0; i < gpu_queue_.size(); i++){
-                    //std::cout << "Invoke gpu queue\n";
-                    for(int j = 0; j < gpuInterpreter_->inputs().size(); j++){
-                        int size = 1;
-                        for(int k = 1; k < input_dims_[j]->size; k++)
-                            size *= input_dims_[j]->data[k];
+            return kTfLiteOk;
+        }
 
-                        if(input_tensors_[j]->type == kTfLiteUInt8){
-                            uint8_t * input_ptr = (uint8_t *)input_datas_[j];
-                            input_ptr += gpu_queue_[i] * size;
-                            memcpy(gpuInterpreter_->typed_input_tensor<uint8_t>(j), input_ptr, sizeof(uint8_t) * size);
-                        }
-                        else if(input_tensors_[j]->type == kTfLiteFloat32){
-                            float * input_ptr = (float *)input_datas_[j];
-                            input_ptr += gpu_queue_[i] * size;
-                            memcpy(gpuInterpreter_->typed_input_tensor<float>(j), input_ptr, sizeof(float) * size);
-                        }
-                    }
-              
-                    if(gpuInterpreter_->Invoke() != kTfLiteOk){
-                        std::cerr << "ERROR: Model execute failed\n";
-                        exit(-1);
-                    }
+        TfLiteStatus Interpreter::ApplyThreadPlacement(int role){
+            // The single device models are invoked by the writer thread, so it feeds the device as well
+            if(mode_ <= 2 && role == THREAD_ROLE_WRITER)
+                role = THREAD_ROLE_FEEDER;
 
-                    for(int j = 0; j < gpuInterpreter_->outputs().size(); j++){
-                        int size = 1;
-                        for(int k = 1; k < output_dims_[j]->size; k++)
-                            size *= output_dims_[j]->data[k];
+            return thread_placement_.apply(role) ? kTfLiteOk : kTfLiteError;
+        }
 
-                        if(output_tensors_[j]->type == kTfLiteUInt8){
-                            uint8_t * output_ptr = (uint8_t *)output_datas_[j];
-                            output_ptr += gpu_queue_[i] * size;
-                            memcpy(output_ptr, gpuInterpreter_->typed_output_tensor<uint8_t>(j), sizeof(uint8_t) * size);
-                        }
-                        else if(output_tensors_[j]->type == kTfLiteFloat32){
-                            float * output_ptr = (float *)output_datas_[j];
-                            output_ptr += gpu_queue_[i] * size;
-                            memcpy(output_ptr, gpuInterpreter_->typed_output_tensor<float>(j), sizeof(float) * size);
-                        }
-                    }
+        std::vector<int> Interpreter::GetPlacementCpus(int role){
+            if(role < 0 || role >= NUM_THREAD_ROLES)
+                return std::vector<int>();
 
-                    auto elapsed = std::chrono::high_resolution_clock::now() - invoke_start_;
-                    turnaround_[gpu_queue_[i]] = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+            return thread_placement_.cpus(role);
+        }
 
-                    batch_run_[gpu_queue_[i]] = 0;
-                    batch_mutex_[gpu_queue_[i]].unlock();
-                }
+        TfLiteStatus Interpreter::SetRealtimeParams(const char * policy, bool lock_memory){
+            if(!thread_placement_.set_realtime(policy))
+                return kTfLiteError;
+
+            bool realtime = thread_placement_.realtime_policy() != SCHED_OTHER;
 
-                gpu_thread_end_cv_.notify_one();
+            if(realtime && lock_memory){
+                if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+                    std::cout << "WARNING: Cannot lock the process memory (" << strerror(errno) << "). Run without it.\n";
+                else
+                    std::cout << "INFO: Process memory is locked\n";
             }
-        }
 
-        void Invoke_hexagon_queue(){
-            for(int i = 0; i < hexagon_queue_.size(); i++){
-                //std::cout << "Invoke hexagon queue\n";
-                for(int j = 0; j < hexagonInterpreter_->inputs().size(); j++){
-                    int size = 1;
-                    for(int k = 1; k < input_dims_[j]->size; k++)
-                        size *= input_dims_[j]->data[k];
+            // Fault in the tensor buffers now instead of on the first inference
+            prefault_arenas_ = realtime;
+            if(realtime){
+                turnaround_mutex_.lock();
+                tensor_arena_.prefault();
+                meta_arena_.prefault();
+                turnaround_mutex_.unlock();
+            }
 
-                    if(input_tensors_[j]->type == kTfLiteUInt8){
-                        uint8_t * input_ptr = (uint8_t *)input_datas_[j];
-                        input_ptr += hexagon_queue_[i] * size;
-                        memcpy(hexagonInterpreter_->typed_input_tensor<uint8_t>(j), input_ptr, sizeof(uint8_t) * size);
-                    }
-                    else if(input_tensors_[j]->type == kTfLiteFloat32){
-                        float * input_ptr = (float *)input_datas_[j];
-                        input_ptr += hexagon_queue_[i] * size;
-                        memcpy(hexagonInterpreter_->typed_input_tensor<float>(j), input_ptr, sizeof(float) * size);
-                    }
-                }
-                
-                if(hexagonInterpreter_->Invoke() != kTfLiteOk){
-                    std::cerr << "ERROR: Model execute failed\n";
-                    exit(-1);
-                }
+            hot_path_monitor_.reset();
+            hot_path_monitor_.set_enabled(realtime);
 
-                for(int j = 0; j < hexagonInterpreter_->outputs().size(); j++){
-                    int size = 1;
-                    for(int k = 1; k < output_dims_[j]->size; k++)
-                        size *= output_dims_[j]->data[k];
+            std::cout << "INFO: Real-time mode: " << policy << std::endl;
 
-                    if(output_tensors_[j]->type == kTfLiteUInt8){
-                        uint8_t * output_ptr = (uint8_t *)output_datas_[j];
-                        output_ptr += hexagon_queue_[i] * size;
-                        memcpy(output_ptr, hexagonInterpreter_->typed_output_tensor<uint8_t>(j), sizeof(uint8_t) * size);
-                    }
-                    else if(output_tensors_[j]->type == kTfLiteFloat32){
-                        float * output_ptr = (float *)output_datas_[j];
-                        output_ptr += hexagon_queue_[i] * size;
-                        memcpy(output_ptr, hexagonInterpreter_->typed_output_tensor<float>(j), sizeof(float) * size);
-                    }
-                }
+            if(mode_ <= 2)
+                return thread_placement_.apply(THREAD_ROLE_FEEDER) ? kTfLiteOk : kTfLiteError;
 
-                auto elapsed = std::chrono::high_resolution_clock::now() - invoke_start_;
-                turnaround_[hexagon_queue_[i]] = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+            return kTfLiteOk;
+        }
 
-                batch_run_[hexagon_queue_[i]] = 1;
-                batch_mutex_[hexagon_queue_[i]].unlock();
-            }
+        ::pkshin::RealtimeStats Interpreter::GetRealtimeStats(){
+            return hot_path_monitor_.stats();
         }
 
-        void Invoke_maccel_queue(){
-            for(int i = 0; i < maccel_queue_.size(); i++){
-                //std::cout << "Invoke maccel queue\n";
-                mobilint::StatusCode sc;
-
-                ::tflite::Interpreter * interpreter;
-                int tflite_input_size, tflite_output_size;
-                if(hexagonInterpreter_ != nullptr){
-                    interpreter = hexagonInterpreter_;
-                    tflite_input_size = interpreter->inputs().size();
-                    tflite_output_size = interpreter->outputs().size();
-                }
-                else if(gpuInterpreter_ != nullptr){
-                    interpreter = gpuInterpreter_;
-                    tflite_input_size = interpreter->inputs().size();
-                    tflite_output_size = interpreter->outputs().size();
-                }
-                else{
-                    tflite_input_size = 0;
-                    tflite_output_size = 0;
-                }
+        TfLiteStatus Interpreter::SetHedgeParams(float factor){
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    if(factor > 0)
+                        std::cout << "WARNING: Hedging needs more than one device. Run without it.\n";
 
-                std::vector<float *> float_input_datas;
-                float_input_datas.resize(inputs_.size() - tflite_input_size);
+                    return kTfLiteOk;
 
-                for(int j = tflite_input_size; j < inputs_.size(); j++){
-                    int size = 1;
-                    for(int k = 1; k < input_dims_[j]->size; k++)
-                        size *= input_dims_[j]->data[k];
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    if(factor > 0 && split_enabled_){
+                        std::cerr << "ERROR: Hedging does not run with a split model\n";
+                        return kTfLiteError;
+                    }
 
-                    float * input_ptr = (float *)input_datas_[j];
-                    input_ptr += maccel_queue_[i] * size;
+                    // Not while a dispatch is running
+                    turnaround_mutex_.lock();
+                    slot_hedger_.set_params(factor);
+                    turnaround_mutex_.unlock();
 
-                    float_input_datas[j - tflite_input_size] = input_ptr;
-                }
-                
-                std::vector<std::vector<float>> outputs = mobilintModel_->infer(float_input_datas, sc);
-                if (!sc) {
-                    std::cerr << "ERROR: Failed to infer an output. error code: " << static_cast<int>(sc) << std::endl;
-                    exit(-1);
-                }
+                    if(factor > 0)
+                        std::cout << "INFO: Hedge the slots running over " << factor << " times the expected service time\n";
 
-                for(int j = tflite_output_size; j < outputs_.size(); j++){
-                    int size = 1;
-                    for(int k = 1; k < output_dims_[j]->size; k++)
-                        size *= output_dims_[j]->data[k];
+                    return kTfLiteOk;
 
-                    float * output_ptr = (float *)output_datas_[j];
-                    output_ptr += maccel_queue_[i] * size;
-                    
-                    memcpy(output_ptr, outputs[j - tflite_output_size].data(), sizeof(float) * size);
+                    break;
                 }
+            }
 
-                auto elapsed = std::chrono::high_resolution_clock::now() - invoke_start_;
-                turnaround_[maccel_queue_[i]] = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+            return kTfLiteError;
+        }
 
-                batch_run_[maccel_queue_[i]] = 2;
-                batch_mutex_[maccel_queue_[i]].unlock();
-            }
+        ::pkshin::HedgeStats Interpreter::GetHedgeStats(){
+            return slot_hedger_.stats();
         }
 
-        void Invoke_hailo_queue(){
-            ::tflite::Interpreter * interpreter;
-            int tflite_input_size, tflite_output_size;
-            if(hexagonInterpreter_ != nullptr){
-                interpreter = hexagonInterpreter_;
-                tflite_input_size = interpreter->inputs().size();
-                tflite_output_size = interpreter->outputs().size();
-            }
-            else if(gpuInterpreter_ != nullptr){
-                interpreter = gpuInterpreter_;
-                tflite_input_size = interpreter->inputs().size();
-                tflite_output_size = interpreter->outputs().size();
-            }
-            else{
-                tflite_input_size = 0;
-                tflite_output_size = 0;
-            }
+        TfLiteStatus Interpreter::SetFaultParams(double device_timeout_ms, const char * inject){
+            bool has_inject = inject != NULL && inject[0] != '\0';
 
-            for(int i = 0; i < hailo_queue_.size(); i++){
-                //std::cout << "Invoke hailo queue1\n";
-                for(int j = tflite_input_size; j < inputs_.size(); j++){
-                    auto & inputVStream = hailoVstreams_->first[j - tflite_input_size];
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    if(device_timeout_ms > 0 || has_inject)
+                        std::cout << "WARNING: Moving slots off failing devices needs more than one device. Run without it.\n";
 
-                    int size = 1;
-                    for(int k = 1; k < input_dims_[j]->size; k++)
-                        size *= input_dims_[j]->data[k];
+                    return kTfLiteOk;
 
-                    if(input_tensors_[j]->type == kTfLiteUInt8){
-                        uint8_t * input_ptr = (uint8_t *)input_datas_[j] + hailo_queue_[i] * size;
-                        auto status = inputVStream.write(hailort::MemoryView(input_ptr, size * sizeof(uint8_t)));
-                        if (HAILO_SUCCESS != status) {
-                            std::cerr << "ERROR: write to input vstream " << j << " failed\n";
-                            exit(-1);
-                        }
-                    }
-                    else if(input_tensors_[j]->type == kTfLiteFloat32){
-                        float * input_ptr = (float *)input_datas_[j] + hailo_queue_[i] * size;
-                        input_ptr += hailo_queue_[i] * size;
-                        auto status = inputVStream.write(hailort::MemoryView(input_ptr, size * sizeof(float)));
-                        if (HAILO_SUCCESS != status) {
-                            std::cerr << "ERROR: write to input vstream " << j << " failed\n";
-                            exit(-1);
-                        }
-                    }
+                    break;
                 }
+                case 3:
+                case 4:
+                {
+                    if(device_timeout_ms > 0 && split_enabled_){
+                        std::cerr << "ERROR: Device timeouts do not run with a split model\n";
+                        return kTfLiteError;
+                    }
 
-                for(int j = tflite_output_size; j < outputs_.size(); j++){
-                    auto & outputVStream = hailoVstreams_->second[j - tflite_output_size];
+                    // Not while a dispatch is running
+                    turnaround_mutex_.lock();
+
+                    if(has_inject && !fault_injector_.parse(inject)){
+                        turnaround_mutex_.unlock();
+                        return kTfLiteError;
+                    }
+
+                    device_timeout_ms_ = device_timeout_ms > 0 ? device_timeout_ms : 0;
+                    device_health_.reset();
+                    turnaround_mutex_.unlock();
+
+                    if(device_timeout_ms_ > 0)
+                        std::cout << "INFO: Move the slots of devices failing or running over " << device_timeout_ms_ << " ms to the other devices\n";
+
+                    if(has_inject){
+                        std::cout << "INFO: Inject device faults: " << inject << "\n";
+                        if(!slot_tracking())
+                            std::cout << "WARNING: Without a device timeout or hedging, an injected error ends the run\n";
+                    }
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        ::pkshin::FaultStats Interpreter::GetFaultStats(){
+            ::pkshin::FaultStats stats = device_health_.stats();
+            stats.enabled = slot_tracking();
+
+            return stats;
+        }
+
+        int Interpreter::AddStream(float weight){
+            int stream = stream_scheduler_.add_stream(weight);
+            if(stream < 0)
+                std::cerr << "ERROR: The stream weight must be positive\n";
+            else
+                std::cout << "INFO: Stream " << stream << " with weight " << weight << "\n";
+
+            return stream;
+        }
+
+        int Interpreter::GetNumStreams(){
+            return stream_scheduler_.num_streams();
+        }
+
+        long Interpreter::EnqueueFrame(int stream){
+            return stream_scheduler_.enqueue(stream);
+        }
+
+        int Interpreter::ScheduleBatch(int max_slots){
+            return stream_scheduler_.schedule(max_slots);
+        }
+
+        int Interpreter::GetSlotStream(int slot){
+            return stream_scheduler_.slot_stream(slot);
+        }
+
+        long Interpreter::GetSlotSequence(int slot){
+            return stream_scheduler_.slot_sequence(slot);
+        }
+
+        TfLiteStatus Interpreter::CompleteSlot(int slot){
+            // Slots no device could run are completed without output
+            bool dropped = false;
+            if((mode_ == 3 || mode_ == 4) && slot >= 0 && slot < batch_run_.size()){
+                batch_mutex_[slot].lock();
+                dropped = batch_run_[slot] < 0;
+                batch_mutex_[slot].unlock();
+            }
+
+            return stream_scheduler_.complete(slot, dropped) ? kTfLiteOk : kTfLiteError;
+        }
+
+        long Interpreter::PopInOrder(int stream){
+            return stream_scheduler_.pop_in_order(stream);
+        }
+
+        ::pkshin::StreamStats Interpreter::GetStreamStats(int stream){
+            return stream_scheduler_.stats(stream);
+        }
+
+        TfLiteStatus Interpreter::SetTraceParams(const char * record_path, const char * replay_path, double replay_speed){
+            bool has_record = record_path != NULL && record_path[0] != '\0';
+            bool has_replay = replay_path != NULL && replay_path[0] != '\0';
+
+            // The arrivals are replayed by the app, so a replay works in every mode
+            if(has_replay){
+                if(!trace_replayer_.open(replay_path, replay_speed))
+                    return kTfLiteError;
+
+                std::cout << "INFO: Replay the dispatches of " << replay_path << " at " << replay_speed << " times the recorded speed\n";
+            }
+
+            if(!has_record)
+                return kTfLiteOk;
+
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    std::cout << "WARNING: The trace records the slots of the devices, it needs more than one device. Run without it.\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    // Not while a dispatch is running
+                    turnaround_mutex_.lock();
+                    bool opened = trace_recorder_.open(record_path);
+                    turnaround_mutex_.unlock();
+
+                    if(!opened)
+                        return kTfLiteError;
+
+                    std::cout << "INFO: Record the dispatches to " << record_path << "\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        int Interpreter::NextReplayBatch(){
+            if(!trace_replayer_.enabled())
+                return 0;
+
+            return trace_replayer_.next_dispatch();
+        }
+
+        // Number of perfs_ of the mode, one per partition index
+        int num_partition_devices(){
+            return mode_ == 3 ? 3 : 5;
+        }
+
+        // Sets perfs_ to the per-slot cost of the devices from the profile database. Only when every device of the mode
+        // has a profile, perfs of different sources do not mix
+        bool seed_profile_perfs(){
+            std::vector<float> perfs = perfs_;
+            perfs.resize(num_partition_devices(), 1);
+
+            for(int j = 0; j < num_partition_devices(); j++){
+                int device = partition_device(j);
+                if(!device_available(device))
+                    continue;
+
+                DeviceProfile profile;
+                if(!profile_db_.find(model_hash_, device_name(device), profile)){
+                    std::cout << "INFO: No profile of " << device_name(device) << " for this model. Run the calibration\n";
+                    return false;
+                }
+
+                perfs[j] = profile.mean_ms + profile.copy_ms;
+            }
+
+            perfs_ = perfs;
+
+            std::cout << "INFO: Scheduler perfs from the profile database:";
+            for(int j = 0; j < perfs_.size(); j++)
+                std::cout << " " << perfs_[j];
+            std::cout << "\n";
+
+            return true;
+        }
+
+        TfLiteStatus Interpreter::SetProfileParams(const char * db_path){
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    std::cout << "WARNING: The profiles seed the scheduler, it needs more than one device. Run without them.\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    if(!profile_db_.load(db_path))
+                        return kTfLiteError;
+
+                    // The accelerator and the tflite part of the model together
+                    model_hash_ = file_hash(tflite_filename_, file_hash(filename_, 0));
+
+                    seed_profile_perfs();
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        TfLiteStatus Interpreter::CalibrateProfile(int runs){
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    std::cout << "WARNING: The calibration profiles the devices of the scheduler, it needs more than one device. Run without it.\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    if(!profile_db_.is_loaded() || runs <= 0){
+                        std::cerr << "ERROR: The calibration needs a profile database and a positive number of runs\n";
+                        return kTfLiteError;
+                    }
+
+                    const int warmup_runs = 3;
+
+                    for(int j = 0; j < num_partition_devices(); j++){
+                        int device = partition_device(j);
+                        if(!device_available(device))
+                            continue;
+
+                        std::cout << "INFO: Calibrate " << device_name(device) << "..\n";
+
+                        // Every slot of the dispatch runs on the device, one run after the other
+                        device_mask_ = 1u << device;
+
+                        long slots = 0;
+                        double sum_ms = 0, sum_sq_ms = 0, sum_copy_ms = 0;
+                        for(int r = 0; r < warmup_runs + runs; r++){
+                            if(Invoke() != kTfLiteOk){
+                                device_mask_ = ~0u;
+                                return kTfLiteError;
+                            }
+
+                            turnaround_mutex_.lock();
+                            for(int i = 0; r >= warmup_runs && i < dispatch_batch_; i++){
+                                if(batch_run_[i] != device)
+                                    continue;
+
+                                slots++;
+                                sum_ms += slot_run_ms_[i];
+                                sum_sq_ms += slot_run_ms_[i] * slot_run_ms_[i];
+                                sum_copy_ms += slot_copy_ms_[i];
+                            }
+                            turnaround_mutex_.unlock();
+                        }
+
+                        device_mask_ = ~0u;
+
+                        if(slots == 0){
+                            std::cout << "WARNING: " << device_name(device) << " ran no slot. It is not profiled\n";
+                            continue;
+                        }
+
+                        DeviceProfile profile;
+                        profile.runs = slots;
+                        profile.mean_ms = sum_ms / slots;
+                        profile.std_ms = sqrt(std::max(0.0, sum_sq_ms / slots - profile.mean_ms * profile.mean_ms));
+                        profile.copy_ms = sum_copy_ms / slots;
+                        profile_db_.update(model_hash_, device_name(device), profile);
+
+                        std::cout << "INFO: " << device_name(device) << ": " << profile.mean_ms << " ms per slot, std " << profile.std_ms << " ms, output copy " << profile.copy_ms << " ms\n";
+                    }
+
+                    if(!profile_db_.save())
+                        return kTfLiteError;
+
+                    seed_profile_perfs();
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        TfLiteStatus Interpreter::SetVariantParams(const char * variants, double target_p95_ms){
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    std::cout << "WARNING: Variants are switched on the tflite devices of a mixed accelerator. Run without them.\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    std::vector<std::string> files;
+                    std::string list(variants);
+                    size_t start = 0, end;
+                    while((end = list.find(',', start)) != std::string::npos){
+                        files.push_back(list.substr(start, end - start));
+                        start = end + 1;
+                    }
+                    files.push_back(list.substr(start));
+
+                    if(files.size() > VariantController::MAX_VARIANTS || target_p95_ms <= 0){
+                        std::cerr << "ERROR: Up to " << VariantController::MAX_VARIANTS << " variants and a positive p95 target\n";
+                        return kTfLiteError;
+                    }
+
+                    // Not while a dispatch is running
+                    turnaround_mutex_.lock();
+
+                    // The gpu thread is started again below, which joins it. A gpu stuck in a call would block the caller
+                    if(gpuInterpreter_ != nullptr && device_busy_[0] && !gpu_feeder_.is_idle()){
+                        turnaround_mutex_.unlock();
+                        std::cerr << "ERROR: The gpu is stuck in a call. Its variants cannot be built\n";
+
+                        return kTfLiteError;
+                    }
+
+                    variant_files_ = files;
+                    variants_failed_ = false;
+
+                    hexagon_variants_.clear();
+                    hexagon_variants_.resize(files.size());
+                    for(int i = 0; hexagonInterpreter_ != nullptr && i < files.size(); i++){
+                        if(!build_tflite_variant(files[i].c_str(), 1, hexagon_variants_[i]))
+                            variants_failed_ = true;
+                    }
+
+                    // Without the files the gpu builds no variants
+                    if(variants_failed_)
+                        variant_files_.clear();
+
+                    // The gpu thread builds its variants when it starts, so it is started again. Once: it drops all of
+                    // them when one fails
+                    if(gpuInterpreter_ != nullptr){
+                        gpu_feeder_.start(Invoke_gpu_queue, Init_gpu_interpreter, Release_gpu_interpreter);
+                    }
+
+                    if(variants_failed_){
+                        variant_files_.clear();
+                        hexagon_variants_.clear();
+                        variant_controller_.set_params(0, 0);
+                        turnaround_mutex_.unlock();
+
+                        return kTfLiteError;
+                    }
+
+                    variant_controller_.set_params(files.size(), target_p95_ms);
+                    turnaround_mutex_.unlock();
+
+                    std::cout << "INFO: Switch between " << files.size() << " variants on the tflite devices for a p95 turnaround of " << target_p95_ms << " ms\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        int Interpreter::GetSlotVariant(int slot){
+            if((mode_ != 3 && mode_ != 4) || slot < 0 || slot >= slot_variants_.size())
+                return -1;
+
+            return slot_variants_[slot];
+        }
+
+        ::pkshin::VariantStats Interpreter::GetVariantStats(){
+            ::pkshin::VariantStats stats = {variant_controller_.enabled(), active_variant_, variant_switches_, {}};
+            for(int i = 0; i < VariantController::MAX_VARIANTS; i++)
+                stats.slots[i] = variant_slots_[i];
+
+            return stats;
+        }
+
+        TfLiteStatus Interpreter::SetCascadeParams(const char * model, float band_lo, float band_hi, int band_count){
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    std::cout << "WARNING: The cascade runs the larger model on the tflite devices of the scheduler, it needs more than one device. Run without it.\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    if(band_lo > band_hi || band_count <= 0){
+                        std::cerr << "ERROR: The uncertainty band needs lo <= hi and a positive count\n";
+                        return kTfLiteError;
+                    }
+
+                    if(gpuInterpreter_ == nullptr && hexagonInterpreter_ == nullptr){
+                        std::cerr << "ERROR: The cascade needs a tflite device\n";
+                        return kTfLiteError;
+                    }
+
+                    // Not while a dispatch is running
+                    turnaround_mutex_.lock();
+
+                    cascade_file_ = model;
+                    cascade_failed_ = false;
+
+                    release_tflite_variant(hexagon_cascade_);
+                    if(hexagonInterpreter_ != nullptr && !build_tflite_variant(model, 1, hexagon_cascade_))
+                        cascade_failed_ = true;
+
+                    // The gpu thread builds its cascade model when it starts, so it is started again
+                    if(gpuInterpreter_ != nullptr){
+                        gpu_feeder_.start(Invoke_gpu_queue, Init_gpu_interpreter, Release_gpu_interpreter);
+                    }
+
+                    if(cascade_failed_){
+                        cascade_file_.clear();
+                        release_tflite_variant(hexagon_cascade_);
+                        gpu_feeder_.start(Invoke_gpu_queue, Init_gpu_interpreter, Release_gpu_interpreter);
+                        turnaround_mutex_.unlock();
+
+                        return kTfLiteError;
+                    }
+
+                    cascade_band_[0] = band_lo;
+                    cascade_band_[1] = band_hi;
+                    cascade_count_ = band_count;
+                    turnaround_mutex_.unlock();
+
+                    std::cout << "INFO: Escalate the frames with " << band_count << " or more scores in [" << band_lo << ", " << band_hi << ") to " << model << "\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        bool Interpreter::IsCascadeEnabled(){
+            return (mode_ == 3 || mode_ == 4) && !cascade_file_.empty();
+        }
+
+        bool Interpreter::NeedsEscalation(const std::vector<float> & scores){
+            if(!IsCascadeEnabled())
+                return false;
+
+            int count = 0;
+            for(int i = 0; i < scores.size(); i++){
+                if(scores[i] >= cascade_band_[0] && scores[i] < cascade_band_[1])
+                    count++;
+            }
+
+            return count >= cascade_count_;
+        }
+
+        TfLiteStatus Interpreter::InvokeCascade(const std::vector<int> & slots){
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    std::cout << "WARNING: No cascade in this mode. Keep the results of the first model.\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    if(!IsCascadeEnabled()){
+                        std::cerr << "ERROR: No cascade model is set\n";
+                        return kTfLiteError;
+                    }
+
+                    if(slots.empty())
+                        return kTfLiteOk;
+
+                    if(active_shape_ >= 0){
+                        std::cerr << "ERROR: The cascade runs at the input shape of the model\n";
+                        return kTfLiteError;
+                    }
+
+                    // Wait for the first stage
+                    turnaround_mutex_.lock();
+
+                    for(int k = 0; k < slots.size(); k++){
+                        if(slots[k] < k || slots[k] >= dispatch_batch_ || (k > 0 && slots[k] <= slots[k - 1])){
+                            std::cerr << "ERROR: The escalated slots must be ascending slots of the last dispatch\n";
+                            turnaround_mutex_.unlock();
+                            return kTfLiteError;
+                        }
+                    }
+
+                    int tflite_input_size, tflite_output_size;
+                    tflite_io_sizes(tflite_input_size, tflite_output_size);
+
+                    // The slots the escalated ones are packed over are saved first, the frames in them keep their results
+                    save_cascade_slots(slots, tflite_input_size, tflite_output_size);
+
+                    // The escalated slots are packed to the front and run as a dispatch of their own
+                    for(int k = 0; k < slots.size(); k++){
+                        if(slots[k] == k)
+                            continue;
+
+                        for(int j = 0; j < tflite_input_size; j++){
+                            size_t bytes = slot_size(input_dims_[j]) * tensor_type_size(input_tensors_[j]->type);
+                            memcpy((uint8_t *)input_datas_[j] + k * bytes, (uint8_t *)input_datas_[j] + slots[k] * bytes, bytes);
+                        }
+                    }
+
+                    ::tflite::Interpreter * gpu_interpreter = gpuInterpreter_;
+                    ::tflite::Interpreter * hexagon_interpreter = hexagonInterpreter_;
+
+                    unsigned mask = 0;
+                    if(gpuInterpreter_ != nullptr){
+                        gpuInterpreter_ = gpu_cascade_.interpreter.get();
+                        mask |= 1u << 0;
+                    }
+                    if(hexagonInterpreter_ != nullptr){
+                        hexagonInterpreter_ = hexagon_cascade_.interpreter.get();
+                        mask |= 1u << 1;
+                    }
+
+                    cascade_batch_ = slots.size();
+                    device_mask_ = mask;
+                    cascade_running_ = true;
+                    turnaround_mutex_.unlock();
+
+                    TfLiteStatus status = Invoke();
+
+                    turnaround_mutex_.lock();
+                    gpuInterpreter_ = gpu_interpreter;
+                    hexagonInterpreter_ = hexagon_interpreter;
+                    device_mask_ = ~0u;
+                    cascade_running_ = false;
+
+                    // Back to the slots of the frames, from the last one so no packed slot is overwritten before it moved
+                    for(int k = slots.size() - 1; status == kTfLiteOk && k >= 0; k--){
+                        if(slots[k] == k)
+                            continue;
+
+                        for(int j = 0; j < tflite_output_size; j++){
+                            size_t bytes = slot_size(output_dims_[j]) * tensor_type_size(output_tensors_[j]->type);
+                            memcpy((uint8_t *)output_datas_[j] + slots[k] * bytes, (uint8_t *)output_datas_[j] + k * bytes, bytes);
+                        }
+
+                        batch_run_[slots[k]] = batch_run_[k];
+                    }
+
+                    restore_cascade_slots(slots, status == kTfLiteOk, tflite_input_size, tflite_output_size);
+
+                    turnaround_mutex_.unlock();
+
+                    return status;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        TfLiteStatus Interpreter::SetAccuracyParams(std::vector<float> accuracies, float min_accuracy, float target_accuracy){
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    std::cout << "WARNING: The accuracy scheduling picks between the devices of the scheduler, it needs more than one device. Run without it.\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    if(accuracies.size() != num_partition_devices()){
+                        std::cerr << "ERROR: The accuracy scheduling needs " << num_partition_devices() << " accuracies, one per device like the perfs\n";
+                        return kTfLiteError;
+                    }
+
+                    turnaround_mutex_.lock();
+                    accuracies_ = accuracies;
+                    min_accuracy_ = min_accuracy;
+                    target_accuracy_ = target_accuracy;
+                    turnaround_mutex_.unlock();
+
+                    std::cout << "INFO: Schedule the slots on the devices with an accuracy of " << min_accuracy << " or more";
+                    if(target_accuracy > 0)
+                        std::cout << ", for a mean accuracy of " << target_accuracy;
+                    std::cout << "\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        TfLiteStatus Interpreter::SetStreamAccuracy(int stream, float min_accuracy){
+            if(stream < 0 || stream >= stream_scheduler_.num_streams()){
+                std::cerr << "ERROR: No stream " << stream << "\n";
+                return kTfLiteError;
+            }
+
+            turnaround_mutex_.lock();
+            if(stream_min_accuracy_.size() <= stream)
+                stream_min_accuracy_.resize(stream + 1, 0);
+            stream_min_accuracy_[stream] = min_accuracy;
+            turnaround_mutex_.unlock();
+
+            std::cout << "INFO: Stream " << stream << " needs an accuracy of " << min_accuracy << " or more\n";
+
+            return kTfLiteOk;
+        }
+
+        ::pkshin::AccuracyStats Interpreter::GetAccuracyStats(){
+            turnaround_mutex_.lock();
+            ::pkshin::AccuracyStats stats = {accuracy_scheduling(), accuracy_slots_, accuracy_slots_ > 0 ? accuracy_sum_ / accuracy_slots_ : 0, accuracy_unmet_};
+            turnaround_mutex_.unlock();
+
+            return stats;
+        }
+
+        TfLiteStatus Interpreter::SetGateParams(const char * config){
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    std::cout << "WARNING: The device gate moves the load between the devices of the scheduler, it needs more than one device. Run without it.\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    turnaround_mutex_.lock();
+                    bool success = device_gate_.parse(config);
+                    turnaround_mutex_.unlock();
+
+                    if(!success)
+                        return kTfLiteError;
+
+                    std::cout << "INFO: Gate the devices on their temperature and the load: " << config << "\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        ::pkshin::GateStats Interpreter::GetGateStats(){
+            turnaround_mutex_.lock();
+            ::pkshin::GateStats stats = device_gate_.stats();
+            turnaround_mutex_.unlock();
+
+            return stats;
+        }
+
+        ::pkshin::BundleInfo Interpreter::GetBundleInfo(){
+            return {model_bundle_.is_loaded(), model_bundle_.family().c_str(), model_bundle_.preprocess().c_str()};
+        }
+
+        TfLiteStatus Interpreter::SetShapeParams(const char * shapes){
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    std::cout << "WARNING: Input shapes are switched on the tflite devices of a mixed accelerator. Run at the shape of the model.\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    if(gpuInterpreter_ == nullptr && hexagonInterpreter_ == nullptr){
+                        std::cerr << "ERROR: Input shapes need a tflite device\n";
+                        return kTfLiteError;
+                    }
+
+                    if(input_dims_[0]->size != 4){
+                        std::cerr << "ERROR: Input shapes need an image input of the model\n";
+                        return kTfLiteError;
+                    }
+
+                    if(split_enabled_){
+                        std::cerr << "ERROR: The head of a split model runs at the shape of the model. Input shapes do not run with it\n";
+                        return kTfLiteError;
+                    }
+
+                    if(remote_link_.enabled()){
+                        std::cerr << "ERROR: The remote engine runs at the shape of the model. Input shapes do not run with it\n";
+                        return kTfLiteError;
+                    }
+
+                    // Not while a dispatch is running
+                    turnaround_mutex_.lock();
+                    apply_input_shape(-1);
+
+                    if(!input_shapes_.parse(shapes, input_dims_[0]->data[2], input_dims_[0]->data[1])){
+                        turnaround_mutex_.unlock();
+                        return kTfLiteError;
+                    }
+
+                    shapes_failed_ = false;
+
+                    hexagon_shapes_.clear();
+                    hexagon_shapes_.resize(input_shapes_.size());
+                    for(int i = 0; hexagonInterpreter_ != nullptr && i < input_shapes_.size(); i++){
+                        if(!build_tflite_variant(NULL, 1, hexagon_shapes_[i], input_shapes_.width(i), input_shapes_.height(i)))
+                            shapes_failed_ = true;
+                    }
+
+                    // The gpu thread builds its shapes when it starts, so it is started again
+                    if(gpuInterpreter_ != nullptr){
+                        gpu_feeder_.start(Invoke_gpu_queue, Init_gpu_interpreter, Release_gpu_interpreter);
+                    }
+
+                    if(gpuInterpreter_ != nullptr && gpu_shapes_.size() != input_shapes_.size())
+                        shapes_failed_ = true;
+
+                    if(shapes_failed_){
+                        input_shapes_.clear();
+                        hexagon_shapes_.clear();
+                        gpu_feeder_.start(Invoke_gpu_queue, Init_gpu_interpreter, Release_gpu_interpreter);
+                        turnaround_mutex_.unlock();
+
+                        return kTfLiteError;
+                    }
+
+                    int tflite_input_size, tflite_output_size;
+                    tflite_io_sizes(tflite_input_size, tflite_output_size);
+
+                    // The dims of the tflite tensors past the batch, at the shape of the model and at every shape
+                    full_dims_.clear();
+                    for(int j = 0; j < tflite_input_size; j++)
+                        full_dims_.insert(full_dims_.end(), input_dims_[j]->data + 1, input_dims_[j]->data + input_dims_[j]->size);
+                    for(int j = 0; j < tflite_output_size; j++)
+                        full_dims_.insert(full_dims_.end(), output_dims_[j]->data + 1, output_dims_[j]->data + output_dims_[j]->size);
+
+                    shape_dims_.assign(input_shapes_.size(), std::vector<int>());
+                    for(int i = 0; i < input_shapes_.size(); i++){
+                        ::tflite::Interpreter * interpreter = hexagonInterpreter_ != nullptr ? hexagon_shapes_[i].interpreter.get() : gpu_shapes_[i].interpreter.get();
+                        for(int j = 0; j < tflite_input_size; j++){
+                            TfLiteIntArray * dims = interpreter->input_tensor(j)->dims;
+                            shape_dims_[i].insert(shape_dims_[i].end(), dims->data + 1, dims->data + dims->size);
+                        }
+                        for(int j = 0; j < tflite_output_size; j++){
+                            TfLiteIntArray * dims = interpreter->output_tensor(j)->dims;
+                            shape_dims_[i].insert(shape_dims_[i].end(), dims->data + 1, dims->data + dims->size);
+                        }
+                    }
+
+                    turnaround_mutex_.unlock();
+
+                    std::cout << "INFO: Run the batches at " << shapes << " besides the " << input_dims_[0]->data[2] << "x" << input_dims_[0]->data[1] << " of the model\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        int Interpreter::PickInputShape(int image_width, int image_height){
+            if((mode_ != 3 && mode_ != 4) || input_shapes_.size() == 0)
+                return -1;
+
+            return input_shapes_.pick(image_width, image_height);
+        }
+
+        TfLiteStatus Interpreter::SetInputShape(int shape){
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    return shape < 0 ? kTfLiteOk : kTfLiteError;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    if(shape < -1 || shape >= input_shapes_.size()){
+                        std::cerr << "ERROR: No input shape " << shape << std::endl;
+                        return kTfLiteError;
+                    }
+
+                    // Once the last dispatch is done. Its outputs have to be read before, their dims change
+                    turnaround_mutex_.lock();
+                    apply_input_shape(shape);
+                    turnaround_mutex_.unlock();
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        ::pkshin::ShapeStats Interpreter::GetShapeStats(){
+            return input_shapes_.stats();
+        }
+
+        TfLiteStatus Interpreter::SetSplitParams(const char * manifest){
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    std::cout << "WARNING: A split model hands the accelerator outputs to a head of the tflite part, it needs a mixed accelerator. Run the whole model on the device.\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    if(gpuInterpreter_ == nullptr && hexagonInterpreter_ == nullptr){
+                        std::cerr << "ERROR: A split model needs the tflite part, its head gives the outputs of it\n";
+                        return kTfLiteError;
+                    }
+
+                    if(slot_tracking() || input_shapes_.size() > 0 || remote_link_.enabled()){
+                        std::cerr << "ERROR: A split model does not run with hedging, device timeouts, input shapes or a remote engine\n";
+                        return kTfLiteError;
+                    }
+
+                    SplitManifest split;
+                    if(!split.load(manifest))
+                        return kTfLiteError;
+
+                    // Not while a dispatch is running
+                    turnaround_mutex_.lock();
+                    release_split();
+
+                    // A head per accelerator, an interpreter is run by one thread at a time
+                    int first = mode_ == 3 ? 2 : 3;
+                    int last = mode_ == 3 ? 2 : 5;
+                    for(int device = first; device <= last; device++){
+                        if(!build_split_head(split, device)){
+                            release_split();
+                            turnaround_mutex_.unlock();
+                            return kTfLiteError;
+                        }
+
+                        split_workers_[device].start(run_split_head, device);
+                    }
+
+                    split_enabled_ = true;
+                    turnaround_mutex_.unlock();
+
+                    std::cout << "INFO: Run the head of the split model " << split.head() << " on the cpu after the " << (mode_ == 3 ? "maccel" : "hailo") << " backbone\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        ::pkshin::SplitStats Interpreter::GetSplitStats(){
+            ::pkshin::SplitStats stats = {split_enabled_, 0, 0, 0};
+            for(int device = 2; device < DeviceHealth::MAX_DEVICES; device++){
+                stats.slots += split_workers_[device].slots();
+                stats.head_ms += split_workers_[device].head_ms();
+                stats.wait_ms += split_workers_[device].wait_ms();
+            }
+
+            if(stats.slots > 0){
+                stats.head_ms /= stats.slots;
+                stats.wait_ms /= stats.slots;
+            }
+
+            return stats;
+        }
+
+        // The registry models run on the cpu whatever the mode, beside the model of the engine
+        TfLiteStatus Interpreter::SetRegistryParams(const char * models, double budget_mb, int threads){
+            if(!model_registry_.parse(models, budget_mb, threads))
+                return kTfLiteError;
+
+            std::cout << "INFO: Serve the registry models " << models;
+            if(budget_mb > 0)
+                std::cout << " within " << budget_mb << " MB";
+            std::cout << "\n";
+
+            return kTfLiteOk;
+        }
+
+        TfLiteStatus Interpreter::PreloadModel(const char * id){
+            if(!model_registry_.has(id)){
+                std::cerr << "ERROR: No registry model " << id << std::endl;
+                return kTfLiteError;
+            }
+
+            model_registry_.preload(id);
+
+            return kTfLiteOk;
+        }
+
+        ::tflite::Interpreter * Interpreter::AcquireModel(const char * id){
+            return model_registry_.acquire(id);
+        }
+
+        void Interpreter::ReleaseModel(const char * id){
+            model_registry_.release(id);
+        }
+
+        ::pkshin::RegistryStats Interpreter::GetRegistryStats(){
+            return model_registry_.stats();
+        }
+
+        TfLiteStatus Interpreter::SetCropParams(const char * id, int max_batch){
+            if(!crop_classifier_.configure(&model_registry_, id, max_batch))
+                return kTfLiteError;
+
+            std::cout << "INFO: Classify the crops of the detections with " << id << " in batches of up to " << max_batch << "\n";
+
+            return kTfLiteOk;
+        }
+
+        TfLiteStatus Interpreter::ClassifyCrops(const std::vector<::pkshin::Crop> & crops, std::vector<int> & classes, std::vector<float> & scores){
+            if(!crop_classifier_.enabled()){
+                std::cerr << "ERROR: No crop classifier. Set it with SetCropParams\n";
+                return kTfLiteError;
+            }
+
+            return crop_classifier_.classify(crops, classes, scores) ? kTfLiteOk : kTfLiteError;
+        }
+
+        ::pkshin::CropStats Interpreter::GetCropStats(){
+            return crop_classifier_.stats();
+        }
+
+        TfLiteStatus Interpreter::SwapModel(const char * filename){
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    std::cerr << "ERROR: A hot swap replaces the tflite part of a mixed accelerator. Restart with the new model\n";
+
+                    return kTfLiteError;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    // They keep interpreters of the model of the command line to switch back to
+                    if(variant_controller_.enabled() || !cascade_file_.empty() || input_shapes_.size() > 0){
+                        std::cerr << "ERROR: A hot swap does not run with variants, the cascade or input shapes\n";
+                        return kTfLiteError;
+                    }
+
+                    // The dispatches switch the interpreters, so they are read between two of them
+                    turnaround_mutex_.lock();
+                    unsigned devices = (gpuInterpreter_ != nullptr ? 1u << 0 : 0) | (hexagonInterpreter_ != nullptr ? 1u << 1 : 0);
+                    turnaround_mutex_.unlock();
+
+                    if(devices == 0){
+                        std::cerr << "ERROR: A hot swap needs a tflite device\n";
+                        return kTfLiteError;
+                    }
+
+                    // The state goes to loading with the check, so of two calls only one starts a swap
+                    {
+                        std::lock_guard<std::mutex> lk(swap_mutex_);
+                        if(swap_state_ != SWAP_IDLE){
+                            std::cerr << "ERROR: The swap to " << swap_file_ << " is still running\n";
+                            return kTfLiteError;
+                        }
+
+                        swap_file_ = filename;
+                        swap_devices_ = devices;
+                        swap_state_ = SWAP_LOADING;
+                    }
+
+                    // The thread of the swap before is done with the state, it may still free a failed gpu model
+                    if(swap_thread_.joinable())
+                        swap_thread_.join();
+
+                    swap_thread_ = std::thread(load_swap);
+
+                    std::cout << "INFO: Load " << filename << " in the background. The running batches stay on the model before\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        ::pkshin::SwapStats Interpreter::GetSwapStats(){
+            std::lock_guard<std::mutex> lk(swap_mutex_);
+
+            ::pkshin::SwapStats stats;
+            stats.enabled = swap_version_ > 0 || swap_state_ != SWAP_IDLE;
+            stats.version = swap_version_;
+            stats.loading = swap_state_ == SWAP_LOADING;
+            for(int i = 0; i < 2; i++){
+                stats.slots[i] = version_slots_[i];
+                stats.slot_ms[i] = version_slots_[i] > 0 ? version_ms_[i] / version_slots_[i] : 0;
+            }
+
+            return stats;
+        }
+
+        TfLiteStatus Interpreter::SetRemoteParams(const char * address, int window, double cost_ms){
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    std::cerr << "ERROR: A remote engine joins the dispatch of a mixed accelerator\n";
+
+                    return kTfLiteError;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    if(split_enabled_ || input_shapes_.size() > 0){
+                        std::cerr << "ERROR: A remote engine does not run with a split model or input shapes\n";
+                        return kTfLiteError;
+                    }
+
+                    // Long enough for a slot of a busy board. A lost board, not a slow slot, closes the link
+                    const double timeout_ms = 10000;
+
+                    // Not while a dispatch is running
+                    turnaround_mutex_.lock();
+                    bool connected = remote_link_.connect(address, remote_layout(), window, timeout_ms);
+                    if(connected){
+                        remote_cost_ms_ = cost_ms;
+                        remote_inputs_.assign(inputs_.size(), NULL);
+                        remote_outputs_.assign(outputs_.size(), NULL);
+                        remote_staging_.resize(outputs_.size());
+                        for(int j = 0; j < outputs_.size(); j++)
+                            remote_staging_[j].resize(slot_size(output_dims_[j]) * tensor_type_size(output_tensors_[j]->type));
+                    }
+                    turnaround_mutex_.unlock();
+
+                    if(!connected)
+                        return kTfLiteError;
+
+                    std::cout << "INFO: The engine at " << address << " joins the dispatch, " << window << " slots in flight\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        TfLiteStatus Interpreter::ServeRemote(const char * address){
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    std::cerr << "ERROR: A served engine runs the dispatch of a mixed accelerator\n";
+
+                    return kTfLiteError;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    // The slots of a client run on the devices of this board only
+                    if(remote_link_.enabled() || split_enabled_ || input_shapes_.size() > 0){
+                        std::cerr << "ERROR: A served engine does not run with a remote engine of its own, a split model or input shapes\n";
+                        return kTfLiteError;
+                    }
+
+                    RemoteLayout layout = remote_layout();
+                    RemoteServer server;
+                    if(!server.listen(address, layout))
+                        return kTfLiteError;
+
+                    std::cout << "INFO: Serve the engine on " << address << "\n";
+
+                    // Until the server socket fails. The clients are served on threads of their own
+                    int fd;
+                    while((fd = server.accept()) >= 0){
+                        std::cout << "INFO: A remote client is in\n";
+                        std::thread(serve_remote_client, this, fd, layout).detach();
+                    }
+
+                    return kTfLiteError;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        ::pkshin::RemoteStats Interpreter::GetRemoteStats(){
+            return remote_link_.stats();
+        }
+
+        TfLiteStatus Interpreter::SetBatchTuningParams(double target_p95_ms){
+            switch(mode_){
+                case 0:
+                case 1:
+                case 2:
+                {
+                    if(target_p95_ms > 0)
+                        std::cout << "WARNING: Batch tuning needs more than one device. Run with the fixed batch size.\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    turnaround_mutex_.lock();
+                    latency_budget_ms_ = target_p95_ms > 0 ? target_p95_ms : 0;
+                    batch_tuner_.set_params(latency_budget_ms_, batch_sizes_);
+                    turnaround_mutex_.unlock();
+
+                    if(target_p95_ms > 0)
+                        std::cout << "INFO: Tune the batch size for a p95 turnaround of " << target_p95_ms << " ms\n";
+
+                    return kTfLiteOk;
+
+                    break;
+                }
+            }
+
+            return kTfLiteError;
+        }
+
+        int Interpreter::GetBatchSize(){
+            switch(mode_){
+                case 0:
+                {
+                    return ::tflite::Interpreter::input_tensor(0)->dims->data[0];
+
+                    break;
+                }
+                case 1:
+                case 2:
+                {
+                    return 1;
+
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    // The next Invoke dispatches the slots the caller fills for this answer. It latches the batch under
+                    // turnaround_mutex_, which is not taken here: it is held for a whole dispatch
+                    int batch = batch_tuner_.batch();
+                    if(batch > batch_sizes_)
+                        batch = batch_sizes_;
+
+                    active_batch_ = batch;
+
+                    return batch;
+
+                    break;
+                }
+            }
+
+            return 0;
+        }
+
+        TfLiteStatus Interpreter::SetExecutorParams(int num_threads, int tflite_threads){
+            if(!cpu_executor_.start(num_threads, &thread_placement_))
+                return kTfLiteError;
+
+            // One cpu backend context per concurrently invoked interpreter. It is not safe to share it between the gpu and hexagon threads
+            switch(mode_){
+                case 0:
+                {
+                    SetExternalContext(kTfLiteCpuBackendContext, &cpu_backend_context_);
+                    if(::tflite::Interpreter::SetNumThreads(tflite_threads) != kTfLiteOk)
+                        return kTfLiteError;
+
+                    break;
+                }
+                case 1:
+                case 2:
+                {
+                    break;
+                }
+                case 3:
+                case 4:
+                {
+                    if(gpuInterpreter_ != nullptr && gpuInterpreter_->SetNumThreads(tflite_threads) != kTfLiteOk)
+                        return kTfLiteError;
+
+                    if(hexagonInterpreter_ != nullptr && hexagonInterpreter_->SetNumThreads(tflite_threads) != kTfLiteOk)
+                        return kTfLiteError;
+
+                    break;
+                }
+            }
+
+            std::cout << "INFO: CPU executor uses " << num_threads << " threads, tflite uses " << tflite_threads << " threads.\n";
+
+            return kTfLiteOk;
+        }
+
+        TfLiteStatus Interpreter::ParallelFor(int role, int n, void (*fn)(void *, int), void * arg){
+            cpu_executor_.parallel_for(role, n, fn, arg);
+
+            return kTfLiteOk;
+        }
+
+        TfLiteStatus Interpreter::SetPostProcessParams(std::vector<float> ori_score_thrs, std::vector<float> new_score_thrs){
+            ori_score_thrs_ = ori_score_thrs;
+            new_score_thrs_ = new_score_thrs;
+            cur_score_thrs_ = ori_score_thrs;
+
+            return kTfLiteOk;
+        }
+
+        const std::vector<float> & Interpreter::GetPostProcessParams(){
+            return cur_score_thrs_;
+        }
+
+        double Interpreter::GetSumTurnAroundTime(){
+            turnaround_mutex_.lock();
+            double return_value = sum_turnaround_;
+            turnaround_mutex_.unlock();
+            return return_value;
+        }
+
+        double Interpreter::GetMaxTurnAroundTime(){
+            turnaround_mutex_.lock();
+            double return_value = max_turnaround_;
+            turnaround_mutex_.unlock();
+            return return_value;
+        }
+
+        // Runs on the gpu feeder thread, the gpu delegate has to be used from the thread that created it
+        TfLiteGpuDelegateOptionsV2 engine_gpu_delegate_options(){
+            TfLiteGpuDelegateOptionsV2 gpu_delegate_options = TfLiteGpuDelegateOptionsV2Default();
+            gpu_delegate_options.inference_priority1 = TFLITE_GPU_INFERENCE_PRIORITY_MIN_LATENCY;
+            gpu_delegate_options.inference_priority2 = TFLITE_GPU_INFERENCE_PRIORITY_MIN_MEMORY_USAGE;
+            gpu_delegate_options.inference_priority3 = TFLITE_GPU_INFERENCE_PRIORITY_MAX_PRECISION;
+            gpu_delegate_options.inference_preference = TFLITE_GPU_INFERENCE_PREFERENCE_SUSTAINED_SPEED;
+            gpu_delegate_options.experimental_flags |= TFLITE_GPU_EXPERIMENTAL_FLAGS_GL_ONLY;
+
+            return gpu_delegate_options;
+        }
+
+        // Builds a variant of the tflite part for device 0 (gpu) or 1 (hexagon). Its tensors must match the ones of the
+        // model of the command line, the slots are copied with their sizes. With no filename it is the model of the
+        // command line at the input shape width x height, its tensors then only have to fit in the slots
+        bool build_tflite_variant(const char * filename, int device, TfliteVariant & variant, int width, int height){
+            ::tflite::Interpreter * base = device == 0 ? gpuInterpreter_ : hexagonInterpreter_;
+            bool shaped = filename == NULL;
+            std::string name = shaped ? std::to_string(width) + "x" + std::to_string(height) + " shape" : std::string("variant ") + filename;
+
+            variant.model = shaped ? build_tflite_model() : ::tflite::FlatBufferModel::BuildFromFile(filename);
+            if(variant.model == NULL){
+                std::cerr << "ERROR: Load of the " << name << " failed\n";
+                return false;
+            }
+
+            ::tflite::ops::builtin::BuiltinOpResolver resolver;
+            ::tflite::InterpreterBuilder builder(*variant.model, resolver);
+            builder(&variant.interpreter);
+            if(variant.interpreter == NULL){
+                std::cerr << "ERROR: Interpreter build of the " << name << " failed\n";
+                return false;
+            }
+
+            // The delegates take the shape they are given, so the inputs are resized before
+            for(int j = 0; shaped && j < variant.interpreter->inputs().size(); j++){
+                TfLiteIntArray * dims = variant.interpreter->input_tensor(j)->dims;
+                if(dims->size != 4)
+                    continue;
+
+                if(variant.interpreter->ResizeInputTensor(variant.interpreter->inputs()[j], {dims->data[0], height, width, dims->data[3]}) != kTfLiteOk){
+                    std::cerr << "ERROR: Cannot resize the input " << j << " to the " << name << std::endl;
+                    return false;
+                }
+            }
+
+            if(device == 0){
+                TfLiteGpuDelegateOptionsV2 gpu_delegate_options = engine_gpu_delegate_options();
+                variant.delegate = ::tflite::Interpreter::TfLiteDelegatePtr(TfLiteGpuDelegateV2Create(&gpu_delegate_options), &TfLiteGpuDelegateV2Delete);
+            }
+            else{
+                TfLiteHexagonDelegateOptions npu_delegate_params = {0};
+                variant.delegate = ::tflite::Interpreter::TfLiteDelegatePtr(TfLiteHexagonDelegateCreate(&npu_delegate_params), &TfLiteHexagonDelegateDelete);
+            }
+
+            if(variant.delegate == nullptr || variant.interpreter->ModifyGraphWithDelegate(variant.delegate.get()) != kTfLiteOk || variant.interpreter->AllocateTensors() != kTfLiteOk){
+                std::cerr << "ERROR: Cannot run the " << name << " on " << device_name(device) << std::endl;
+                return false;
+            }
+
+            bool match = variant.interpreter->inputs().size() == base->inputs().size() && variant.interpreter->outputs().size() == base->outputs().size();
+            for(int j = 0; match && j < base->inputs().size(); j++){
+                size_t bytes = variant.interpreter->input_tensor(j)->bytes;
+                match = shaped ? bytes <= base->input_tensor(j)->bytes && variant.interpreter->input_tensor(j)->dims->size == base->input_tensor(j)->dims->size : bytes == base->input_tensor(j)->bytes;
+            }
+            for(int j = 0; match && j < base->outputs().size(); j++){
+                size_t bytes = variant.interpreter->output_tensor(j)->bytes;
+                match = shaped ? bytes <= base->output_tensor(j)->bytes && variant.interpreter->output_tensor(j)->dims->size == base->output_tensor(j)->dims->size : bytes == base->output_tensor(j)->bytes;
+            }
+
+            if(!match){
+                std::cerr << "ERROR: The tensors of the " << name << " do not " << (shaped ? "fit in the slots of" : "match") << " the model\n";
+                return false;
+            }
+
+            return true;
+        }
+
+        // The interpreter goes first, it uses the delegate and the model
+        void release_tflite_variant(TfliteVariant & variant){
+            variant.interpreter.reset();
+            variant.delegate.reset();
+            variant.model.reset();
+        }
+
+        void Init_gpu_interpreter(){
+            gpu_model_ = build_tflite_model();
+            if(gpu_model_ == NULL){
+                std::cerr << "ERROR: Model load failed. Check the model name.\n";
+                exit(-1);
+            }
+            
+            ::tflite::ops::builtin::BuiltinOpResolver resolver;
+            ::tflite::InterpreterBuilder builder(*gpu_model_, resolver);
+            builder(&gpu_interpreter_);
+            if(gpu_interpreter_ == NULL){
+                std::cerr << "ERROR: Interpreter build failed.\n";
+                exit(-1);
+            }
+            
+            TfLiteGpuDelegateOptionsV2 gpu_delegate_options = engine_gpu_delegate_options();
+
+            auto * gpu_delegate_ptr = TfLiteGpuDelegateV2Create(&gpu_delegate_options);
+            if(gpu_delegate_ptr == NULL){
+                std::cout << "WARNING: Cannot create gpu delegate. Run without gpu delegate.\n";
+                TfLiteGpuDelegateV2Delete(gpu_delegate_ptr);
+                gpuInterpreter_ = nullptr;
+            }
+            else{
+                // Kept as long as the interpreter uses it
+                gpu_delegate_ = ::tflite::Interpreter::TfLiteDelegatePtr(gpu_delegate_ptr, &TfLiteGpuDelegateV2Delete);
+
+                if (gpu_interpreter_->ModifyGraphWithDelegate(gpu_delegate_.get()) != kTfLiteOk){
+                    std::cout << "WARNING: Cannot convert model with gpu delegate. Run without gpu delegate.\n";
+                    gpuInterpreter_ = nullptr;
+                }
+                else{
+                    if(gpu_interpreter_->AllocateTensors() != kTfLiteOk) {
+                        std::cerr << "ERROR: Memory allocation for interpreter failed.\n";
+                        exit(-1);
+                    }
+                    
+                    gpuInterpreter_ = gpu_interpreter_.get();
+                }
+            }
+
+            // The gpu variants are built here too, a gpu interpreter is only used from the thread that built it
+            if(gpuInterpreter_ != nullptr && !variant_files_.empty()){
+                gpu_variants_.resize(variant_files_.size());
+                for(int i = 0; i < variant_files_.size(); i++){
+                    if(!build_tflite_variant(variant_files_[i].c_str(), 0, gpu_variants_[i]))
+                        variants_failed_ = true;
+                }
+
+                if(variants_failed_)
+                    gpu_variants_.clear();
+            }
+
+            if(gpuInterpreter_ != nullptr && !cascade_file_.empty()){
+                if(!build_tflite_variant(cascade_file_.c_str(), 0, gpu_cascade_))
+                    cascade_failed_ = true;
+            }
+
+            if(gpuInterpreter_ != nullptr && input_shapes_.size() > 0){
+                gpu_shapes_.resize(input_shapes_.size());
+                for(int i = 0; i < input_shapes_.size(); i++){
+                    if(!build_tflite_variant(NULL, 0, gpu_shapes_[i], input_shapes_.width(i), input_shapes_.height(i)))
+                        shapes_failed_ = true;
+                }
+            }
+        }
+
+        void Release_gpu_interpreter(){
+            std::cout << "INFO: Terminate gpu thread\n";
+
+            gpuInterpreter_ = nullptr;
+            gpu_variants_.clear();
+            release_tflite_variant(gpu_cascade_);
+            release_tflite_variant(gpu_swap_);
+            gpu_shapes_.clear();
+            gpu_interpreter_.reset();
+            gpu_delegate_.reset();
+            gpu_model_.reset();
+        }
+
+        void Invoke_gpu_queue(){
+            thread_placement_.apply(THREAD_ROLE_FEEDER);
+            HotPathScope hot_path(hot_path_monitor_);
+
+            run_device_queue(0, gpu_queue_);
+        }
+
+        // Elements of one batch slot of a tensor
+        int slot_size(TfLiteIntArray * dims){
+            int size = 1;
+            for(int k = 1; k < dims->size; k++)
+                size *= dims->data[k];
+
+            return size;
+        }
+
+        // Moves the tflite devices and the dims of the tflite tensors to an input shape, -1 for the one of the model. The
+        // slots of the tensors are packed at the dims, so the app fills and reads them like at the shape of the model.
+        // The accelerator part keeps its compiled shape and sits the shaped batches out. Called with turnaround_mutex_ held
+        void apply_input_shape(int shape){
+            if(shape == active_shape_)
+                return;
+
+            if(active_shape_ < 0){
+                full_gpu_interpreter_ = gpuInterpreter_;
+                full_hexagon_interpreter_ = hexagonInterpreter_;
+            }
+
+            int tflite_input_size, tflite_output_size;
+            tflite_io_sizes(tflite_input_size, tflite_output_size);
+
+            const std::vector<int> & dims = shape < 0 ? full_dims_ : shape_dims_[shape];
+            int k = 0;
+            for(int j = 0; j < tflite_input_size; j++){
+                for(int d = 1; d < input_dims_[j]->size; d++)
+                    input_dims_[j]->data[d] = dims[k++];
+            }
+            for(int j = 0; j < tflite_output_size; j++){
+                for(int d = 1; d < output_dims_[j]->size; d++)
+                    output_dims_[j]->data[d] = dims[k++];
+            }
+
+            if(shape < 0){
+                gpuInterpreter_ = full_gpu_interpreter_;
+                hexagonInterpreter_ = full_hexagon_interpreter_;
+                device_mask_ = ~0u;
+            }
+            else{
+                unsigned mask = 0;
+                if(full_gpu_interpreter_ != nullptr){
+                    gpuInterpreter_ = gpu_shapes_[shape].interpreter.get();
+                    mask |= 1u << 0;
+                }
+                if(full_hexagon_interpreter_ != nullptr){
+                    hexagonInterpreter_ = hexagon_shapes_[shape].interpreter.get();
+                    mask |= 1u << 1;
+                }
+                device_mask_ = mask;
+            }
+
+            active_shape_ = shape;
+        }
+
+        // The tflite part comes first in the inputs and outputs, the accelerator part follows it
+        void tflite_io_sizes(int & input_size, int & output_size){
+            ::tflite::Interpreter * interpreter = hexagonInterpreter_ != nullptr ? hexagonInterpreter_ : gpuInterpreter_;
+            if(interpreter != nullptr){
+                input_size = interpreter->inputs().size();
+                output_size = interpreter->outputs().size();
+            }
+            else{
+                input_size = 0;
+                output_size = 0;
+            }
+        }
+
+        // Saves the slots the escalated ones are packed over, every k below the count with slots[k] != k. Their tflite
+        // tensors go to the scratch, the per slot state of the dispatch beside them
+        void save_cascade_slots(const std::vector<int> & slots, int tflite_input_size, int tflite_output_size){
+            size_t bytes = 0;
+            for(int j = 0; j < tflite_input_size; j++)
+                bytes += slot_size(input_dims_[j]) * tensor_type_size(input_tensors_[j]->type);
+            for(int j = 0; j < tflite_output_size; j++)
+                bytes += slot_size(output_dims_[j]) * tensor_type_size(output_tensors_[j]->type);
+
+            cascade_saved_slots_.clear();
+            for(int k = 0; k < slots.size(); k++){
+                if(slots[k] != k)
+                    cascade_saved_slots_.push_back({k, batch_run_[k], slot_devices_[k], slot_variants_[k], remote_parts_[k], slot_run_ms_[k], slot_copy_ms_[k], turnaround_[k]});
+            }
+
+            if(cascade_saved_tensors_.size() < cascade_saved_slots_.size() * bytes)
+                cascade_saved_tensors_.resize(cascade_saved_slots_.size() * bytes);
+
+            uint8_t * saved = cascade_saved_tensors_.data();
+            for(int i = 0; i < cascade_saved_slots_.size(); i++){
+                int slot = cascade_saved_slots_[i].slot;
+                for(int j = 0; j < tflite_input_size; j++){
+                    size_t size = slot_size(input_dims_[j]) * tensor_type_size(input_tensors_[j]->type);
+                    memcpy(saved, (uint8_t *)input_datas_[j] + slot * size, size);
+                    saved += size;
+                }
+                for(int j = 0; j < tflite_output_size; j++){
+                    size_t size = slot_size(output_dims_[j]) * tensor_type_size(output_tensors_[j]->type);
+                    memcpy(saved, (uint8_t *)output_datas_[j] + slot * size, size);
+                    saved += size;
+                }
+            }
+        }
+
+        // Puts the saved slots back once the results of the cascade are in the slots of their frames. The inputs all come
+        // back, the outputs and state only for the frames that were not escalated, or for all when the cascade failed
+        void restore_cascade_slots(const std::vector<int> & slots, bool escalated, int tflite_input_size, int tflite_output_size){
+            uint8_t * saved = cascade_saved_tensors_.data();
+            for(int i = 0; i < cascade_saved_slots_.size(); i++){
+                const CascadeSavedSlot & state = cascade_saved_slots_[i];
+                bool outputs = !escalated || !std::binary_search(slots.begin(), slots.end(), state.slot);
+
+                for(int j = 0; j < tflite_input_size; j++){
+                    size_t size = slot_size(input_dims_[j]) * tensor_type_size(input_tensors_[j]->type);
+                    memcpy((uint8_t *)input_datas_[j] + state.slot * size, saved, size);
+                    saved += size;
+                }
+                for(int j = 0; j < tflite_output_size; j++){
+                    size_t size = slot_size(output_dims_[j]) * tensor_type_size(output_tensors_[j]->type);
+                    if(outputs)
+                        memcpy((uint8_t *)output_datas_[j] + state.slot * size, saved, size);
+                    saved += size;
+                }
+
+                if(!outputs)
+                    continue;
+
+                batch_run_[state.slot] = state.run;
+                slot_devices_[state.slot] = state.device;
+                slot_variants_[state.slot] = state.variant;
+                remote_parts_[state.slot] = state.remote_part;
+                slot_run_ms_[state.slot] = state.run_ms;
+                slot_copy_ms_[state.slot] = state.copy_ms;
+                turnaround_[state.slot] = state.turnaround;
+            }
+        }
+
+        std::pair<std::vector<hailort::InputVStream>, std::vector<hailort::OutputVStream>> * hailo_device_vstreams(int device){
+            switch(device){
+                case 3:
+                    return hailoVstreams_;
+                case 4:
+                    return hailoVstreams2_;
+                default:
+                    return hailoVstreams3_;
+            }
+        }
+
+        // Runs a slot on a device (batch_run_ codes). The outputs stay in the buffers of the device until store_device_slot,
+        // except for hailo with direct set, which reads them straight into the slot. Returns a DeviceFault
+        int run_device_slot(int device, int slot, bool direct){
+            if(fault_injector_.inject(device) != DEVICE_OK){
+                std::cerr << "ERROR: Injected fault on " << device_name(device) << "\n";
+                return DEVICE_ERROR;
+            }
+
+            int tflite_input_size, tflite_output_size;
+            tflite_io_sizes(tflite_input_size, tflite_output_size);
+
+            switch(device){
+                case 0:
+                case 1:
+                {
+                    ::tflite::Interpreter * interpreter = device == 0 ? gpuInterpreter_ : hexagonInterpreter_;
+
+                    for(int j = 0; j < interpreter->inputs().size(); j++){
+                        size_t bytes = slot_size(input_dims_[j]) * tensor_type_size(input_tensors_[j]->type);
+                        if(bytes > 0)
+                            memcpy(interpreter->input_tensor(j)->data.raw, (uint8_t *)input_datas_[j] + slot * bytes, bytes);
+                    }
+
+                    if(interpreter->Invoke() != kTfLiteOk){
+                        std::cerr << "ERROR: Model execute failed\n";
+                        return DEVICE_ERROR;
+                    }
+
+                    break;
+                }
+                case 2:
+                {
+                    maccel_inputs_.resize(inputs_.size() - tflite_input_size);
+
+                    for(int j = tflite_input_size; j < inputs_.size(); j++)
+                        maccel_inputs_[j - tflite_input_size] = (float *)input_datas_[j] + slot * slot_size(input_dims_[j]);
+
+                    // The output vectors are kept, so they are only allocated on the first inference
+                    mobilint::StatusCode sc = mobilintModel_->infer(maccel_inputs_, maccel_outputs_);
+                    if (!sc) {
+                        std::cerr << "ERROR: Failed to infer an output. error code: " << static_cast<int>(sc) << std::endl;
+                        return DEVICE_ERROR;
+                    }
+
+                    break;
+                }
+                case 3:
+                case 4:
+                case 5:
+                {
+                    auto * vstreams = hailo_device_vstreams(device);
+                    std::vector<std::vector<uint8_t>> & staging = hailo_staging_[device - 3];
+
+                    for(int j = tflite_input_size; j < inputs_.size(); j++){
+                        auto & inputVStream = vstreams->first[j - tflite_input_size];
+
+                        size_t bytes = slot_size(input_dims_[j]) * tensor_type_size(input_tensors_[j]->type);
+                        if(bytes == 0)
+                            continue;
+
+                        auto status = inputVStream.write(hailort::MemoryView((uint8_t *)input_datas_[j] + slot * bytes, bytes));
+                        if (HAILO_SUCCESS != status) {
+                            std::cerr << "ERROR: write to input vstream " << j << " failed\n";
+                            return status == HAILO_TIMEOUT ? DEVICE_TIMEOUT : DEVICE_ERROR;
+                        }
+                    }
+
+                    if(staging.size() < outputs_.size() - tflite_output_size)
+                        staging.resize(outputs_.size() - tflite_output_size);
+
+                    for(int j = tflite_output_size; j < outputs_.size(); j++){
+                        auto & outputVStream = vstreams->second[j - tflite_output_size];
+
+                        size_t bytes = slot_size(output_dims_[j]) * tensor_type_size(output_tensors_[j]->type);
+                        if(bytes == 0)
+                            continue;
+
+                        uint8_t * output_ptr;
+                        if(direct){
+                            output_ptr = (uint8_t *)output_datas_[j] + slot * bytes;
+                        }
+                        else{
+                            std::vector<uint8_t> & buffer = staging[j - tflite_output_size];
+                            if(buffer.size() < bytes)
+                                buffer.resize(bytes);
+                            output_ptr = buffer.data();
+                        }
+
+                        auto status = outputVStream.read(hailort::MemoryView(output_ptr, bytes));
+                        if (HAILO_SUCCESS != status) {
+                            std::cerr << "ERROR: reading output vstream " << j << " failed\n";
+                            return status == HAILO_TIMEOUT ? DEVICE_TIMEOUT : DEVICE_ERROR;
+                        }
+                    }
+
+                    break;
+                }
+                case REMOTE_DEVICE:
+                {
+                    // One request at a time, the result is staged like a hedged hailo one. run_remote_queue pipelines them
+                    for(int j = 0; j < inputs_.size(); j++)
+                        remote_inputs_[j] = (uint8_t *)input_datas_[j] + slot * slot_size(input_dims_[j]) * tensor_type_size(input_tensors_[j]->type);
+                    for(int j = 0; j < outputs_.size(); j++)
+                        remote_outputs_[j] = remote_staging_[j].data();
+
+                    auto start = std::chrono::high_resolution_clock::now();
+                    int fault = remote_link_.send(slot, remote_inputs_.data());
+                    if(fault == DEVICE_OK)
+                        fault = remote_link_.receive(slot, remote_part_, remote_outputs_.data());
+                    if(fault != DEVICE_OK)
+                        return fault;
+
+                    double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+                    remote_link_.record_queue(1, ms, ms);
+
+                    if(remote_part_ == REMOTE_FAILED){
+                        std::cerr << "ERROR: The remote engine failed the slot\n";
+                        remote_link_.count_lost(1);
+                        return DEVICE_ERROR;
+                    }
+
+                    break;
+                }
+            }
+
+            return DEVICE_OK;
+        }
+
+        // Copies the outputs of the last run_device_slot of a device into the slot
+        void store_device_slot(int device, int slot, bool direct){
+            int tflite_input_size, tflite_output_size;
+            tflite_io_sizes(tflite_input_size, tflite_output_size);
+
+            switch(device){
+                case 0:
+                case 1:
+                {
+                    ::tflite::Interpreter * interpreter = device == 0 ? gpuInterpreter_ : hexagonInterpreter_;
+
+                    for(int j = 0; j < interpreter->outputs().size(); j++){
+                        size_t bytes = slot_size(output_dims_[j]) * tensor_type_size(output_tensors_[j]->type);
+                        if(bytes > 0)
+                            memcpy((uint8_t *)output_datas_[j] + slot * bytes, interpreter->output_tensor(j)->data.raw, bytes);
+                    }
+
+                    break;
+                }
+                case 2:
+                {
+                    for(int j = tflite_output_size; j < outputs_.size(); j++){
+                        int size = slot_size(output_dims_[j]);
+                        memcpy((float *)output_datas_[j] + slot * size, maccel_outputs_[j - tflite_output_size].data(), sizeof(float) * size);
+                    }
+
+                    break;
+                }
+                case 3:
+                case 4:
+                case 5:
+                {
+                    if(direct)
+                        break;
+
+                    for(int j = tflite_output_size; j < outputs_.size(); j++){
+                        size_t bytes = slot_size(output_dims_[j]) * tensor_type_size(output_tensors_[j]->type);
+                        if(bytes > 0)
+                            memcpy((uint8_t *)output_datas_[j] + slot * bytes, hailo_staging_[device - 3][j - tflite_output_size].data(), bytes);
+                    }
+
+                    break;
+                }
+                case REMOTE_DEVICE:
+                {
+                    int first = remote_part_ == REMOTE_TFLITE ? 0 : tflite_output_size;
+                    int last = remote_part_ == REMOTE_TFLITE ? tflite_output_size : outputs_.size();
+                    for(int j = first; j < last; j++){
+                        size_t bytes = slot_size(output_dims_[j]) * tensor_type_size(output_tensors_[j]->type);
+                        if(bytes > 0)
+                            memcpy((uint8_t *)output_datas_[j] + slot * bytes, remote_staging_[j].data(), bytes);
+                    }
+
+                    remote_parts_[slot] = remote_part_;
+
+                    break;
+                }
+            }
+        }
+
+        // Hands a finished slot to the app. start is the start of the run that gave the result and stored the end of it
+        void finish_device_slot(int device, int slot, std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point stored){
+            auto end = std::chrono::high_resolution_clock::now();
+            slot_run_ms_[slot] = std::chrono::duration<double, std::milli>(stored - start).count();
+            slot_copy_ms_[slot] = std::chrono::duration<double, std::milli>(end - stored).count();
+            slot_variants_[slot] = device <= 1 ? active_variant_ : -1;
+            turnaround_[slot] = std::chrono::duration_cast<std::chrono::milliseconds>(end - invoke_start_).count();
+            trace_recorder_.record(slot, device, start, end);
+
+            batch_run_[slot] = device;
+            batch_mutex_[slot].unlock();
+        }
+
+        // Builds the head of a split model for an accelerator and checks it against the tensors of the engine: the
+        // links take accelerator outputs to head inputs, and the head outputs are the outputs of the tflite part
+        bool build_split_head(SplitManifest & split, int device){
+            SplitHead & head = split_heads_[device];
+            int tflite_input_size, tflite_output_size;
+            tflite_io_sizes(tflite_input_size, tflite_output_size);
+
+            head.model = ::tflite::FlatBufferModel::BuildFromFile(split.head().c_str());
+            if(head.model == NULL){
+                std::cerr << "ERROR: Load of the split head " << split.head() << " failed\n";
+                return false;
+            }
+
+            ::tflite::ops::builtin::BuiltinOpResolver resolver;
+            ::tflite::InterpreterBuilder builder(*head.model, resolver);
+            builder(&head.interpreter);
+            if(head.interpreter == NULL){
+                std::cerr << "ERROR: Interpreter build of the split head failed\n";
+                return false;
+            }
+
+            head.interpreter->SetNumThreads(split.threads());
+            if(head.interpreter->AllocateTensors() != kTfLiteOk){
+                std::cerr << "ERROR: Memory allocation for the split head failed\n";
+                return false;
+            }
+
+            ::tflite::Interpreter * interpreter = head.interpreter.get();
+            head.links.assign(interpreter->inputs().size(), -1);
+            for(const SplitLink & link : split.links()){
+                int output = -1;
+                for(int j = tflite_output_size; j < outputs_.size(); j++){
+                    if(strcmp(output_names_[j], link.output.c_str()) == 0)
+                        output = j;
+                }
+
+                int input = -1;
+                for(int i = 0; i < interpreter->inputs().size(); i++){
+                    if(strcmp(interpreter->GetInputName(i), link.input.c_str()) == 0)
+                        input = i;
+                }
+
+                if(output < 0 || input < 0){
+                    std::cerr << "ERROR: The split link " << link.output << " -> " << link.input << " names no " << (output < 0 ? "accelerator output" : "head input") << std::endl;
+                    return false;
+                }
+
+                TfLiteTensor * from = output_tensors_[output];
+                TfLiteTensor * to = interpreter->input_tensor(input);
+                bool convertible = from->type == to->type || (to->type == kTfLiteFloat32 && tensor_type_size(from->type) > 0) || (from->type == kTfLiteFloat32 && to->type == kTfLiteUInt8);
+                if(!convertible || tensor_type_size(to->type) == 0 || to->bytes != slot_size(output_dims_[output]) * tensor_type_size(to->type)){
+                    std::cerr << "ERROR: The accelerator output " << link.output << " does not fit the head input " << link.input << std::endl;
+                    return false;
+                }
+
+                head.links[input] = output;
+            }
+
+            for(int i = 0; i < head.links.size(); i++){
+                if(head.links[i] < 0){
+                    std::cerr << "ERROR: The head input " << interpreter->GetInputName(i) << " has no split link\n";
+                    return false;
+                }
+            }
+
+            if(interpreter->outputs().size() != tflite_output_size){
+                std::cerr << "ERROR: The split head has " << interpreter->outputs().size() << " outputs, the tflite part " << tflite_output_size << std::endl;
+                return false;
+            }
+
+            for(int j = 0; j < tflite_output_size; j++){
+                TfLiteTensor * to = interpreter->output_tensor(j);
+                if(to->type != output_tensors_[j]->type || to->bytes != slot_size(output_dims_[j]) * tensor_type_size(output_tensors_[j]->type)){
+                    std::cerr << "ERROR: The output " << j << " of the split head differs from the one of the tflite part\n";
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        // Stops the head workers, once their slots are done, and drops the heads
+        void release_split(){
+            split_enabled_ = false;
+            for(int device = 0; device < DeviceHealth::MAX_DEVICES; device++){
+                split_workers_[device].stop();
+                split_heads_[device].interpreter.reset();
+                split_heads_[device].model.reset();
+                split_heads_[device].links.clear();
+            }
+        }
+
+        // Hands a backbone output to a head input. The accelerator quantization is undone for a float head, and the
+        // head one applied to a uint8 head fed a float output
+        void convert_split_tensor(TfLiteTensor * from, const void * data, int size, TfLiteTensor * to){
+            if(from->type == to->type){
+                memcpy(to->data.raw, data, size * tensor_type_size(to->type));
+            }
+            else if(to->type == kTfLiteFloat32){
+                float scale = from->params.scale;
+                int zero_point = from->params.zero_point;
+                float * out = to->data.f;
+                if(from->type == kTfLiteUInt8){
+                    for(int k = 0; k < size; k++)
+                        out[k] = (((const uint8_t *)data)[k] - zero_point) * scale;
+                }
+                else{
+                    for(int k = 0; k < size; k++)
+                        out[k] = (((const uint16_t *)data)[k] - zero_point) * scale;
+                }
+            }
+            else{
+                float scale = to->params.scale;
+                int zero_point = to->params.zero_point;
+                for(int k = 0; k < size; k++){
+                    int value = (int)roundf(((const float *)data)[k] / scale) + zero_point;
+                    to->data.uint8[k] = (uint8_t)std::min(255, std::max(0, value));
+                }
+            }
+        }
+
+        // Second stage of an accelerator slot of a split model, on the worker of the device: the head takes the
+        // backbone outputs of the slot to the tflite outputs of it. start is the start of the backbone run
+        void run_split_head(int device, int slot, std::chrono::high_resolution_clock::time_point start){
+            ::tflite::Interpreter * interpreter = split_heads_[device].interpreter.get();
+
+            for(int i = 0; i < interpreter->inputs().size(); i++){
+                int j = split_heads_[device].links[i];
+                int size = slot_size(output_dims_[j]);
+                convert_split_tensor(output_tensors_[j], (uint8_t *)output_datas_[j] + slot * size * tensor_type_size(output_tensors_[j]->type), size, interpreter->input_tensor(i));
+            }
+
+            if(interpreter->Invoke() != kTfLiteOk){
+                std::cerr << "ERROR: Split head execute failed\n";
+                exit(-1);
+            }
+
+            auto stored = std::chrono::high_resolution_clock::now();
+            for(int j = 0; j < interpreter->outputs().size(); j++){
+                size_t bytes = slot_size(output_dims_[j]) * tensor_type_size(output_tensors_[j]->type);
+                if(bytes > 0)
+                    memcpy((uint8_t *)output_datas_[j] + slot * bytes, interpreter->output_tensor(j)->data.raw, bytes);
+            }
+
+            finish_device_slot(device, slot, start, stored);
+        }
+
+        // Slots are tracked per dispatch when another device may take them over, for hedging or after a device fault
+        bool slot_tracking(){
+            return slot_hedger_.enabled() || device_timeout_ms_ > 0;
+        }
+
+        // Gives up a slot no device could run. The app gets no output for it
+        void drop_slot(int slot){
+            auto end = std::chrono::high_resolution_clock::now();
+            turnaround_[slot] = std::chrono::duration_cast<std::chrono::milliseconds>(end - invoke_start_).count();
+            trace_recorder_.record(slot, -1, end, end);
+
+            device_health_.count_dropped(1);
+            batch_run_[slot] = -1;
+            batch_mutex_[slot].unlock();
+        }
+
+        // Runs a slot that another device may also run. The outputs are staged and only the first result is stored
+        int run_tracked_slot(int device, int slot, int generation){
+            auto start = std::chrono::high_resolution_clock::now();
+            int fault = run_device_slot(device, slot, false);
+            if(fault != DEVICE_OK)
+                return fault;
+
+            double service_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+            if(slot_hedger_.finish(slot, device, generation, service_ms)){
+                auto stored = std::chrono::high_resolution_clock::now();
+                store_device_slot(device, slot, false);
+                finish_device_slot(device, slot, start, stored);
+            }
+
+            return DEVICE_OK;
+        }
+
+        // Runs the queue of the remote engine without slot tracking. The requests go out up to the window ahead of the
+        // results, so the remote board runs a slot while the next ones are on the wire. A lost link drops the slots it
+        // did not give back, the other devices take them over only with slot tracking
+        void run_remote_queue(std::vector<int> & queue){
+            auto queue_start = std::chrono::high_resolution_clock::now();
+            auto previous = queue_start;
+            double first_ms = 0;
+            int sent = 0, done = 0;
+            int fault = DEVICE_OK;
+
+            for(; done < queue.size(); done++){
+                while(fault == DEVICE_OK && sent < queue.size() && sent - done < remote_link_.window()){
+                    int slot = queue[sent];
+                    for(int j = 0; j < inputs_.size(); j++)
+                        remote_inputs_[j] = (uint8_t *)input_datas_[j] + slot * slot_size(input_dims_[j]) * tensor_type_size(input_tensors_[j]->type);
+
+                    remote_sent_at_[slot] = std::chrono::high_resolution_clock::now();
+                    fault = remote_link_.send(slot, remote_inputs_.data());
+                    sent++;
+                }
+
+                int slot = queue[done];
+                for(int j = 0; j < outputs_.size(); j++)
+                    remote_outputs_[j] = (uint8_t *)output_datas_[j] + slot * slot_size(output_dims_[j]) * tensor_type_size(output_tensors_[j]->type);
+
+                int part;
+                if(fault == DEVICE_OK)
+                    fault = remote_link_.receive(slot, part, remote_outputs_.data());
+                if(fault != DEVICE_OK)
+                    break;
+
+                auto stored = std::chrono::high_resolution_clock::now();
+                if(done == 0)
+                    first_ms = std::chrono::duration<double, std::milli>(stored - queue_start).count();
+
+                // A pipelined slot runs from its send or from the result before it, whichever is later
+                auto start = std::max(remote_sent_at_[slot], previous);
+                previous = stored;
+
+                if(part == REMOTE_FAILED){
+                    remote_link_.count_lost(1);
+                    drop_slot(slot);
+                    continue;
+                }
+
+                remote_parts_[slot] = part;
+                finish_device_slot(REMOTE_DEVICE, slot, start, stored);
+            }
+
+            if(fault != DEVICE_OK){
+                std::cout << "WARNING: The remote engine is lost. Drop its " << queue.size() - done << " slots of the batch\n";
+                remote_link_.count_lost(queue.size() - done);
+                device_health_.report_fault(REMOTE_DEVICE, fault);
+                for(int i = done; i < queue.size(); i++)
+                    drop_slot(queue[i]);
+
+                return;
+            }
+
+            if(!queue.empty())
+                remote_link_.record_queue(queue.size(), first_ms, std::chrono::duration<double, std::milli>(previous - queue_start).count());
+        }
+
+        // Slot cost of the remote engine for the partition: measured once it ran slots, before that the one of the
+        // app or the slowest device of the mode
+        float remote_cost(){
+            if(!remote_link_.connected())
+                return PARTITION_UNUSABLE;
+
+            if(remote_link_.slot_ms() > 0)
+                return remote_link_.slot_ms();
+
+            if(remote_cost_ms_ > 0)
+                return remote_cost_ms_;
+
+            float slowest = 0;
+            for(int j = 0; j < num_partition_devices() && j < perfs_.size(); j++){
+                if(device_available(partition_device(j)))
+                    slowest = std::max(slowest, perfs_[j]);
+            }
+
+            return slowest > 0 ? slowest : 1;
+        }
+
+        // The slot bytes of the tensors, what a remote engine has to run the same way
+        RemoteLayout remote_layout(){
+            int tflite_input_size, tflite_output_size;
+            tflite_io_sizes(tflite_input_size, tflite_output_size);
+
+            RemoteLayout layout;
+            layout.mode = mode_;
+            layout.tflite_outputs = tflite_output_size;
+            for(int j = 0; j < inputs_.size(); j++)
+                layout.input_bytes.push_back(slot_size(input_dims_[j]) * tensor_type_size(input_tensors_[j]->type));
+            for(int j = 0; j < outputs_.size(); j++)
+                layout.output_bytes.push_back(slot_size(output_dims_[j]) * tensor_type_size(output_tensors_[j]->type));
+
+            return layout;
+        }
+
+        // Serves the engine of another board. The requests waiting are run as one dispatch of this engine, up to its
+        // batch, and the results go back in order as the slots finish. The clients take turns on the engine
+        void serve_remote_client(Interpreter * interpreter, int fd, RemoteLayout layout){
+            std::vector<void *> inputs(inputs_.size());
+            std::vector<void *> outputs(outputs_.size());
+            std::vector<uint32_t> tags(batch_sizes_);
+            bool open = true;
+
+            while(open && remote_readable(fd, -1)){
+                std::lock_guard<std::mutex> lk(remote_serve_mutex_);
+
+                // The first request is there, the ones waiting behind it join its dispatch
+                int count = 0;
+                do{
+                    for(int j = 0; j < inputs_.size(); j++)
+                        inputs[j] = (uint8_t *)input_datas_[j] + count * layout.input_bytes[j];
+
+                    open = remote_read_request(fd, layout, tags[count], inputs.data());
+                    if(open)
+                        count++;
+                } while(open && count < batch_sizes_ && remote_readable(fd, 0));
+
+                if(count == 0)
+                    break;
+
+                turnaround_mutex_.lock();
+                active_batch_ = count;
+                turnaround_mutex_.unlock();
+
+                TfLiteStatus status = interpreter->Invoke();
+
+                for(int i = 0; i < count; i++){
+                    int part = REMOTE_FAILED;
+                    if(status == kTfLiteOk){
+                        batch_mutex_[i].lock();
+                        int device = batch_run_[i];
+                        batch_mutex_[i].unlock();
+
+                        part = device < 0 ? REMOTE_FAILED : device <= 1 ? REMOTE_TFLITE : REMOTE_ACCELERATOR;
+                    }
+
+                    for(int j = 0; j < outputs_.size(); j++)
+                        outputs[j] = (uint8_t *)output_datas_[j] + i * layout.output_bytes[j];
+
+                    if(!remote_write_result(fd, layout, tags[i], part, outputs.data())){
+                        open = false;
+                        break;
+                    }
+                }
+            }
+
+            close(fd);
+            std::cout << "INFO: A remote client left\n";
+        }
+
+        // Runs the queue of a device. With slot tracking on, a failing device hands its slots to the others, and a device
+        // done with its queue then takes the slots of failed devices and, with hedging, the ones other devices are late on
+        void run_device_queue(int device, std::vector<int> & queue){
+            if(!slot_tracking() && device == REMOTE_DEVICE){
+                run_remote_queue(queue);
+                return;
+            }
+
+            if(!slot_tracking()){
+                int fault = DEVICE_OK;
+                for(int i = 0; i < queue.size(); i++){
+                    auto start = std::chrono::high_resolution_clock::now();
+                    fault = run_device_slot(device, queue[i], true);
+
+                    // Nothing takes the slots over without slot tracking. They are dropped and the device is quarantined
+                    if(fault != DEVICE_OK){
+                        std::cout << "WARNING: " << device_name(device) << " failed. Drop its " << queue.size() - i << " slots of the batch\n";
+                        device_health_.report_fault(device, fault);
+                        for(int j = i; j < queue.size(); j++)
+                            drop_slot(queue[j]);
+                        break;
+                    }
+
+                    auto stored = std::chrono::high_resolution_clock::now();
+                    store_device_slot(device, queue[i], true);
+
+                    // The head of a split model runs on the worker while the backbone takes the next slot
+                    if(split_enabled_ && device >= 2)
+                        split_workers_[device].push(queue[i], start);
+                    else
+                        finish_device_slot(device, queue[i], start, stored);
+                }
 
-                    int size = 1;
-                    for(int k = 1; k < output_dims_[j]->size; k++)
-                        size *= output_dims_[j]->data[k];
+                if(split_enabled_ && device >= 2)
+                    split_workers_[device].drain();
 
-                    if(output_tensors_[j]->type == kTfLiteUInt8){
-                        uint8_t * output_ptr = (uint8_t *)output_datas_[j] + hailo_queue_[i] * size;
-                        auto status = outputVStream.read(hailort::MemoryView(output_ptr, size * sizeof(uint8_t)));
-                        if (HAILO_SUCCESS != status) {
-                            std::cerr << "ERROR: reading output vstream " << j << " failed\n";
-                            exit(-1);
-                        }
-                    }
-                    else if(output_tensors_[j]->type == kTfLiteFloat32){
-                        float * output_ptr = (float *)output_datas_[j] + hailo_queue_[i] * size;
-                        auto status = outputVStream.read(hailort::MemoryView(output_ptr, size * sizeof(float)));
-                        if (HAILO_SUCCESS != status) {
-                            std::cerr << "ERROR: reading output vstream " << j << " failed\n";
-                            exit(-1);
-                        }
-                    }
+                if(fault == DEVICE_OK && !queue.empty())
+                    device_health_.report_ok(device);
+
+                return;
+            }
+
+            int generation = slot_hedger_.generation();
+            int fault = DEVICE_OK;
+            bool ran = false;
+
+            for(int i = 0; i < queue.size() && fault == DEVICE_OK; i++){
+                if(slot_hedger_.claim(queue[i], device, generation)){
+                    fault = run_tracked_slot(device, queue[i], generation);
+                    ran = true;
                 }
-                auto elapsed = std::chrono::high_resolution_clock::now() - invoke_start_;
-                turnaround_[hailo_queue_[i]] = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+            }
+
+            int slot;
+            while(fault == DEVICE_OK && (slot = slot_hedger_.take_straggler(device, generation)) >= 0){
+                fault = run_tracked_slot(device, slot, generation);
+                ran = true;
+            }
 
-                batch_run_[hailo_queue_[i]] = 3;
-                batch_mutex_[hailo_queue_[i]].unlock();
+            if(fault != DEVICE_OK){
+                device_health_.report_fault(device, fault);
+                device_health_.count_requeued(slot_hedger_.fail(device, generation, drop_slot));
+            }
+            else if(ran && !slot_hedger_.failed(device, generation)){
+                // A device the watchdog gave up on stays quarantined even if its call came back
+                device_health_.report_ok(device);
             }
         }
 
+        void Invoke_hexagon_queue(){
+            thread_placement_.apply(THREAD_ROLE_FEEDER);
+            HotPathScope hot_path(hot_path_monitor_);
+
+            run_device_queue(1, hexagon_queue_);
+        }
+
+        void Invoke_maccel_queue(){
+            thread_placement_.apply(THREAD_ROLE_FEEDER);
+            HotPathScope hot_path(hot_path_monitor_);
+
+            run_device_queue(2, maccel_queue_);
+        }
+
+        void Invoke_hailo_queue(){
+            thread_placement_.apply(THREAD_ROLE_FEEDER);
+            HotPathScope hot_path(hot_path_monitor_);
+
+            run_device_queue(3, hailo_queue_);
+        }
+
         void Invoke_hailo_queue2(){
-            ::tflite::Interpreter * interpreter;
-            int tflite_input_size, tflite_output_size;
-            if(hexagonInterpreter_ != nullptr){
-                interpreter = hexagonInterpreter_;
-                tflite_input_size = interpreter->inputs().size();
-                tflite_output_size = interpreter->outputs().size();
+            thread_placement_.apply(THREAD_ROLE_FEEDER);
+            HotPathScope hot_path(hot_path_monitor_);
+
+            run_device_queue(4, hailo_queue2_);
+        }
+
+        void Invoke_hailo_queue3(){
+            thread_placement_.apply(THREAD_ROLE_FEEDER);
+            HotPathScope hot_path(hot_path_monitor_);
+
+            run_device_queue(5, hailo_queue3_);
+        }
+
+        void Invoke_remote_queue(){
+            thread_placement_.apply(THREAD_ROLE_FEEDER);
+            HotPathScope hot_path(hot_path_monitor_);
+
+            run_device_queue(REMOTE_DEVICE, remote_queue_);
+        }
+
+        // Feeds the finished dispatch to the variant controller, with the frames of the streams waiting for a slot
+        void record_variant_dispatch(){
+            if(!variant_controller_.enabled() || active_shape_ >= 0)
+                return;
+
+            for(int i = 0; i < dispatch_batch_; i++){
+                int device = batch_run_[i];
+                if(device != 0 && device != 1)
+                    continue;
+
+                double & ms = variant_ms_[device][active_variant_ + 1];
+                ms = ms == 0 ? slot_run_ms_[i] : 0.9 * ms + 0.1 * slot_run_ms_[i];
+                if(active_variant_ >= 0)
+                    variant_slots_[active_variant_]++;
             }
-            else if(gpuInterpreter_ != nullptr){
-                interpreter = gpuInterpreter_;
-                tflite_input_size = interpreter->inputs().size();
-                tflite_output_size = interpreter->outputs().size();
+
+            long backlog = 0;
+            for(int i = 0; i < stream_scheduler_.num_streams(); i++)
+                backlog += stream_scheduler_.stats(i).pending;
+
+            variant_controller_.record(dispatch_batch_, turnaround_.data(), backlog);
+        }
+
+        bool accuracy_scheduling(){
+            return !accuracies_.empty();
+        }
+
+        // Partition index of a batch_run_ device code, the inverse of partition_device
+        int partition_index(int device){
+            if(device == REMOTE_DEVICE)
+                return num_partition_devices();
+
+            return mode_ == 4 && device >= 3 ? device - 1 : device;
+        }
+
+        // Partitions the slots of the dispatch over the n devices of costs c. Under accuracy scheduling every slot needs
+        // the minimum of the engine and of its stream. Called with turnaround_mutex_ held
+        void partition_dispatch(const float * c, int n, int * k){
+            if(!accuracy_scheduling() || cascade_running_){
+                // The round trip of the remote engine comes once per dispatch, whatever its share
+                float latencies[DeviceHealth::MAX_DEVICES + 1];
+                for(int j = 0; j < n; j++)
+                    latencies[j] = partition_device(j) == REMOTE_DEVICE ? remote_link_.latency_ms() : 0;
+
+                partition_greedy(c, n, dispatch_batch_, slot_devices_.data(), k, latencies);
+                return;
             }
-            else{
-                tflite_input_size = 0;
-                tflite_output_size = 0;
+
+            // The remote engine sits the accuracy scheduling out
+            for(int j = num_partition_devices(); j < n; j++)
+                k[j] = 0;
+            n = num_partition_devices();
+
+            for(int i = 0; i < dispatch_batch_; i++){
+                int stream = stream_scheduler_.slot_stream(i);
+                slot_min_accuracy_[i] = min_accuracy_;
+                if(stream >= 0 && stream < stream_min_accuracy_.size())
+                    slot_min_accuracy_[i] = std::max(min_accuracy_, stream_min_accuracy_[stream]);
             }
 
-            for(int i = 0; i < hailo_queue2_.size(); i++){
-                //std::cout << "Invoke hailo queue2\n";
-                for(int j = tflite_input_size; j < inputs_.size(); j++){
-                    auto & inputVStream = hailoVstreams2_->first[j - tflite_input_size];
+            partition_accuracy(c, accuracies_.data(), n, dispatch_batch_, slot_min_accuracy_.data(), target_accuracy_, slot_devices_.data(), k);
+        }
 
-                    int size = 1;
-                    for(int k = 1; k < input_dims_[j]->size; k++)
-                        size *= input_dims_[j]->data[k];
+        // Devices under the minimum of the slot, kept from taking it over. None when no device meets it, the slot then
+        // runs wherever it can
+        unsigned accuracy_excluded(int slot){
+            if(!accuracy_scheduling() || cascade_running_)
+                return 0;
+
+            unsigned excluded = 0;
+            bool met = false;
+            for(int j = 0; j < num_partition_devices(); j++){
+                if(accuracies_[j] < slot_min_accuracy_[slot])
+                    excluded |= 1u << partition_device(j);
+                else
+                    met = met || device_available(partition_device(j));
+            }
 
-                    if(input_tensors_[j]->type == kTfLiteUInt8){
-                        uint8_t * input_ptr = (uint8_t *)input_datas_[j] + hailo_queue2_[i] * size;
-                        auto status = inputVStream.write(hailort::MemoryView(input_ptr, size * sizeof(uint8_t)));
-                        if (HAILO_SUCCESS != status) {
-                            std::cerr << "ERROR: write to input vstream " << j << " failed\n";
-                            exit(-1);
-                        }
-                    }
-                    else if(input_tensors_[j]->type == kTfLiteFloat32){
-                        float * input_ptr = (float *)input_datas_[j] + hailo_queue2_[i] * size;
-                        auto status = inputVStream.write(hailort::MemoryView(input_ptr, size * sizeof(float)));
-                        if (HAILO_SUCCESS != status) {
-                            std::cerr << "ERROR: write to input vstream " << j << " failed\n";
-                            exit(-1);
-                        }
-                    }
+            return met ? excluded : 0;
+        }
+
+        // Thermal and load gating of the dispatch. The costs c of the n partition devices grow with the heat of the device.
+        // Not while calibrating or for the cascade. Called with turnaround_mutex_ held
+        unsigned gate_devices(float * c, int n, unsigned devices){
+            if(!device_gate_.enabled() || device_mask_ != ~0u)
+                return devices;
+
+            float scale[DeviceGate::MAX_DEVICES];
+            unsigned gated = device_gate_.gate(devices, dispatch_batch_, scale);
+
+            for(int j = 0; j < n; j++){
+                if(c[j] < PARTITION_UNUSABLE)
+                    c[j] *= scale[partition_device(j)];
+            }
+
+            return gated;
+        }
+
+        void record_accuracy_dispatch(){
+            if(!accuracy_scheduling())
+                return;
+
+            for(int i = 0; i < dispatch_batch_; i++){
+                if(batch_run_[i] < 0)
+                    continue;
+
+                float accuracy = accuracies_[partition_index(batch_run_[i])];
+                accuracy_slots_++;
+                accuracy_sum_ += accuracy;
+                if(accuracy < slot_min_accuracy_[i])
+                    accuracy_unmet_++;
+            }
+        }
+
+        // Moves the tflite devices to the variant of the controller. Called with turnaround_mutex_ held
+        void apply_variant(){
+            if(!variant_controller_.enabled() || cascade_running_ || active_shape_ >= 0)
+                return;
+
+            int variant = variant_controller_.variant();
+            if(variant == active_variant_)
+                return;
+
+            // The share of a device follows the change of its slot time once it ran both variants
+            for(int d = 0; d < 2 && d < perfs_.size(); d++){
+                double from_ms = variant_ms_[d][active_variant_ + 1];
+                double to_ms = variant_ms_[d][variant + 1];
+                if(from_ms > 0 && to_ms > 0)
+                    perfs_[d] *= to_ms / from_ms;
+            }
+
+            if(gpuInterpreter_ != nullptr)
+                gpuInterpreter_ = gpu_variants_[variant].interpreter.get();
+            if(hexagonInterpreter_ != nullptr)
+                hexagonInterpreter_ = hexagon_variants_[variant].interpreter.get();
+
+            std::cout << "INFO: The tflite devices run variant " << variant << ": " << variant_files_[variant] << "\n";
+
+            if(active_variant_ >= 0)
+                variant_switches_++;
+            active_variant_ = variant;
+        }
+
+        // Switches the tflite devices to the model of a hot swap once it is built. Called with turnaround_mutex_ held,
+        // so the dispatches before ran on the old model and the ones after run on the new one
+        void apply_swap(){
+            // The old hexagon model is freed after the switch. Not while a stuck or losing call of it has not returned
+            if(device_busy_[1])
+                return;
+
+            std::unique_lock<std::mutex> lk(swap_mutex_);
+            if(swap_state_ != SWAP_READY)
+                return;
+
+            swap_old_hexagon_ = hexagonInterpreter_;
+            if(hexagonInterpreter_ != nullptr)
+                hexagonInterpreter_ = hexagon_swap_.interpreter.get();
+            if(gpuInterpreter_ != nullptr && gpu_swap_.interpreter != nullptr)
+                gpuInterpreter_ = gpu_swap_.interpreter.get();
+
+            swapped_file_ = swap_file_;
+            swap_version_++;
+            version_slots_[0] = version_slots_[1];
+            version_ms_[0] = version_ms_[1];
+            version_slots_[1] = 0;
+            version_ms_[1] = 0;
+
+            swap_state_ = SWAP_SWITCHED;
+            swap_cv_.notify_all();
+
+            std::cout << "INFO: The tflite devices run version " << swap_version_ << ": " << swapped_file_ << "\n";
+        }
+
+        // Sums the runs of the tflite slots of the finished dispatch for the running model version
+        void record_swap_dispatch(){
+            for(int i = 0; i < dispatch_batch_; i++){
+                if(batch_run_[i] == 0 || batch_run_[i] == 1){
+                    version_slots_[1]++;
+                    version_ms_[1] += slot_run_ms_[i];
                 }
+            }
+        }
 
-                for(int j = tflite_output_size; j < outputs_.size(); j++){
-                    auto & outputVStream = hailoVstreams2_->second[j - tflite_output_size];
+        // Takes the gpu thread out of the dispatches, once the running one is done with it
+        void set_swap_gpu_busy(bool busy){
+            turnaround_mutex_.lock();
+            swap_gpu_busy_ = busy;
+            turnaround_mutex_.unlock();
+        }
 
-                    int size = 1;
-                    for(int k = 1; k < output_dims_[j]->size; k++)
-                        size *= output_dims_[j]->data[k];
+        void build_gpu_swap(){
+            if(!build_tflite_variant(swap_file_.c_str(), 0, gpu_swap_))
+                release_tflite_variant(gpu_swap_);
+        }
 
-                    if(output_tensors_[j]->type == kTfLiteUInt8){
-                        uint8_t * output_ptr = (uint8_t *)output_datas_[j] + hailo_queue2_[i] * size;
-                        auto status = outputVStream.read(hailort::MemoryView(output_ptr, size * sizeof(uint8_t)));
-                        if (HAILO_SUCCESS != status) {
-                            std::cerr << "ERROR: reading output vstream " << j << " failed\n";
-                            exit(-1);
-                        }
-                    }
-                    else if(output_tensors_[j]->type == kTfLiteFloat32){
-                        float * output_ptr = (float *)output_datas_[j] + hailo_queue2_[i] * size;
-                        auto status = outputVStream.read(hailort::MemoryView(output_ptr, size * sizeof(float)));
-                        if (HAILO_SUCCESS != status) {
-                            std::cerr << "ERROR: reading output vstream " << j << " failed\n";
-                            exit(-1);
-                        }
+        // The swapped in gpu model takes the place of the old one. The old interpreter goes before its delegate and model
+        void adopt_gpu_swap(){
+            gpu_interpreter_ = std::move(gpu_swap_.interpreter);
+            gpu_delegate_ = std::move(gpu_swap_.delegate);
+            gpu_model_ = std::move(gpu_swap_.model);
+        }
+
+        void release_gpu_swap(){
+            release_tflite_variant(gpu_swap_);
+        }
+
+        // Swap thread: builds the new model beside the running one, waits for the dispatches to switch to it, and
+        // frees the old one. The gpu builds and frees its models on its own thread
+        void load_swap(){
+            bool built = true;
+            if(swap_devices_ & (1u << 1))
+                built = build_tflite_variant(swap_file_.c_str(), 1, hexagon_swap_);
+
+            if(built && (swap_devices_ & (1u << 0))){
+                set_swap_gpu_busy(true);
+                built = gpu_feeder_.run(build_gpu_swap) && gpu_swap_.interpreter != nullptr;
+                set_swap_gpu_busy(false);
+            }
+
+            std::unique_lock<std::mutex> lk(swap_mutex_);
+            if(!built){
+                std::cerr << "ERROR: Swap to " << swap_file_ << " failed. Keep the running model\n";
+                release_tflite_variant(hexagon_swap_);
+                swap_state_ = SWAP_IDLE;
+                lk.unlock();
+
+                set_swap_gpu_busy(true);
+                gpu_feeder_.run(release_gpu_swap);
+                set_swap_gpu_busy(false);
+
+                return;
+            }
+
+            swap_state_ = SWAP_READY;
+            std::cout << "INFO: " << swap_file_ << " is loaded. Switch to it at the next batch\n";
+
+            swap_cv_.wait(lk, []{ return swap_state_ == SWAP_SWITCHED || swap_stop_; });
+            if(swap_stop_)
+                return;
+            lk.unlock();
+
+            // No dispatch runs the old model anymore
+            if(swap_old_hexagon_ != nullptr){
+                if(hexagon_live_.interpreter.get() == swap_old_hexagon_)
+                    release_tflite_variant(hexagon_live_);
+
+                hexagon_live_.interpreter = std::move(hexagon_swap_.interpreter);
+                hexagon_live_.delegate = std::move(hexagon_swap_.delegate);
+                hexagon_live_.model = std::move(hexagon_swap_.model);
+                swap_old_hexagon_ = nullptr;
+            }
+
+            if(swap_devices_ & (1u << 0)){
+                set_swap_gpu_busy(true);
+                gpu_feeder_.run(adopt_gpu_swap);
+                set_swap_gpu_busy(false);
+            }
+
+            lk.lock();
+            swap_state_ = SWAP_IDLE;
+        }
+
+        void Invoke_thread(){
+            thread_placement_.apply(THREAD_ROLE_FEEDER);
+
+            for(int i = 0; i < DeviceHealth::MAX_DEVICES; i++){
+                if(dispatch_devices_ & (1u << i))
+                    device_feeder(i)->kick();
+            }
+
+            int generation = slot_hedger_.generation();
+            if(slot_tracking()){
+                // Watchdog of the running slots. A device over the timeout is failed and its slots go to the others
+                int device, moved;
+                while((device = slot_hedger_.wait_slots(generation, device_timeout_ms_, drop_slot, moved)) >= 0){
+                    std::cout << "WARNING: " << device_name(device) << " is over the device timeout of " << device_timeout_ms_ << " ms\n";
+                    device_health_.report_fault(device, DEVICE_TIMEOUT);
+                    device_health_.count_requeued(moved);
+                }
+            }
+
+            for(int i = 0; i < DeviceHealth::MAX_DEVICES; i++){
+                if(!(dispatch_devices_ & (1u << i)))
+                    continue;
+
+                FeederThread * feeder = device_feeder(i);
+
+                // The slots are done. A device still in a call, a failed one or a hedged run, is left behind until it returns
+                if(slot_tracking() && slot_hedger_.straggling(i, generation)){
+                    device_busy_[i] = true;
+                    device_straggling_[i] = true;
+                    continue;
+                }
+
+                if(device_timeout_ms_ > 0){
+                    double timeout_ms = slot_hedger_.failed(i, slot_hedger_.generation()) ? 0 : device_timeout_ms_;
+                    if(!feeder->wait_for(timeout_ms)){
+                        device_busy_[i] = true;
+                        continue;
                     }
                 }
-                auto elapsed = std::chrono::high_resolution_clock::now() - invoke_start_;
-                turnaround_[hailo_queue2_[i]] = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+                else{
+                    feeder->wait();
+                }
 
-                batch_run_[hailo_queue2_[i]] = 4;
-                batch_mutex_[hailo_queue2_[i]].unlock();
+                device_queue(i).clear();
             }
-        }
 
-        void Invoke_hailo_queue3(){
-            ::tflite::Interpreter * interpreter;
-            int tflite_input_size, tflite_output_size;
-            if(hexagonInterpreter_ != nullptr){
-                interpreter = hexagonInterpreter_;
-                tflite_input_size = interpreter->inputs().size();
-                tflite_output_size = interpreter->outputs().size();
+            auto elapsed = std::chrono::high_resolution_clock::now() - invoke_start_;
+            max_turnaround_ = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+
+            // The batch is done with its last slot, not with the discarded runs of the losing devices
+            if(slot_tracking()){
+                max_turnaround_ = 0;
+                for(int i = 0; i < dispatch_batch_; i++)
+                    max_turnaround_ = std::max(max_turnaround_, turnaround_[i]);
             }
-            else if(gpuInterpreter_ != nullptr){
-                interpreter = gpuInterpreter_;
-                tflite_input_size = interpreter->inputs().size();
-                tflite_output_size = interpreter->outputs().size();
+
+            sum_turnaround_ = 0;
+            for(int i = 0; i < dispatch_batch_; i++)
+                sum_turnaround_ += turnaround_[i];
+
+            for(int i = 0; device_gate_.enabled() && i < dispatch_batch_; i++)
+                device_gate_.record_slot(batch_run_[i], slot_run_ms_[i]);
+
+            if(!cascade_running_){
+                batch_tuner_.record(dispatch_batch_, turnaround_.data(), invoke_start_);
+                record_variant_dispatch();
+                record_swap_dispatch();
+                record_accuracy_dispatch();
+                input_shapes_.record(active_shape_, dispatch_batch_);
             }
-            else{
-                tflite_input_size = 0;
-                tflite_output_size = 0;
+            trace_recorder_.end_dispatch();
+
+            turnaround_mutex_.unlock();
+        }
+
+        // Whether the device is part of the mode
+        bool device_available(int device){
+            switch(device){
+                case 0:
+                    return gpuInterpreter_ != nullptr;
+                case 1:
+                    return hexagonInterpreter_ != nullptr;
+                case 2:
+                    return mode_ == 3;
+                case REMOTE_DEVICE:
+                    return remote_link_.connected();
+                default:
+                    return mode_ == 4;
             }
+        }
 
-            for(int i = 0; i < hailo_queue3_.size(); i++){
-                //std::cout << "Invoke hailo queue3\n";
-                for(int j = tflite_input_size; j < inputs_.size(); j++){
-                    auto & inputVStream = hailoVstreams3_->first[j - tflite_input_size];
+        // Devices of partition index j, in the order of perfs_. The remote engine comes after them
+        int partition_device(int j){
+            if(j == num_partition_devices())
+                return REMOTE_DEVICE;
 
-                    int size = 1;
-                    for(int k = 1; k < input_dims_[j]->size; k++)
-                        size *= input_dims_[j]->data[k];
-                    
-                    if(input_tensors_[j]->type == kTfLiteUInt8){
-                        uint8_t * input_ptr = (uint8_t *)input_datas_[j] + hailo_queue3_[i] * size;
-                        auto status = inputVStream.write(hailort::MemoryView(input_ptr, size * sizeof(uint8_t)));
-                        if (HAILO_SUCCESS != status) {
-                            std::cerr << "ERROR: write to input vstream " << j << " failed\n";
-                            exit(-1);
-                        }
-                    }
-                    else if(input_tensors_[j]->type == kTfLiteFloat32){
-                        float * input_ptr = (float *)input_datas_[j] + hailo_queue3_[i] * size;
-                        auto status = inputVStream.write(hailort::MemoryView(input_ptr, size * sizeof(float)));
-                        if (HAILO_SUCCESS != status) {
-                            std::cerr << "ERROR: write to input vstream " << j << " failed\n";
-                            exit(-1);
-                        }
-                    }
+            return mode_ == 4 && j >= 2 ? j + 1 : j;
+        }
+
+        // Devices the next dispatch can use. Called with turnaround_mutex_ held
+        unsigned usable_devices(){
+            unsigned available = 0;
+            unsigned usable = 0;
+
+            for(int i = 0; i < DeviceHealth::MAX_DEVICES; i++){
+                // A lost remote engine is tried again between dispatches. It has no accuracy to schedule with, and the
+                // shaped batches do not fit its tensors
+                if(i == REMOTE_DEVICE){
+                    if(accuracy_scheduling() || active_shape_ >= 0)
+                        continue;
+                    if(!device_busy_[i])
+                        remote_link_.reconnect();
                 }
 
-                for(int j = tflite_output_size; j < outputs_.size(); j++){
-                    auto & outputVStream = hailoVstreams3_->second[j - tflite_output_size];
+                if(!device_available(i))
+                    continue;
 
-                    int size = 1;
-                    for(int k = 1; k < output_dims_[j]->size; k++)
-                        size *= output_dims_[j]->data[k];
+                if(i == 0 && swap_gpu_busy_)
+                    continue;
 
-                    if(output_tensors_[j]->type == kTfLiteUInt8){
-                        uint8_t * output_ptr = (uint8_t *)output_datas_[j] + hailo_queue3_[i] * size;
-                        auto status = outputVStream.read(hailort::MemoryView(output_ptr, size * sizeof(uint8_t)));
-                        if (HAILO_SUCCESS != status) {
-                            std::cerr << "ERROR: reading output vstream " << j << " failed\n";
-                            exit(-1);
-                        }
-                    }
-                    else if(output_tensors_[j]->type == kTfLiteFloat32){
-                        float * output_ptr = (float *)output_datas_[j] + hailo_queue3_[i] * size;
-                        auto status = outputVStream.read(hailort::MemoryView(output_ptr, size * sizeof(float)));
-                        if (HAILO_SUCCESS != status) {
-                            std::cerr << "ERROR: reading output vstream " << j << " failed\n";
-                            exit(-1);
-                        }
-                    }
+                // A stuck device is back once its call returns. Its queue was left to it until then
+                if(device_busy_[i] && device_feeder(i)->is_idle()){
+                    if(!device_straggling_[i])
+                        std::cout << "INFO: " << device_name(i) << " returned from its stuck call\n";
+                    device_busy_[i] = false;
+                    device_straggling_[i] = false;
+                    device_queue(i).clear();
                 }
-                auto elapsed = std::chrono::high_resolution_clock::now() - invoke_start_;
-                turnaround_[hailo_queue3_[i]] = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
 
-                batch_run_[hailo_queue3_[i]] = 5;
-                batch_mutex_[hailo_queue3_[i]].unlock();
+                if(device_busy_[i])
+                    continue;
+
+                available |= 1u << i;
+                if(device_health_.usable(i))
+                    usable |= 1u << i;
             }
+
+            // Every device is quarantined. Probe them all rather than run nothing
+            return usable != 0 ? usable : available;
         }
 
-        void Invoke_thread(){
-            std::thread hexagon_thread;
-            std::thread maccel_thread;
-            std::thread hailo_thread;
-            std::thread hailo_thread2;
-            std::thread hailo_thread3;
+        // Gives up a whole dispatch when every device is stuck. Called with turnaround_mutex_ held
+        void drop_dispatch(){
+            std::cout << "WARNING: Every device is stuck. Drop the batch\n";
 
-            if(gpu_queue_.size() > 0){
-                gpu_thread_start_cv_.notify_one();
+            for(int i = 0; i < dispatch_batch_; i++){
+                batch_mutex_[i].lock();
+                drop_slot(i);
             }
 
-            if(hexagon_queue_.size() > 0)
-                hexagon_thread = std::thread(Invoke_hexagon_queue);
+            max_turnaround_ = 0;
+            sum_turnaround_ = 0;
+            trace_recorder_.end_dispatch();
+            turnaround_mutex_.unlock();
+        }
+
+        // Starts the trace records of the dispatch. Called with turnaround_mutex_ held
+        void trace_dispatch(){
+            if(!trace_recorder_.enabled())
+                return;
 
-            if(maccel_queue_.size() > 0)
-                maccel_thread = std::thread(Invoke_maccel_queue);
-            
-            if(hailo_queue_.size() > 0)
-                hailo_thread = std::thread(Invoke_hailo_queue);
+            trace_recorder_.begin_dispatch(dispatch_batch_, invoke_start_);
 
-            if(hailo_queue2_.size() > 0)
-                hailo_thread2 = std::thread(Invoke_hailo_queue2);
-            
-            if(hailo_queue3_.size() > 0)
-                hailo_thread3 = std::thread(Invoke_hailo_queue3);
+            for(int i = 0; i < dispatch_batch_; i++){
+                uint64_t hash = 0;
+                for(int j = 0; j < inputs_.size(); j++){
+                    size_t bytes = slot_size(input_dims_[j]) * tensor_type_size(input_tensors_[j]->type);
+                    hash = trace_hash((uint8_t *)input_datas_[j] + i * bytes, bytes, hash);
+                }
 
-            if(gpu_queue_.size() > 0){
-                std::unique_lock<std::mutex> lk(gpu_thread_mutex_);
-                gpu_thread_end_cv_.wait(lk);
-                gpu_thread_mutex_.unlock();
+                trace_recorder_.set_input_hash(i, hash);
             }
+        }
 
-            if(hexagon_queue_.size() > 0)
-                hexagon_thread.join();
-            
-            if(maccel_queue_.size() > 0)
-                maccel_thread.join();
-            
-            if(hailo_queue_.size() > 0)
-                hailo_thread.join();
+        // Starts the partitioned dispatch. With slot tracking every usable device runs to take over the slots of the
+        // others, otherwise only the devices with slots do
+        void begin_dispatch(unsigned devices){
+            dispatch_devices_ = 0;
+            for(int i = 0; i < DeviceHealth::MAX_DEVICES; i++){
+                if(!device_busy_[i] && (!device_queue(i).empty() || (slot_tracking() && (devices & (1u << i)))))
+                    dispatch_devices_ |= 1u << i;
+            }
 
-            if(hailo_queue2_.size() > 0)
-                hailo_thread2.join();
+            slot_hedger_.begin(dispatch_batch_, dispatch_devices_);
+            for(int i = 0; i < DeviceHealth::MAX_DEVICES; i++){
+                if(!(dispatch_devices_ & (1u << i)))
+                    continue;
 
-            if(hailo_queue3_.size() > 0)
-                hailo_thread3.join();
+                std::vector<int> & queue = device_queue(i);
+                for(int j = 0; j < queue.size(); j++){
+                    slot_hedger_.assign(queue[j], i);
+                    slot_hedger_.exclude(queue[j], accuracy_excluded(queue[j]));
+                }
+            }
 
-            gpu_queue_.clear();
-            hexagon_queue_.clear();
-            maccel_queue_.clear();
-            hailo_queue_.clear();
-            hailo_queue2_.clear();
-            hailo_queue3_.clear();
+            invoke_feeder_.kick();
+        }
 
-            auto elapsed = std::chrono::high_resolution_clock::now() - invoke_start_;
-            max_turnaround_ = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+        // Gives up a dispatch that failed before any slot was locked. Called with turnaround_mutex_ held
+        void abort_dispatch(){
+            // A stuck device still runs its queue
+            for(int i = 0; i < DeviceHealth::MAX_DEVICES; i++){
+                if(!device_busy_[i])
+                    device_queue(i).clear();
+            }
 
+            max_turnaround_ = 0;
             sum_turnaround_ = 0;
-            for(int i = 0; i < batch_sizes_; i++)
-                sum_turnaround_ += turnaround_[i];
-
+            trace_recorder_.end_dispatch();
             turnaround_mutex_.unlock();
         }
 
+        // Sets the nms score threshold of the first outputs of the three hailo devices
+        bool set_nms_score_threshold(float threshold, int outputs){
+            for(int i = 0; i < outputs; i++){
+                auto & outputVStream = hailoVstreams_->second[i];
+                auto & outputVStream2 = hailoVstreams2_->second[i];
+                auto & outputVStream3 = hailoVstreams3_->second[i];
+
+                auto status = outputVStream.set_nms_score_threshold(threshold);
+                if (HAILO_SUCCESS != status) {
+                    std::cerr << "ERROR: Failed to set score threshold to " << threshold << " for output vstream " << i << ", status = " << status << std::endl;
+                    return false;
+                }
+
+                status = outputVStream2.set_nms_score_threshold(threshold);
+                if (HAILO_SUCCESS != status) {
+                    std::cerr << "ERROR: Failed to set score threshold to " << threshold << " for output vstream " << i << ", status = " << status << std::endl;
+                    return false;
+                }
+
+                status = outputVStream3.set_nms_score_threshold(threshold);
+                if (HAILO_SUCCESS != status) {
+                    std::cerr << "ERROR: Failed to set score threshold to " << threshold << " for output vstream " << i << ", status = " << status << std::endl;
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
         TfLiteStatus Interpreter::Invoke(){
+            HotPathScope hot_path(hot_path_monitor_);
+
             invoke_start_ = std::chrono::high_resolution_clock::now();
             switch(mode_){
                 case 0:
@@ -2106,20 +4727,19 @@ namespace tflite{
                     //std::cout << "Invoke maccel\n";
                     mobilint::StatusCode sc;
 
-                    std::vector<float *> float_input_datas;
-                    float_input_datas.resize(input_datas_.size());
+                    maccel_inputs_.resize(input_datas_.size());
 
                     for(int i = 0; i < input_datas_.size(); i++)
-                        float_input_datas[i] = (float *)input_datas_[i];
+                        maccel_inputs_[i] = (float *)input_datas_[i];
                     
-                    std::vector<std::vector<float>> outputs = mobilintModel_->infer(float_input_datas, sc);
+                    sc = mobilintModel_->infer(maccel_inputs_, maccel_outputs_);
                     if (!sc) {
                         std::cerr << "ERROR: Failed to infer an output. error code: " << static_cast<int>(sc) << std::endl;
                         return kTfLiteError;
                     }
 
-                    for(int i = 0; i < outputs.size(); i++){
-                        memcpy(output_datas_[i], outputs[i].data(), outputs[i].size() * sizeof(float));
+                    for(int i = 0; i < maccel_outputs_.size(); i++){
+                        memcpy(output_datas_[i], maccel_outputs_[i].data(), maccel_outputs_[i].size() * sizeof(float));
                     }
 
                     auto elapsed = std::chrono::high_resolution_clock::now() - invoke_start_;
@@ -2189,52 +4809,47 @@ namespace tflite{
                 }
                 case 3:
                 {
-                    float c[3];
+                    float c[4];
                     c[0] = perfs_[0];
                     c[1] = perfs_[1];
                     c[2] = perfs_[2];
+                    c[3] = remote_cost();
                     if(gpuInterpreter_ == nullptr){
-                        c[0] = 2147483647;
+                        c[0] = PARTITION_UNUSABLE;
                     }
                     if(hexagonInterpreter_ == nullptr){
-                        c[1] = 2147483647;
+                        c[1] = PARTITION_UNUSABLE;
                     }
 
-                    int k[3] = {0, 0, 0};
+                    // Wait for the previous dispatch before refilling its queues
+                    turnaround_mutex_.lock();
+                    dispatch_batch_ = cascade_running_ ? cascade_batch_ : active_batch_.load();
+                    apply_variant();
+                    apply_swap();
+                    trace_dispatch();
+
+                    // Stuck and quarantined devices get no slots
+                    unsigned devices = usable_devices() & device_mask_;
+                    if(devices == 0){
+                        drop_dispatch();
+                        return kTfLiteOk;
+                    }
 
-                    for(int i = 0; i < batch_sizes_; i++){
-                        int min_l = 2147483647;
-                        int index;
+                    // Hot devices get a smaller share, and the ones the load does not need are parked
+                    devices = gate_devices(c, 4, devices);
 
-                        for(int j = 0; j < 3; j++){
-                            if((k[j] + 1) * c[j] < min_l){
-                                min_l = (k[j] + 1) * c[j];
-                                index = j;
-                            }
-                        }
+                    for(int j = 0; j < 4; j++){
+                        if(!(devices & (1u << partition_device(j))))
+                            c[j] = PARTITION_UNUSABLE;
+                    }
 
-                        k[index]++;
+                    int k[4];
+                    partition_dispatch(c, 4, k);
 
-                        switch(index){
-                            case 0:
-                            {
-                                gpu_queue_.push_back(i);       
-                                break;
-                            }
-                            case 1:
-                            {
-                                hexagon_queue_.push_back(i);
-                                break;
-                            }
-                            case 2:
-                            {
-                                maccel_queue_.push_back(i);
-                                break;
-                            }
-                        }
-                    }
+                    for(int i = 0; i < dispatch_batch_; i++)
+                        device_queue(partition_device(slot_devices_[i])).push_back(i);
 
-                    if(!gpu_queue_.empty() || !hexagon_queue_.empty()){
+                    if(k[0] > 0 || k[1] > 0){
                         if(new_score_thrs_[0] >= 0)
                             cur_score_thrs_[0] = new_score_thrs_[0];
                     }
@@ -2243,14 +4858,11 @@ namespace tflite{
                             cur_score_thrs_[0] = ori_score_thrs_[0];
                     }
 
-                    turnaround_mutex_.lock();
-
-                    for(int i = 0; i < batch_sizes_; i++){
+                    for(int i = 0; i < dispatch_batch_; i++){
                         batch_mutex_[i].lock();
                     }
 
-                    std::thread invoke_thread(Invoke_thread);
-                    invoke_thread.detach();
+                    begin_dispatch(devices);
 
                     return kTfLiteOk;
 
@@ -2258,62 +4870,47 @@ namespace tflite{
                 }
                 case 4:
                 {
-                    float c[5];
+                    float c[6];
                     c[0] = perfs_[0];
                     c[1] = perfs_[1];
                     c[2] = perfs_[2];
                     c[3] = perfs_[3];
                     c[4] = perfs_[4];
+                    c[5] = remote_cost();
                     if(gpuInterpreter_ == nullptr){
-                        c[0] = 2147483647;
+                        c[0] = PARTITION_UNUSABLE;
                     }
                     if(hexagonInterpreter_ == nullptr){
-                        c[1] = 2147483647;
+                        c[1] = PARTITION_UNUSABLE;
                     }
 
-                    int k[5] = {0, 0, 0, 0, 0};
+                    // Wait for the previous dispatch before refilling its queues
+                    turnaround_mutex_.lock();
+                    dispatch_batch_ = cascade_running_ ? cascade_batch_ : active_batch_.load();
+                    apply_variant();
+                    apply_swap();
+                    trace_dispatch();
+
+                    // Stuck and quarantined devices get no slots
+                    unsigned devices = usable_devices() & device_mask_;
+                    if(devices == 0){
+                        drop_dispatch();
+                        return kTfLiteOk;
+                    }
 
-                    for(int i = 0; i < batch_sizes_; i++){
-                        int min_l = 2147483647;
-                        int index;
+                    // Hot devices get a smaller share, and the ones the load does not need are parked
+                    devices = gate_devices(c, 6, devices);
 
-                        for(int j = 0; j < 5; j++){
-                            if((k[j] + 1) * c[j] < min_l){
-                                min_l = (k[j] + 1) * c[j];
-                                index = j;
-                            }
-                        }
+                    for(int j = 0; j < 6; j++){
+                        if(!(devices & (1u << partition_device(j))))
+                            c[j] = PARTITION_UNUSABLE;
+                    }
 
-                        k[index]++;
+                    int k[6];
+                    partition_dispatch(c, 6, k);
 
-                        switch(index){
-                            case 0:
-                            {
-                                gpu_queue_.push_back(i);
-                                break;
-                            }
-                            case 1:
-                            {
-                                hexagon_queue_.push_back(i);
-                                break;
-                            }
-                            case 2:
-                            {
-                                hailo_queue_.push_back(i);
-                                break;
-                            }
-                            case 3:
-                            {
-                                hailo_queue2_.push_back(i);
-                                break;
-                            }
-                            case 4:
-                            {
-                                hailo_queue3_.push_back(i);
-                                break;
-                            }
-                        }
-                    }
+                    for(int i = 0; i < dispatch_batch_; i++)
+                        device_queue(partition_device(slot_devices_[i])).push_back(i);
 
                     ::tflite::Interpreter * interpreter;
                     int tflite_output_size;
@@ -2329,32 +4926,14 @@ namespace tflite{
                         tflite_output_size = 0;
                     }
 
-                    if(!gpu_queue_.empty() || !hexagon_queue_.empty()){
+                    if(k[0] > 0 || k[1] > 0){
                         if(new_score_thrs_[0] >= 0){
                             cur_score_thrs_[0] = new_score_thrs_[0];
 
-                            for(int i = 0; i < outputs_.size() - tflite_output_size; i++){
-                                auto & outputVStream = hailoVstreams_->second[i];
-                                auto & outputVStream2 = hailoVstreams2_->second[i];
-                                auto & outputVStream3 = hailoVstreams3_->second[i];
-
-                                auto status = outputVStream.set_nms_score_threshold(new_score_thrs_[0]);
-                                if (HAILO_SUCCESS != status) {
-                                    std::cerr << "ERROR: Failed to set score threshold to " << new_score_thrs_[0] << " for output vstream " << i << ", status = " << status << std::endl;
-                                    return kTfLiteError;
-                                }
-
-                                status = outputVStream2.set_nms_score_threshold(new_score_thrs_[0]);
-                                if (HAILO_SUCCESS != status) {
-                                    std::cerr << "ERROR: Failed to set score threshold to " << new_score_thrs_[0] << " for output vstream " << i << ", status = " << status << std::endl;
-                                    return kTfLiteError;
-                                }
-
-                                status = outputVStream3.set_nms_score_threshold(new_score_thrs_[0]);
-                                if (HAILO_SUCCESS != status) {
-                                    std::cerr << "ERROR: Failed to set score threshold to " << new_score_thrs_[0] << " for output vstream " << i << ", status = " << status << std::endl;
-                                    return kTfLiteError;
-                                }
+                            // The backbone of a split model has no nms
+                            if(!split_enabled_ && !set_nms_score_threshold(new_score_thrs_[0], outputs_.size() - tflite_output_size)){
+                                abort_dispatch();
+                                return kTfLiteError;
                             }
                         }
                     }
@@ -2362,40 +4941,19 @@ namespace tflite{
                         if(ori_score_thrs_[0] >= 0){
                             cur_score_thrs_[0] = ori_score_thrs_[0];
 
-                            for(int i = 0; i < outputs_.size() - tflite_output_size; i++){
-                                auto & outputVStream = hailoVstreams_->second[i];
-                                auto & outputVStream2 = hailoVstreams2_->second[i];
-                                auto & outputVStream3 = hailoVstreams3_->second[i];
-
-                                auto status = outputVStream.set_nms_score_threshold(ori_score_thrs_[0]);
-                                if (HAILO_SUCCESS != status) {
-                                    std::cerr << "ERROR: Failed to set score threshold to " << ori_score_thrs_[0] << " for output vstream " << i << ", status = " << status << std::endl;
-                                    return kTfLiteError;
-                                }
-
-                                status = outputVStream2.set_nms_score_threshold(ori_score_thrs_[0]);
-                                if (HAILO_SUCCESS != status) {
-                                    std::cerr << "ERROR: Failed to set score threshold to " << ori_score_thrs_[0] << " for output vstream " << i << ", status = " << status << std::endl;
-                                    return kTfLiteError;
-                                }
-
-                                status = outputVStream3.set_nms_score_threshold(ori_score_thrs_[0]);
-                                if (HAILO_SUCCESS != status) {
-                                    std::cerr << "ERROR: Failed to set score threshold to " << ori_score_thrs_[0] << " for output vstream " << i << ", status = " << status << std::endl;
-                                    return kTfLiteError;
-                                }
+                            // The backbone of a split model has no nms
+                            if(!split_enabled_ && !set_nms_score_threshold(ori_score_thrs_[0], outputs_.size() - tflite_output_size)){
+                                abort_dispatch();
+                                return kTfLiteError;
                             }
                         }
                     }
 
-                    turnaround_mutex_.lock();
-
-                    for(int i = 0; i < batch_sizes_; i++){
+                    for(int i = 0; i < dispatch_batch_; i++){
                         batch_mutex_[i].lock();
                     }
-                    
-                    std::thread invoke_thread(Invoke_thread);
-                    invoke_thread.detach();
+
+                    begin_dispatch(devices);
 
                     return kTfLiteOk;
 
@@ -1,11 +1,18 @@
 #include <cstring>
+#include <strings.h>
 #include <iostream>
+#include <string>
 #include <vector>
 #include <memory>
 #include <thread>
 #include <chrono>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
+#include <cerrno>
+#include <algorithm>
+
+#include <sys/mman.h>
 
 #include <opencv2/opencv.hpp>
 
@@ -15,14 +22,35 @@
 #include <tensorflow/lite/model.h>
 #include <tensorflow/lite/interpreter.h>
 #include <tensorflow/lite/kernels/register.h>
+#include <tensorflow/lite/external_cpu_backend_context.h>
 
 #include <maccel/maccel.h>
 #include <hailo/hailort.hpp>
 
+#include "arena.hpp"
+#include "placement.hpp"
+#include "executor.hpp"
+#include "hedge.hpp"
+#include "tuner.hpp"
+#include "fault.hpp"
+#include "stream.hpp"
+#include "partition.hpp"
+#include "trace.hpp"
+#include "profile.hpp"
+#include "variant.hpp"
+#include "thermal.hpp"
+#include "bundle.hpp"
+#include "shape.hpp"
+#include "split.hpp"
+#include "registry.hpp"
+#include "crop.hpp"
+#include "remote.hpp"
+
 namespace pkshin{
     static int mode_ = 0; // 0 for tflite, 1 for maccel, 2 for hailo, 3 for tflite+maccel, 4 for tflite+hailo
     static char filename_[500];
     static char tflite_filename_[500];
+    static ModelBundle model_bundle_;    // the model came as a bundle when it is loaded
 
     static std::pair<std::vector<hailort::InputVStream>, std::vector<hailort::OutputVStream>> * hailoVstreams_;
     static std::pair<std::vector<hailort::InputVStream>, std::vector<hailort::OutputVStream>> * hailoVstreams2_;
@@ -45,15 +73,33 @@ namespace pkshin{
     static std::vector<TfLiteTensor *> output_tensors_;
     static std::vector<void *> output_datas_;
 
+    static std::vector<size_t> input_bytes_;
+    static std::vector<size_t> output_bytes_;
+    static TensorArena tensor_arena_;
+    static TensorArena meta_arena_;
+
+    static ThreadPlacement thread_placement_;
+    static HotPathMonitor hot_path_monitor_;
+    static bool prefault_arenas_ = false;
+    static CpuExecutor cpu_executor_;
+    static ::tflite::ExternalCpuBackendContext cpu_backend_context_;
+
     static int batch_sizes_ = 1;
+    static std::atomic<int> active_batch_(1);    // slots the app fills for the next Invoke, see GetBatchSize
+    static int dispatch_batch_ = 1;    // slots of the running dispatch
+    static unsigned dispatch_devices_ = 0;    // mask of the devices running it
+    static BatchTuner batch_tuner_;
+    static double latency_budget_ms_ = 0;
     static std::vector<int> batch_run_ = {0};
+    static std::vector<int> slot_devices_ = {0};    // partition index of every slot of the dispatch
+    static std::vector<double> slot_run_ms_ = {0};  // run of the result of every slot, input copy included
+    static std::vector<double> slot_copy_ms_ = {0}; // output copy of every slot
+    static std::vector<int> slot_variants_ = {0};    // variant that ran every slot, -1 for the model of the command line
     static std::vector<std::mutex> batch_mutex_ = std::vector<std::mutex>(1);
 
-    static std::thread gpu_thread_;
-    static std::mutex gpu_thread_mutex_;
-    static std::condition_variable gpu_thread_set_cv_;
-    static std::condition_variable gpu_thread_start_cv_;
-    static std::condition_variable gpu_thread_end_cv_;
+    static std::unique_ptr<::tflite::FlatBufferModel> gpu_model_;
+    static ::tflite::Interpreter::TfLiteDelegatePtr gpu_delegate_(nullptr, &TfLiteGpuDelegateV2Delete);
+    static std::unique_ptr<::tflite::Interpreter> gpu_interpreter_;
 
     static std::vector<float> perfs_ = {1, 1, 1, 1, 1};
     static std::vector<float> ori_score_thrs_ = {-1, -1};
@@ -72,6 +118,155 @@ namespace pkshin{
     static std::vector<int> hailo_queue_;
     static std::vector<int> hailo_queue2_;
     static std::vector<int> hailo_queue3_;
+
+    static FeederThread invoke_feeder_;
+    static FeederThread gpu_feeder_;
+    static FeederThread hexagon_feeder_;
+    static FeederThread maccel_feeder_;
+    static FeederThread hailo_feeder_;
+    static FeederThread hailo_feeder2_;
+    static FeederThread hailo_feeder3_;
+    static std::vector<float *> maccel_inputs_;
+    static std::vector<std::vector<float>> maccel_outputs_;
+
+    static SlotHedger slot_hedger_;
+    static DeviceHealth device_health_;
+    static FaultInjector fault_injector_;
+    static double device_timeout_ms_ = 0;                         // 0 for no watchdog on the device calls
+    static bool device_busy_[DeviceHealth::MAX_DEVICES] = {};    // feeder still stuck in a call of an earlier dispatch
+    static bool device_straggling_[DeviceHealth::MAX_DEVICES] = {};    // busy with a losing run, not stuck
+    static std::vector<std::vector<uint8_t>> hailo_staging_[3];    // hedged hailo outputs before they are stored
+
+    static StreamScheduler stream_scheduler_;
+    static TraceRecorder trace_recorder_;
+    static TraceReplayer trace_replayer_;
+
+    static ProfileDatabase profile_db_;
+    static uint64_t model_hash_ = 0;
+    static unsigned device_mask_ = ~0u;    // devices the dispatches may use, narrowed while calibrating and for the cascade
+
+    // A variant of the tflite part, on one device
+    struct TfliteVariant {
+        std::unique_ptr<::tflite::FlatBufferModel> model;
+        ::tflite::Interpreter::TfLiteDelegatePtr delegate = ::tflite::Interpreter::TfLiteDelegatePtr(nullptr, &TfLiteGpuDelegateV2Delete);
+        std::unique_ptr<::tflite::Interpreter> interpreter;
+    };
+
+    static VariantController variant_controller_;
+    static std::vector<std::string> variant_files_;
+    static std::vector<TfliteVariant> gpu_variants_;        // built on the gpu feeder thread
+    static std::vector<TfliteVariant> hexagon_variants_;
+    static bool variants_failed_ = false;
+    static int active_variant_ = -1;                         // -1 for the model of the command line
+    static long variant_switches_ = 0;
+    static long variant_slots_[VariantController::MAX_VARIANTS] = {};
+    static double variant_ms_[2][VariantController::MAX_VARIANTS + 1] = {};    // average slot run of gpu and hexagon per variant, the model of the command line first
+
+    static std::string cascade_file_;
+    static TfliteVariant gpu_cascade_;        // built on the gpu feeder thread
+    static TfliteVariant hexagon_cascade_;
+    static bool cascade_failed_ = false;
+    static bool cascade_running_ = false;    // the dispatch is an escalation, it is kept out of the tuners
+    static int cascade_batch_ = 0;           // escalated slots it runs, apart from the batch the app asked for
+    static float cascade_band_[2] = {0, 0};
+    static int cascade_count_ = 1;
+
+    // A slot the escalated ones were packed over, put back after the cascade
+    struct CascadeSavedSlot {
+        int slot;
+        int run;
+        int device;
+        int variant;
+        int remote_part;
+        double run_ms;
+        double copy_ms;
+        double turnaround;
+    };
+
+    static std::vector<CascadeSavedSlot> cascade_saved_slots_;
+    static std::vector<uint8_t> cascade_saved_tensors_;    // their tflite inputs then outputs, only grows
+
+    static std::vector<float> accuracies_;            // per partition device like perfs_, empty without accuracy scheduling
+    static float min_accuracy_ = 0;
+    static float target_accuracy_ = 0;                // mean over the slots of a dispatch, 0 for none
+    static std::vector<float> stream_min_accuracy_;
+    static std::vector<float> slot_min_accuracy_;
+    static long accuracy_slots_ = 0;
+    static double accuracy_sum_ = 0;
+    static long accuracy_unmet_ = 0;
+
+    static DeviceGate device_gate_;
+
+    static InputShapes input_shapes_;
+    static std::vector<TfliteVariant> gpu_shapes_;        // built on the gpu feeder thread
+    static std::vector<TfliteVariant> hexagon_shapes_;
+    static bool shapes_failed_ = false;
+    static std::vector<std::vector<int>> shape_dims_;        // per shape, the dims of the tflite inputs then the outputs
+    static std::vector<int> full_dims_;                      // the same for the shape of the model, to switch back to
+    static int active_shape_ = -1;                           // -1 for the shape of the model
+    static ::tflite::Interpreter * full_gpu_interpreter_ = nullptr;        // the interpreters the shape replaced
+    static ::tflite::Interpreter * full_hexagon_interpreter_ = nullptr;
+
+    // The head of a split model for one accelerator, run on the cpu
+    struct SplitHead {
+        std::unique_ptr<::tflite::FlatBufferModel> model;
+        std::unique_ptr<::tflite::Interpreter> interpreter;
+        std::vector<int> links;    // per input of the head, the output of the engine it takes
+    };
+
+    static bool split_enabled_ = false;
+    static SplitHead split_heads_[DeviceHealth::MAX_DEVICES];        // by the batch_run_ code of the accelerator
+    static StageWorker split_workers_[DeviceHealth::MAX_DEVICES];
+
+    static ModelRegistry model_registry_;
+    static CropClassifier crop_classifier_;
+
+    // Hot swaps of the tflite part
+    struct SwapStats {
+        bool enabled;          // a swap ran or is running
+        int version;           // 0 for the model of the command line, one more per swap
+        bool loading;
+        long slots[2];         // tflite slots of the version before and of the current one
+        double slot_ms[2];     // their average run
+    };
+
+    // Hot swap of the tflite part. The new model is built beside the running one and switched in between dispatches
+    enum SwapState {
+        SWAP_IDLE = 0,
+        SWAP_LOADING = 1,
+        SWAP_READY = 2,
+        SWAP_SWITCHED = 3    // the old model waits to be freed
+    };
+
+    static int swap_state_ = SWAP_IDLE;
+    static std::mutex swap_mutex_;
+    static std::condition_variable swap_cv_;
+    static bool swap_stop_ = false;
+    static std::thread swap_thread_;
+    static std::string swap_file_;
+    static std::string swapped_file_;        // the tflite model of the command line once a swap replaced it
+    static unsigned swap_devices_ = 0;       // tflite devices the swap builds the model for
+    static bool swap_gpu_busy_ = false;       // the gpu thread builds or frees a model, it sits the dispatches out
+    static TfliteVariant gpu_swap_;          // built on the gpu feeder thread
+    static TfliteVariant hexagon_swap_;
+    static TfliteVariant hexagon_live_;      // the hexagon model in use, the one of the command line until a swap
+    static ::tflite::Interpreter * swap_old_hexagon_ = nullptr;
+    static int swap_version_ = 0;
+    static long version_slots_[2] = {};      // tflite slots of the version before and of the current one
+    static double version_ms_[2] = {};
+
+    // The engine of another board as one more device of the dispatch, batch_run_ code REMOTE_DEVICE
+    static RemoteLink remote_link_;
+    static FeederThread remote_feeder_;
+    static std::vector<int> remote_queue_;
+    static double remote_cost_ms_ = 0;                    // slot cost until the link measured one, 0 for the slowest device
+    static std::vector<void *> remote_inputs_;            // slots of the tensors of the running request
+    static std::vector<void *> remote_outputs_;
+    static std::vector<std::vector<uint8_t>> remote_staging_;    // hedged remote outputs before they are stored
+    static int remote_part_ = REMOTE_FAILED;              // part of the last staged result
+    static std::vector<int> remote_parts_ = {0};          // RemotePart of every slot the remote engine ran
+    static std::vector<std::chrono::high_resolution_clock::time_point> remote_sent_at_ = {std::chrono::high_resolution_clock::now()};
+    static std::mutex remote_serve_mutex_;                // clients of the served engine take turns
 }
 
 namespace tflite{
@@ -153,9 +348,132 @@ namespace tflite{
 
             TfLiteStatus SetSchedulerParams(std::vector<float> perfs);
 
+            TfLiteStatus SetMemoryParams(bool huge_pages);
+
+            TfLiteStatus SetPlacementParams(const char * config);
+
+            TfLiteStatus ApplyThreadPlacement(int role);
+
+            std::vector<int> GetPlacementCpus(int role);
+
+            TfLiteStatus SetRealtimeParams(const char * policy, bool lock_memory);
+
+            ::pkshin::RealtimeStats GetRealtimeStats();
+
+            TfLiteStatus SetHedgeParams(float factor);
+
+            ::pkshin::HedgeStats GetHedgeStats();
+
+            TfLiteStatus SetFaultParams(double device_timeout_ms, const char * inject);
+
+            ::pkshin::FaultStats GetFaultStats();
+
+            int AddStream(float weight);
+
+            int GetNumStreams();
+
+            long EnqueueFrame(int stream);
+
+            int ScheduleBatch(int max_slots);
+
+            int GetSlotStream(int slot);
+
+            long GetSlotSequence(int slot);
+
+            TfLiteStatus CompleteSlot(int slot);
+
+            long PopInOrder(int stream);
+
+            ::pkshin::StreamStats GetStreamStats(int stream);
+
+            TfLiteStatus SetTraceParams(const char * record_path, const char * replay_path, double replay_speed);
+
+            int NextReplayBatch();
+
+            TfLiteStatus SetProfileParams(const char * db_path);
+
+            TfLiteStatus CalibrateProfile(int runs);
+
+            TfLiteStatus SetVariantParams(const char * variants, double target_p95_ms);
+
+            int GetSlotVariant(int slot);
+
+            ::pkshin::VariantStats GetVariantStats();
+
+            TfLiteStatus SetCascadeParams(const char * model, float band_lo, float band_hi, int band_count);
+
+            bool IsCascadeEnabled();
+
+            bool NeedsEscalation(const std::vector<float> & scores);
+
+            TfLiteStatus InvokeCascade(const std::vector<int> & slots);
+
+            TfLiteStatus SetAccuracyParams(std::vector<float> accuracies, float min_accuracy, float target_accuracy);
+
+            TfLiteStatus SetStreamAccuracy(int stream, float min_accuracy);
+
+            ::pkshin::AccuracyStats GetAccuracyStats();
+
+            TfLiteStatus SetGateParams(const char * config);
+
+            ::pkshin::GateStats GetGateStats();
+
+            ::pkshin::BundleInfo GetBundleInfo();
+
+            TfLiteStatus SetShapeParams(const char * shapes);
+
+            int PickInputShape(int image_width, int image_height);
+
+            TfLiteStatus SetInputShape(int shape);
+
+            ::pkshin::ShapeStats GetShapeStats();
+
+            TfLiteStatus SetSplitParams(const char * manifest);
+
+            ::pkshin::SplitStats GetSplitStats();
+
+            TfLiteStatus SetRegistryParams(const char * models, double budget_mb, int threads);
+
+            TfLiteStatus PreloadModel(const char * id);
+
+            ::tflite::Interpreter * AcquireModel(const char * id);
+
+            void ReleaseModel(const char * id);
+
+            ::pkshin::RegistryStats GetRegistryStats();
+
+            TfLiteStatus SetCropParams(const char * id, int max_batch);
+
+            TfLiteStatus ClassifyCrops(const std::vector<::pkshin::Crop> & crops, std::vector<int> & classes, std::vector<float> & scores);
+
+            ::pkshin::CropStats GetCropStats();
+
+            TfLiteStatus SwapModel(const char * filename);
+
+            ::pkshin::SwapStats GetSwapStats();
+
+            TfLiteStatus SetRemoteParams(const char * address, int window, double cost_ms);
+
+            TfLiteStatus ServeRemote(const char * address);
+
+            ::pkshin::RemoteStats GetRemoteStats();
+
+            TfLiteStatus SetBatchTuningParams(double target_p95_ms);
+
+            int GetBatchSize();
+
+            TfLiteStatus SetExecutorParams(int num_threads, int tflite_threads);
+
+            TfLiteStatus ParallelFor(int role, int n, void (*fn)(void *, int), void * arg);
+
+            template <class F>
+            TfLiteStatus ParallelFor(int role, int n, F & fn){
+                return ParallelFor(role, n, [](void * arg, int i){ (*(F *)arg)(i); }, &fn);
+            }
+
             TfLiteStatus SetPostProcessParams(std::vector<float> ori_score_thrs, std::vector<float> new_score_thrs);
 
-            std::vector<float> GetPostProcessParams();
+            const std::vector<float> & GetPostProcessParams();
 
             double GetSumTurnAroundTime();
 
@@ -0,0 +1,310 @@
+#include "executor.hpp"
+
+#include <iostream>
+
+namespace pkshin{
+    CpuExecutor::CpuExecutor() : queued_(0), submitted_(0), next_worker_(0), stop_(false), placement_(NULL){
+
+    }
+
+    CpuExecutor::~CpuExecutor(){
+        stop();
+    }
+
+    bool CpuExecutor::start(int num_threads, ThreadPlacement * placement){
+        stop();
+
+        if(num_threads < 0){
+            std::cerr << "ERROR: The number of executor threads must not be negative\n";
+            return false;
+        }
+
+        placement_ = placement;
+        stop_ = false;
+        next_worker_ = 0;
+
+        for(int i = 0; i < num_threads; i++){
+            workers_.push_back(std::unique_ptr<Worker>(new Worker()));
+            workers_[i]->tasks.resize(16);
+            workers_[i]->head = 0;
+            workers_[i]->count = 0;
+        }
+
+        for(int i = 0; i < num_threads; i++)
+            workers_[i]->thread = std::thread(&CpuExecutor::worker_loop, this, i);
+
+        return true;
+    }
+
+    void CpuExecutor::stop(){
+        if(workers_.empty())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lk(wait_mutex_);
+            stop_ = true;
+        }
+        wait_cv_.notify_all();
+
+        for(int i = 0; i < workers_.size(); i++)
+            workers_[i]->thread.join();
+
+        workers_.clear();
+    }
+
+    int CpuExecutor::num_threads(){
+        return workers_.size();
+    }
+
+    void CpuExecutor::push(Worker & worker, const Task & task){
+        if(worker.count == worker.tasks.size()){
+            std::vector<Task> tasks(worker.tasks.size() * 2);
+            for(size_t i = 0; i < worker.count; i++)
+                tasks[i] = worker.tasks[(worker.head + i) % worker.tasks.size()];
+
+            worker.tasks.swap(tasks);
+            worker.head = 0;
+        }
+
+        worker.tasks[(worker.head + worker.count) % worker.tasks.size()] = task;
+        worker.count++;
+    }
+
+    bool CpuExecutor::pop(int worker_id, Task & task){
+        // Own tasks first, newest first
+        if(worker_id >= 0){
+            Worker & worker = *workers_[worker_id];
+            std::lock_guard<std::mutex> lk(worker.mutex);
+            if(worker.count > 0){
+                worker.count--;
+                task = worker.tasks[(worker.head + worker.count) % worker.tasks.size()];
+                queued_--;
+                return true;
+            }
+        }
+
+        // Steal the oldest task of the others
+        for(int i = 1; i <= workers_.size(); i++){
+            int victim = (worker_id + i) % workers_.size();
+            if(victim == worker_id)
+                continue;
+
+            Worker & worker = *workers_[victim];
+            std::lock_guard<std::mutex> lk(worker.mutex);
+            if(worker.count > 0){
+                task = worker.tasks[worker.head];
+                worker.head = (worker.head + 1) % worker.tasks.size();
+                worker.count--;
+                queued_--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void CpuExecutor::run(Task & task, int & cur_role){
+        if(task.role != cur_role && placement_ != NULL){
+            placement_->apply(task.role);
+            cur_role = task.role;
+        }
+
+        task.fn(task.arg, task.index);
+
+        if(--(*task.pending) == 0){
+            std::lock_guard<std::mutex> lk(wait_mutex_);
+            done_cv_.notify_all();
+        }
+    }
+
+    void CpuExecutor::worker_loop(int worker_id){
+        int cur_role = -1;
+        Task task;
+
+        while(true){
+            long seen = submitted_;
+            if(pop(worker_id, task)){
+                run(task, cur_role);
+                continue;
+            }
+
+            // The tasks left in queued_ are taken by the other workers, this one sleeps until new ones come
+            std::unique_lock<std::mutex> lk(wait_mutex_);
+            wait_cv_.wait(lk, [this, seen]{ return stop_ || submitted_ != seen; });
+            if(stop_ && queued_ == 0)
+                break;
+        }
+    }
+
+    void CpuExecutor::parallel_for(int role, int n, void (*fn)(void *, int), void * arg){
+        if(n <= 0)
+            return;
+
+        if(workers_.empty()){
+            for(int i = 0; i < n; i++)
+                fn(arg, i);
+
+            return;
+        }
+
+        std::atomic<int> pending(n);
+
+        {
+            // Spread the tasks over the queues so that the workers start without stealing
+            std::lock_guard<std::mutex> submit_lk(submit_mutex_);
+            for(int i = 0; i < n; i++){
+                Worker & worker = *workers_[next_worker_];
+                next_worker_ = (next_worker_ + 1) % workers_.size();
+
+                std::lock_guard<std::mutex> lk(worker.mutex);
+                push(worker, {fn, arg, i, role, &pending});
+                queued_++;
+            }
+        }
+
+        std::unique_lock<std::mutex> lk(wait_mutex_);
+        submitted_++;
+        wait_cv_.notify_all();
+        done_cv_.wait(lk, [&pending]{ return pending == 0; });
+    }
+
+    FeederThread::FeederThread() : state_(std::make_shared<State>()), started_(false){
+
+    }
+
+    FeederThread::~FeederThread(){
+        stop();
+    }
+
+    bool FeederThread::start(void (*fn)(), void (*init)(), void (*fini)()){
+        stop();
+
+        // A fresh state, so a thread left behind by stop(false) cannot take the new kicks
+        state_ = std::make_shared<State>();
+        State & state = *state_;
+        state.fn = fn;
+        state.init = init;
+        state.fini = fini;
+        thread_ = std::thread(&FeederThread::loop, state_);
+        started_ = true;
+
+        std::unique_lock<std::mutex> lk(state.mutex);
+        state.cv.wait(lk, [&state]{ return state.ready; });
+
+        return true;
+    }
+
+    void FeederThread::stop(bool wait){
+        if(!started_)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lk(state_->mutex);
+            state_->stop = true;
+        }
+        state_->cv.notify_all();
+
+        // A detached thread holds its state until fn returns, then it runs fini and ends. It never touches this object
+        if(wait)
+            thread_.join();
+        else
+            thread_.detach();
+        started_ = false;
+    }
+
+    bool FeederThread::is_started(){
+        return started_;
+    }
+
+    bool FeederThread::is_idle(){
+        std::lock_guard<std::mutex> lk(state_->mutex);
+        return !state_->running && !state_->pending;
+    }
+
+    void FeederThread::kick(){
+        State & state = *state_;
+        {
+            std::lock_guard<std::mutex> lk(state.mutex);
+            state.pending = true;
+            state.done = false;
+        }
+        state.cv.notify_all();
+    }
+
+    void FeederThread::wait(){
+        State & state = *state_;
+        std::unique_lock<std::mutex> lk(state.mutex);
+        state.cv.wait(lk, [&state]{ return state.done || state.stop; });
+    }
+
+    bool FeederThread::wait_for(double ms){
+        State & state = *state_;
+        std::unique_lock<std::mutex> lk(state.mutex);
+        return state.cv.wait_for(lk, std::chrono::duration<double, std::milli>(ms), [&state]{ return state.done || state.stop; });
+    }
+
+    bool FeederThread::run(void (*task)()){
+        if(!started_)
+            return false;
+
+        State & state = *state_;
+        std::unique_lock<std::mutex> lk(state.mutex);
+        state.cv.wait(lk, [&state]{ return state.task == NULL || state.stop; });
+        if(state.stop)
+            return false;
+
+        state.task = task;
+        long ticket = ++state.task_seq;
+        state.cv.notify_all();
+        state.cv.wait(lk, [&state, ticket]{ return state.task_done >= ticket || state.stop; });
+
+        return state.task_done >= ticket;
+    }
+
+    void FeederThread::loop(std::shared_ptr<State> shared){
+        State & state = *shared;
+        if(state.init != NULL)
+            state.init();
+
+        std::unique_lock<std::mutex> lk(state.mutex);
+        state.ready = true;
+        state.cv.notify_all();
+
+        while(true){
+            state.cv.wait(lk, [&state]{ return state.pending || state.task != NULL || state.stop; });
+            if(state.stop)
+                break;
+
+            if(state.task != NULL){
+                void (*task)() = state.task;
+                state.running = true;
+                lk.unlock();
+
+                task();
+
+                lk.lock();
+                state.task = NULL;
+                state.task_done++;
+                state.running = false;
+                state.cv.notify_all();
+                continue;
+            }
+
+            state.pending = false;
+            state.running = true;
+            lk.unlock();
+
+            state.fn();
+
+            lk.lock();
+            state.running = false;
+            if(!state.pending)
+                state.done = true;
+            state.cv.notify_all();
+        }
+
+        lk.unlock();
+        if(state.fini != NULL)
+            state.fini();
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef _EXECUTOR_HPP_
+#define _EXECUTOR_HPP_
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+
+#include "placement.hpp"
+
+namespace pkshin{
+    // Work-stealing pool shared by the app stages. Every worker owns a task queue: it pops its own tasks from the back
+    // and steals from the front of the other queues when it runs dry.
+    // A task carries a thread role, and the worker moves itself to the cores of that role before running it.
+    class CpuExecutor {
+        public:
+        CpuExecutor();
+
+        ~CpuExecutor();
+
+        bool start(int num_threads, ThreadPlacement * placement);
+
+        void stop();
+
+        int num_threads();
+
+        // Runs fn(arg, i) for i in [0, n) and returns when all of them are done.
+        // Runs on the calling thread when the pool is not started.
+        void parallel_for(int role, int n, void (*fn)(void *, int), void * arg);
+
+        private:
+        struct Task {
+            void (*fn)(void *, int);
+            void * arg;
+            int index;
+            int role;
+            std::atomic<int> * pending;
+        };
+
+        // Ring buffer of tasks. It only grows, so the steady state does not allocate
+        struct Worker {
+            std::vector<Task> tasks;
+            size_t head;
+            size_t count;
+            std::mutex mutex;
+            std::thread thread;
+        };
+
+        void push(Worker & worker, const Task & task);
+
+        bool pop(int worker_id, Task & task);
+
+        void run(Task & task, int & cur_role);
+
+        void worker_loop(int worker_id);
+
+        std::vector<std::unique_ptr<Worker>> workers_;
+        std::atomic<int> queued_;
+        std::atomic<long> submitted_;    // parallel_for calls, a worker that found nothing waits for the next one
+        std::mutex wait_mutex_;
+        std::condition_variable wait_cv_;
+        std::condition_variable done_cv_;
+        std::mutex submit_mutex_;
+        int next_worker_;
+        bool stop_;
+        ThreadPlacement * placement_;
+    };
+
+    // Persistent thread running the same function on every kick(), so the device feeders are not created per batch.
+    // init runs on the thread before start() returns and fini when it stops, for device state owned by the thread.
+    class FeederThread {
+        public:
+        FeederThread();
+
+        ~FeederThread();
+
+        bool start(void (*fn)(), void (*init)() = NULL, void (*fini)() = NULL);
+
+        // Without wait, a thread stuck in fn is left behind instead of joined
+        void stop(bool wait = true);
+
+        bool is_started();
+
+        // True when fn is not running or pending
+        bool is_idle();
+
+        void kick();
+
+        void wait();
+
+        // wait() giving up after ms. Returns whether fn is done
+        bool wait_for(double ms);
+
+        // Runs task once on the thread, between two runs of fn, and returns when it is done. For device state the
+        // thread owns. False when the thread stopped
+        bool run(void (*task)());
+
+        private:
+        // Shared with the thread. A thread left behind by stop() keeps its own state, and the next start() makes a new one
+        struct State {
+            void (*fn)() = NULL;
+            void (*init)() = NULL;
+            void (*fini)() = NULL;
+            void (*task)() = NULL;
+            long task_seq = 0;
+            long task_done = 0;
+            std::mutex mutex;
+            std::condition_variable cv;
+            bool ready = false;
+            bool running = false;
+            bool pending = false;
+            bool done = false;
+            bool stop = false;
+        };
+
+        static void loop(std::shared_ptr<State> state);
+
+        std::shared_ptr<State> state_;
+        std::thread thread_;
+        bool started_;
+    };
+}
+
+#endif //_EXECUTOR_HPP_
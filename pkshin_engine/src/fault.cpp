@@ -0,0 +1,186 @@
+#include "fault.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <thread>
+#include <cstring>
+#include <cstdlib>
+
+namespace pkshin{
+    static const char * device_names_[DeviceHealth::MAX_DEVICES] = {"gpu", "hexagon", "maccel", "hailo0", "hailo1", "hailo2", "remote"};
+
+    const char * device_name(int device){
+        if(device < 0 || device >= DeviceHealth::MAX_DEVICES)
+            return "unknown";
+
+        return device_names_[device];
+    }
+
+    DeviceHealth::DeviceHealth() : base_backoff_ms_(1000), max_backoff_ms_(60000){
+        reset();
+    }
+
+    void DeviceHealth::set_params(double base_backoff_ms, double max_backoff_ms){
+        std::lock_guard<std::mutex> lk(mutex_);
+        base_backoff_ms_ = base_backoff_ms;
+        max_backoff_ms_ = max_backoff_ms;
+    }
+
+    void DeviceHealth::reset(){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        for(int i = 0; i < MAX_DEVICES; i++){
+            quarantined_[i] = false;
+            faults_in_row_[i] = 0;
+        }
+
+        stats_ = {false, 0, 0, 0, 0, 0};
+    }
+
+    bool DeviceHealth::usable(int device){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return !quarantined_[device] || std::chrono::steady_clock::now() >= retry_at_[device];
+    }
+
+    void DeviceHealth::report_ok(int device){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        if(quarantined_[device])
+            std::cout << "INFO: " << device_name(device) << " is back after " << faults_in_row_[device] << " faults\n";
+
+        quarantined_[device] = false;
+        faults_in_row_[device] = 0;
+    }
+
+    void DeviceHealth::report_fault(int device, int fault){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        if(fault == DEVICE_TIMEOUT)
+            stats_.timeouts++;
+        else
+            stats_.errors++;
+
+        // Only the first fault of a probe counts, the calls already running on the device may fail as well
+        if(quarantined_[device] && std::chrono::steady_clock::now() < retry_at_[device])
+            return;
+
+        double backoff_ms = base_backoff_ms_;
+        for(int i = 0; i < faults_in_row_[device] && backoff_ms < max_backoff_ms_; i++)
+            backoff_ms *= 2;
+        if(backoff_ms > max_backoff_ms_)
+            backoff_ms = max_backoff_ms_;
+
+        quarantined_[device] = true;
+        faults_in_row_[device]++;
+        retry_at_[device] = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(backoff_ms));
+        stats_.quarantines++;
+
+        std::cout << "WARNING: " << device_name(device) << (fault == DEVICE_TIMEOUT ? " timed out" : " failed") << ". Quarantine it for " << backoff_ms << " ms\n";
+    }
+
+    void DeviceHealth::count_requeued(long slots){
+        std::lock_guard<std::mutex> lk(mutex_);
+        stats_.requeued += slots;
+    }
+
+    void DeviceHealth::count_dropped(long slots){
+        std::lock_guard<std::mutex> lk(mutex_);
+        stats_.dropped += slots;
+    }
+
+    FaultStats DeviceHealth::stats(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return stats_;
+    }
+
+    FaultInjector::FaultInjector() : configured_(false){
+        for(int i = 0; i < DeviceHealth::MAX_DEVICES; i++){
+            error_prob_[i] = 0;
+            stall_prob_[i] = 0;
+            stall_ms_[i] = 10000;
+        }
+    }
+
+    bool FaultInjector::parse(const char * config){
+        std::stringstream ss(config);
+        std::string entry;
+
+        while(std::getline(ss, entry, ',')){
+            if(entry.empty())
+                continue;
+
+            size_t equal = entry.find('=');
+            size_t colon = entry.find(':');
+            if(equal == std::string::npos || colon == std::string::npos || colon < equal){
+                std::cerr << "ERROR: Invalid fault injection entry: " << entry << std::endl;
+                return false;
+            }
+
+            std::string name = entry.substr(0, equal);
+            std::string kind = entry.substr(equal + 1, colon - equal - 1);
+            std::string args = entry.substr(colon + 1);
+
+            char * end;
+            float prob = strtof(args.c_str(), &end);
+            int ms = 10000;
+            if(*end == ':')
+                ms = strtol(end + 1, &end, 10);
+            if(*end != '\0' || prob < 0 || prob > 1 || ms < 0){
+                std::cerr << "ERROR: Invalid fault injection entry: " << entry << std::endl;
+                return false;
+            }
+
+            int first = -1, last = -1;
+            if(name == "hailo"){
+                first = 3;
+                last = 5;
+            }
+            else{
+                for(int i = 0; i < DeviceHealth::MAX_DEVICES; i++){
+                    if(name == device_names_[i])
+                        first = last = i;
+                }
+            }
+
+            if(first < 0 || (kind != "error" && kind != "stall")){
+                std::cerr << "ERROR: Invalid fault injection entry: " << entry << std::endl;
+                return false;
+            }
+
+            for(int i = first; i <= last; i++){
+                if(kind == "error"){
+                    error_prob_[i] = prob;
+                }
+                else{
+                    stall_prob_[i] = prob;
+                    stall_ms_[i] = ms;
+                }
+            }
+        }
+
+        configured_ = true;
+
+        return true;
+    }
+
+    bool FaultInjector::is_configured(){
+        return configured_;
+    }
+
+    int FaultInjector::inject(int device){
+        if(!configured_)
+            return DEVICE_OK;
+
+        thread_local std::mt19937 rng(std::random_device{}());
+        std::uniform_real_distribution<float> uniform(0, 1);
+
+        if(stall_prob_[device] > 0 && uniform(rng) < stall_prob_[device])
+            std::this_thread::sleep_for(std::chrono::milliseconds(stall_ms_[device]));
+
+        if(error_prob_[device] > 0 && uniform(rng) < error_prob_[device])
+            return DEVICE_ERROR;
+
+        return DEVICE_OK;
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef _FAULT_HPP_
+#define _FAULT_HPP_
+
+#include <string>
+#include <chrono>
+#include <mutex>
+
+namespace pkshin{
+    // Outcome of one device call
+    enum DeviceFault {
+        DEVICE_OK = 0,
+        DEVICE_ERROR = 1,      // the call returned an error
+        DEVICE_TIMEOUT = 2     // the call timed out or stalled past the device timeout
+    };
+
+    // Device faults seen while the fault tolerance is on
+    struct FaultStats {
+        bool enabled;
+        long errors;
+        long timeouts;
+        long quarantines;    // times a device was taken out of the dispatch
+        long requeued;       // slots moved to another device
+        long dropped;        // slots no device could run. The app gets no output for them
+    };
+
+    // Quarantine of failing devices. A fault takes the device out of the dispatch for a backoff that doubles with every
+    // fault in a row, up to max_backoff_ms. Once the backoff is over the next dispatch probes the device again, and a
+    // successful call brings it back.
+    // Devices are the batch_run_ codes of the engine.
+    class DeviceHealth {
+        public:
+        static const int MAX_DEVICES = 7;
+
+        DeviceHealth();
+
+        void set_params(double base_backoff_ms, double max_backoff_ms);
+
+        void reset();
+
+        // Healthy, or quarantined with the backoff over
+        bool usable(int device);
+
+        void report_ok(int device);
+
+        void report_fault(int device, int fault);
+
+        void count_requeued(long slots);
+
+        void count_dropped(long slots);
+
+        FaultStats stats();
+
+        private:
+        bool quarantined_[MAX_DEVICES];
+        int faults_in_row_[MAX_DEVICES];
+        std::chrono::steady_clock::time_point retry_at_[MAX_DEVICES];
+        double base_backoff_ms_;
+        double max_backoff_ms_;
+        FaultStats stats_;
+        std::mutex mutex_;
+    };
+
+    // Failure injection for testing the fault tolerance without broken hardware. The config is a comma separated list of
+    // device=kind:probability[:ms] entries, e.g. "hailo1=error:0.05,maccel=stall:0.01:3000".
+    // device is gpu, hexagon, maccel, hailo0, hailo1, hailo2, remote or hailo for all three. error fails the call, stall blocks
+    // it for ms (default 10000) like a hung device.
+    class FaultInjector {
+        public:
+        FaultInjector();
+
+        bool parse(const char * config);
+
+        bool is_configured();
+
+        // Called before a device call. Returns the injected fault, after sleeping for an injected stall
+        int inject(int device);
+
+        private:
+        bool configured_;
+        float error_prob_[DeviceHealth::MAX_DEVICES];
+        float stall_prob_[DeviceHealth::MAX_DEVICES];
+        int stall_ms_[DeviceHealth::MAX_DEVICES];
+    };
+
+    // batch_run_ code of the engine of another board, see RemoteLink
+    static const int REMOTE_DEVICE = 6;
+
+    const char * device_name(int device);
+}
+
+#endif //_FAULT_HPP_
@@ -0,0 +1,261 @@
+#include "hedge.hpp"
+
+namespace pkshin{
+    // Weight of a new service time sample
+    static const double SERVICE_EWMA_ALPHA = 0.125;
+
+    static inline std::chrono::steady_clock::duration milliseconds_of(double ms){
+        return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(ms));
+    }
+
+    SlotHedger::SlotHedger() : num_slots_(0), pending_(0), generation_(0), devices_(0), failed_(0), factor_(0), hedged_(0), won_(0){
+        for(int i = 0; i < MAX_DEVICES; i++){
+            running_[i] = -1;
+            service_ms_[i] = 0;
+        }
+    }
+
+    void SlotHedger::set_params(float factor){
+        std::lock_guard<std::mutex> lk(mutex_);
+        factor_ = factor > 0 ? factor : 0;
+        hedged_ = 0;
+        won_ = 0;
+    }
+
+    bool SlotHedger::enabled(){
+        return factor_ > 0;
+    }
+
+    void SlotHedger::begin(int num_slots, unsigned devices){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        // Only grows, so the dispatch does not allocate in the steady state
+        if(slots_.size() < num_slots)
+            slots_.resize(num_slots);
+
+        for(int i = 0; i < num_slots; i++){
+            slots_[i].owner = -1;
+            slots_[i].device = -1;
+            slots_[i].excluded = 0;
+            slots_[i].hedged = false;
+            slots_[i].done = false;
+        }
+
+        num_slots_ = num_slots;
+        pending_ = num_slots;
+        generation_++;
+        devices_ = devices;
+        failed_ = 0;
+    }
+
+    void SlotHedger::assign(int slot, int device){
+        std::lock_guard<std::mutex> lk(mutex_);
+        slots_[slot].owner = device;
+    }
+
+    void SlotHedger::exclude(int slot, unsigned devices){
+        std::lock_guard<std::mutex> lk(mutex_);
+        slots_[slot].excluded |= devices;
+    }
+
+    int SlotHedger::generation(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return generation_;
+    }
+
+    bool SlotHedger::claim(int slot, int device, int generation){
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+
+            Slot & s = slots_[slot];
+            if(generation != generation_ || s.done || s.owner != device || s.device >= 0)
+                return false;
+
+            s.device = device;
+            s.start = std::chrono::steady_clock::now();
+            running_[device] = slot;
+        }
+        cv_.notify_all();
+
+        return true;
+    }
+
+    bool SlotHedger::finish(int slot, int device, int generation, double service_ms){
+        bool first;
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            running_[device] = -1;
+
+            if(service_ms_[device] <= 0)
+                service_ms_[device] = service_ms;
+            else
+                service_ms_[device] += SERVICE_EWMA_ALPHA * (service_ms - service_ms_[device]);
+
+            first = generation == generation_ && !slots_[slot].done;
+            if(first){
+                slots_[slot].done = true;
+                pending_--;
+                if(slots_[slot].hedged && device != slots_[slot].owner)
+                    won_++;
+            }
+        }
+        cv_.notify_all();
+
+        return first;
+    }
+
+    void SlotHedger::fail_locked(int device, void (*drop)(int slot), int & moved){
+        failed_ |= 1u << device;
+
+        for(int i = 0; i < num_slots_; i++){
+            Slot & s = slots_[i];
+            if(s.done)
+                continue;
+
+            bool queued_here = s.owner == device && s.device < 0;
+            bool running_here = s.device == device;
+            if(!queued_here && !running_here)
+                continue;
+
+            s.owner = -1;
+            s.device = -1;
+            s.excluded |= 1u << device;
+
+            // No device is left to run it
+            if((devices_ & ~failed_ & ~s.excluded) == 0){
+                s.done = true;
+                pending_--;
+                if(drop != NULL)
+                    drop(i);
+            }
+            else{
+                moved++;
+            }
+        }
+    }
+
+    int SlotHedger::fail(int device, int generation, void (*drop)(int slot)){
+        int moved = 0;
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            running_[device] = -1;
+            if(generation != generation_)
+                return 0;
+
+            fail_locked(device, drop, moved);
+        }
+        cv_.notify_all();
+
+        return moved;
+    }
+
+    bool SlotHedger::failed(int device, int generation){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return generation != generation_ || (failed_ & (1u << device));
+    }
+
+    int SlotHedger::take_straggler(int device, int generation){
+        std::unique_lock<std::mutex> lk(mutex_);
+
+        while(pending_ > 0 && generation == generation_ && !(failed_ & (1u << device))){
+            auto now = std::chrono::steady_clock::now();
+            auto next_check = std::chrono::steady_clock::time_point::max();
+
+            // Slots of failed devices first
+            for(int i = 0; i < num_slots_; i++){
+                Slot & slot = slots_[i];
+                if(!slot.done && slot.owner < 0 && slot.device < 0 && !(slot.excluded & (1u << device))){
+                    slot.owner = device;
+                    slot.device = device;
+                    slot.start = now;
+                    running_[device] = i;
+                    return i;
+                }
+            }
+
+            for(int i = 0; i < num_slots_ && factor_ > 0; i++){
+                Slot & slot = slots_[i];
+                if(slot.done || slot.hedged || slot.device < 0 || slot.device == device || (slot.excluded & (1u << device)))
+                    continue;
+
+                // The owner has no estimate yet, or this device is too slow to beat it
+                double expected_ms = service_ms_[slot.device];
+                if(expected_ms <= 0 || (service_ms_[device] > 0 && service_ms_[device] > factor_ * expected_ms))
+                    continue;
+
+                auto deadline = slot.start + milliseconds_of(factor_ * expected_ms);
+                if(deadline <= now){
+                    slot.hedged = true;
+                    hedged_++;
+                    running_[device] = i;
+                    return i;
+                }
+
+                if(deadline < next_check)
+                    next_check = deadline;
+            }
+
+            if(next_check == std::chrono::steady_clock::time_point::max())
+                cv_.wait(lk);
+            else
+                cv_.wait_until(lk, next_check);
+        }
+
+        return -1;
+    }
+
+    int SlotHedger::wait_slots(int generation, double timeout_ms, void (*drop)(int slot), int & moved){
+        std::unique_lock<std::mutex> lk(mutex_);
+
+        while(pending_ > 0 && generation == generation_){
+            if(timeout_ms <= 0){
+                cv_.wait(lk);
+                continue;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            auto next_check = std::chrono::steady_clock::time_point::max();
+
+            for(int i = 0; i < num_slots_; i++){
+                Slot & slot = slots_[i];
+                if(slot.done || slot.device < 0)
+                    continue;
+
+                auto deadline = slot.start + milliseconds_of(timeout_ms);
+                if(deadline <= now){
+                    int device = slot.device;
+                    moved = 0;
+                    fail_locked(device, drop, moved);
+                    lk.unlock();
+                    cv_.notify_all();
+                    return device;
+                }
+
+                if(deadline < next_check)
+                    next_check = deadline;
+            }
+
+            if(next_check == std::chrono::steady_clock::time_point::max())
+                cv_.wait(lk);
+            else
+                cv_.wait_until(lk, next_check);
+        }
+
+        return -1;
+    }
+
+    bool SlotHedger::straggling(int device, int generation){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return generation == generation_ && running_[device] >= 0 && slots_[running_[device]].done;
+    }
+
+    double SlotHedger::expected(int device){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return service_ms_[device];
+    }
+
+    HedgeStats SlotHedger::stats(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return {factor_ > 0, hedged_, won_};
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef _HEDGE_HPP_
+#define _HEDGE_HPP_
+
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+namespace pkshin{
+    // Slots run again on an idle device because their own device was late
+    struct HedgeStats {
+        bool enabled;
+        long hedged;    // slots dispatched to a second device
+        long won;       // hedged slots whose second result came first
+    };
+
+    // Slot states of a dispatch shared by the device feeders, for hedging and for moving the slots of failed devices.
+    // A device that has run its own queue takes the slots of failed devices, and with hedging a slot that another device
+    // has been running for longer than factor times the expected service time of that device. The first result of a
+    // slot is kept and the later one is discarded; a device call in flight cannot be cancelled.
+    // Every dispatch is a new generation, so a device that comes back from a stall cannot touch the slots of a later one.
+    // Devices are the batch_run_ codes of the engine.
+    class SlotHedger {
+        public:
+        static const int MAX_DEVICES = 7;
+
+        SlotHedger();
+
+        // factor <= 0 disables hedging
+        void set_params(float factor);
+
+        bool enabled();
+
+        // Called per dispatch before the devices start. devices is the mask of the devices running it
+        void begin(int num_slots, unsigned devices);
+
+        // Puts a slot in the queue of a device
+        void assign(int slot, int device);
+
+        // Devices that must not run the slot, neither as moved slot nor as hedge
+        void exclude(int slot, unsigned devices);
+
+        int generation();
+
+        // Starts a slot of the device's own queue. False when the slot was moved or the dispatch is over
+        bool claim(int slot, int device, int generation);
+
+        // Returns true when this is the first result of the slot. The caller stores it, otherwise drops it
+        bool finish(int slot, int device, int generation, double service_ms);
+
+        // Takes the device out of the dispatch and moves its unfinished slots to the others. Slots no other device can
+        // run are given up and passed to drop. Returns the number of moved slots, without the dropped ones
+        int fail(int device, int generation, void (*drop)(int slot));
+
+        // Whether the device was failed in the dispatch. Also true once the dispatch is over
+        bool failed(int device, int generation);
+
+        // Blocks until device can take a moved slot or a straggler. Returns -1 once every slot is done
+        int take_straggler(int device, int generation);
+
+        // Waits until every slot is done or a running slot has been on its device for timeout_ms. That device is failed
+        // like with fail() and returned, with the number of moved slots in moved. Returns -1 when the slots are done
+        int wait_slots(int generation, double timeout_ms, void (*drop)(int slot), int & moved);
+
+        // Whether the device is still in its call of a slot another device has finished, a losing hedge or a
+        // moved slot. It is left to return in the background
+        bool straggling(int device, int generation);
+
+        double expected(int device);
+
+        HedgeStats stats();
+
+        private:
+        struct Slot {
+            int owner;       // device whose queue has the slot, -1 once moved
+            int device;      // device running it, -1 while queued
+            unsigned excluded;    // devices that failed on it or may not run it
+            bool hedged;
+            bool done;
+            std::chrono::steady_clock::time_point start;
+        };
+
+        void fail_locked(int device, void (*drop)(int slot), int & moved);
+
+        std::vector<Slot> slots_;
+        int num_slots_;
+        int pending_;
+        int generation_;
+        unsigned devices_;
+        unsigned failed_;
+        int running_[MAX_DEVICES];    // slot in the call of the device, -1 between calls
+        double service_ms_[MAX_DEVICES];    // EWMA of the service time per slot, 0 until the first sample
+        float factor_;
+        long hedged_;
+        long won_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+    };
+}
+
+#endif //_HEDGE_HPP_
@@ -0,0 +1,118 @@
+#include "partition.hpp"
+
+#include <algorithm>
+
+namespace pkshin{
+    bool partition_greedy(const float * costs, int num_devices, int num_slots, int * slot_devices, int * counts, const float * latencies){
+        int first_device = -1;
+        for(int j = num_devices - 1; j >= 0; j--){
+            counts[j] = 0;
+            if(costs[j] < PARTITION_UNUSABLE)
+                first_device = j;
+        }
+
+        if(first_device < 0)
+            return false;
+
+        for(int i = 0; i < num_slots; i++){
+            int min_l = 2147483647;
+            int index = first_device;
+
+            for(int j = 0; j < num_devices; j++){
+                float l = (counts[j] + 1) * costs[j] + (latencies != NULL && costs[j] < PARTITION_UNUSABLE ? latencies[j] : 0);
+                if(l < min_l){
+                    min_l = l;
+                    index = j;
+                }
+            }
+
+            counts[index]++;
+            slot_devices[i] = index;
+        }
+
+        return true;
+    }
+
+    // Whether device j may run a slot of minimum accuracy min_accuracy
+    static bool meets(const float * costs, const float * accuracies, int j, float min_accuracy){
+        return costs[j] < PARTITION_UNUSABLE && accuracies[j] >= min_accuracy;
+    }
+
+    bool partition_accuracy(const float * costs, const float * accuracies, int num_devices, int num_slots, const float * slot_min, float target_mean, int * slot_devices, int * counts){
+        int most_accurate = -1;
+        for(int j = 0; j < num_devices; j++){
+            counts[j] = 0;
+            if(costs[j] < PARTITION_UNUSABLE && (most_accurate < 0 || accuracies[j] > accuracies[most_accurate]))
+                most_accurate = j;
+        }
+
+        if(most_accurate < 0)
+            return false;
+
+        // The most constrained slots take their devices first. Counted on the fly, the dispatch path does not allocate
+        for(int eligible = 1; eligible <= num_devices; eligible++){
+            for(int i = 0; i < num_slots; i++){
+                float min_accuracy = slot_min != NULL ? slot_min[i] : 0;
+
+                int n = 0;
+                for(int j = 0; j < num_devices; j++){
+                    if(meets(costs, accuracies, j, min_accuracy))
+                        n++;
+                }
+                if(std::max(n, 1) != eligible)
+                    continue;
+
+                int index = most_accurate;
+                float min_l = PARTITION_UNUSABLE;
+                for(int j = 0; n > 0 && j < num_devices; j++){
+                    if(meets(costs, accuracies, j, min_accuracy) && (counts[j] + 1) * costs[j] < min_l){
+                        min_l = (counts[j] + 1) * costs[j];
+                        index = j;
+                    }
+                }
+
+                counts[index]++;
+                slot_devices[i] = index;
+            }
+        }
+
+        if(target_mean <= 0)
+            return true;
+
+        double sum = 0;
+        for(int i = 0; i < num_slots; i++)
+            sum += accuracies[slot_devices[i]];
+
+        // Every move raises the sum, so it ends
+        while(sum < (double)target_mean * num_slots){
+            int slot = -1, to = -1;
+            float min_l = PARTITION_UNUSABLE;
+            float gain = 0;
+            for(int i = 0; i < num_slots; i++){
+                int from = slot_devices[i];
+                for(int j = 0; j < num_devices; j++){
+                    if(!meets(costs, accuracies, j, accuracies[from]) || accuracies[j] == accuracies[from])
+                        continue;
+
+                    float l = (counts[j] + 1) * costs[j];
+                    if(l < min_l || (l == min_l && accuracies[j] - accuracies[from] > gain)){
+                        min_l = l;
+                        gain = accuracies[j] - accuracies[from];
+                        slot = i;
+                        to = j;
+                    }
+                }
+            }
+
+            if(slot < 0)
+                break;
+
+            counts[slot_devices[slot]]--;
+            counts[to]++;
+            slot_devices[slot] = to;
+            sum += gain;
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef _PARTITION_HPP_
+#define _PARTITION_HPP_
+
+#include <cstddef>
+
+namespace pkshin{
+    // Accuracy of the slots run under the accuracy requirements
+    struct AccuracyStats {
+        bool enabled;
+        long slots;               // slots run
+        double mean_accuracy;     // of the devices that ran them
+        long unmet;               // slots run below their minimum, no usable device met it
+    };
+
+    // Cost of a device left out of the partition
+    static const float PARTITION_UNUSABLE = 2147483647;
+
+    // Greedy partition of the slots of a dispatch, the scheduler of Interpreter::Invoke: slot by slot, the slot goes to
+    // the device whose queue would end first with it, costs[j] being the time of a slot on device j.
+    // slot_devices gets the device of every slot and counts the slots per device. Devices of PARTITION_UNUSABLE cost
+    // get no slots. Returns false when every device is unusable. latencies[j], when given, is the time device j takes
+    // before its first slot whatever the number of slots, like the round trip of a remote device.
+    // Shared with the simulator, so what it reports is what the engine does.
+    bool partition_greedy(const float * costs, int num_devices, int num_slots, int * slot_devices, int * counts, const float * latencies = NULL);
+
+    // Greedy partition under accuracy requirements, accuracies[j] being the measured accuracy of device j. A slot only
+    // goes to the devices meeting its minimum slot_min[i] (NULL for none), the slots with the fewest such devices first.
+    // A slot no usable device meets goes to the most accurate one. With target_mean > 0, slots then move to more
+    // accurate devices, each time the move ending first, until the mean accuracy of the slots reaches the target or no
+    // move raises it. Returns false when every device is unusable.
+    bool partition_accuracy(const float * costs, const float * accuracies, int num_devices, int num_slots, const float * slot_min, float target_mean, int * slot_devices, int * counts);
+}
+
+#endif //_PARTITION_HPP_
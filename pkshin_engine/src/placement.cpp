@@ -0,0 +1,431 @@
+#include "placement.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+
+#include <pthread.h>
+#include <sys/resource.h>
+
+namespace pkshin{
+    static const int default_role_prios_[NUM_THREAD_ROLES] = {80, 70, 70, 60};
+
+    static thread_local bool is_realtime_thread_ = false;
+    static thread_local int hot_path_depth_ = 0;
+    static thread_local struct rusage hot_path_usage_;
+
+    static bool parse_cpu_list(const std::string & str, char separator, std::vector<int> & cpus){
+        std::stringstream ss(str);
+        std::string token;
+
+        while(std::getline(ss, token, separator)){
+            if(token.empty())
+                continue;
+
+            size_t dash = token.find('-');
+            char * end;
+
+            if(dash == std::string::npos){
+                int cpu = strtol(token.c_str(), &end, 10);
+                if(*end != '\0')
+                    return false;
+
+                cpus.push_back(cpu);
+            }
+            else{
+                int first = strtol(token.substr(0, dash).c_str(), &end, 10);
+                if(*end != '\0')
+                    return false;
+
+                int last = strtol(token.substr(dash + 1).c_str(), &end, 10);
+                if(*end != '\0' || last < first)
+                    return false;
+
+                for(int cpu = first; cpu <= last; cpu++)
+                    cpus.push_back(cpu);
+            }
+        }
+
+        std::sort(cpus.begin(), cpus.end());
+        cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+
+        return true;
+    }
+
+    const char * thread_role_name(int role){
+        switch(role){
+            case THREAD_ROLE_FEEDER:
+                return "feeder";
+            case THREAD_ROLE_PRE:
+                return "pre";
+            case THREAD_ROLE_POST:
+                return "post";
+            case THREAD_ROLE_WRITER:
+                return "writer";
+            default:
+                return "unknown";
+        }
+    }
+
+    CpuTopology::CpuTopology(){
+
+    }
+
+    bool CpuTopology::detect(const char * sysfs_root){
+        online_.clear();
+        clusters_.clear();
+
+        std::ifstream online_file(std::string(sysfs_root) + "/online");
+        std::string online_str;
+        if(!online_file.is_open() || !std::getline(online_file, online_str) || !parse_cpu_list(online_str, ',', online_)){
+            int num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            for(int i = 0; i < num_cpus; i++)
+                online_.push_back(i);
+        }
+
+        // Group the cores by their maximum frequency, or by their capacity when cpufreq is not exposed
+        std::vector<std::pair<long, int>> speeds;
+        for(int i = 0; i < online_.size(); i++){
+            std::string cpu_dir = std::string(sysfs_root) + "/cpu" + std::to_string(online_[i]);
+            long speed = 0;
+
+            std::ifstream freq_file(cpu_dir + "/cpufreq/cpuinfo_max_freq");
+            if(!(freq_file >> speed)){
+                std::ifstream capacity_file(cpu_dir + "/cpu_capacity");
+                if(!(capacity_file >> speed))
+                    speed = 0;
+            }
+
+            speeds.push_back({speed, online_[i]});
+        }
+
+        std::sort(speeds.begin(), speeds.end());
+
+        for(int i = 0; i < speeds.size(); i++){
+            if(i == 0 || speeds[i].first != speeds[i - 1].first)
+                clusters_.push_back(std::vector<int>());
+
+            clusters_.back().push_back(speeds[i].second);
+        }
+
+        for(int i = 0; i < clusters_.size(); i++)
+            std::sort(clusters_[i].begin(), clusters_[i].end());
+
+        return !online_.empty();
+    }
+
+    const std::vector<int> & CpuTopology::online(){
+        return online_;
+    }
+
+    const std::vector<std::vector<int>> & CpuTopology::clusters(){
+        return clusters_;
+    }
+
+    std::vector<int> CpuTopology::little(){
+        if(clusters_.empty())
+            return online_;
+
+        return clusters_.front();
+    }
+
+    std::vector<int> CpuTopology::big(){
+        if(clusters_.empty())
+            return online_;
+
+        return clusters_.back();
+    }
+
+    ThreadPlacement::ThreadPlacement() : role_cpus_(NUM_THREAD_ROLES), role_prios_(default_role_prios_, default_role_prios_ + NUM_THREAD_ROLES), configured_(false), isolate_(false), rt_policy_(SCHED_OTHER){
+
+    }
+
+    bool ThreadPlacement::parse_cpus(const std::string & str, std::vector<int> & cpus){
+        cpus.clear();
+
+        if(str == "all"){
+            cpus = topology_.online();
+        }
+        else if(str == "big"){
+            cpus = topology_.big();
+        }
+        else if(str == "little"){
+            cpus = topology_.little();
+        }
+        else if(str.compare(0, 7, "cluster") == 0){
+            int cluster = atoi(str.c_str() + 7);
+            if(cluster < 0 || cluster >= topology_.clusters().size())
+                return false;
+
+            cpus = topology_.clusters()[cluster];
+        }
+        else{
+            if(!parse_cpu_list(str, '+', cpus))
+                return false;
+
+            const std::vector<int> & online = topology_.online();
+            for(int i = 0; i < cpus.size(); i++){
+                if(std::find(online.begin(), online.end(), cpus[i]) == online.end()){
+                    std::cout << "WARNING: cpu " << cpus[i] << " is not online. Ignore it.\n";
+                    cpus.erase(cpus.begin() + i);
+                    i--;
+                }
+            }
+        }
+
+        return !cpus.empty();
+    }
+
+    bool ThreadPlacement::parse(const char * config){
+        topology_.detect();
+
+        // Roles without an entry keep the cores the process was started with (e.g. by taskset)
+        std::vector<int> inherited_cpus;
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        if(pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) == 0){
+            for(int i = 0; i < topology_.online().size(); i++){
+                if(CPU_ISSET(topology_.online()[i], &cpuset))
+                    inherited_cpus.push_back(topology_.online()[i]);
+            }
+        }
+        if(inherited_cpus.empty())
+            inherited_cpus = topology_.online();
+
+        for(int i = 0; i < NUM_THREAD_ROLES; i++)
+            role_cpus_[i] = inherited_cpus;
+        isolate_ = false;
+
+        std::stringstream ss(config);
+        std::string token;
+
+        while(std::getline(ss, token, ',')){
+            if(token.empty())
+                continue;
+
+            size_t equal = token.find('=');
+            if(equal == std::string::npos){
+                std::cerr << "ERROR: Invalid placement entry: " << token << std::endl;
+                return false;
+            }
+
+            std::string key = token.substr(0, equal);
+            std::string value = token.substr(equal + 1);
+
+            if(key == "isolate"){
+                isolate_ = value != "0";
+                continue;
+            }
+
+            if(key.size() > 5 && key.compare(key.size() - 5, 5, "_prio") == 0){
+                int role;
+                for(role = 0; role < NUM_THREAD_ROLES; role++){
+                    if(key.compare(0, key.size() - 5, thread_role_name(role)) == 0)
+                        break;
+                }
+
+                int prio = atoi(value.c_str());
+                if(role == NUM_THREAD_ROLES || prio < sched_get_priority_min(SCHED_FIFO) || prio > sched_get_priority_max(SCHED_FIFO)){
+                    std::cerr << "ERROR: Invalid real-time priority in placement: " << token << std::endl;
+                    return false;
+                }
+
+                role_prios_[role] = prio;
+                continue;
+            }
+
+            int role;
+            for(role = 0; role < NUM_THREAD_ROLES; role++){
+                if(key == thread_role_name(role))
+                    break;
+            }
+
+            if(role == NUM_THREAD_ROLES){
+                std::cerr << "ERROR: Unknown thread role in placement: " << key << std::endl;
+                return false;
+            }
+
+            if(!parse_cpus(value, role_cpus_[role])){
+                std::cerr << "ERROR: Invalid cpu set for " << key << ": " << value << std::endl;
+                return false;
+            }
+        }
+
+        if(isolate_){
+            const std::vector<int> & feeder_cpus = role_cpus_[THREAD_ROLE_FEEDER];
+
+            for(int role = 0; role < NUM_THREAD_ROLES; role++){
+                if(role == THREAD_ROLE_FEEDER)
+                    continue;
+
+                std::vector<int> cpus;
+                for(int i = 0; i < role_cpus_[role].size(); i++){
+                    if(std::find(feeder_cpus.begin(), feeder_cpus.end(), role_cpus_[role][i]) == feeder_cpus.end())
+                        cpus.push_back(role_cpus_[role][i]);
+                }
+
+                if(cpus.empty())
+                    std::cout << "WARNING: Isolating the feeder cores leaves no core for " << thread_role_name(role) << ". Share them.\n";
+                else
+                    role_cpus_[role] = cpus;
+            }
+        }
+
+        configured_ = true;
+
+        return true;
+    }
+
+    bool ThreadPlacement::is_configured(){
+        return configured_;
+    }
+
+    bool ThreadPlacement::set_realtime(const char * policy){
+        if(strcmp(policy, "fifo") == 0)
+            rt_policy_ = SCHED_FIFO;
+        else if(strcmp(policy, "rr") == 0)
+            rt_policy_ = SCHED_RR;
+        else if(strcmp(policy, "off") == 0)
+            rt_policy_ = SCHED_OTHER;
+        else{
+            std::cerr << "ERROR: Unknown real-time policy: " << policy << ". Use fifo, rr or off.\n";
+            return false;
+        }
+
+        return true;
+    }
+
+    int ThreadPlacement::realtime_policy(){
+        return rt_policy_;
+    }
+
+    bool ThreadPlacement::apply(int role){
+        if(role < 0 || role >= NUM_THREAD_ROLES)
+            return true;
+
+        if(configured_){
+            cpu_set_t cpuset;
+            CPU_ZERO(&cpuset);
+            for(int i = 0; i < role_cpus_[role].size(); i++)
+                CPU_SET(role_cpus_[role][i], &cpuset);
+
+            if(pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset) != 0){
+                std::cerr << "ERROR: Failed to set the affinity of " << thread_role_name(role) << " thread\n";
+                return false;
+            }
+        }
+
+        if(rt_policy_ != SCHED_OTHER || is_realtime_thread_){
+            struct sched_param param;
+            param.sched_priority = rt_policy_ != SCHED_OTHER ? role_prios_[role] : 0;
+
+            if(pthread_setschedparam(pthread_self(), rt_policy_, &param) != 0){
+                // Usually EPERM without CAP_SYS_NICE or an RLIMIT_RTPRIO. Keep running under SCHED_OTHER
+                static std::atomic<bool> warned(false);
+                if(!warned.exchange(true))
+                    std::cout << "WARNING: Cannot set the real-time priority of " << thread_role_name(role) << " thread. Run without it.\n";
+            }
+            else{
+                is_realtime_thread_ = rt_policy_ != SCHED_OTHER;
+            }
+        }
+
+        return true;
+    }
+
+    const std::vector<int> & ThreadPlacement::cpus(int role){
+        return role_cpus_[role];
+    }
+
+    std::string ThreadPlacement::describe(){
+        std::string str;
+
+        for(int role = 0; role < NUM_THREAD_ROLES; role++){
+            if(role > 0)
+                str += ", ";
+
+            str += thread_role_name(role);
+            str += ":";
+            for(int i = 0; i < role_cpus_[role].size(); i++){
+                str += i == 0 ? " " : ",";
+                str += std::to_string(role_cpus_[role][i]);
+            }
+        }
+
+        if(isolate_)
+            str += " (feeder isolated)";
+
+        if(rt_policy_ != SCHED_OTHER){
+            str += rt_policy_ == SCHED_FIFO ? " (fifo" : " (rr";
+            for(int role = 0; role < NUM_THREAD_ROLES; role++){
+                str += role == 0 ? " " : ",";
+                str += thread_role_name(role);
+                str += ":";
+                str += std::to_string(role_prios_[role]);
+            }
+            str += ")";
+        }
+
+        return str;
+    }
+
+    CpuTopology & ThreadPlacement::topology(){
+        return topology_;
+    }
+
+    HotPathMonitor::HotPathMonitor() : enabled_(false), minor_faults_(0), major_faults_(0), involuntary_switches_(0){
+
+    }
+
+    void HotPathMonitor::set_enabled(bool enabled){
+        enabled_ = enabled;
+    }
+
+    bool HotPathMonitor::is_enabled(){
+        return enabled_;
+    }
+
+    void HotPathMonitor::enter(){
+        if(!enabled_ || hot_path_depth_++ > 0)
+            return;
+
+        getrusage(RUSAGE_THREAD, &hot_path_usage_);
+    }
+
+    void HotPathMonitor::leave(){
+        if(!enabled_ || hot_path_depth_ == 0 || --hot_path_depth_ > 0)
+            return;
+
+        struct rusage usage;
+        getrusage(RUSAGE_THREAD, &usage);
+
+        minor_faults_ += usage.ru_minflt - hot_path_usage_.ru_minflt;
+        major_faults_ += usage.ru_majflt - hot_path_usage_.ru_majflt;
+
+        // A real-time thread only loses its core involuntarily to an equal or higher priority one
+        if(is_realtime_thread_)
+            involuntary_switches_ += usage.ru_nivcsw - hot_path_usage_.ru_nivcsw;
+    }
+
+    RealtimeStats HotPathMonitor::stats(){
+        return {enabled_, minor_faults_, major_faults_, involuntary_switches_};
+    }
+
+    void HotPathMonitor::reset(){
+        minor_faults_ = 0;
+        major_faults_ = 0;
+        involuntary_switches_ = 0;
+    }
+
+    HotPathScope::HotPathScope(HotPathMonitor & monitor) : monitor_(monitor){
+        monitor_.enter();
+    }
+
+    HotPathScope::~HotPathScope(){
+        monitor_.leave();
+    }
+}
@@ -0,0 +1,121 @@
+#ifndef _PLACEMENT_HPP_
+#define _PLACEMENT_HPP_
+
+#include <string>
+#include <vector>
+#include <atomic>
+
+#include <sched.h>
+
+namespace pkshin{
+    enum ThreadRole {
+        THREAD_ROLE_FEEDER = 0,    // engine threads feeding the devices
+        THREAD_ROLE_PRE = 1,       // app preprocessing
+        THREAD_ROLE_POST = 2,      // app postprocessing
+        THREAD_ROLE_WRITER = 3,    // app thread collecting and writing the results
+        NUM_THREAD_ROLES = 4
+    };
+
+    // Page faults and preemptions seen by the threads on the inference path while the real-time mode is on
+    struct RealtimeStats {
+        bool enabled;
+        long minor_faults;
+        long major_faults;
+        long involuntary_switches;    // involuntary context switches (ru_nivcsw) of the real-time hot path threads
+    };
+
+    // CPU clusters read from sysfs, ordered from the slowest (LITTLE) to the fastest (big) cluster.
+    class CpuTopology {
+        public:
+        CpuTopology();
+
+        bool detect(const char * sysfs_root = "/sys/devices/system/cpu");
+
+        const std::vector<int> & online();
+
+        const std::vector<std::vector<int>> & clusters();
+
+        std::vector<int> little();
+
+        std::vector<int> big();
+
+        private:
+        std::vector<int> online_;
+        std::vector<std::vector<int>> clusters_;
+    };
+
+    // Per-role CPU sets. The config is a comma separated list of role=cpus pairs, e.g.
+    // "feeder=big,pre=little,post=little,writer=0+1,isolate=1".
+    // cpus is all, big, little, clusterN or a '+' joined list of cpu ids and ranges such as 0-3+6.
+    // Roles without an entry keep the affinity of the thread calling parse().
+    // isolate=1 removes the feeder cores from every other role.
+    // role_prio=N sets the real-time priority of the role, used once set_realtime() picks fifo or rr.
+    class ThreadPlacement {
+        public:
+        ThreadPlacement();
+
+        bool parse(const char * config);
+
+        bool is_configured();
+
+        bool set_realtime(const char * policy);
+
+        int realtime_policy();
+
+        bool apply(int role);
+
+        const std::vector<int> & cpus(int role);
+
+        std::string describe();
+
+        CpuTopology & topology();
+
+        private:
+        bool parse_cpus(const std::string & str, std::vector<int> & cpus);
+
+        CpuTopology topology_;
+        std::vector<std::vector<int>> role_cpus_;
+        std::vector<int> role_prios_;
+        bool configured_;
+        bool isolate_;
+        int rt_policy_;
+    };
+
+    // Accumulates the page faults and involuntary switches of the threads between enter() and leave()
+    class HotPathMonitor {
+        public:
+        HotPathMonitor();
+
+        void set_enabled(bool enabled);
+
+        bool is_enabled();
+
+        void enter();
+
+        void leave();
+
+        RealtimeStats stats();
+
+        void reset();
+
+        private:
+        std::atomic<bool> enabled_;
+        std::atomic<long> minor_faults_;
+        std::atomic<long> major_faults_;
+        std::atomic<long> involuntary_switches_;
+    };
+
+    class HotPathScope {
+        public:
+        HotPathScope(HotPathMonitor & monitor);
+
+        ~HotPathScope();
+
+        private:
+        HotPathMonitor & monitor_;
+    };
+
+    const char * thread_role_name(int role);
+}
+
+#endif //_PLACEMENT_HPP_
@@ -0,0 +1,115 @@
+#include "profile.hpp"
+#include "trace.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cstdio>
+#include <cinttypes>
+
+namespace pkshin{
+    ProfileDatabase::ProfileDatabase() : loaded_(false){
+
+    }
+
+    bool ProfileDatabase::load(const char * path){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        path_ = path;
+        profiles_.clear();
+        loaded_ = true;
+
+        std::ifstream file(path);
+        if(!file.is_open()){
+            std::cout << "INFO: No profile database at " << path << " yet. It is created by the calibration\n";
+            return true;
+        }
+
+        std::string line;
+        int line_number = 0;
+        while(std::getline(file, line)){
+            line_number++;
+            if(line.empty() || line[0] == '#')
+                continue;
+
+            std::istringstream fields(line);
+            std::string hash_str, device;
+            DeviceProfile profile;
+            if(!(fields >> hash_str >> device >> profile.runs >> profile.mean_ms >> profile.std_ms >> profile.copy_ms)){
+                std::cerr << "ERROR: Invalid profile in " << path << " line " << line_number << ": " << line << std::endl;
+                loaded_ = false;
+                return false;
+            }
+
+            profiles_[std::make_pair(strtoull(hash_str.c_str(), NULL, 16), device)] = profile;
+        }
+
+        return true;
+    }
+
+    bool ProfileDatabase::is_loaded(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return loaded_;
+    }
+
+    bool ProfileDatabase::save(){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        if(!loaded_)
+            return false;
+
+        // Written aside and renamed, so a crash never leaves half a database
+        std::string tmp_path = path_ + ".tmp";
+        FILE * file = fopen(tmp_path.c_str(), "w");
+        if(file == NULL){
+            std::cerr << "ERROR: Cannot write the profile database: " << tmp_path << std::endl;
+            return false;
+        }
+
+        fprintf(file, "# model_hash device runs mean_ms std_ms copy_ms\n");
+        for(auto it = profiles_.begin(); it != profiles_.end(); it++){
+            const DeviceProfile & profile = it->second;
+            fprintf(file, "%016" PRIx64 " %s %ld %.4f %.4f %.4f\n", it->first.first, it->first.second.c_str(), profile.runs, profile.mean_ms, profile.std_ms, profile.copy_ms);
+        }
+
+        if(fclose(file) != 0 || rename(tmp_path.c_str(), path_.c_str()) != 0){
+            std::cerr << "ERROR: Cannot write the profile database: " << path_ << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool ProfileDatabase::find(uint64_t model_hash, const char * device, DeviceProfile & profile){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        auto it = profiles_.find(std::make_pair(model_hash, std::string(device)));
+        if(it == profiles_.end())
+            return false;
+
+        profile = it->second;
+        return true;
+    }
+
+    void ProfileDatabase::update(uint64_t model_hash, const char * device, const DeviceProfile & profile){
+        std::lock_guard<std::mutex> lk(mutex_);
+        profiles_[std::make_pair(model_hash, std::string(device))] = profile;
+    }
+
+    uint64_t file_hash(const char * path, uint64_t seed){
+        FILE * file = fopen(path, "rb");
+        if(file == NULL)
+            return seed;
+
+        std::vector<uint8_t> chunk(1 << 20);
+        uint64_t hash = seed;
+        size_t bytes;
+        while((bytes = fread(chunk.data(), 1, chunk.size(), file)) > 0)
+            hash = trace_hash(chunk.data(), bytes, hash);
+
+        fclose(file);
+
+        return hash;
+    }
+}
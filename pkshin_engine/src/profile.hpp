@@ -0,0 +1,48 @@
+#ifndef _PROFILE_HPP_
+#define _PROFILE_HPP_
+
+#include <cstdint>
+#include <string>
+#include <map>
+#include <mutex>
+
+namespace pkshin{
+    // Measured cost of one slot of a model on a device
+    struct DeviceProfile {
+        long runs;
+        double mean_ms;    // run of the slot, input copy included
+        double std_ms;
+        double copy_ms;    // copy of the outputs into the slot
+    };
+
+    // Device profiles keyed by the content hash of the model files and the device name, kept in a text file with one
+    // "model_hash device runs mean_ms std_ms copy_ms" line per profile. A model that was profiled once is scheduled
+    // from its profile on every later run, whatever its file name.
+    class ProfileDatabase {
+        public:
+        ProfileDatabase();
+
+        // A missing file is an empty database, it is created on save
+        bool load(const char * path);
+
+        bool is_loaded();
+
+        bool save();
+
+        bool find(uint64_t model_hash, const char * device, DeviceProfile & profile);
+
+        // Replaces the profile
+        void update(uint64_t model_hash, const char * device, const DeviceProfile & profile);
+
+        private:
+        bool loaded_;
+        std::string path_;
+        std::map<std::pair<uint64_t, std::string>, DeviceProfile> profiles_;
+        std::mutex mutex_;
+    };
+
+    // Content hash of a file, chained from seed. Returns seed when the file cannot be read
+    uint64_t file_hash(const char * path, uint64_t seed);
+}
+
+#endif //_PROFILE_HPP_
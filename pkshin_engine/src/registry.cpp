@@ -0,0 +1,293 @@
+#include "registry.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <chrono>
+
+#include <tensorflow/lite/kernels/register.h>
+
+namespace pkshin{
+    ModelRegistry::ModelRegistry() : budget_bytes_(0), resident_bytes_(0), threads_(1), clock_(0), load_sum_ms_(0), loads_(0), stop_(false){
+        stats_ = {false, 0, 0, 0, 0, 0, 0, 0};
+    }
+
+    ModelRegistry::~ModelRegistry(){
+        clear();
+    }
+
+    bool ModelRegistry::parse(const char * models, double budget_mb, int threads){
+        clear();
+
+        std::stringstream ss(models);
+        std::string entry;
+        std::vector<std::unique_ptr<Entry>> entries;
+
+        while(std::getline(ss, entry, ',')){
+            if(entry.empty())
+                continue;
+
+            size_t equal = entry.find('=');
+            if(equal == std::string::npos || equal == 0 || equal == entry.size() - 1){
+                std::cerr << "ERROR: Invalid registry model: " << entry << ". Give it as ID=FILE\n";
+                return false;
+            }
+
+            std::unique_ptr<Entry> model(new Entry());
+            model->id = entry.substr(0, equal);
+            model->path = entry.substr(equal + 1);
+            model->bytes = 0;
+            model->load_ms = 0;
+            model->loading = false;
+            model->failed = false;
+            model->queued = false;
+            model->pins = 0;
+            model->last_use = 0;
+
+            for(int i = 0; i < entries.size(); i++){
+                if(entries[i]->id == model->id){
+                    std::cerr << "ERROR: The registry model " << model->id << " is given twice\n";
+                    return false;
+                }
+            }
+
+            entries.push_back(std::move(model));
+        }
+
+        if(entries.empty() || budget_mb < 0 || threads <= 0){
+            std::cerr << "ERROR: The registry needs a model, a budget of 0 or more MB and a thread or more\n";
+            return false;
+        }
+
+        entries_ = std::move(entries);
+        budget_bytes_ = budget_mb * 1024 * 1024;
+        threads_ = threads;
+        stats_ = {true, 0, 0, 0, 0, 0, 0, 0};
+
+        stop_ = false;
+        loader_ = std::thread(&ModelRegistry::loader_loop, this);
+
+        return true;
+    }
+
+    bool ModelRegistry::enabled(){
+        return stats_.enabled;
+    }
+
+    bool ModelRegistry::has(const char * id){
+        return find(id) != NULL;
+    }
+
+    ModelRegistry::Entry * ModelRegistry::find(const char * id){
+        for(int i = 0; i < entries_.size(); i++){
+            if(entries_[i]->id == id)
+                return entries_[i].get();
+        }
+
+        return NULL;
+    }
+
+    void ModelRegistry::preload(const char * id){
+        Entry * entry = find(id);
+        if(entry == NULL)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            if(entry->loading || entry->interpreter != nullptr || entry->failed || entry->queued)
+                return;
+
+            entry->queued = true;
+            preload_queue_.push_back(entry);
+        }
+        cv_.notify_all();
+    }
+
+    ::tflite::Interpreter * ModelRegistry::acquire(const char * id){
+        Entry * entry = find(id);
+        if(entry == NULL){
+            std::cerr << "ERROR: No registry model " << id << std::endl;
+            return NULL;
+        }
+
+        std::unique_lock<std::mutex> lk(mutex_);
+        // Held from here, so a load for another model does not drop it
+        entry->pins++;
+        entry->last_use = ++clock_;
+        cv_.wait(lk, [entry]{ return !entry->loading; });
+
+        if(entry->interpreter != nullptr){
+            stats_.hits++;
+        }
+        else if(!entry->failed){
+            stats_.misses++;
+            entry->loading = true;
+            lk.unlock();
+
+            bool loaded = load(*entry);
+
+            lk.lock();
+            finish_load(*entry, loaded, false);
+        }
+
+        if(entry->interpreter == nullptr){
+            entry->pins--;
+            return NULL;
+        }
+
+        lk.unlock();
+        entry->run_mutex.lock();
+
+        return entry->interpreter.get();
+    }
+
+    void ModelRegistry::release(const char * id){
+        Entry * entry = find(id);
+        if(entry == NULL)
+            return;
+
+        entry->run_mutex.unlock();
+
+        std::lock_guard<std::mutex> lk(mutex_);
+        entry->pins--;
+        evict(NULL);
+    }
+
+    bool ModelRegistry::load(Entry & entry){
+        auto start = std::chrono::high_resolution_clock::now();
+
+        entry.model = ::tflite::FlatBufferModel::BuildFromFile(entry.path.c_str());
+        if(entry.model == NULL){
+            std::cerr << "ERROR: Load of the registry model " << entry.id << " failed: " << entry.path << std::endl;
+            return false;
+        }
+
+        ::tflite::ops::builtin::BuiltinOpResolver resolver;
+        ::tflite::InterpreterBuilder builder(*entry.model, resolver);
+        builder(&entry.interpreter);
+        if(entry.interpreter == NULL){
+            std::cerr << "ERROR: Interpreter build of the registry model " << entry.id << " failed\n";
+            entry.model.reset();
+            return false;
+        }
+
+        entry.interpreter->SetNumThreads(threads_);
+        if(entry.interpreter->AllocateTensors() != kTfLiteOk){
+            std::cerr << "ERROR: Memory allocation for the registry model " << entry.id << " failed\n";
+            entry.interpreter.reset();
+            entry.model.reset();
+            return false;
+        }
+
+        // The flatbuffer and the tensors, a lower bound of what the interpreter holds
+        entry.bytes = entry.model->allocation() != NULL ? entry.model->allocation()->bytes() : 0;
+        for(int i = 0; i < entry.interpreter->tensors_size(); i++){
+            TfLiteTensor * tensor = entry.interpreter->tensor(i);
+            if(tensor->allocation_type == kTfLiteArenaRw || tensor->allocation_type == kTfLiteArenaRwPersistent || tensor->allocation_type == kTfLiteDynamic)
+                entry.bytes += tensor->bytes;
+        }
+
+        entry.load_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        return true;
+    }
+
+    void ModelRegistry::finish_load(Entry & entry, bool loaded, bool preload){
+        entry.loading = false;
+
+        if(loaded){
+            load_sum_ms_ += entry.load_ms;
+            loads_++;
+            resident_bytes_ += entry.bytes;
+            stats_.resident++;
+            if(preload)
+                stats_.preloads++;
+
+            evict(&entry);
+        }
+        else{
+            entry.failed = true;
+        }
+
+        stats_.resident_mb = (double)resident_bytes_ / (1024 * 1024);
+        cv_.notify_all();
+    }
+
+    void ModelRegistry::evict(Entry * keep){
+        while(budget_bytes_ > 0 && resident_bytes_ > budget_bytes_){
+            Entry * victim = NULL;
+            for(int i = 0; i < entries_.size(); i++){
+                Entry * entry = entries_[i].get();
+                if(entry == keep || entry->loading || entry->interpreter == nullptr || entry->pins > 0)
+                    continue;
+
+                if(victim == NULL || entry->last_use < victim->last_use)
+                    victim = entry;
+            }
+
+            // The held models alone are over the budget
+            if(victim == NULL)
+                break;
+
+            victim->interpreter.reset();
+            victim->model.reset();
+            resident_bytes_ -= victim->bytes;
+            stats_.resident--;
+            stats_.evictions++;
+        }
+
+        stats_.resident_mb = (double)resident_bytes_ / (1024 * 1024);
+    }
+
+    void ModelRegistry::loader_loop(){
+        std::unique_lock<std::mutex> lk(mutex_);
+
+        while(true){
+            cv_.wait(lk, [this]{ return !preload_queue_.empty() || stop_; });
+            if(stop_)
+                break;
+
+            Entry * entry = preload_queue_.front();
+            preload_queue_.pop_front();
+            entry->queued = false;
+            if(entry->loading || entry->interpreter != nullptr || entry->failed)
+                continue;
+
+            // A preloaded model counts as just used, so it is not the first one dropped
+            entry->loading = true;
+            entry->last_use = ++clock_;
+            lk.unlock();
+
+            bool loaded = load(*entry);
+
+            lk.lock();
+            finish_load(*entry, loaded, true);
+        }
+    }
+
+    void ModelRegistry::clear(){
+        if(loader_.joinable()){
+            {
+                std::lock_guard<std::mutex> lk(mutex_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            loader_.join();
+        }
+
+        preload_queue_.clear();
+        entries_.clear();
+        resident_bytes_ = 0;
+        load_sum_ms_ = 0;
+        loads_ = 0;
+        stats_ = {false, 0, 0, 0, 0, 0, 0, 0};
+    }
+
+    RegistryStats ModelRegistry::stats(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        RegistryStats stats = stats_;
+        long loads = loads_;
+        stats.load_ms = loads > 0 ? load_sum_ms_ / loads : 0;
+
+        return stats;
+    }
+}
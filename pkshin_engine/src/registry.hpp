@@ -0,0 +1,104 @@
+#ifndef _REGISTRY_HPP_
+#define _REGISTRY_HPP_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <tensorflow/lite/model.h>
+#include <tensorflow/lite/interpreter.h>
+
+namespace pkshin{
+    // Use of the models of the registry
+    struct RegistryStats {
+        bool enabled;
+        long hits;             // acquires of a loaded model
+        long misses;           // acquires that had to load the model
+        long preloads;         // loads in the background
+        long evictions;
+        int resident;          // models loaded
+        double resident_mb;
+        double load_ms;        // average load, preloads included
+    };
+
+    // Models besides the one of the engine, by id, e.g. "cls=mobilenet.tflite,obb=yolov8s_obb.tflite". They are
+    // loaded on first use or preloaded in the background, and the least recently used ones that nobody holds are
+    // dropped to keep the loaded ones under the memory budget. A model is run by one holder at a time.
+    class ModelRegistry {
+        public:
+        ModelRegistry();
+
+        ~ModelRegistry();
+
+        // budget_mb 0 for no budget. threads of every interpreter
+        bool parse(const char * models, double budget_mb, int threads);
+
+        bool enabled();
+
+        bool has(const char * id);
+
+        // Loads the model on the background thread, if it is not loaded yet
+        void preload(const char * id);
+
+        // The interpreter of the model, loaded if needed and held until release. NULL when it cannot be loaded
+        ::tflite::Interpreter * acquire(const char * id);
+
+        void release(const char * id);
+
+        // Drops every model. Nobody may hold one
+        void clear();
+
+        RegistryStats stats();
+
+        private:
+        struct Entry {
+            std::string id;
+            std::string path;
+            std::unique_ptr<::tflite::FlatBufferModel> model;
+            std::unique_ptr<::tflite::Interpreter> interpreter;
+            size_t bytes;
+            double load_ms;
+            bool loading;
+            bool failed;
+            bool queued;
+            int pins;             // acquires not released yet, and the ones waiting for the model
+            long last_use;
+            std::mutex run_mutex;
+        };
+
+        Entry * find(const char * id);
+
+        // Builds the interpreter of the entry, without mutex_
+        bool load(Entry & entry);
+
+        // Called with mutex_ held after a load
+        void finish_load(Entry & entry, bool loaded, bool preload);
+
+        // Drops the least recently used models nobody holds until the budget is met, except keep
+        void evict(Entry * keep);
+
+        void loader_loop();
+
+        std::vector<std::unique_ptr<Entry>> entries_;
+        size_t budget_bytes_;
+        size_t resident_bytes_;
+        int threads_;
+        long clock_;
+        double load_sum_ms_;
+        long loads_;
+
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::deque<Entry *> preload_queue_;
+        std::thread loader_;
+        bool stop_;
+
+        RegistryStats stats_;
+    };
+}
+
+#endif //_REGISTRY_HPP_
@@ -0,0 +1,472 @@
+#include "remote.hpp"
+#include "fault.hpp"
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#include <unistd.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+namespace pkshin{
+    static const uint32_t REMOTE_MAGIC = 0x4d524b50;    // "PKRM"
+    static const uint32_t REMOTE_VERSION = 1;
+    static const int REMOTE_MAX_TENSORS = 256;
+
+    static void set_socket_timeout(int fd, double timeout_ms){
+        struct timeval tv;
+        tv.tv_sec = (long)(timeout_ms / 1000);
+        tv.tv_usec = (long)((timeout_ms - tv.tv_sec * 1000) * 1000);
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+
+    // Opens a socket on HOST:PORT or unix:PATH, listening for a server and connected for a client. The timeouts of
+    // the socket bound the connect of a client
+    static int open_socket(const std::string & address, bool server, double timeout_ms){
+        if(address.compare(0, 5, "unix:") == 0){
+            std::string path = address.substr(5);
+            struct sockaddr_un addr;
+            if(path.empty() || path.size() >= sizeof(addr.sun_path))
+                return -1;
+
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            strcpy(addr.sun_path, path.c_str());
+
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if(fd < 0)
+                return -1;
+
+            if(server){
+                unlink(path.c_str());
+                if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 && ::listen(fd, 8) == 0)
+                    return fd;
+            }
+            else{
+                set_socket_timeout(fd, timeout_ms);
+                if(::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+                    return fd;
+            }
+
+            close(fd);
+            return -1;
+        }
+
+        size_t colon = address.rfind(':');
+        if(colon == std::string::npos || colon == address.size() - 1)
+            return -1;
+
+        std::string host = address.substr(0, colon);
+        std::string port = address.substr(colon + 1);
+
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = server ? AI_PASSIVE : 0;
+
+        struct addrinfo * infos;
+        if(getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &infos) != 0)
+            return -1;
+
+        int fd = -1;
+        for(struct addrinfo * info = infos; fd < 0 && info != NULL; info = info->ai_next){
+            fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+            if(fd < 0)
+                continue;
+
+            bool opened;
+            if(server){
+                int one = 1;
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+                opened = bind(fd, info->ai_addr, info->ai_addrlen) == 0 && ::listen(fd, 8) == 0;
+            }
+            else{
+                set_socket_timeout(fd, timeout_ms);
+                opened = ::connect(fd, info->ai_addr, info->ai_addrlen) == 0;
+            }
+
+            if(!opened){
+                close(fd);
+                fd = -1;
+            }
+        }
+
+        freeaddrinfo(infos);
+
+        // The results are small and waited for, they go out at once
+        if(fd >= 0 && !server){
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+
+        return fd;
+    }
+
+    // Sends the buffers as one message. Returns a DeviceFault
+    static int send_all(int fd, struct iovec * iov, int count){
+        while(count > 0){
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+
+            // A closed peer is an error of the call, not a SIGPIPE
+            ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+            if(sent < 0){
+                if(errno == EINTR)
+                    continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK ? DEVICE_TIMEOUT : DEVICE_ERROR;
+            }
+
+            while(count > 0 && (size_t)sent >= iov->iov_len){
+                sent -= iov->iov_len;
+                iov++;
+                count--;
+            }
+
+            if(count > 0){
+                iov->iov_base = (uint8_t *)iov->iov_base + sent;
+                iov->iov_len -= sent;
+            }
+        }
+
+        return DEVICE_OK;
+    }
+
+    // Returns a DeviceFault
+    static int receive_all(int fd, void * data, size_t bytes){
+        uint8_t * p = (uint8_t *)data;
+        while(bytes > 0){
+            ssize_t received = recv(fd, p, bytes, MSG_WAITALL);
+            if(received == 0)
+                return DEVICE_ERROR;
+            if(received < 0){
+                if(errno == EINTR)
+                    continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK ? DEVICE_TIMEOUT : DEVICE_ERROR;
+            }
+
+            p += received;
+            bytes -= received;
+        }
+
+        return DEVICE_OK;
+    }
+
+    static std::vector<uint32_t> layout_hello(const RemoteLayout & layout){
+        std::vector<uint32_t> hello = {REMOTE_MAGIC, REMOTE_VERSION, (uint32_t)layout.mode, (uint32_t)layout.tflite_outputs, (uint32_t)layout.input_bytes.size(), (uint32_t)layout.output_bytes.size()};
+        hello.insert(hello.end(), layout.input_bytes.begin(), layout.input_bytes.end());
+        hello.insert(hello.end(), layout.output_bytes.begin(), layout.output_bytes.end());
+
+        return hello;
+    }
+
+    // First and one past the last output of a part
+    static void part_outputs(const RemoteLayout & layout, int part, int & first, int & last){
+        first = part == REMOTE_ACCELERATOR ? layout.tflite_outputs : 0;
+        last = part == REMOTE_TFLITE ? layout.tflite_outputs : part == REMOTE_ACCELERATOR ? layout.output_bytes.size() : 0;
+    }
+
+    static void update_ewma(double & ewma, double sample){
+        ewma = ewma == 0 ? sample : 0.9 * ewma + 0.1 * sample;
+    }
+
+    RemoteLink::RemoteLink() : window_(1), timeout_ms_(0), fd_(-1), connected_(false){
+        stats_ = {false, false, 0, 0, 0, 0, 0, 0};
+    }
+
+    RemoteLink::~RemoteLink(){
+        close_link();
+    }
+
+    bool RemoteLink::connect(const char * address, const RemoteLayout & layout, int window, double timeout_ms){
+        close_link();
+
+        if(window <= 0 || timeout_ms <= 0){
+            std::cerr << "ERROR: The remote engine needs a window of 1 or more and a positive timeout\n";
+            return false;
+        }
+
+        address_ = address;
+        layout_ = layout;
+        window_ = window;
+        timeout_ms_ = timeout_ms;
+        if(!open(true)){
+            address_.clear();
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lk(mutex_);
+        stats_ = {true, true, 0, 0, 0, 0, 0, 0};
+
+        return true;
+    }
+
+    bool RemoteLink::open(bool report){
+        fd_ = open_socket(address_, false, timeout_ms_);
+        if(fd_ < 0){
+            if(report)
+                std::cerr << "ERROR: Cannot connect to the remote engine at " << address_ << std::endl;
+            return false;
+        }
+
+        std::vector<uint32_t> hello = layout_hello(layout_);
+        struct iovec iov = {hello.data(), hello.size() * sizeof(uint32_t)};
+        uint32_t status = 1;
+        if(send_all(fd_, &iov, 1) != DEVICE_OK || receive_all(fd_, &status, sizeof(status)) != DEVICE_OK || status != 0){
+            if(report)
+                std::cerr << "ERROR: The remote engine at " << address_ << " does not run the same mode and model\n";
+            close(fd_);
+            fd_ = -1;
+            return false;
+        }
+
+        connected_ = true;
+
+        return true;
+    }
+
+    void RemoteLink::close_link(){
+        if(fd_ >= 0)
+            close(fd_);
+        fd_ = -1;
+        connected_ = false;
+    }
+
+    bool RemoteLink::enabled(){
+        return !address_.empty();
+    }
+
+    bool RemoteLink::connected(){
+        return connected_;
+    }
+
+    bool RemoteLink::reconnect(){
+        if(connected_ || address_.empty())
+            return connected_;
+
+        auto now = std::chrono::steady_clock::now();
+        if(now < retry_at_)
+            return false;
+        retry_at_ = now + std::chrono::seconds(1);
+
+        if(!open(false))
+            return false;
+
+        std::cout << "INFO: Reconnected to the remote engine at " << address_ << "\n";
+
+        return true;
+    }
+
+    int RemoteLink::window(){
+        return window_;
+    }
+
+    int RemoteLink::send(uint32_t tag, void * const * inputs){
+        thread_local std::vector<struct iovec> iov;
+        iov.resize(layout_.input_bytes.size() + 1);
+
+        iov[0] = {&tag, sizeof(tag)};
+        size_t bytes = sizeof(tag);
+        int count = 1;
+        for(int j = 0; j < layout_.input_bytes.size(); j++){
+            if(layout_.input_bytes[j] == 0)
+                continue;
+
+            iov[count++] = {inputs[j], layout_.input_bytes[j]};
+            bytes += layout_.input_bytes[j];
+        }
+
+        int fault = send_all(fd_, iov.data(), count);
+        if(fault != DEVICE_OK){
+            std::cerr << "ERROR: Send to the remote engine failed\n";
+            close_link();
+            return fault;
+        }
+
+        std::lock_guard<std::mutex> lk(mutex_);
+        stats_.sent_mb += (double)bytes / (1024 * 1024);
+
+        return DEVICE_OK;
+    }
+
+    int RemoteLink::receive(uint32_t tag, int & part, void * const * outputs){
+        uint32_t header[2];
+        int fault = receive_all(fd_, header, sizeof(header));
+
+        // A result of another slot means the stream is out of step, it cannot be read on
+        if(fault == DEVICE_OK && (header[0] != tag || header[1] > REMOTE_FAILED))
+            fault = DEVICE_ERROR;
+
+        int first = 0, last = 0;
+        if(fault == DEVICE_OK)
+            part_outputs(layout_, header[1], first, last);
+
+        size_t bytes = sizeof(header);
+        for(int j = first; fault == DEVICE_OK && j < last; j++){
+            fault = receive_all(fd_, outputs[j], layout_.output_bytes[j]);
+            bytes += layout_.output_bytes[j];
+        }
+
+        if(fault != DEVICE_OK){
+            std::cerr << "ERROR: Receive from the remote engine failed\n";
+            close_link();
+            return fault;
+        }
+
+        part = header[1];
+
+        std::lock_guard<std::mutex> lk(mutex_);
+        stats_.received_mb += (double)bytes / (1024 * 1024);
+
+        return DEVICE_OK;
+    }
+
+    void RemoteLink::record_queue(int slots, double first_ms, double total_ms){
+        std::lock_guard<std::mutex> lk(mutex_);
+        stats_.slots += slots;
+
+        // A lone slot cannot tell the latency from the run, it counts as run until a longer queue comes
+        if(slots > 1)
+            update_ewma(stats_.slot_ms, (total_ms - first_ms) / (slots - 1));
+        else if(stats_.slot_ms == 0)
+            stats_.slot_ms = first_ms;
+
+        update_ewma(stats_.latency_ms, std::max(0.0, first_ms - stats_.slot_ms));
+    }
+
+    void RemoteLink::count_lost(long slots){
+        std::lock_guard<std::mutex> lk(mutex_);
+        stats_.lost += slots;
+    }
+
+    double RemoteLink::latency_ms(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return stats_.latency_ms;
+    }
+
+    double RemoteLink::slot_ms(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return stats_.slot_ms;
+    }
+
+    RemoteStats RemoteLink::stats(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        RemoteStats stats = stats_;
+        stats.connected = connected_;
+
+        return stats;
+    }
+
+    RemoteServer::RemoteServer() : fd_(-1){
+
+    }
+
+    RemoteServer::~RemoteServer(){
+        if(fd_ >= 0)
+            close(fd_);
+        if(!unix_path_.empty())
+            unlink(unix_path_.c_str());
+    }
+
+    bool RemoteServer::listen(const char * address, const RemoteLayout & layout){
+        std::string server_address = address;
+        fd_ = open_socket(server_address, true, 0);
+        if(fd_ < 0){
+            std::cerr << "ERROR: Cannot listen on " << address << ". Give HOST:PORT, :PORT or unix:PATH\n";
+            return false;
+        }
+
+        if(server_address.compare(0, 5, "unix:") == 0)
+            unix_path_ = server_address.substr(5);
+        layout_ = layout;
+
+        return true;
+    }
+
+    int RemoteServer::accept(){
+        std::vector<uint32_t> hello = layout_hello(layout_);
+        std::vector<uint32_t> peer(hello.size());
+
+        while(true){
+            int fd = ::accept(fd_, NULL, NULL);
+            if(fd < 0){
+                if(errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                std::cerr << "ERROR: Accept of a remote client failed\n";
+                return -1;
+            }
+
+            // A client that does not say hello in time is dropped, then it may wait as long as it wants
+            set_socket_timeout(fd, 5000);
+
+            uint32_t header[6];
+            bool same = receive_all(fd, header, sizeof(header)) == DEVICE_OK && header[0] == REMOTE_MAGIC && header[1] == REMOTE_VERSION;
+            same = same && header[4] + header[5] < REMOTE_MAX_TENSORS && 6 + header[4] + header[5] == hello.size();
+            if(same){
+                memcpy(peer.data(), header, sizeof(header));
+                same = receive_all(fd, peer.data() + 6, (peer.size() - 6) * sizeof(uint32_t)) == DEVICE_OK && peer == hello;
+            }
+
+            uint32_t status = same ? 0 : 1;
+            struct iovec iov = {&status, sizeof(status)};
+            send_all(fd, &iov, 1);
+
+            if(!same){
+                std::cout << "WARNING: A remote client of another mode or model is turned away\n";
+                close(fd);
+                continue;
+            }
+
+            set_socket_timeout(fd, 0);
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            return fd;
+        }
+    }
+
+    bool remote_readable(int fd, int timeout_ms){
+        struct pollfd pfd = {fd, POLLIN, 0};
+        return poll(&pfd, 1, timeout_ms) > 0;
+    }
+
+    bool remote_read_request(int fd, const RemoteLayout & layout, uint32_t & tag, void * const * inputs){
+        if(receive_all(fd, &tag, sizeof(tag)) != DEVICE_OK)
+            return false;
+
+        for(int j = 0; j < layout.input_bytes.size(); j++){
+            if(layout.input_bytes[j] > 0 && receive_all(fd, inputs[j], layout.input_bytes[j]) != DEVICE_OK)
+                return false;
+        }
+
+        return true;
+    }
+
+    bool remote_write_result(int fd, const RemoteLayout & layout, uint32_t tag, int part, void * const * outputs){
+        thread_local std::vector<struct iovec> iov;
+        iov.resize(layout.output_bytes.size() + 1);
+
+        uint32_t header[2] = {tag, (uint32_t)part};
+        iov[0] = {header, sizeof(header)};
+
+        int first, last;
+        part_outputs(layout, part, first, last);
+
+        int count = 1;
+        for(int j = first; j < last; j++){
+            if(layout.output_bytes[j] > 0)
+                iov[count++] = {outputs[j], layout.output_bytes[j]};
+        }
+
+        return send_all(fd, iov.data(), count) == DEVICE_OK;
+    }
+}
@@ -0,0 +1,128 @@
+#ifndef _REMOTE_HPP_
+#define _REMOTE_HPP_
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace pkshin{
+    // Slots run by the engine of another board
+    struct RemoteStats {
+        bool enabled;
+        bool connected;
+        long slots;            // slots the remote engine ran
+        long lost;             // slots lost with the connection or failed by the remote engine
+        double latency_ms;     // EWMA of the wait for the first result of a queue over the time of a slot
+        double slot_ms;        // EWMA of the time per slot once the results stream in
+        double sent_mb;
+        double received_mb;
+    };
+
+    // Bytes of one batch slot of every tensor the engines exchange. Both engines must run the same mode and model
+    struct RemoteLayout {
+        int mode;
+        int tflite_outputs;    // outputs of the tflite part, first in the outputs
+        std::vector<uint32_t> input_bytes;
+        std::vector<uint32_t> output_bytes;
+    };
+
+    // Which outputs of a slot a result carries, the ones of the device that ran it on the remote engine
+    enum RemotePart {
+        REMOTE_TFLITE = 0,
+        REMOTE_ACCELERATOR = 1,
+        REMOTE_FAILED = 2
+    };
+
+    // The wire format, in the byte order of the boards. The client opens with the layout, the server answers 0 when
+    // it runs the same one:
+    //  hello    u32 magic, u32 version, u32 mode, u32 tflite outputs, u32 inputs, u32 outputs, u32 bytes of every tensor
+    //  request  u32 tag, the slot of every input back to back
+    //  result   u32 tag, u32 part, the slot of every output of the part back to back
+    // The sizes come from the layout, so a slot has no other framing. Results come back in the order of the requests.
+    // Addresses are HOST:PORT, or unix:PATH for a unix socket.
+
+    // Client end, used by the feeder of the remote device. Requests are pipelined up to window ahead of the results.
+    // A failed call closes the connection, the device is then out until reconnect gets it back
+    class RemoteLink {
+        public:
+        RemoteLink();
+
+        ~RemoteLink();
+
+        // timeout_ms bounds the connect and every send and receive
+        bool connect(const char * address, const RemoteLayout & layout, int window, double timeout_ms);
+
+        bool enabled();
+
+        bool connected();
+
+        // Tries the address again, at most once a second. Not while a call runs
+        bool reconnect();
+
+        int window();
+
+        // inputs[j] is the slot of input j. Returns a DeviceFault
+        int send(uint32_t tag, void * const * inputs);
+
+        // The result of tag, the next one. outputs[j] is where the slot of output j goes, only the part is written
+        int receive(uint32_t tag, int & part, void * const * outputs);
+
+        // A queue of slots ran, first_ms to the first result and total_ms to the last one
+        void record_queue(int slots, double first_ms, double total_ms);
+
+        // The slots a closed connection took with it
+        void count_lost(long slots);
+
+        // 0 until the first queue
+        double latency_ms();
+        double slot_ms();
+
+        RemoteStats stats();
+
+        private:
+        bool open(bool report);
+
+        void close_link();
+
+        std::string address_;
+        RemoteLayout layout_;
+        int window_;
+        double timeout_ms_;
+        int fd_;
+        std::atomic<bool> connected_;
+        std::chrono::steady_clock::time_point retry_at_;
+
+        std::mutex mutex_;
+        RemoteStats stats_;
+    };
+
+    // Server end: accepts the engines of the other boards and hands them the sockets
+    class RemoteServer {
+        public:
+        RemoteServer();
+
+        ~RemoteServer();
+
+        bool listen(const char * address, const RemoteLayout & layout);
+
+        // The socket of the next client that runs the layout, -1 when the server socket fails
+        int accept();
+
+        private:
+        std::string unix_path_;
+        RemoteLayout layout_;
+        int fd_;
+    };
+
+    // Reads and writes of the server on a client socket. Whether a request is waiting, within timeout_ms
+    bool remote_readable(int fd, int timeout_ms);
+
+    bool remote_read_request(int fd, const RemoteLayout & layout, uint32_t & tag, void * const * inputs);
+
+    bool remote_write_result(int fd, const RemoteLayout & layout, uint32_t tag, int part, void * const * outputs);
+}
+
+#endif //_REMOTE_HPP_
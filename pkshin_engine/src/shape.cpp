@@ -0,0 +1,113 @@
+#include "shape.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+
+namespace pkshin{
+    InputShapes::InputShapes() : full_width_(0), full_height_(0), full_pixels_(0), run_pixels_(0){
+        stats_ = {false, 0, {}, 0};
+    }
+
+    bool InputShapes::parse(const char * shapes, int full_width, int full_height){
+        std::stringstream ss(shapes);
+        std::string entry;
+        std::vector<int> widths, heights;
+
+        while(std::getline(ss, entry, ',')){
+            if(entry.empty())
+                continue;
+
+            int width, height;
+            char x, rest;
+            std::istringstream fields(entry);
+            if(!(fields >> width >> x >> height) || x != 'x' || (fields >> rest) || width <= 0 || height <= 0){
+                std::cerr << "ERROR: Invalid input shape: " << entry << ". Give it as WxH\n";
+                return false;
+            }
+
+            if(width > full_width || height > full_height){
+                std::cerr << "ERROR: The input shape " << entry << " does not fit in the " << full_width << "x" << full_height << " of the model\n";
+                return false;
+            }
+
+            widths.push_back(width);
+            heights.push_back(height);
+        }
+
+        if(widths.empty() || widths.size() > MAX_SHAPES){
+            std::cerr << "ERROR: Give 1 to " << MAX_SHAPES << " input shapes\n";
+            return false;
+        }
+
+        full_width_ = full_width;
+        full_height_ = full_height;
+        widths_ = widths;
+        heights_ = heights;
+
+        stats_ = {true, 0, {}, 0};
+        full_pixels_ = 0;
+        run_pixels_ = 0;
+
+        return true;
+    }
+
+    void InputShapes::clear(){
+        widths_.clear();
+        heights_.clear();
+        stats_ = {false, 0, {}, 0};
+    }
+
+    int InputShapes::size(){
+        return widths_.size();
+    }
+
+    int InputShapes::width(int shape){
+        return shape < 0 ? full_width_ : widths_[shape];
+    }
+
+    int InputShapes::height(int shape){
+        return shape < 0 ? full_height_ : heights_[shape];
+    }
+
+    int InputShapes::pick(int image_width, int image_height){
+        if(image_width <= 0 || image_height <= 0)
+            return -1;
+
+        double full_scale = std::min((double)full_width_ / image_width, (double)full_height_ / image_height);
+
+        int best = -1;
+        long best_pixels = (long)full_width_ * full_height_;
+        for(int i = 0; i < widths_.size(); i++){
+            double scale = std::min((double)widths_[i] / image_width, (double)heights_[i] / image_height);
+            long pixels = (long)widths_[i] * heights_[i];
+
+            // A pixel of rounding is still the same resize
+            if(scale * std::max(image_width, image_height) >= full_scale * std::max(image_width, image_height) - 1 && pixels < best_pixels){
+                best = i;
+                best_pixels = pixels;
+            }
+        }
+
+        return best;
+    }
+
+    void InputShapes::record(int shape, int batch){
+        if(!stats_.enabled || batch <= 0)
+            return;
+
+        if(shape < 0)
+            stats_.full_batches++;
+        else
+            stats_.batches[shape]++;
+
+        full_pixels_ += (double)batch * full_width_ * full_height_;
+        run_pixels_ += (double)batch * width(shape) * height(shape);
+        stats_.pixels = run_pixels_ / full_pixels_;
+    }
+
+    ShapeStats InputShapes::stats(){
+        return stats_;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef _SHAPE_HPP_
+#define _SHAPE_HPP_
+
+#include <vector>
+
+namespace pkshin{
+    // Batches run per input shape
+    struct ShapeStats {
+        bool enabled;
+        long full_batches;     // batches run at the shape of the model
+        long batches[8];       // batches run at every shape
+        double pixels;         // input pixels of the batches against the ones at the shape of the model
+    };
+
+    // Input shapes of the tflite part besides the one of the model, from a list of WxH, e.g. "640x384,384x640". Every
+    // shape fits in the shape of the model, so its slots fit in the slots of the tensors.
+    class InputShapes {
+        public:
+        static const int MAX_SHAPES = 8;
+
+        InputShapes();
+
+        bool parse(const char * shapes, int full_width, int full_height);
+
+        void clear();
+
+        int size();
+
+        int width(int shape);
+
+        int height(int shape);
+
+        // Tightest shape for a letterboxed image: the smallest one that keeps the scale the shape of the model gives
+        // the image. -1 when none is smaller than the shape of the model
+        int pick(int image_width, int image_height);
+
+        void record(int shape, int batch);
+
+        ShapeStats stats();
+
+        private:
+        int full_width_;
+        int full_height_;
+        std::vector<int> widths_;
+        std::vector<int> heights_;
+
+        ShapeStats stats_;
+        double full_pixels_;
+        double run_pixels_;
+    };
+}
+
+#endif //_SHAPE_HPP_
@@ -0,0 +1,184 @@
+#include "split.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+namespace pkshin{
+    SplitManifest::SplitManifest() : threads_(1){
+
+    }
+
+    bool SplitManifest::load(const char * path){
+        std::ifstream file(path);
+        if(!file.is_open()){
+            std::cerr << "ERROR: Cannot open the split manifest: " << path << std::endl;
+            return false;
+        }
+
+        std::string manifest_path = path;
+        std::string dir;
+        size_t slash = manifest_path.rfind('/');
+        if(slash != std::string::npos)
+            dir = manifest_path.substr(0, slash + 1);
+
+        head_.clear();
+        links_.clear();
+        threads_ = 1;
+
+        std::string line;
+        int line_number = 0;
+        bool header = false, ended = false;
+        while(!ended && std::getline(file, line)){
+            line_number++;
+            if(line.empty() || line[0] == '#')
+                continue;
+
+            std::istringstream fields(line);
+            std::string key, value;
+            fields >> key;
+
+            bool valid = true;
+            if(!header){
+                int version = 0;
+                valid = key == "pksplit" && (fields >> version) && version == 1;
+                header = true;
+            }
+            else if(key == "end"){
+                ended = true;
+            }
+            else if(key == "head"){
+                valid = (bool)(fields >> value);
+                if(valid)
+                    head_ = value[0] == '/' ? value : dir + value;
+            }
+            else if(key == "link"){
+                SplitLink link;
+                valid = (bool)(fields >> link.output >> link.input);
+                if(valid)
+                    links_.push_back(link);
+            }
+            else if(key == "threads"){
+                valid = (fields >> threads_) && threads_ > 0;
+            }
+            else{
+                valid = false;
+            }
+
+            if(!valid){
+                std::cerr << "ERROR: Invalid split manifest " << path << " line " << line_number << ": " << line << std::endl;
+                return false;
+            }
+        }
+
+        if(!header || head_.empty() || links_.empty()){
+            std::cerr << "ERROR: The split manifest " << path << " needs a pksplit header, a head and its links\n";
+            return false;
+        }
+
+        return true;
+    }
+
+    const std::string & SplitManifest::head(){
+        return head_;
+    }
+
+    const std::vector<SplitLink> & SplitManifest::links(){
+        return links_;
+    }
+
+    int SplitManifest::threads(){
+        return threads_;
+    }
+
+    StageWorker::StageWorker() : fn_(NULL), device_(-1), busy_(false), stop_(false), slots_(0), head_sum_ms_(0), wait_sum_ms_(0){
+
+    }
+
+    StageWorker::~StageWorker(){
+        stop();
+    }
+
+    void StageWorker::start(StageFn fn, int device){
+        stop();
+
+        fn_ = fn;
+        device_ = device;
+        stop_ = false;
+        slots_ = 0;
+        head_sum_ms_ = 0;
+        wait_sum_ms_ = 0;
+        thread_ = std::thread(&StageWorker::loop, this);
+    }
+
+    void StageWorker::stop(){
+        if(!thread_.joinable())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
+    }
+
+    bool StageWorker::is_running(){
+        return thread_.joinable();
+    }
+
+    void StageWorker::push(int slot, std::chrono::high_resolution_clock::time_point start){
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            items_.push_back({slot, start, std::chrono::high_resolution_clock::now()});
+        }
+        cv_.notify_all();
+    }
+
+    void StageWorker::drain(){
+        std::unique_lock<std::mutex> lk(mutex_);
+        cv_.wait(lk, [this]{ return items_.empty() && !busy_; });
+    }
+
+    long StageWorker::slots(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return slots_;
+    }
+
+    double StageWorker::head_ms(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return head_sum_ms_;
+    }
+
+    double StageWorker::wait_ms(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return wait_sum_ms_;
+    }
+
+    void StageWorker::loop(){
+        std::unique_lock<std::mutex> lk(mutex_);
+
+        while(true){
+            cv_.wait(lk, [this]{ return !items_.empty() || stop_; });
+            // The pushed slots still run, the app waits for them
+            if(items_.empty())
+                break;
+
+            Item item = items_.front();
+            items_.pop_front();
+            busy_ = true;
+            lk.unlock();
+
+            auto begin = std::chrono::high_resolution_clock::now();
+            fn_(device_, item.slot, item.start);
+            auto end = std::chrono::high_resolution_clock::now();
+
+            lk.lock();
+            slots_++;
+            head_sum_ms_ += std::chrono::duration<double, std::milli>(end - begin).count();
+            wait_sum_ms_ += std::chrono::duration<double, std::milli>(begin - item.pushed).count();
+            busy_ = false;
+            cv_.notify_all();
+        }
+    }
+}
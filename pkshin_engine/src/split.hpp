@@ -0,0 +1,108 @@
+#ifndef _SPLIT_HPP_
+#define _SPLIT_HPP_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace pkshin{
+    // Slots of the accelerators whose head ran on the cpu
+    struct SplitStats {
+        bool enabled;
+        long slots;
+        double head_ms;        // average head run, the hand over of the linked tensors included
+        double wait_ms;        // average wait of a finished backbone for the head of the slot before it
+    };
+
+    // A backbone output of the accelerator feeding an input of the head
+    struct SplitLink {
+        std::string output;
+        std::string input;
+    };
+
+    // A split model: the accelerator artifact is the backbone and a tflite head on the cpu takes its outputs to the
+    // outputs of the tflite part, e.g.
+    //     pksplit 1
+    //     head yolov8s_head.tflite
+    //     link yolov8s/conv63 head/input_0
+    //     link yolov8s/conv74 head/input_1
+    //     threads 2
+    //     end
+    // The head is a path relative to the manifest. The links cut the model by tensor names, every input of the head
+    // needs one.
+    class SplitManifest {
+        public:
+        SplitManifest();
+
+        bool load(const char * path);
+
+        const std::string & head();
+
+        const std::vector<SplitLink> & links();
+
+        // Threads of every head interpreter
+        int threads();
+
+        private:
+        std::string head_;
+        std::vector<SplitLink> links_;
+        int threads_;
+    };
+
+    // Thread running the second stage of the slots of a device, so the backbone of a slot overlaps the head of the
+    // one before it. The slots run in the order they are pushed
+    class StageWorker {
+        public:
+        typedef void (*StageFn)(int device, int slot, std::chrono::high_resolution_clock::time_point start);
+
+        StageWorker();
+
+        ~StageWorker();
+
+        void start(StageFn fn, int device);
+
+        void stop();
+
+        bool is_running();
+
+        // start is the start of the first stage of the slot
+        void push(int slot, std::chrono::high_resolution_clock::time_point start);
+
+        // Returns when every pushed slot is done
+        void drain();
+
+        long slots();
+
+        double head_ms();
+
+        double wait_ms();
+
+        private:
+        struct Item {
+            int slot;
+            std::chrono::high_resolution_clock::time_point start;
+            std::chrono::high_resolution_clock::time_point pushed;
+        };
+
+        void loop();
+
+        StageFn fn_;
+        int device_;
+        std::thread thread_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::deque<Item> items_;
+        bool busy_;
+        bool stop_;
+
+        long slots_;
+        double head_sum_ms_;
+        double wait_sum_ms_;
+    };
+}
+
+#endif //_SPLIT_HPP_
@@ -0,0 +1,191 @@
+#include "stream.hpp"
+
+#include <algorithm>
+
+namespace pkshin{
+    StreamScheduler::StreamScheduler() : cursor_(0), turn_credited_(false), min_weight_(0){
+
+    }
+
+    int StreamScheduler::add_stream(float weight){
+        if(weight <= 0)
+            return -1;
+
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        streams_.emplace_back();
+        Stream & stream = streams_.back();
+        stream.weight = weight;
+        stream.deficit = 0;
+        stream.frames.resize(16);
+        stream.next_seq = 0;
+        stream.sched_seq = 0;
+        stream.deliver_seq = 0;
+        stream.completed = 0;
+        stream.dropped = 0;
+        stream.sum_latency_ms = 0;
+
+        if(min_weight_ <= 0 || weight < min_weight_)
+            min_weight_ = weight;
+
+        return streams_.size() - 1;
+    }
+
+    int StreamScheduler::num_streams(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return streams_.size();
+    }
+
+    StreamScheduler::Frame & StreamScheduler::frame(Stream & stream, long seq){
+        return stream.frames[seq % stream.frames.size()];
+    }
+
+    long StreamScheduler::enqueue(int stream_id){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        if(stream_id < 0 || stream_id >= streams_.size())
+            return -1;
+
+        Stream & stream = streams_[stream_id];
+
+        if(stream.next_seq - stream.deliver_seq == stream.frames.size()){
+            std::vector<Frame> frames(stream.frames.size() * 2);
+            for(long seq = stream.deliver_seq; seq < stream.next_seq; seq++)
+                frames[seq % frames.size()] = frame(stream, seq);
+
+            stream.frames.swap(frames);
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if(stream.next_seq == 0)
+            stream.first_enqueue = now;
+
+        frame(stream, stream.next_seq) = {now, false};
+
+        return stream.next_seq++;
+    }
+
+    int StreamScheduler::schedule(int max_slots){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        if(slot_streams_.size() < max_slots){
+            slot_streams_.resize(max_slots, -1);
+            slot_seqs_.resize(max_slots, 0);
+        }
+
+        long waiting = 0;
+        for(int i = 0; i < streams_.size(); i++)
+            waiting += streams_[i].next_seq - streams_[i].sched_seq;
+
+        int n = 0;
+        while(n < max_slots && waiting > 0){
+            Stream & stream = streams_[cursor_];
+            long backlog = stream.next_seq - stream.sched_seq;
+
+            // The weight of the lightest stream is worth one frame per turn
+            if(backlog > 0 && !turn_credited_){
+                stream.deficit += stream.weight / min_weight_;
+                turn_credited_ = true;
+            }
+
+            while(n < max_slots && backlog > 0 && stream.deficit >= 1){
+                slot_streams_[n] = cursor_;
+                slot_seqs_[n] = stream.sched_seq++;
+                stream.deficit -= 1;
+                backlog--;
+                waiting--;
+                n++;
+            }
+
+            // No banking of credit while idle
+            if(backlog == 0)
+                stream.deficit = 0;
+
+            // A full batch leaves the turn to the stream for the next one while it has credit
+            if(n < max_slots || stream.deficit < 1){
+                cursor_ = (cursor_ + 1) % streams_.size();
+                turn_credited_ = false;
+            }
+        }
+
+        for(int i = n; i < slot_streams_.size(); i++)
+            slot_streams_[i] = -1;
+
+        return n;
+    }
+
+    int StreamScheduler::slot_stream(int slot){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return slot >= 0 && slot < slot_streams_.size() ? slot_streams_[slot] : -1;
+    }
+
+    long StreamScheduler::slot_sequence(int slot){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return slot >= 0 && slot < slot_streams_.size() && slot_streams_[slot] >= 0 ? slot_seqs_[slot] : -1;
+    }
+
+    bool StreamScheduler::complete(int slot, bool dropped){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        if(slot < 0 || slot >= slot_streams_.size() || slot_streams_[slot] < 0)
+            return false;
+
+        Stream & stream = streams_[slot_streams_[slot]];
+        Frame & completed = frame(stream, slot_seqs_[slot]);
+        slot_streams_[slot] = -1;
+
+        auto now = std::chrono::steady_clock::now();
+        double latency_ms = std::chrono::duration<double, std::milli>(now - completed.enqueued).count();
+        completed.done = true;
+
+        stream.latencies_ms[stream.completed % LATENCY_WINDOW] = latency_ms;
+        stream.sum_latency_ms += latency_ms;
+        stream.completed++;
+        if(dropped)
+            stream.dropped++;
+        stream.last_complete = now;
+
+        return true;
+    }
+
+    long StreamScheduler::pop_in_order(int stream_id){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        if(stream_id < 0 || stream_id >= streams_.size())
+            return -1;
+
+        Stream & stream = streams_[stream_id];
+        if(stream.deliver_seq == stream.sched_seq || !frame(stream, stream.deliver_seq).done)
+            return -1;
+
+        return stream.deliver_seq++;
+    }
+
+    StreamStats StreamScheduler::stats(int stream_id){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        if(stream_id < 0 || stream_id >= streams_.size())
+            return {false, 0, 0, 0, 0, 0, 0, 0};
+
+        Stream & stream = streams_[stream_id];
+        StreamStats stats = {true, stream.weight, stream.completed, stream.dropped, stream.next_seq - stream.sched_seq, 0, 0, 0};
+        if(stream.completed == 0)
+            return stats;
+
+        int count = std::min<long>(stream.completed, LATENCY_WINDOW);
+        double latencies_ms[LATENCY_WINDOW];
+        std::copy(stream.latencies_ms, stream.latencies_ms + count, latencies_ms);
+
+        int p95_index = std::min(count - 1, (int)(count * 0.95));
+        std::nth_element(latencies_ms, latencies_ms + p95_index, latencies_ms + count);
+
+        stats.mean_latency_ms = stream.sum_latency_ms / stream.completed;
+        stats.p95_latency_ms = latencies_ms[p95_index];
+
+        double elapsed_s = std::chrono::duration<double>(stream.last_complete - stream.first_enqueue).count();
+        if(elapsed_s > 0)
+            stats.fps = stream.completed / elapsed_s;
+
+        return stats;
+    }
+}
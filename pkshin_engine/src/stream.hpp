@@ -0,0 +1,89 @@
+#ifndef _STREAM_HPP_
+#define _STREAM_HPP_
+
+#include <vector>
+#include <chrono>
+#include <mutex>
+
+namespace pkshin{
+    // Counters of one stream
+    struct StreamStats {
+        bool enabled;
+        float weight;
+        long frames;              // completed frames, dropped ones included
+        long dropped;             // frames the engine gave up on. They have no output
+        long pending;             // frames waiting for a slot
+        double mean_latency_ms;   // from the enqueue to the completion of the frame
+        double p95_latency_ms;    // over the last LATENCY_WINDOW frames
+        double fps;               // completed frames per second since the first enqueue
+    };
+
+    // Fair share of the batch slots between streams, e.g. cameras or clients. Slots are handed out by deficit round
+    // robin: on its turn a stream with frames waiting gets credit in proportion to its weight and spends one per frame
+    // it puts in the batch, so a busy stream cannot starve the others and an idle one does not bank credit.
+    // Every slot runs the same model, so a share of the slots is a share of the device time.
+    // Frames complete in the order their slots finish. The reorder buffer hands them back per stream in enqueue order.
+    class StreamScheduler {
+        public:
+        static const int LATENCY_WINDOW = 256;
+
+        StreamScheduler();
+
+        // Returns the stream id, or -1 when the weight is not positive
+        int add_stream(float weight);
+
+        int num_streams();
+
+        // A frame arrives on the stream. Returns its sequence number, or -1 for an unknown stream
+        long enqueue(int stream);
+
+        // Assigns waiting frames to slots 0..n-1 of the next batch and returns n <= max_slots
+        int schedule(int max_slots);
+
+        int slot_stream(int slot);
+
+        long slot_sequence(int slot);
+
+        // The frame of the slot is done. dropped when the engine gave up on it
+        bool complete(int slot, bool dropped);
+
+        // Next frame of the stream in enqueue order once it is complete, otherwise -1
+        long pop_in_order(int stream);
+
+        StreamStats stats(int stream);
+
+        private:
+        struct Frame {
+            std::chrono::steady_clock::time_point enqueued;
+            bool done;
+        };
+
+        // Frames from deliver_seq on, in a ring that only grows
+        struct Stream {
+            float weight;
+            double deficit;
+            std::vector<Frame> frames;
+            long next_seq;       // of the next enqueued frame
+            long sched_seq;      // of the next frame to schedule
+            long deliver_seq;    // of the next frame to hand back
+            long completed;
+            long dropped;
+            double sum_latency_ms;
+            double latencies_ms[LATENCY_WINDOW];
+            std::chrono::steady_clock::time_point first_enqueue;
+            std::chrono::steady_clock::time_point last_complete;
+        };
+
+        Frame & frame(Stream & stream, long seq);
+
+        std::vector<Stream> streams_;
+        std::vector<int> slot_streams_;
+        std::vector<long> slot_seqs_;
+        int cursor_;          // stream whose turn it is
+        bool turn_credited_;  // the stream at the cursor got its credit for this turn
+        float min_weight_;
+        std::mutex mutex_;
+    };
+}
+
+#endif //_STREAM_HPP_
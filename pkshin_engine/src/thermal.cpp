@@ -0,0 +1,271 @@
+#include "thermal.hpp"
+#include "fault.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace pkshin{
+    // Degrees C of a sysfs style temperature file, NAN when it cannot be read. No allocation, it runs in the dispatch
+    static float read_temp(const std::string & path){
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            return NAN;
+
+        char buffer[32];
+        ssize_t n = read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+        if(n <= 0)
+            return NAN;
+
+        buffer[n] = '\0';
+        char * end;
+        float temp = strtof(buffer, &end);
+        if(end == buffer)
+            return NAN;
+
+        // sysfs thermal zones report millidegrees
+        return temp > 1000 ? temp / 1000 : temp;
+    }
+
+    DeviceGate::DeviceGate() : enabled_(false), soft_temp_(70), hard_temp_(85), poll_ms_(500), park_util_(0), wake_util_(0.85), parked_(0), park_streak_(0), interval_ms_(0), demand_(0), started_(false){
+        for(int i = 0; i < MAX_DEVICES; i++){
+            wake_ms_[i] = 0;
+            temps_[i] = NAN;
+            hot_[i] = false;
+            slot_ms_[i] = 0;
+        }
+
+        stats_ = {false, 0, 0, 0, 0};
+    }
+
+    bool DeviceGate::parse(const char * config){
+        std::stringstream ss(config);
+        std::string entry;
+
+        while(std::getline(ss, entry, ',')){
+            if(entry.empty())
+                continue;
+
+            size_t equal = entry.find('=');
+            if(equal == std::string::npos){
+                std::cerr << "ERROR: Invalid device gate entry: " << entry << std::endl;
+                return false;
+            }
+
+            std::string key = entry.substr(0, equal);
+            std::string value = entry.substr(equal + 1);
+
+            bool wake = key.size() > 5 && key.compare(key.size() - 5, 5, "_wake") == 0;
+            std::string name = wake ? key.substr(0, key.size() - 5) : key;
+
+            int first = -1, last = -1;
+            if(name == "hailo"){
+                first = 3;
+                last = 5;
+            }
+            else{
+                for(int i = 0; i < MAX_DEVICES; i++){
+                    if(name == device_name(i))
+                        first = last = i;
+                }
+            }
+
+            char * end;
+            double number = strtod(value.c_str(), &end);
+            bool is_number = !value.empty() && *end == '\0' && number >= 0;
+
+            if(first >= 0 && wake && is_number){
+                for(int i = first; i <= last; i++)
+                    wake_ms_[i] = number;
+            }
+            else if(first >= 0 && !wake && !value.empty()){
+                for(int i = first; i <= last; i++)
+                    temp_paths_[i] = value;
+            }
+            else if(key == "soc" && !value.empty()){
+                soc_path_ = value;
+            }
+            else if(key == "soft" && is_number){
+                soft_temp_ = number;
+            }
+            else if(key == "hard" && is_number){
+                hard_temp_ = number;
+            }
+            else if(key == "poll" && is_number){
+                poll_ms_ = number;
+            }
+            else if(key == "park" && is_number && number < 1){
+                park_util_ = number;
+            }
+            else if(key == "wake" && is_number && number > 0){
+                wake_util_ = number;
+            }
+            else{
+                std::cerr << "ERROR: Invalid device gate entry: " << entry << std::endl;
+                return false;
+            }
+        }
+
+        if(soft_temp_ >= hard_temp_ || park_util_ >= wake_util_){
+            std::cerr << "ERROR: The device gate needs soft under hard and park under wake\n";
+            return false;
+        }
+
+        enabled_ = true;
+        stats_.enabled = true;
+
+        return true;
+    }
+
+    bool DeviceGate::enabled(){
+        return enabled_;
+    }
+
+    void DeviceGate::read_temps(std::chrono::steady_clock::time_point now){
+        if(started_ && std::chrono::duration<double, std::milli>(now - last_poll_).count() < poll_ms_)
+            return;
+        last_poll_ = now;
+
+        float soc_temp = soc_path_.empty() ? NAN : read_temp(soc_path_);
+
+        for(int i = 0; i < MAX_DEVICES; i++){
+            // The remote engine is on another board, the SoC here says nothing about it
+            float temp = !temp_paths_[i].empty() ? read_temp(temp_paths_[i]) : i == REMOTE_DEVICE ? NAN : soc_temp;
+            temps_[i] = temp;
+            if(std::isnan(temp))
+                continue;
+
+            if(temp > stats_.max_temp)
+                stats_.max_temp = temp;
+
+            // Out over hard, back under soft
+            if(!hot_[i] && temp >= hard_temp_){
+                std::cout << "WARNING: " << device_name(i) << " is at " << temp << " C. Hold it back until it cools down\n";
+                hot_[i] = true;
+                stats_.hot++;
+            }
+            else if(hot_[i] && temp < soft_temp_){
+                std::cout << "INFO: " << device_name(i) << " cooled down to " << temp << " C\n";
+                hot_[i] = false;
+            }
+        }
+    }
+
+    double DeviceGate::capacity(unsigned devices){
+        double slots_per_ms = 0;
+        for(int i = 0; i < MAX_DEVICES; i++){
+            if((devices & (1u << i)) && slot_ms_[i] > 0)
+                slots_per_ms += 1 / slot_ms_[i];
+        }
+
+        return slots_per_ms;
+    }
+
+    unsigned DeviceGate::gate(unsigned devices, int batch, float * scale){
+        auto now = std::chrono::steady_clock::now();
+
+        read_temps(now);
+
+        // The share shrinks as the device heats up from soft to hard, before the device throttles itself
+        unsigned cool = 0;
+        for(int i = 0; i < MAX_DEVICES; i++){
+            scale[i] = 1;
+            if(!(devices & (1u << i)))
+                continue;
+
+            if(!std::isnan(temps_[i]) && temps_[i] > soft_temp_)
+                scale[i] = 1 / std::max(0.1f, 1 - (temps_[i] - soft_temp_) / (hard_temp_ - soft_temp_));
+
+            if(!hot_[i])
+                cool |= 1u << i;
+        }
+
+        if(started_){
+            double interval_ms = std::chrono::duration<double, std::milli>(now - last_dispatch_).count();
+            interval_ms_ = interval_ms_ == 0 ? interval_ms : 0.9 * interval_ms_ + 0.1 * interval_ms;
+            demand_ = interval_ms_ > 0 ? batch / interval_ms_ : 0;
+        }
+        started_ = true;
+        last_dispatch_ = now;
+
+        if(park_util_ > 0 && demand_ > 0){
+            unsigned active = cool & ~parked_;
+            double util = capacity(active) > 0 ? demand_ / capacity(active) : 1;
+
+            // A device waking up slowly is woken at a lower utilization, so it is ready when the load gets there
+            int wake = -1;
+            for(int i = 0; i < MAX_DEVICES; i++){
+                if(!(parked_ & cool & (1u << i)))
+                    continue;
+
+                double threshold = wake_util_ * interval_ms_ / (interval_ms_ + wake_ms_[i]);
+                if((util > threshold || util >= 1) && (wake < 0 || wake_ms_[i] < wake_ms_[wake]))
+                    wake = i;
+            }
+
+            if(wake >= 0){
+                std::cout << "INFO: Wake " << device_name(wake) << " up for a utilization of " << util << "\n";
+                parked_ &= ~(1u << wake);
+                park_streak_ = 0;
+                stats_.wakes++;
+            }
+            else{
+                // The slowest device goes first, the others would run the load without it
+                int slowest = -1;
+                int num_active = 0;
+                for(int i = 0; i < MAX_DEVICES; i++){
+                    if(!(active & (1u << i)))
+                        continue;
+
+                    num_active++;
+                    if(slot_ms_[i] <= 0){
+                        slowest = -1;
+                        num_active = 0;
+                        break;
+                    }
+                    if(slowest < 0 || slot_ms_[i] > slot_ms_[slowest])
+                        slowest = i;
+                }
+
+                double rest = slowest >= 0 ? capacity(active & ~(1u << slowest)) : 0;
+                if(num_active > 1 && rest > 0 && demand_ / rest < park_util_)
+                    park_streak_++;
+                else
+                    park_streak_ = 0;
+
+                // Over a few dispatches, not for a single gap
+                if(park_streak_ >= 20){
+                    std::cout << "INFO: Park " << device_name(slowest) << ", the others run the load at a utilization of " << demand_ / rest << "\n";
+                    parked_ |= 1u << slowest;
+                    park_streak_ = 0;
+                    stats_.parks++;
+                }
+            }
+        }
+
+        unsigned gated = devices & cool & ~parked_;
+        if(gated == 0)
+            gated = devices & cool;
+        if(gated == 0)
+            gated = devices;
+
+        return gated;
+    }
+
+    void DeviceGate::record_slot(int device, double ms){
+        if(device < 0 || device >= MAX_DEVICES || ms <= 0)
+            return;
+
+        slot_ms_[device] = slot_ms_[device] == 0 ? ms : 0.9 * slot_ms_[device] + 0.1 * ms;
+    }
+
+    GateStats DeviceGate::stats(){
+        return stats_;
+    }
+}
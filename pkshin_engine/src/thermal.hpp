@@ -0,0 +1,78 @@
+#ifndef _THERMAL_HPP_
+#define _THERMAL_HPP_
+
+#include <string>
+#include <chrono>
+
+namespace pkshin{
+    // Devices held back by the gate
+    struct GateStats {
+        bool enabled;
+        long parks;         // devices parked for a low load
+        long wakes;         // parked devices woken again
+        long hot;           // times a device went over the hard temperature
+        float max_temp;     // hottest reading, in degrees C
+    };
+
+    // Thermal and load gating of the devices of the dispatches. The config is a comma separated list of key=value
+    // entries, e.g. "gpu=/sys/class/thermal/thermal_zone10/temp,soc=/sys/class/thermal/thermal_zone0/temp,park=0.5".
+    //  device=PATH   temperature of the device (gpu, hexagon, maccel, hailo0, hailo1, hailo2 or hailo for all three)
+    //  soc=PATH      temperature of the SoC, for the devices without their own. Not for the remote engine
+    //  soft=70       the share of a device shrinks from soft on, hard=85 takes it out until it is back under soft
+    //  poll=500      ms between two readings of the temperatures
+    //  park=0.5      parks the slowest device while the others would run the load at under this utilization
+    //  wake=0.85     wakes a parked device once the utilization goes over this
+    //  device_wake=MS  wake latency of a device. The longer it is, the earlier the device is woken
+    // The temperature files hold degrees or millidegrees C like sysfs, so plain files can stand in for them.
+    // The load is the slots per ms the dispatches bring against the slots per ms the devices run, from the slot times.
+    // Devices are the batch_run_ codes of the engine.
+    class DeviceGate {
+        public:
+        static const int MAX_DEVICES = 7;
+
+        DeviceGate();
+
+        bool parse(const char * config);
+
+        bool enabled();
+
+        // Called per dispatch of batch slots over devices. Returns the devices to use and the factor of the slot cost
+        // of every device in scale, over 1 for a warm one. Never returns no device when devices has some
+        unsigned gate(unsigned devices, int batch, float * scale);
+
+        // A slot ran for ms on the device
+        void record_slot(int device, double ms);
+
+        GateStats stats();
+
+        private:
+        void read_temps(std::chrono::steady_clock::time_point now);
+
+        // Slots per ms of the devices
+        double capacity(unsigned devices);
+
+        bool enabled_;
+        std::string temp_paths_[MAX_DEVICES];
+        std::string soc_path_;
+        float soft_temp_;
+        float hard_temp_;
+        double poll_ms_;
+        float park_util_;
+        float wake_util_;
+        double wake_ms_[MAX_DEVICES];
+
+        float temps_[MAX_DEVICES];
+        bool hot_[MAX_DEVICES];
+        unsigned parked_;
+        int park_streak_;
+        double slot_ms_[MAX_DEVICES];       // EWMA of the slot time, 0 until the first slot
+        double interval_ms_;                // EWMA of the time between dispatches
+        double demand_;                     // EWMA of the slots per ms
+        bool started_;
+        std::chrono::steady_clock::time_point last_dispatch_;
+        std::chrono::steady_clock::time_point last_poll_;
+        GateStats stats_;
+    };
+}
+
+#endif //_THERMAL_HPP_
@@ -0,0 +1,172 @@
+#include "trace.hpp"
+
+#include <iostream>
+#include <cstring>
+#include <thread>
+
+namespace pkshin{
+    uint64_t trace_hash(const void * data, size_t bytes, uint64_t seed){
+        const uint64_t prime = 0x100000001b3ULL;
+        uint64_t hash = 0xcbf29ce484222325ULL ^ seed;
+
+        // FNV-1a over 8 byte words, the inputs are large
+        const uint8_t * p = (const uint8_t *)data;
+        size_t words = bytes / 8;
+        for(size_t i = 0; i < words; i++){
+            uint64_t word;
+            memcpy(&word, p + i * 8, 8);
+            hash = (hash ^ word) * prime;
+        }
+
+        for(size_t i = words * 8; i < bytes; i++)
+            hash = (hash ^ p[i]) * prime;
+
+        return hash;
+    }
+
+    TraceRecorder::TraceRecorder() : file_(NULL), dispatch_(0){
+
+    }
+
+    TraceRecorder::~TraceRecorder(){
+        close();
+    }
+
+    bool TraceRecorder::open(const char * path){
+        close();
+
+        file_ = fopen(path, "wb");
+        if(file_ == NULL){
+            std::cerr << "ERROR: Cannot open the trace file: " << path << std::endl;
+            return false;
+        }
+
+        TraceHeader header;
+        memcpy(header.magic, "PKTR", 4);
+        header.version = TRACE_VERSION;
+        fwrite(&header, sizeof(header), 1, file_);
+
+        dispatch_ = 0;
+        trace_start_ = std::chrono::high_resolution_clock::now();
+
+        return true;
+    }
+
+    void TraceRecorder::close(){
+        if(file_ != NULL){
+            fclose(file_);
+            file_ = NULL;
+        }
+    }
+
+    bool TraceRecorder::enabled(){
+        return file_ != NULL;
+    }
+
+    uint32_t TraceRecorder::since_arrival_us(std::chrono::high_resolution_clock::time_point t){
+        return std::chrono::duration_cast<std::chrono::microseconds>(t - arrival_).count();
+    }
+
+    void TraceRecorder::begin_dispatch(int batch, std::chrono::high_resolution_clock::time_point arrival){
+        if(file_ == NULL)
+            return;
+
+        arrival_ = arrival;
+        uint64_t arrival_us = std::chrono::duration_cast<std::chrono::microseconds>(arrival - trace_start_).count();
+
+        records_.resize(batch);
+        for(int i = 0; i < batch; i++)
+            records_[i] = {arrival_us, 0, 0, 0, dispatch_, (uint16_t)i, -1, 0};
+    }
+
+    void TraceRecorder::set_input_hash(int slot, uint64_t hash){
+        if(file_ != NULL && slot < records_.size())
+            records_[slot].input_hash = hash;
+    }
+
+    void TraceRecorder::record(int slot, int device, std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point end){
+        if(file_ == NULL || slot >= records_.size())
+            return;
+
+        records_[slot].device = device;
+        records_[slot].start_us = since_arrival_us(start);
+        records_[slot].end_us = since_arrival_us(end);
+    }
+
+    void TraceRecorder::end_dispatch(){
+        if(file_ == NULL)
+            return;
+
+        if(fwrite(records_.data(), sizeof(TraceRecord), records_.size(), file_) != records_.size()){
+            std::cerr << "ERROR: Trace write failed. Stop recording\n";
+            close();
+            return;
+        }
+
+        dispatch_++;
+    }
+
+    bool read_trace(const char * path, std::vector<TraceRecord> & records){
+        FILE * file = fopen(path, "rb");
+        if(file == NULL){
+            std::cerr << "ERROR: Cannot open the trace file: " << path << std::endl;
+            return false;
+        }
+
+        TraceHeader header;
+        if(fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, "PKTR", 4) != 0 || header.version != TRACE_VERSION){
+            std::cerr << "ERROR: Not a trace of this version: " << path << std::endl;
+            fclose(file);
+            return false;
+        }
+
+        records.clear();
+        TraceRecord record;
+        while(fread(&record, sizeof(record), 1, file) == 1)
+            records.push_back(record);
+
+        fclose(file);
+
+        return true;
+    }
+
+    TraceReplayer::TraceReplayer() : enabled_(false), speed_(1), next_(0){
+
+    }
+
+    bool TraceReplayer::open(const char * path, double speed){
+        if(speed <= 0 || !read_trace(path, records_))
+            return false;
+
+        enabled_ = true;
+        speed_ = speed;
+        next_ = 0;
+
+        return true;
+    }
+
+    bool TraceReplayer::enabled(){
+        return enabled_;
+    }
+
+    int TraceReplayer::next_dispatch(){
+        if(next_ >= records_.size())
+            return -1;
+
+        if(next_ == 0)
+            replay_start_ = std::chrono::steady_clock::now();
+
+        // A dispatch arriving while the previous one still runs waits for it in Invoke, like in the recorded run
+        double offset_us = (records_[next_].arrival_us - records_[0].arrival_us) / speed_;
+        std::this_thread::sleep_until(replay_start_ + std::chrono::microseconds((long long)offset_us));
+
+        uint32_t dispatch = records_[next_].dispatch;
+        int slots = 0;
+        while(next_ < records_.size() && records_[next_].dispatch == dispatch){
+            next_++;
+            slots++;
+        }
+
+        return slots;
+    }
+}
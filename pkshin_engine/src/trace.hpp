@@ -0,0 +1,94 @@
+#ifndef _TRACE_HPP_
+#define _TRACE_HPP_
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <chrono>
+
+namespace pkshin{
+    // One slot of a dispatch. The file is a TraceHeader followed by the records, dispatch by dispatch in slot order
+    struct TraceRecord {
+        uint64_t arrival_us;    // Invoke of the dispatch, from the start of the trace
+        uint64_t input_hash;    // of the input bytes of the slot
+        uint32_t start_us;      // start of the run that gave the result, from the arrival
+        uint32_t end_us;        // end of that run, from the arrival
+        uint32_t dispatch;
+        uint16_t slot;
+        int8_t device;          // batch_run_ code of the engine, -1 for a dropped slot
+        uint8_t reserved;
+    };
+
+    static_assert(sizeof(TraceRecord) == 32, "The trace record is a fixed 32 bytes");
+
+    struct TraceHeader {
+        char magic[4];          // "PKTR"
+        uint32_t version;
+    };
+
+    static const uint32_t TRACE_VERSION = 1;
+
+    // Hash of the input of a slot, to tell the frames apart in a trace. Not a checksum
+    uint64_t trace_hash(const void * data, size_t bytes, uint64_t seed);
+
+    // Records the slots of the dispatches to a binary trace. The slots of the running dispatch are kept in memory and
+    // written once it is done, so the device feeders only fill in their own slot.
+    class TraceRecorder {
+        public:
+        TraceRecorder();
+
+        ~TraceRecorder();
+
+        bool open(const char * path);
+
+        void close();
+
+        bool enabled();
+
+        // Called before the slots start
+        void begin_dispatch(int batch, std::chrono::high_resolution_clock::time_point arrival);
+
+        void set_input_hash(int slot, uint64_t hash);
+
+        // The result of the slot comes from device. device -1 for a dropped slot
+        void record(int slot, int device, std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point end);
+
+        // Called when every slot is done
+        void end_dispatch();
+
+        private:
+        uint32_t since_arrival_us(std::chrono::high_resolution_clock::time_point t);
+
+        FILE * file_;
+        uint32_t dispatch_;
+        std::chrono::high_resolution_clock::time_point trace_start_;
+        std::chrono::high_resolution_clock::time_point arrival_;
+        std::vector<TraceRecord> records_;
+    };
+
+    // Reads a trace back
+    bool read_trace(const char * path, std::vector<TraceRecord> & records);
+
+    // Feeds the dispatches of a trace back at their recorded arrival, speed times faster
+    class TraceReplayer {
+        public:
+        TraceReplayer();
+
+        bool open(const char * path, double speed);
+
+        bool enabled();
+
+        // Waits for the arrival of the next dispatch and returns its slots, or -1 at the end of the trace
+        int next_dispatch();
+
+        private:
+        bool enabled_;
+        double speed_;
+        size_t next_;
+        std::vector<TraceRecord> records_;
+        std::chrono::steady_clock::time_point replay_start_;
+    };
+}
+
+#endif //_TRACE_HPP_
@@ -0,0 +1,139 @@
+#include "tuner.hpp"
+
+#include <iostream>
+#include <algorithm>
+
+namespace pkshin{
+    BatchTuner::BatchTuner() : target_p95_ms_(0), max_batch_(1), window_(10), cur_(1), lo_(0), hi_(2), settled_(false), dispatches_(0), frames_(0){
+
+    }
+
+    void BatchTuner::set_params(double target_p95_ms, int max_batch, int window){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        target_p95_ms_ = target_p95_ms > 0 ? target_p95_ms : 0;
+        max_batch_ = max_batch > 0 ? max_batch : 1;
+        window_ = window > 0 ? window : 1;
+
+        cur_ = target_p95_ms_ > 0 ? 1 : max_batch_;
+        lo_ = 0;
+        hi_ = max_batch_ + 1;
+        settled_ = target_p95_ms_ <= 0;
+        results_.assign(max_batch_ + 1, {false, 0, 0});
+
+        dispatches_ = 0;
+        frames_ = 0;
+        latencies_.clear();
+        latencies_.reserve(window_ * max_batch_);
+    }
+
+    bool BatchTuner::enabled(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return target_p95_ms_ > 0;
+    }
+
+    int BatchTuner::batch(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return cur_;
+    }
+
+    bool BatchTuner::settled(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return settled_;
+    }
+
+    void BatchTuner::record(int batch, const double * latencies_ms, std::chrono::high_resolution_clock::time_point dispatch_start){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        // Dispatches issued before the last change of the batch do not count
+        if(target_p95_ms_ <= 0 || batch != cur_)
+            return;
+
+        // The first dispatch of a batch warms up the devices at that size
+        if(dispatches_ == 0){
+            dispatches_++;
+            window_start_ = std::chrono::high_resolution_clock::now();
+            return;
+        }
+
+        for(int i = 0; i < batch; i++)
+            latencies_.push_back(latencies_ms[i]);
+        frames_ += batch;
+        dispatches_++;
+
+        if(dispatches_ <= window_)
+            return;
+
+        double elapsed_s = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - window_start_).count();
+        double fps = elapsed_s > 0 ? frames_ / elapsed_s : 0;
+
+        size_t p95_index = (latencies_.size() * 95) / 100;
+        if(p95_index >= latencies_.size())
+            p95_index = latencies_.size() - 1;
+        std::nth_element(latencies_.begin(), latencies_.begin() + p95_index, latencies_.end());
+        double p95_ms = latencies_[p95_index];
+
+        dispatches_ = 0;
+        frames_ = 0;
+        latencies_.clear();
+
+        decide(p95_ms, fps);
+    }
+
+    void BatchTuner::decide(double p95_ms, double fps){
+        results_[cur_] = {true, p95_ms, fps};
+        bool feasible = p95_ms <= target_p95_ms_;
+
+        if(settled_){
+            if(feasible || cur_ == 1)
+                return;
+
+            // The load or the devices changed. Search again below the batch
+            std::cout << "INFO: Batch " << cur_ << " misses the p95 budget (" << p95_ms << " ms). Tune again\n";
+            settled_ = false;
+            lo_ = 0;
+            hi_ = cur_;
+            for(int i = 1; i < results_.size(); i++)
+                results_[i].measured = false;
+        }
+        else{
+            // A larger batch that is not faster bounds the search like a missed budget
+            bool slower = false;
+            for(int i = 1; i < cur_; i++){
+                if(results_[i].measured && results_[i].p95_ms <= target_p95_ms_ && results_[i].fps > fps)
+                    slower = true;
+            }
+
+            if(feasible && !slower)
+                lo_ = std::max(lo_, cur_);
+            else
+                hi_ = std::min(hi_, cur_);
+        }
+
+        if(hi_ > max_batch_ && cur_ < max_batch_)
+            cur_ = std::min(max_batch_, cur_ * 2);
+        else if(hi_ - lo_ > 1 && (lo_ + hi_) / 2 != cur_)
+            cur_ = (lo_ + hi_) / 2;
+        else
+            settle();
+    }
+
+    void BatchTuner::settle(){
+        int best = 0;
+        for(int i = 1; i < results_.size(); i++){
+            if(results_[i].measured && results_[i].p95_ms <= target_p95_ms_ && (best == 0 || results_[i].fps > results_[best].fps))
+                best = i;
+        }
+
+        settled_ = true;
+
+        if(best == 0){
+            cur_ = 1;
+            std::cout << "WARNING: No batch meets the p95 budget of " << target_p95_ms_ << " ms. Use batch 1\n";
+            return;
+        }
+
+        cur_ = best;
+        std::cout << "INFO: Batch tuner settled on batch " << cur_ << " (p95 " << results_[cur_].p95_ms << " ms, " << results_[cur_].fps << " fps)\n";
+    }
+}
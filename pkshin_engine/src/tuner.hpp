@@ -0,0 +1,59 @@
+#ifndef _TUNER_HPP_
+#define _TUNER_HPP_
+
+#include <vector>
+#include <chrono>
+#include <mutex>
+
+namespace pkshin{
+    // Batch size search under a p95 turnaround budget. Every candidate runs for a window of dispatches. The search doubles
+    // the batch until the budget is missed or the throughput drops, then bisects between the last good and the first bad
+    // batch, and settles on the measured batch with the best throughput within the budget.
+    // Once settled it keeps measuring and searches again below the batch when the budget is missed.
+    class BatchTuner {
+        public:
+        BatchTuner();
+
+        // target_p95_ms <= 0 disables the tuner, and batch() returns max_batch
+        void set_params(double target_p95_ms, int max_batch, int window = 10);
+
+        bool enabled();
+
+        // Batch for the next dispatch
+        int batch();
+
+        bool settled();
+
+        // Called when a dispatch of batch slots is done. latencies_ms are the turnaround of its slots
+        void record(int batch, const double * latencies_ms, std::chrono::high_resolution_clock::time_point dispatch_start);
+
+        private:
+        struct Result {
+            bool measured;
+            double p95_ms;
+            double fps;
+        };
+
+        void decide(double p95_ms, double fps);
+
+        void settle();
+
+        double target_p95_ms_;
+        int max_batch_;
+        int window_;
+
+        int cur_;
+        int lo_;    // largest batch known to meet the budget, 0 if none
+        int hi_;    // smallest batch known to miss it or to lose throughput, max_batch_ + 1 if none
+        bool settled_;
+        std::vector<Result> results_;
+
+        int dispatches_;
+        int frames_;
+        std::vector<double> latencies_;
+        std::chrono::high_resolution_clock::time_point window_start_;
+        std::mutex mutex_;
+    };
+}
+
+#endif //_TUNER_HPP_
@@ -0,0 +1,95 @@
+#include "variant.hpp"
+
+#include <iostream>
+#include <algorithm>
+
+namespace pkshin{
+    VariantController::VariantController() : num_variants_(0), target_p95_ms_(0), window_(10), up_ratio_(0.7), up_windows_(2), cur_(0), warming_(false), under_(0), dispatches_(0), max_backlog_(0){
+
+    }
+
+    void VariantController::set_params(int num_variants, double target_p95_ms, int window, double up_ratio, int up_windows){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        bool enabled = num_variants > 0 && target_p95_ms > 0;
+        num_variants_ = enabled ? std::min(num_variants, (int)MAX_VARIANTS) : 0;
+        target_p95_ms_ = enabled ? target_p95_ms : 0;
+        window_ = window > 0 ? window : 1;
+        up_ratio_ = up_ratio;
+        up_windows_ = up_windows > 0 ? up_windows : 1;
+
+        cur_ = num_variants_ - 1;
+        warming_ = true;
+        under_ = 0;
+        dispatches_ = 0;
+        max_backlog_ = 0;
+        latencies_.clear();
+    }
+
+    bool VariantController::enabled(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return num_variants_ > 0;
+    }
+
+    int VariantController::variant(){
+        std::lock_guard<std::mutex> lk(mutex_);
+        return cur_;
+    }
+
+    void VariantController::record(int batch, const double * latencies_ms, long backlog){
+        std::lock_guard<std::mutex> lk(mutex_);
+
+        if(num_variants_ <= 0)
+            return;
+
+        for(int i = 0; i < batch; i++)
+            latencies_.push_back(latencies_ms[i]);
+        // Only the frames a dispatch cannot take count as a backlog
+        max_backlog_ = std::max(max_backlog_, backlog - batch);
+        dispatches_++;
+
+        if(dispatches_ < window_)
+            return;
+
+        if(!latencies_.empty() && !warming_){
+            size_t p95_index = (latencies_.size() * 95) / 100;
+            if(p95_index >= latencies_.size())
+                p95_index = latencies_.size() - 1;
+            std::nth_element(latencies_.begin(), latencies_.begin() + p95_index, latencies_.end());
+
+            decide(latencies_[p95_index], max_backlog_);
+        }
+        else{
+            warming_ = false;
+        }
+
+        dispatches_ = 0;
+        max_backlog_ = 0;
+        latencies_.clear();
+    }
+
+    void VariantController::decide(double p95_ms, long backlog){
+        if(p95_ms > target_p95_ms_ || backlog > 0){
+            under_ = 0;
+            if(cur_ == 0)
+                return;
+
+            cur_--;
+            warming_ = true;
+            std::cout << "INFO: p95 " << p95_ms << " ms, backlog " << backlog << ". Step down to variant " << cur_ << "\n";
+        }
+        else if(p95_ms < target_p95_ms_ * up_ratio_){
+            under_++;
+            if(under_ < up_windows_ || cur_ == num_variants_ - 1)
+                return;
+
+            under_ = 0;
+            cur_++;
+            warming_ = true;
+            std::cout << "INFO: p95 " << p95_ms << " ms. Step up to variant " << cur_ << "\n";
+        }
+        else{
+            under_ = 0;
+        }
+    }
+}
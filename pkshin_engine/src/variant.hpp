@@ -0,0 +1,59 @@
+#ifndef _VARIANT_HPP_
+#define _VARIANT_HPP_
+
+#include <vector>
+#include <mutex>
+
+namespace pkshin{
+    // Variant switches and the slots every variant ran
+    struct VariantStats {
+        bool enabled;
+        int active;        // variant of the tflite devices, -1 for the model of the command line
+        long switches;
+        long slots[8];     // slots run by every variant
+    };
+
+    // Load-adaptive choice between variants of a model, ordered from the smallest to the largest. Every window of
+    // dispatches is judged on its p95 turnaround against the target and on the frames waiting for a slot: a window over
+    // the target or with more frames waiting than a dispatch takes steps down to the next smaller variant, and
+    // up_windows windows in a row under up_ratio of the target with no backlog step up again. The window after a switch
+    // only warms the new variant up.
+    // Starts on the largest variant.
+    class VariantController {
+        public:
+        static const int MAX_VARIANTS = 8;
+
+        VariantController();
+
+        // num_variants <= 0 or target_p95_ms <= 0 disables the controller
+        void set_params(int num_variants, double target_p95_ms, int window = 10, double up_ratio = 0.7, int up_windows = 2);
+
+        bool enabled();
+
+        // Variant for the next dispatch
+        int variant();
+
+        // Called when a dispatch of batch slots is done. latencies_ms are the turnaround of its slots, backlog the frames
+        // still waiting for a slot
+        void record(int batch, const double * latencies_ms, long backlog);
+
+        private:
+        void decide(double p95_ms, long backlog);
+
+        int num_variants_;
+        double target_p95_ms_;
+        int window_;
+        double up_ratio_;
+        int up_windows_;
+
+        int cur_;
+        bool warming_;     // first window after a switch
+        int under_;        // windows in a row under up_ratio of the target
+        int dispatches_;
+        long max_backlog_;
+        std::vector<double> latencies_;
+        std::mutex mutex_;
+    };
+}
+
+#endif //_VARIANT_HPP_
@@ -0,0 +1,129 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bundle.hpp"
+
+// Packs the tflite and hef artifacts of a bundle manifest into one bundle file, so the engine maps them instead of
+// opening a file per device. The mxq stays a file, the maccel runtime only loads it from a path.
+
+static const char * embedded_keys_[] = {"tflite", "hef"};
+static const int embedded_kinds_[] = {pkshin::BUNDLE_TFLITE, pkshin::BUNDLE_HEF};
+static const size_t ALIGNMENT = 4096;
+
+static size_t align_up(size_t value){
+    return (value + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+int main(int argc, char * argv[]){
+    if(argc != 3){
+        std::cerr << "Usage: pkshin_bundle MANIFEST OUTPUT.pkbundle\n";
+        std::cerr << "MANIFEST is a bundle with its artifacts as files. OUTPUT gets the tflite and hef artifacts embedded, the other paths are kept as they are, relative to the bundle.\n";
+        return -1;
+    }
+
+    pkshin::ModelBundle manifest;
+    if(!manifest.load(argv[1]))
+        return -1;
+
+    // The offsets of an embedded artifact are the ones of the manifest file, they do not carry over to the output
+    for(int i = 0; i < pkshin::BUNDLE_KINDS; i++){
+        size_t size;
+        if(manifest.has(i) && manifest.data(i, size) != NULL){
+            std::cerr << "ERROR: The manifest " << argv[1] << " already embeds artifacts. Give their files\n";
+            return -1;
+        }
+    }
+
+    std::vector<std::string> files;
+    std::vector<size_t> sizes;
+    for(int i = 0; i < 2; i++){
+        if(!manifest.has(embedded_kinds_[i])){
+            files.push_back("");
+            sizes.push_back(0);
+            continue;
+        }
+
+        std::ifstream file(manifest.path(embedded_kinds_[i]), std::ios::binary | std::ios::ate);
+        if(!file.is_open()){
+            std::cerr << "ERROR: Cannot open the artifact: " << manifest.path(embedded_kinds_[i]) << std::endl;
+            return -1;
+        }
+
+        files.push_back(manifest.path(embedded_kinds_[i]));
+        sizes.push_back(file.tellg());
+    }
+
+    // The manifest without the lines of the packed artifacts and the end
+    std::ifstream in(argv[1]);
+    std::string header, line;
+    while(std::getline(in, line)){
+        std::istringstream fields(line);
+        std::string key;
+        fields >> key;
+
+        if(key == "end")
+            break;
+        if((key == "tflite" && !files[0].empty()) || (key == "hef" && !files[1].empty()))
+            continue;
+
+        header += line + "\n";
+    }
+
+    // Fixed width offsets, so the header length is known before the offsets are
+    size_t header_size = header.size() + strlen("end\n");
+    for(int i = 0; i < 2; i++){
+        if(!files[i].empty())
+            header_size += strlen(embedded_keys_[i]) + strlen(" @000000000000:000000000000\n");
+    }
+
+    size_t offset = align_up(header_size);
+    char entry[100];
+    for(int i = 0; i < 2; i++){
+        if(files[i].empty())
+            continue;
+
+        snprintf(entry, sizeof(entry), "%s @%012zu:%012zu\n", embedded_keys_[i], offset, sizes[i]);
+        header += entry;
+        offset = align_up(offset + sizes[i]);
+    }
+    header += "end\n";
+
+    std::ofstream out(argv[2], std::ios::binary);
+    if(!out.is_open()){
+        std::cerr << "ERROR: Cannot open the output: " << argv[2] << std::endl;
+        return -1;
+    }
+
+    out << header;
+    std::vector<char> padding(ALIGNMENT, 0);
+    out.write(padding.data(), align_up(header.size()) - header.size());
+
+    for(int i = 0; i < 2; i++){
+        if(files[i].empty())
+            continue;
+
+        std::ifstream file(files[i], std::ios::binary);
+        out << file.rdbuf();
+        out.write(padding.data(), align_up(sizes[i]) - sizes[i]);
+    }
+
+    out.close();
+    if(!out){
+        std::cerr << "ERROR: Write failed: " << argv[2] << std::endl;
+        return -1;
+    }
+
+    // Read back like the engine does
+    pkshin::ModelBundle bundle;
+    if(!bundle.load(argv[2]))
+        return -1;
+
+    std::cout << "INFO: Wrote " << argv[2] << std::endl;
+
+    return 0;
+}